@@ -1,14 +1,27 @@
 // Blink LED on pin 13
+// Timed by TimerWheel.h instead of delay(), so loop() is free for other work
+
+#include <TimerWheel.h>
 
 int led = 13;
+bool ledOn = true;
+
+TimerWheel wheel;
+
+// Called every 500 ms
+void toggleLed(Timer &) {
+  ledOn = !ledOn;
+  digitalWrite(led, ledOn ? HIGH : LOW); // LED ON / OFF
+}
+
+Timer blinkTimer(toggleLed);
 
 void setup() {
   pinMode(led, OUTPUT);
+  digitalWrite(led, HIGH);
+  wheel.start(blinkTimer, 500, 500); // first toggle after 500 ms, then every 500 ms
 }
 
 void loop() {
-  digitalWrite(led, HIGH); // LED ON
-  delay(500);
-  digitalWrite(led, LOW);  // LED OFF
-  delay(500);
+  wheel.update(); // runs the timer callbacks that are due
 }
@@ -1,21 +1,24 @@
  // Pulse-Width Modulation, is a technique for controlling the average power or amplitude of an electrical signal by varying the "on-time" (pulse width) of a rectangular wave within a fixed period
  // Basically similar to squared analog wavelenghts
 
-int led = 9;  // Must be a PWM pin
+ // analogWrite() only works on the hardware PWM pins; SoftPWM.h makes the
+ // PWM in a timer interrupt instead, so it works on any pin and the fade
+ // runs by itself. (It uses Timer2, so tone() is not available with it.)
+
+#include <SoftPWM.h>
+
+int led = 9;  // Any digital pin works now
+
+int8_t ledChannel;
 
 void setup() {
-  pinMode(led, OUTPUT);
+  ledChannel = softPwmAttach(led);
+  softPwmBegin();
+
+  // Fade in and out forever, 2.55 s each way (like 255 steps of 10 ms)
+  softPwmPulse(ledChannel, 0, 255, 2550);
 }
 
 void loop() {
-  // Fade in
-  for (int i = 0; i <= 255; i++) {
-    analogWrite(led, i);
-    delay(10);
-  }
-  // Fade out
-  for (int i = 255; i >= 0; i--) {
-    analogWrite(led, i);
-    delay(10);
-  }
+  // Nothing to do: the fade runs in the timer interrupt
 }
@@ -1,17 +1,32 @@
 // Speedometer using potentiometer input
+// The pot is sampled in the background by AdcSampler.h (oversampled, so
+// the reading does not jitter between two neighbouring speeds) and sent
+// as binary telemetry (Telemetry.h): decode it on the PC with
+// Tools/telemetry2csv.cpp
+
+#include <AdcSampler.h>
+#include <Telemetry.h>
 
 int potPin = A0;   // Potentiometer pin
+int8_t potChannel;
 int speedValue = 0;
+unsigned long lastSample = 0;
+
+#define SAMPLE_MS 5       // 200 speeds a second instead of 5 text lines
+#define SPEED_STREAM 0
 
 void setup() {
-  Serial.begin(9600);
+  telemetryBegin(9600);
+  potChannel = adcAttach(potPin);
+  adcBegin();
 }
 
 void loop() {
-  speedValue = analogRead(potPin);  // Read potentiometer (0-1023)
-  int speed = map(speedValue, 0, 1023, 0, 200); // Map to 0-200 km/h
-  Serial.print("Speed: ");
-  Serial.print(speed);
-  Serial.println(" km/h");
-  delay(200);
+  if (millis() - lastSample >= SAMPLE_MS) {
+    lastSample += SAMPLE_MS;
+    speedValue = adcRead(potChannel);  // Read potentiometer (0-ADC_MAX)
+    int speed = map(speedValue, 0, ADC_MAX, 0, 200); // Map to 0-200 km/h
+    telemetryAdd(SPEED_STREAM, speed);
+  }
+  telemetryPump();  // never waits for the serial port
 }
@@ -1,20 +1,40 @@
+#include <AdcSampler.h>
+#include <Telemetry.h>
+
 byte ldr = A2;
 byte led = 13;
 int nilai;
+int8_t ldrChannel;
+unsigned long lastSample = 0;
+
+// LDR readings go out as binary telemetry every 5 ms; decode them on the
+// PC with Tools/telemetry2csv.cpp
+#define SAMPLE_MS 5
+
+// The LED turns on below 90 and off above 110 (instead of both at 100),
+// so a reading wobbling around 100 does not make it flicker
+#define LDR_DARK  90
+#define LDR_LIGHT 110
 
 
 void setup() {
   pinMode(led, OUTPUT);
-  Serial.begin(9600);
+  telemetryBegin(9600);
+  ldrChannel = adcAttach(ldr);
+  adcHysteresis(ldrChannel, ADC_SCALE(LDR_DARK), ADC_SCALE(LDR_LIGHT));
+  adcBegin();
 }
 
 void loop() 
 {
-  nilai = analogRead(ldr);
-  Serial.print("Nilai LDR: ");
-  Serial.println(nilai);
+  if (millis() - lastSample >= SAMPLE_MS) {
+    lastSample += SAMPLE_MS;
+    nilai = adcRead(ldrChannel) >> ADC_EXTRA_BITS; // back to 0-1023
+    telemetryAdd(0, nilai);
+  }
+  telemetryPump();
 
-  if (nilai < 100){
+  if (!adcAbove(ldrChannel)){
     digitalWrite(led, HIGH);
   }
   else{
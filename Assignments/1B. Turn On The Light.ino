@@ -1,28 +1,49 @@
-byte ldrPin = A2;
-byte ledPin = 13;
-byte buzzerPin = 10; // Choose the appropriate pin for your buzzer
-int ldrValue;
-
-void setup() {
-  pinMode(ledPin, OUTPUT);
-  pinMode(buzzerPin, OUTPUT);
-  Serial.begin(9600);
-}
-
-void loop() {
-  ldrValue = analogRead(ldrPin);
-  Serial.print("LDR Value: ");
-  Serial.println(ldrValue);
-
-  if (ldrValue < 100) {
-    // If LDR is hindered, activate LED and buzzer
-    digitalWrite(ledPin, HIGH);
-    tone(buzzerPin, 1000); // Adjust the frequency as needed
-  } else {
-    // If LDR is not hindered, turn off LED and buzzer
-    digitalWrite(ledPin, LOW);
-    noTone(buzzerPin);
-  }
-
-  delay(100);  // Adjust the delay time based on your needs
-}
+#include <AdcSampler.h>
+#include <Telemetry.h>
+
+byte ldrPin = A2;
+byte ledPin = 13;
+byte buzzerPin = 10; // Choose the appropriate pin for your buzzer
+int ldrValue;
+int8_t ldrChannel;
+
+// Hindered below 90, clear again above 110: the gap stops the LED and
+// buzzer from chattering when the light level sits near the threshold
+#define LDR_DARK  90
+#define LDR_LIGHT 110
+bool hindered = false;
+unsigned long lastSample = 0;
+
+// LDR readings go out as binary telemetry every 5 ms; decode them on the
+// PC with Tools/telemetry2csv.cpp
+#define SAMPLE_MS 5
+
+void setup() {
+  pinMode(ledPin, OUTPUT);
+  pinMode(buzzerPin, OUTPUT);
+  telemetryBegin(9600);
+  ldrChannel = adcAttach(ldrPin);
+  adcHysteresis(ldrChannel, ADC_SCALE(LDR_DARK), ADC_SCALE(LDR_LIGHT));
+  adcBegin();
+}
+
+void loop() {
+  telemetryPump();  // never waits for the serial port
+  if (millis() - lastSample < SAMPLE_MS) return;
+  lastSample += SAMPLE_MS;
+
+  ldrValue = adcRead(ldrChannel) >> ADC_EXTRA_BITS; // back to 0-1023
+  telemetryAdd(0, ldrValue);
+
+  bool dark = !adcAbove(ldrChannel);
+  if (dark && !hindered) {
+    // If LDR is hindered, activate LED and buzzer
+    digitalWrite(ledPin, HIGH);
+    tone(buzzerPin, 1000); // Adjust the frequency as needed
+  } else if (!dark && hindered) {
+    // If LDR is not hindered, turn off LED and buzzer
+    digitalWrite(ledPin, LOW);
+    noTone(buzzerPin);
+  }
+  hindered = dark;
+}
@@ -0,0 +1,919 @@
+// Arduino.cpp - the simulation behind Host/Arduino.h and Host/Sim.h
+//
+// One global clock counts CPU cycles. Code moves it forward (register
+// accesses, core calls, delay()), and every peripheral keeps the time of
+// its next event: a timer compare match, the end of an ADC conversion, a
+// UART frame leaving or arriving, or an action a test queued with simAt().
+// Whenever the clock passes one of those times the event is applied at its
+// own time, and any interrupt it raises runs right there if interrupts are
+// on - between two instructions of the sketch, as on the chip.
+
+#include "Arduino.h"
+#include "Sim.h"
+
+#include <stdio.h>
+#include <deque>
+#include <queue>
+
+// ---- Costs (cycles on a 16 MHz Uno, rounded) ----
+#define CYCLES_DIGITAL_WRITE 54    // pin lookup tables, PWM check, cli/restore
+#define CYCLES_DIGITAL_READ  52
+#define CYCLES_PIN_MODE      60
+#define CYCLES_MILLIS        24    // cli, copy 4 bytes, restore
+#define CYCLES_ANALOG_READ   1760  // 13 ADC clocks at 125 kHz + set-up
+#define CYCLES_ISR           40    // vector jump, prologue/epilogue, reti
+
+#define NEVER UINT64_MAX
+
+// ---- Interrupt vectors ----
+// Weak, so a vector the sketch does not define is simply null
+extern "C" {
+void PCINT0_vect(void) __attribute__((weak));
+void PCINT1_vect(void) __attribute__((weak));
+void PCINT2_vect(void) __attribute__((weak));
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void USART_RX_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+}
+
+// ---- Registers ----
+SimRegister<uint8_t> PORTB(SIM_PORTB), PORTC(SIM_PORTC), PORTD(SIM_PORTD);
+SimRegister<uint8_t> DDRB(SIM_DDRB), DDRC(SIM_DDRC), DDRD(SIM_DDRD);
+SimRegister<uint8_t> PINB(SIM_PINB), PINC(SIM_PINC), PIND(SIM_PIND);
+SimRegister<uint8_t> PCICR(SIM_PCICR), PCIFR(SIM_PCIFR);
+SimRegister<uint8_t> PCMSK0(SIM_PCMSK0), PCMSK1(SIM_PCMSK1), PCMSK2(SIM_PCMSK2);
+SimRegister<uint8_t> SREG(SIM_SREG, 1 << SREG_I);  // the core enables interrupts before setup()
+SimRegister<uint8_t> TCCR1A(SIM_TCCR1A), TCCR1B(SIM_TCCR1B), TIMSK1(SIM_TIMSK1), TIFR1(SIM_TIFR1);
+SimRegister<uint16_t> TCNT1(SIM_TCNT1), OCR1A(SIM_OCR1A);
+SimRegister<uint8_t> TCCR2A(SIM_TCCR2A), TCCR2B(SIM_TCCR2B), TCNT2(SIM_TCNT2), OCR2A(SIM_OCR2A);
+SimRegister<uint8_t> TIMSK2(SIM_TIMSK2), TIFR2(SIM_TIFR2);
+SimRegister<uint8_t> ADCSRA(SIM_ADCSRA), ADCSRB(SIM_ADCSRB), ADMUX(SIM_ADMUX), DIDR0(SIM_DIDR0);
+SimRegister<uint16_t> ADC(SIM_ADC);
+SimRegister<uint8_t> UCSR0A(SIM_UCSR0A, 1 << UDRE0), UCSR0B(SIM_UCSR0B), UCSR0C(SIM_UCSR0C, 0x06);
+SimRegister<uint8_t> UDR0(SIM_UDR0);
+SimRegister<uint16_t> UBRR0(SIM_UBRR0);
+
+// ---- Clock and events ----
+static uint64_t now = 0;
+static uint64_t nextEvent = NEVER;
+static int isrDepth = 0;
+static unsigned long registerAccesses = 0;
+
+uint32_t simLoopCycles = 160;
+bool simUartEcho = false;
+
+struct SimAction {
+  uint64_t at;
+  unsigned long order;      // keeps actions at the same time in order
+  std::function<void()> run;
+  bool operator<(const SimAction &o) const {
+    return at != o.at ? at > o.at : order > o.order;
+  }
+};
+static std::priority_queue<SimAction> actions;
+static unsigned long actionCount = 0;
+
+static void updateNextEvent();
+static void serviceInterrupts();
+
+// Move the clock to 'target', applying every event on the way at its time
+static void advanceTo(uint64_t target);
+
+void simCharge(uint32_t cycles) {
+  advanceTo(now + cycles);
+}
+
+uint64_t simCycles() {
+  return now;
+}
+
+void simAdvance(uint64_t cycles) {
+  advanceTo(now + cycles);
+}
+
+void simAt(uint64_t cycle, std::function<void()> action) {
+  actions.push(SimAction{cycle, actionCount++, action});
+  updateNextEvent();
+}
+
+void simRunLoop(double ms) {
+  uint64_t end = now + simMs(ms);
+  while (now < end) {
+    loop();
+    simCharge(simLoopCycles);
+  }
+}
+
+unsigned long simRegisterAccesses() {
+  return registerAccesses;
+}
+
+// ---- Pins ----
+// Port 0 = B (pins 8..13), 1 = C (A0..A5), 2 = D (pins 0..7)
+struct PortModel {
+  SimRegister<uint8_t> &out;
+  SimRegister<uint8_t> &ddr;
+  SimRegister<uint8_t> &in;
+  SimRegister<uint8_t> &pcmsk;
+  uint8_t driven;   // bits driven from outside
+  uint8_t level;    // their levels
+  uint8_t last;     // pin levels at the last pin-change check
+};
+
+static PortModel ports[3] = {
+  {PORTB, DDRB, PINB, PCMSK0, 0, 0, 0},
+  {PORTC, DDRC, PINC, PCMSK1, 0, 0, 0},
+  {PORTD, DDRD, PIND, PCMSK2, 0, 0, 0},
+};
+
+static int portIndex(uint8_t pin) {
+  if (pin < 8) return 2;
+  if (pin < 14) return 0;
+  if (pin < 20) return 1;
+  return -1;
+}
+
+static uint8_t pinBit(uint8_t pin) {
+  if (pin < 8) return 1 << pin;
+  if (pin < 14) return 1 << (pin - 8);
+  if (pin < 20) return 1 << (pin - 14);
+  return 0;
+}
+
+// Outputs read back what they drive; inputs read the outside level, or
+// the pull-up, or 0 when floating
+static uint8_t portLevels(const PortModel &p) {
+  uint8_t ddr = p.ddr.value, out = p.out.value;
+  return (ddr & out) | (~ddr & p.driven & p.level) | (~ddr & ~p.driven & out);
+}
+
+static void checkPinChange(int index) {
+  PortModel &p = ports[index];
+  uint8_t levels = portLevels(p);
+  uint8_t changed = (levels ^ p.last) & p.pcmsk.value;
+  p.last = levels;
+  if (changed) {
+    PCIFR.value |= 1 << index;
+    serviceInterrupts();
+  }
+}
+
+void simSetPin(uint8_t pin, int level) {
+  int i = portIndex(pin);
+  if (i < 0) return;
+  ports[i].driven |= pinBit(pin);
+  if (level) ports[i].level |= pinBit(pin);
+  else ports[i].level &= ~pinBit(pin);
+  checkPinChange(i);
+}
+
+void simReleasePin(uint8_t pin) {
+  int i = portIndex(pin);
+  if (i < 0) return;
+  ports[i].driven &= ~pinBit(pin);
+  checkPinChange(i);
+}
+
+int simPinLevel(uint8_t pin) {
+  int i = portIndex(pin);
+  if (i < 0) return LOW;
+  return (portLevels(ports[i]) & pinBit(pin)) ? HIGH : LOW;
+}
+
+uint8_t digitalPinToPort(uint8_t pin) {
+  static const uint8_t id[3] = {PB, PC, PD};
+  int i = portIndex(pin);
+  return i < 0 ? NOT_A_PIN : id[i];
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+  return pinBit(pin);
+}
+
+static PortModel *portById(uint8_t port) {
+  switch (port) {
+    case PB: return &ports[0];
+    case PC: return &ports[1];
+    case PD: return &ports[2];
+  }
+  return nullptr;
+}
+
+volatile uint8_t *portOutputRegister(uint8_t port) {
+  PortModel *p = portById(port);
+  return p ? &p->out.value : nullptr;
+}
+
+volatile uint8_t *portInputRegister(uint8_t port) {
+  PortModel *p = portById(port);
+  return p ? &p->in.value : nullptr;
+}
+
+volatile uint8_t *portModeRegister(uint8_t port) {
+  PortModel *p = portById(port);
+  return p ? &p->ddr.value : nullptr;
+}
+
+static int analogWriteValue[20];
+static bool analogWriteUsed[20];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  int i = portIndex(pin);
+  if (i >= 0) {
+    PortModel &p = ports[i];
+    uint8_t bit = pinBit(pin);
+    if (mode == OUTPUT) {
+      p.ddr.value |= bit;
+    } else {
+      p.ddr.value &= ~bit;
+      if (mode == INPUT_PULLUP) p.out.value |= bit;
+      else p.out.value &= ~bit;
+    }
+    checkPinChange(i);
+  }
+  simCharge(CYCLES_PIN_MODE);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  int i = portIndex(pin);
+  if (i >= 0) {
+    analogWriteUsed[pin] = false;
+    if (val == LOW) ports[i].out.value &= ~pinBit(pin);
+    else ports[i].out.value |= pinBit(pin);
+    checkPinChange(i);
+  }
+  simCharge(CYCLES_DIGITAL_WRITE);
+}
+
+int digitalRead(uint8_t pin) {
+  simCharge(CYCLES_DIGITAL_READ);
+  return simPinLevel(pin);
+}
+
+// Hardware PWM is not generated: the pin shows the nearer of LOW / HIGH
+void analogWrite(uint8_t pin, int val) {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, val >= 128 ? HIGH : LOW);
+  if (pin < 20) {
+    analogWriteValue[pin] = val;
+    analogWriteUsed[pin] = true;
+  }
+}
+
+int simAnalogWriteValue(uint8_t pin) {
+  return pin < 20 && analogWriteUsed[pin] ? analogWriteValue[pin] : -1;
+}
+
+// ---- Tones ----
+static std::vector<SimToneEvent> toneLog;
+static uint8_t tonePin = 0;
+static uint64_t toneStopAt = NEVER;
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  pinMode(pin, OUTPUT);
+  toneLog.push_back(SimToneEvent{now, pin, frequency});
+  tonePin = pin;
+  toneStopAt = duration > 0 ? now + simMs(duration) : NEVER;
+  updateNextEvent();
+}
+
+void noTone(uint8_t pin) {
+  toneLog.push_back(SimToneEvent{now, pin, 0});
+  if (pin == tonePin) toneStopAt = NEVER;
+  updateNextEvent();
+  digitalWrite(pin, LOW);
+}
+
+const std::vector<SimToneEvent> &simTones() {
+  return toneLog;
+}
+
+// ---- Time ----
+unsigned long millis() {
+  simCharge(CYCLES_MILLIS);
+  return (unsigned long)(now / (F_CPU / 1000));
+}
+
+unsigned long micros() {
+  simCharge(CYCLES_MILLIS);
+  return (unsigned long)(now / SIM_CYCLES_PER_US);
+}
+
+void delay(unsigned long ms) {
+  advanceTo(now + simMs(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  advanceTo(now + simUs(us));
+}
+
+// ---- Timers ----
+// Only the compare-match A interrupt in CTC mode is modelled: the counter
+// runs from 0 to OCRnA, raises OCFnA and starts again.
+struct TimerModel {
+  uint32_t max;               // 0xFF or 0xFFFF
+  uint32_t prescaler;         // 0 = stopped
+  uint64_t zeroAt;            // when the counter last was (or next is) 0
+  uint32_t stoppedCount;
+  uint64_t matchAt;
+};
+
+static TimerModel timer1 = {0xFFFF, 0, 0, 0, NEVER};
+static TimerModel timer2 = {0xFF, 0, 0, 0, NEVER};
+
+static uint32_t timer1Prescaler() {
+  static const uint32_t div[8] = {0, 1, 8, 64, 256, 1024, 0, 0};  // 6, 7 = external clock
+  return div[TCCR1B.value & 7];
+}
+
+static uint32_t timer2Prescaler() {
+  static const uint32_t div[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+  return div[TCCR2B.value & 7];
+}
+
+static bool timer1Ctc() { return (TCCR1B.value & (1 << WGM12)) && !(TCCR1B.value & (1 << WGM13)); }
+static bool timer2Ctc() { return (TCCR2A.value & 3) == (1 << WGM21) && !(TCCR2B.value & (1 << WGM22)); }
+
+static uint32_t timerCount(const TimerModel &t) {
+  if (t.prescaler == 0) return t.stoppedCount;
+  int64_t ticks = (int64_t)(now - t.zeroAt);
+  ticks = ticks >= 0 ? ticks / t.prescaler : -(((-ticks) + t.prescaler - 1) / t.prescaler);
+  int64_t wrap = (int64_t)t.max + 1;
+  return (uint32_t)(((ticks % wrap) + wrap) % wrap);
+}
+
+// Work out the next compare match after a register change
+static void timerSchedule(TimerModel &t, bool ctc, uint32_t top) {
+  if (t.prescaler == 0 || !ctc) {
+    t.matchAt = NEVER;
+  } else {
+    if (t.zeroAt <= now && (now - t.zeroAt) / t.prescaler > top) {
+      // Already past the new top: the counter runs on to max and wraps
+      t.zeroAt += (uint64_t)(t.max + 1) * t.prescaler;
+    }
+    t.matchAt = t.zeroAt + (uint64_t)(top + 1) * t.prescaler;
+  }
+  updateNextEvent();
+}
+
+static void timer1Schedule() { timerSchedule(timer1, timer1Ctc(), OCR1A.value); }
+static void timer2Schedule() { timerSchedule(timer2, timer2Ctc(), OCR2A.value); }
+
+// Prescaler change: keep the count, continue at the new rate
+static void timerClock(TimerModel &t, uint32_t prescaler) {
+  uint32_t count = timerCount(t);
+  t.prescaler = prescaler;
+  if (prescaler == 0) t.stoppedCount = count;
+  else t.zeroAt = now - (uint64_t)count * prescaler;
+}
+
+static void timerSetCount(TimerModel &t, uint32_t count) {
+  if (t.prescaler == 0) t.stoppedCount = count;
+  else t.zeroAt = now - (uint64_t)count * t.prescaler;
+}
+
+// ---- ADC ----
+static std::function<int()> analogSource[8];
+static unsigned long adcConversions[8];
+static bool adcBusy = false;
+static bool adcFirst = true;   // the first conversion after enabling takes 25 clocks
+static bool adcFlag = false;
+static uint8_t adcMux = 0;     // channel latched when the conversion started
+static uint64_t adcDoneAt = NEVER;
+
+void simSetAnalog(uint8_t pin, std::function<int()> source) {
+  uint8_t channel = (pin >= A0 ? pin - A0 : pin) & 7;
+  analogSource[channel] = source;
+}
+
+void simSetAnalog(uint8_t pin, int value) {
+  simSetAnalog(pin, [value] { return value; });
+}
+
+unsigned long simAdcConversions(uint8_t channel) {
+  return channel < 8 ? adcConversions[channel] : 0;
+}
+
+static int sampleChannel(uint8_t channel) {
+  channel &= 7;
+  adcConversions[channel]++;
+  int v = analogSource[channel] ? analogSource[channel]() : 0;
+  return v < 0 ? 0 : (v > 1023 ? 1023 : v);
+}
+
+static void adcStart() {
+  uint8_t ps = ADCSRA.value & 7;
+  uint32_t prescaler = ps == 0 ? 2 : (1 << ps);
+  adcMux = ADMUX.value & 0x0F;
+  adcDoneAt = now + (uint64_t)(adcFirst ? 25 : 13) * prescaler;
+  adcFirst = false;
+  adcBusy = true;
+  updateNextEvent();
+}
+
+static void adcComplete() {
+  ADC.value = sampleChannel(adcMux);
+  adcFlag = true;
+  if ((ADCSRA.value & (1 << ADATE)) && (ADCSRB.value & 7) == 0) {
+    adcStart();  // free running: the next conversion starts at once
+  } else {
+    adcBusy = false;
+    adcDoneAt = NEVER;
+    updateNextEvent();
+  }
+}
+
+int analogRead(uint8_t pin) {
+  simCharge(CYCLES_ANALOG_READ);
+  return sampleChannel(pin >= A0 ? pin - A0 : pin);
+}
+
+// ---- UART ----
+static bool txBusy = false;        // shift register
+static uint8_t txShift = 0;
+static uint64_t txStart = 0;
+static uint64_t txDoneAt = NEVER;
+static bool txBufFull = false;     // UDR0 transmit buffer
+static uint8_t txBuf = 0;
+static bool txComplete = false;    // TXC0
+static std::vector<SimUartByte> uartSent;
+
+static std::deque<uint8_t> rxWire;  // bytes still to arrive
+static uint64_t rxDoneAt = NEVER;
+static std::deque<uint8_t> rxFifo;  // received, not read yet (2 deep)
+static bool rxOverrun = false;
+static unsigned long rxOverruns = 0;
+
+uint64_t simUartByteCycles() {
+  uint32_t perBit = (UCSR0A.value & (1 << U2X0)) ? 8 : 16;
+  return 10ULL * perBit * (UBRR0.value + 1);
+}
+
+static void txLoad(uint8_t value, uint64_t start) {
+  txBusy = true;
+  txShift = value;
+  txStart = start;
+  txDoneAt = start + simUartByteCycles();
+  updateNextEvent();
+}
+
+static void txShifted() {
+  uartSent.push_back(SimUartByte{txStart, txDoneAt, txShift});
+  if (simUartEcho) {
+    putchar(txShift);
+    fflush(stdout);
+  }
+  txComplete = true;
+  if (txBufFull) {
+    txBufFull = false;
+    txLoad(txBuf, txDoneAt);
+  } else {
+    txBusy = false;
+    txDoneAt = NEVER;
+    updateNextEvent();
+  }
+}
+
+static void rxArrived() {
+  uint8_t value = rxWire.front();
+  rxWire.pop_front();
+  if (UCSR0B.value & (1 << RXEN0)) {
+    if (rxFifo.size() < 2) {
+      rxFifo.push_back(value);
+    } else {
+      rxOverrun = true;
+      rxOverruns++;
+    }
+  }
+  rxDoneAt = rxWire.empty() ? NEVER : rxDoneAt + simUartByteCycles();
+  updateNextEvent();
+}
+
+void simUartReceive(uint8_t value) {
+  rxWire.push_back(value);
+  if (rxDoneAt == NEVER) {
+    rxDoneAt = now + simUartByteCycles();
+    updateNextEvent();
+  }
+}
+
+const std::vector<SimUartByte> &simUartSent() {
+  return uartSent;
+}
+
+unsigned long simUartOverruns() {
+  return rxOverruns;
+}
+
+// ---- Register side effects ----
+void simRegisterRead(SimRegisterId id) {
+  registerAccesses++;
+  simCharge(1);
+  switch (id) {
+    case SIM_PINB: PINB.value = portLevels(ports[0]); break;
+    case SIM_PINC: PINC.value = portLevels(ports[1]); break;
+    case SIM_PIND: PIND.value = portLevels(ports[2]); break;
+    case SIM_TCNT1: TCNT1.value = timerCount(timer1); break;
+    case SIM_TCNT2: TCNT2.value = timerCount(timer2); break;
+    case SIM_ADCSRA:
+      ADCSRA.value = (ADCSRA.value & ~((1 << ADSC) | (1 << ADIF)))
+                   | (adcBusy ? 1 << ADSC : 0) | (adcFlag ? 1 << ADIF : 0);
+      break;
+    case SIM_UCSR0A:
+      UCSR0A.value = (UCSR0A.value & ((1 << U2X0) | (1 << MPCM0)))
+                   | (!rxFifo.empty() ? 1 << RXC0 : 0) | (txComplete ? 1 << TXC0 : 0)
+                   | (!txBufFull ? 1 << UDRE0 : 0) | (rxOverrun ? 1 << DOR0 : 0);
+      break;
+    case SIM_UDR0:
+      if (!rxFifo.empty()) {
+        UDR0.value = rxFifo.front();
+        rxFifo.pop_front();
+        rxOverrun = false;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void simRegisterWritten(SimRegisterId id, unsigned int old) {
+  registerAccesses++;
+  switch (id) {
+    case SIM_PORTB: case SIM_DDRB: case SIM_PCMSK0: checkPinChange(0); break;
+    case SIM_PORTC: case SIM_DDRC: case SIM_PCMSK1: checkPinChange(1); break;
+    case SIM_PORTD: case SIM_DDRD: case SIM_PCMSK2: checkPinChange(2); break;
+    case SIM_PINB: case SIM_PINC: case SIM_PIND: {
+      // Writing 1s to PINx toggles those PORTx bits
+      int i = id - SIM_PINB;
+      ports[i].out.value ^= ports[i].in.value;
+      ports[i].in.value = old;
+      checkPinChange(i);
+      break;
+    }
+    case SIM_PCIFR: PCIFR.value = old & ~PCIFR.value; break;  // write 1 to clear
+    case SIM_TIFR1: TIFR1.value = old & ~TIFR1.value; break;
+    case SIM_TIFR2: TIFR2.value = old & ~TIFR2.value; break;
+    case SIM_TCCR1A: case SIM_TCCR1B: timerClock(timer1, timer1Prescaler()); timer1Schedule(); break;
+    case SIM_OCR1A: timer1Schedule(); break;
+    case SIM_TCNT1: timerSetCount(timer1, TCNT1.value); timer1Schedule(); break;
+    case SIM_TCCR2A: case SIM_TCCR2B: timerClock(timer2, timer2Prescaler()); timer2Schedule(); break;
+    case SIM_OCR2A: timer2Schedule(); break;
+    case SIM_TCNT2: timerSetCount(timer2, TCNT2.value); timer2Schedule(); break;
+    case SIM_ADCSRA: {
+      uint8_t v = ADCSRA.value;
+      if (v & (1 << ADIF)) adcFlag = false;  // write 1 to clear
+      if (!(v & (1 << ADEN))) {
+        adcBusy = false;
+        adcFirst = true;
+        adcDoneAt = NEVER;
+        updateNextEvent();
+      } else if ((v & (1 << ADSC)) && !adcBusy) {
+        adcStart();
+      }
+      break;
+    }
+    case SIM_UCSR0A:
+      if (UCSR0A.value & (1 << TXC0)) txComplete = false;  // write 1 to clear
+      break;
+    case SIM_UDR0:
+      if (UCSR0B.value & (1 << TXEN0)) {
+        if (!txBusy) txLoad(UDR0.value, now);
+        else if (!txBufFull) {
+          txBuf = UDR0.value;
+          txBufFull = true;
+        }
+        // a third byte while both are full is lost, as on the chip
+      }
+      break;
+    default:
+      break;
+  }
+  simCharge(1);
+  serviceInterrupts();
+}
+
+// ---- Interrupts ----
+static void serialRxIsr();
+static void serialUdreIsr();
+static bool serialStarted = false;
+
+static SimIsrStats isrStats[SIM_VECTOR_COUNT];
+static const char *const vectorNames[SIM_VECTOR_COUNT] = {
+  "PCINT0_vect", "PCINT1_vect", "PCINT2_vect", "TIMER2_COMPA_vect",
+  "TIMER1_COMPA_vect", "USART_RX_vect", "USART_UDRE_vect", "ADC_vect"
+};
+
+const SimIsrStats &simIsrStats(SimVector vector) {
+  return isrStats[vector];
+}
+
+void simResetIsrStats() {
+  for (int i = 0; i < SIM_VECTOR_COUNT; i++) isrStats[i] = SimIsrStats{0, 0, 0};
+}
+
+// Highest-priority interrupt that is flagged and enabled, -1 if none.
+// SimVector is in the chip's vector order, which is also its priority.
+static int pendingVector() {
+  for (int i = 0; i < 3; i++) {
+    if ((PCIFR.value & PCICR.value) & (1 << i)) return SIM_PCINT0 + i;
+  }
+  if ((TIFR2.value & TIMSK2.value) & (1 << OCF2A)) return SIM_TIMER2_COMPA;
+  if ((TIFR1.value & TIMSK1.value) & (1 << OCF1A)) return SIM_TIMER1_COMPA;
+  if (!rxFifo.empty() && (UCSR0B.value & (1 << RXCIE0))) return SIM_USART_RX;
+  if (!txBufFull && (UCSR0B.value & (1 << UDRIE0))) return SIM_USART_UDRE;
+  if (adcFlag && (ADCSRA.value & (1 << ADIE))) return SIM_ADC_VECT;
+  return -1;
+}
+
+static void (*vectorHandler(int vector))() {
+  switch (vector) {
+    case SIM_PCINT0: return PCINT0_vect;
+    case SIM_PCINT1: return PCINT1_vect;
+    case SIM_PCINT2: return PCINT2_vect;
+    case SIM_TIMER2_COMPA: return TIMER2_COMPA_vect;
+    case SIM_TIMER1_COMPA: return TIMER1_COMPA_vect;
+    case SIM_USART_RX: return USART_RX_vect ? USART_RX_vect : (serialStarted ? serialRxIsr : nullptr);
+    case SIM_USART_UDRE: return USART_UDRE_vect ? USART_UDRE_vect : (serialStarted ? serialUdreIsr : nullptr);
+    case SIM_ADC_VECT: return ADC_vect;
+  }
+  return nullptr;
+}
+
+static void serviceInterrupts() {
+  if (isrDepth > 0) return;
+  while (SREG.value & (1 << SREG_I)) {
+    int vector = pendingVector();
+    if (vector < 0) return;
+
+    // Flags of edge interrupts clear when the handler starts
+    switch (vector) {
+      case SIM_PCINT0: case SIM_PCINT1: case SIM_PCINT2:
+        PCIFR.value &= ~(1 << (vector - SIM_PCINT0));
+        break;
+      case SIM_TIMER2_COMPA: TIFR2.value &= ~(1 << OCF2A); break;
+      case SIM_TIMER1_COMPA: TIFR1.value &= ~(1 << OCF1A); break;
+      case SIM_ADC_VECT: adcFlag = false; break;
+    }
+
+    void (*handler)() = vectorHandler(vector);
+    if (!handler) {
+      // On the chip this jumps to __bad_interrupt and resets
+      fprintf(stderr, "sim: %s enabled but not defined\n", vectorNames[vector]);
+      abort();
+    }
+
+    uint64_t start = now;
+    SREG.value &= ~(1 << SREG_I);
+    isrDepth++;
+    simCharge(CYCLES_ISR / 2);
+    handler();
+    simCharge(CYCLES_ISR - CYCLES_ISR / 2);
+    isrDepth--;
+    SREG.value |= 1 << SREG_I;  // reti
+
+    SimIsrStats &s = isrStats[vector];
+    uint64_t cycles = now - start;
+    s.calls++;
+    s.cycles += cycles;
+    if (cycles > s.maxCycles) s.maxCycles = cycles;
+  }
+}
+
+void cli() {
+  SREG.value &= ~(1 << SREG_I);
+  simCharge(1);
+}
+
+void sei() {
+  SREG.value |= 1 << SREG_I;
+  simCharge(1);
+  serviceInterrupts();
+}
+
+// ---- Event loop ----
+static void updateNextEvent() {
+  uint64_t t = NEVER;
+  if (timer1.matchAt < t) t = timer1.matchAt;
+  if (timer2.matchAt < t) t = timer2.matchAt;
+  if (adcDoneAt < t) t = adcDoneAt;
+  if (txDoneAt < t) t = txDoneAt;
+  if (rxDoneAt < t) t = rxDoneAt;
+  if (toneStopAt < t) t = toneStopAt;
+  if (!actions.empty() && actions.top().at < t) t = actions.top().at;
+  nextEvent = t;
+}
+
+static void runDueEvents() {
+  if (timer1.matchAt <= now) {
+    TIFR1.value |= 1 << OCF1A;
+    timer1.zeroAt = timer1.matchAt;
+    timer1Schedule();
+  }
+  if (timer2.matchAt <= now) {
+    TIFR2.value |= 1 << OCF2A;
+    timer2.zeroAt = timer2.matchAt;
+    timer2Schedule();
+  }
+  if (adcDoneAt <= now) adcComplete();
+  if (txDoneAt <= now) txShifted();
+  if (rxDoneAt <= now) rxArrived();
+  if (toneStopAt <= now) {
+    toneLog.push_back(SimToneEvent{toneStopAt, tonePin, 0});
+    toneStopAt = NEVER;
+  }
+  while (!actions.empty() && actions.top().at <= now) {
+    std::function<void()> run = actions.top().run;
+    actions.pop();
+    run();
+  }
+  updateNextEvent();
+}
+
+static void advanceTo(uint64_t target) {
+  while (nextEvent <= target) {
+    if (nextEvent > now) now = nextEvent;
+    runDueEvents();
+    serviceInterrupts();
+  }
+  if (now < target) now = target;
+}
+
+// ---- Serial ----
+// The core's HardwareSerial: 64-byte rings filled and emptied by the UART
+// interrupts. write() waits while the TX ring is full.
+#define SERIAL_BUFFER_SIZE 64
+
+HardwareSerial Serial;
+
+static uint8_t serialRx[SERIAL_BUFFER_SIZE];
+static uint8_t serialRxHead = 0, serialRxTail = 0;
+static uint8_t serialTx[SERIAL_BUFFER_SIZE];
+static volatile uint8_t serialTxHead = 0, serialTxTail = 0;
+static bool serialWritten = false;
+
+static void serialRxIsr() {
+  uint8_t c = UDR0;
+  uint8_t next = (serialRxHead + 1) % SERIAL_BUFFER_SIZE;
+  if (next != serialRxTail) {
+    serialRx[serialRxHead] = c;
+    serialRxHead = next;
+  }
+}
+
+static void serialUdreIsr() {
+  uint8_t c = serialTx[serialTxTail];
+  serialTxTail = (serialTxTail + 1) % SERIAL_BUFFER_SIZE;
+  UDR0 = c;
+  UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+  if (serialTxHead == serialTxTail) UCSR0B &= ~(1 << UDRIE0);
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  serialStarted = true;
+  UCSR0A = 1 << U2X0;
+  UBRR0 = (F_CPU / 4 / baud - 1) / 2;
+  UCSR0C = 0x06;  // 8N1
+  UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+void HardwareSerial::end() {
+  flush();
+  UCSR0B = 0;
+  serialRxHead = serialRxTail = 0;
+}
+
+int HardwareSerial::available() {
+  return (SERIAL_BUFFER_SIZE + serialRxHead - serialRxTail) % SERIAL_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek() {
+  return serialRxHead == serialRxTail ? -1 : serialRx[serialRxTail];
+}
+
+int HardwareSerial::read() {
+  if (serialRxHead == serialRxTail) return -1;
+  uint8_t c = serialRx[serialRxTail];
+  serialRxTail = (serialRxTail + 1) % SERIAL_BUFFER_SIZE;
+  return c;
+}
+
+int HardwareSerial::availableForWrite() {
+  uint8_t head = serialTxHead, tail = serialTxTail;
+  if (head >= tail) return SERIAL_BUFFER_SIZE - 1 - head + tail;
+  return tail - head - 1;
+}
+
+void HardwareSerial::flush() {
+  if (!serialWritten) return;
+  while (bit_is_set(UCSR0B, UDRIE0) || bit_is_clear(UCSR0A, TXC0)) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(UCSR0B, UDRIE0) && bit_is_set(UCSR0A, UDRE0)) {
+      serialUdreIsr();
+    }
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  serialWritten = true;
+  // Empty ring and free data register: skip the ring
+  if (serialTxHead == serialTxTail && bit_is_set(UCSR0A, UDRE0)) {
+    UDR0 = c;
+    UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+    return 1;
+  }
+  uint8_t next = (serialTxHead + 1) % SERIAL_BUFFER_SIZE;
+  while (next == serialTxTail) {
+    // Ring full: wait for the interrupt to make room (or do its job
+    // when interrupts are off)
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(UCSR0A, UDRE0)) serialUdreIsr();
+  }
+  serialTx[serialTxHead] = c;
+  serialTxHead = next;
+  UCSR0B |= 1 << UDRIE0;
+  return 1;
+}
+
+// ---- Print ----
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(unsigned long v, int base) {
+  if (base < 2) base = 10;
+  char buf[8 * sizeof(long) + 1];
+  char *p = &buf[sizeof(buf) - 1];
+  *p = '\0';
+  do {
+    unsigned long digit = v % base;
+    v /= base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+  } while (v);
+  return write(p);
+}
+
+size_t Print::print(long v, int base) {
+  if (base == 10 && v < 0) {
+    return print('-') + print((unsigned long)-v, 10);
+  }
+  return print((unsigned long)v, base);
+}
+
+// Same rounding and limits as the core's printFloat()
+size_t Print::print(double number, int digits) {
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+  if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+
+  size_t n = 0;
+  if (number < 0.0) {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (int i = 0; i < digits; i++) rounding /= 10.0;
+  number += rounding;
+
+  unsigned long whole = (unsigned long)number;
+  double remainder = number - (double)whole;
+  n += print(whole);
+  if (digits > 0) n += print('.');
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    unsigned int digit = (unsigned int)remainder;
+    n += print(digit);
+    remainder -= digit;
+  }
+  return n;
+}
+
+// ---- Maths ----
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// avr-libc's random(): Park-Miller "minimal standard" generator
+static unsigned long randomState = 1;
+
+static long nextRandom() {
+  long hi = randomState / 127773L;
+  long lo = randomState % 127773L;
+  long x = 16807L * lo - 2836L * hi;
+  if (x < 0) x += 0x7FFFFFFFL;
+  randomState = x;
+  return x;
+}
+
+long random(long howBig) {
+  return howBig == 0 ? 0 : nextRandom() % howBig;
+}
+
+long random(long howSmall, long howBig) {
+  return howSmall >= howBig ? howSmall : random(howBig - howSmall) + howSmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) randomState = seed;
+}
@@ -0,0 +1,338 @@
+// Arduino.h - host stand-in for the Arduino core (Uno / ATmega328P)
+//
+// Lets the sketches in this repo build and run on a PC, so they can be
+// tested and timed without a board. Build with CMake from the repo root:
+//
+//   cmake -S . -B build && cmake --build build && ctest --test-dir build
+//
+// What is modelled:
+//   - a virtual clock that only moves when the sketch does something:
+//     every I/O register access costs 1 CPU cycle, the core functions cost
+//     roughly what they do on a real Uno (digitalWrite ~54 cycles) and
+//     delay() jumps straight ahead, so hours run in seconds
+//   - ports B, C and D (PORTx / DDRx / PINx) with pull-ups and inputs
+//     driven from the test, pin-change interrupts
+//   - Timer1 and Timer2 compare-match A interrupts (CTC mode)
+//   - the ADC, single or free-running, with its 104 us conversions
+//   - the UART at the real byte rate, both for Serial and for sketches
+//     that drive UDR0 themselves
+//   - tone()/noTone() and analogWrite() are recorded, not generated
+// Interrupts only fire between register accesses and core calls, the same
+// points at which they could fire on the chip. Plain computation takes no
+// time; each loop() pass is charged a fixed cost instead (see Sim.h).
+//
+// Tests steer the simulation through Sim.h.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+#define __AVR_ATmega328P__ 1
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// ---- Program memory ----
+// Flash and RAM are the same thing on a PC
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+// Words are copied out rather than read through a cast pointer: the table
+// they come from may be declared as another type (strict aliasing)
+template <typename T> inline T simPgmRead(const void *addr) {
+  T value;
+  memcpy(&value, addr, sizeof(value));
+  return value;
+}
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  simPgmRead<uint16_t>(addr)
+#define pgm_read_dword(addr) simPgmRead<uint32_t>(addr)
+
+// ---- I/O registers ----
+// Each register is an object that tells the simulation when it is read or
+// written, so side effects (starting a conversion, sending a byte) happen
+// and the access is charged one cycle. 'value' is the raw storage, which
+// portOutputRegister() hands out as a plain pointer like the real core.
+enum SimRegisterId {
+  SIM_PORTB, SIM_PORTC, SIM_PORTD,
+  SIM_DDRB, SIM_DDRC, SIM_DDRD,
+  SIM_PINB, SIM_PINC, SIM_PIND,
+  SIM_PCICR, SIM_PCIFR, SIM_PCMSK0, SIM_PCMSK1, SIM_PCMSK2,
+  SIM_SREG,
+  SIM_TCCR1A, SIM_TCCR1B, SIM_TCNT1, SIM_OCR1A, SIM_TIMSK1, SIM_TIFR1,
+  SIM_TCCR2A, SIM_TCCR2B, SIM_TCNT2, SIM_OCR2A, SIM_TIMSK2, SIM_TIFR2,
+  SIM_ADCSRA, SIM_ADCSRB, SIM_ADMUX, SIM_ADC, SIM_DIDR0,
+  SIM_UCSR0A, SIM_UCSR0B, SIM_UCSR0C, SIM_UBRR0, SIM_UDR0,
+  SIM_REGISTER_COUNT
+};
+
+void simRegisterRead(SimRegisterId id);
+void simRegisterWritten(SimRegisterId id, unsigned int old);
+
+template <typename T>
+class SimRegister {
+public:
+  constexpr explicit SimRegister(SimRegisterId id, T reset = 0) : value(reset), id(id) {}
+
+  operator T() {
+    simRegisterRead(id);
+    return value;
+  }
+
+  SimRegister &operator=(T v) {
+    T old = value;
+    value = v;
+    simRegisterWritten(id, old);
+    return *this;
+  }
+
+  SimRegister &operator=(SimRegister &other) { return *this = (T)other; }
+  SimRegister &operator|=(T v) { return *this = (T)(T(*this) | v); }
+  SimRegister &operator&=(T v) { return *this = (T)(T(*this) & v); }
+  SimRegister &operator^=(T v) { return *this = (T)(T(*this) ^ v); }
+
+  volatile T value;
+  const SimRegisterId id;
+};
+
+extern SimRegister<uint8_t> PORTB, PORTC, PORTD;
+extern SimRegister<uint8_t> DDRB, DDRC, DDRD;
+extern SimRegister<uint8_t> PINB, PINC, PIND;
+extern SimRegister<uint8_t> PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+extern SimRegister<uint8_t> SREG;
+extern SimRegister<uint8_t> TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern SimRegister<uint16_t> TCNT1, OCR1A;
+extern SimRegister<uint8_t> TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2, TIFR2;
+extern SimRegister<uint8_t> ADCSRA, ADCSRB, ADMUX, DIDR0;
+extern SimRegister<uint16_t> ADC;
+extern SimRegister<uint8_t> UCSR0A, UCSR0B, UCSR0C, UDR0;
+extern SimRegister<uint16_t> UBRR0;
+
+// Register bits (ATmega328P datasheet names)
+#define SREG_I 7
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define OCIE1A 1
+#define OCF1A 1
+#define WGM20 0
+#define WGM21 1
+#define WGM22 3
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCF2A 1
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define MUX0 0
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define MPCM0 0
+#define U2X0 1
+#define UPE0 2
+#define DOR0 3
+#define FE0 4
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define TXB80 0
+#define UCSZ02 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCSZ00 1
+#define UCSZ01 2
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+
+// ---- Interrupts ----
+// ISR(v) defines v() with C linkage; the simulation calls it when the
+// interrupt fires. Vectors a sketch does not define are left alone.
+#define ISR(vector, ...) extern "C" void vector(void)
+
+void cli();
+void sei();
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+// ---- Pins ----
+#define NOT_A_PIN 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portOutputRegister(uint8_t port);
+volatile uint8_t *portInputRegister(uint8_t port);
+volatile uint8_t *portModeRegister(uint8_t port);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+// ---- Time ----
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// ---- Maths ----
+// Templates rather than the core's macros, so the C++ library still builds
+template <typename A, typename B>
+typename std::common_type<A, B>::type min(A a, B b) { return b < a ? b : a; }
+template <typename A, typename B>
+typename std::common_type<A, B>::type max(A a, B b) { return a < b ? b : a; }
+template <typename X, typename L, typename H>
+X constrain(X x, L low, H high) { return x < low ? low : (high < x ? high : x); }
+#define sq(x) ((x) * (x))
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// ---- String ----
+// Just enough of the core's String for the lessons
+class String {
+public:
+  String(const char *s = "") : s(s ? s : "") {}
+  explicit String(int v) : s(std::to_string(v)) {}
+  explicit String(long v) : s(std::to_string(v)) {}
+  explicit String(unsigned long v) : s(std::to_string(v)) {}
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  String &operator+=(const char *o) { s += o; return *this; }
+  String &operator+=(char c) { s += c; return *this; }
+  friend String operator+(String a, const String &b) { return a += b; }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool equalsIgnoreCase(const String &o) const { return strcasecmp(s.c_str(), o.s.c_str()) == 0; }
+  long toInt() const { return atol(s.c_str()); }
+
+private:
+  std::string s;
+};
+
+// ---- Print / Stream / Serial ----
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T>
+  size_t println(T v, int format) { size_t n = print(v, format); return n + println(); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud);
+  void end();
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override;
+  int availableForWrite() override;
+  size_t write(uint8_t c) override;
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// The sketch
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,101 @@
+// Sim.h - controls for the host simulation behind Host/Arduino.h
+//
+// A test includes the sketch source (so it can look at the sketch's own
+// variables), then this header, and drives the run:
+//
+//   #include "../../Project 3 (Traffic Lighting).cpp"
+//   #include "Sim.h"
+//
+//   int main() {
+//     setup();
+//     simAt(simMs(5000), [] { simSetPin(A4, LOW); });   // press a button
+//     simRunLoop(10000);                                // 10 s of loop()
+//     return simPinLevel(13) == HIGH ? 0 : 1;
+//   }
+//
+// Time is counted in CPU cycles at F_CPU (16 per microsecond).
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include "Arduino.h"
+#include <functional>
+#include <vector>
+
+#define SIM_CYCLES_PER_US (F_CPU / 1000000UL)
+
+// ---- Clock ----
+uint64_t simCycles();                      // cycles since power-up
+inline uint64_t simUs(double us) { return (uint64_t)(us * SIM_CYCLES_PER_US); }
+inline uint64_t simMs(double ms) { return simUs(ms * 1000.0); }
+inline double simNowUs() { return simCycles() / (double)SIM_CYCLES_PER_US; }
+inline double simNowMs() { return simNowUs() / 1000.0; }
+
+// Let time pass: pending events and interrupts run, loop() does not
+void simAdvance(uint64_t cycles);
+
+// Run loop() until 'ms' of simulated time have passed. Each pass is
+// charged simLoopCycles on top of what it does (the code between I/O
+// accesses is not timed); 160 cycles = 10 us by default.
+void simRunLoop(double ms);
+extern uint32_t simLoopCycles;
+
+// Charge the running code 'cycles' of work the model cannot see
+void simCharge(uint32_t cycles);
+
+// Run 'action' at an absolute time (cycles), between two instructions of
+// whatever the sketch is doing then
+void simAt(uint64_t cycle, std::function<void()> action);
+
+// ---- Pins ----
+void simSetPin(uint8_t pin, int level);    // drive an input from outside
+void simReleasePin(uint8_t pin);           // stop driving it (pull-up or floating)
+int simPinLevel(uint8_t pin);              // level on the pin as seen from outside
+int simAnalogWriteValue(uint8_t pin);      // last analogWrite() value, -1 if none
+
+// Analog source of an ADC input (A0..A7), read when a conversion ends
+void simSetAnalog(uint8_t pin, std::function<int()> source);
+void simSetAnalog(uint8_t pin, int value);
+
+// Count ADC conversions that ended, per channel
+unsigned long simAdcConversions(uint8_t channel);
+
+// ---- Tones ----
+struct SimToneEvent {
+  uint64_t cycle;
+  uint8_t pin;
+  unsigned int frequency;   // 0 = stopped
+};
+const std::vector<SimToneEvent> &simTones();
+
+// ---- UART ----
+struct SimUartByte {
+  uint64_t start;           // first bit on the wire
+  uint64_t end;             // stop bit done
+  uint8_t value;
+};
+const std::vector<SimUartByte> &simUartSent();
+void simUartReceive(uint8_t value);        // starts once the RX line is free
+uint64_t simUartByteCycles();              // one 10-bit frame at the set baud
+unsigned long simUartOverruns();           // bytes lost because RX was not read
+extern bool simUartEcho;                   // copy sent bytes to stdout
+
+// ---- Costs ----
+// Cycles spent in each interrupt handler, entry and exit included
+enum SimVector {
+  SIM_PCINT0, SIM_PCINT1, SIM_PCINT2,
+  SIM_TIMER2_COMPA, SIM_TIMER1_COMPA,
+  SIM_USART_RX, SIM_USART_UDRE, SIM_ADC_VECT,
+  SIM_VECTOR_COUNT
+};
+struct SimIsrStats {
+  unsigned long calls;
+  uint64_t cycles;
+  uint64_t maxCycles;
+};
+const SimIsrStats &simIsrStats(SimVector vector);
+void simResetIsrStats();
+
+unsigned long simRegisterAccesses();       // I/O register reads + writes
+
+#endif
@@ -0,0 +1,27 @@
+// SketchMain.cpp - runs one sketch on the host
+//
+//   ./sketch_project_3 [ms] [--serial]
+//
+// Calls setup(), then loop() for 'ms' of simulated time (10 s by default).
+// --serial prints what the sketch sends on the UART as it goes.
+
+#include "Arduino.h"
+#include "Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  double ms = 10000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--serial") == 0) simUartEcho = true;
+    else ms = atof(argv[i]);
+  }
+
+  setup();
+  simRunLoop(ms);
+
+  fprintf(stderr, "\n%.0f ms simulated, %lu bytes sent on the UART\n",
+          simNowMs(), (unsigned long)simUartSent().size());
+  return 0;
+}
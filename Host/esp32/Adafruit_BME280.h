@@ -0,0 +1,55 @@
+// Adafruit_BME280.h - host stand-in for the Adafruit BME280 library
+//
+// Does the same register traffic as the library (v2.2): begin() reads the
+// chip id, resets and reads the calibration word by word, and
+// takeForcedMeasurement() starts a conversion and polls the status
+// register every millisecond until it is done. readTemperature(),
+// readHumidity() and readPressure() read the data registers as the library
+// does, each humidity or pressure read re-reading the temperature first,
+// and compensate with the calibration of the BME280 model.
+
+#ifndef HOST_ESP32_ADAFRUIT_BME280_H
+#define HOST_ESP32_ADAFRUIT_BME280_H
+
+#include "Adafruit_Sensor.h"
+#include "Wire.h"
+
+class Adafruit_BME280 {
+public:
+  enum sensor_sampling {
+    SAMPLING_NONE = 0,
+    SAMPLING_X1 = 1,
+    SAMPLING_X2 = 2,
+    SAMPLING_X4 = 3,
+    SAMPLING_X8 = 4,
+    SAMPLING_X16 = 5
+  };
+  enum sensor_mode { MODE_SLEEP = 0, MODE_FORCED = 1, MODE_NORMAL = 3 };
+  enum sensor_filter { FILTER_OFF = 0, FILTER_X2 = 1, FILTER_X4 = 2, FILTER_X8 = 3, FILTER_X16 = 4 };
+  enum standby_duration { STANDBY_MS_0_5 = 0, STANDBY_MS_62_5 = 1, STANDBY_MS_125 = 2, STANDBY_MS_250 = 3,
+                          STANDBY_MS_500 = 4, STANDBY_MS_1000 = 5, STANDBY_MS_10 = 6, STANDBY_MS_20 = 7 };
+
+  bool begin(uint8_t address = 0x77, TwoWire *wire = &Wire);
+  void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling tempSampling = SAMPLING_X16,
+                   sensor_sampling pressSampling = SAMPLING_X16, sensor_sampling humSampling = SAMPLING_X16,
+                   sensor_filter filter = FILTER_OFF, standby_duration duration = STANDBY_MS_0_5);
+  bool takeForcedMeasurement();
+  float readTemperature();  // C
+  float readPressure();     // Pa
+  float readHumidity();     // %
+  uint32_t sensorID() const { return sensorId; }
+
+private:
+  TwoWire *wire = nullptr;
+  uint8_t address = 0x77;
+  uint8_t sensorId = 0;
+  uint8_t measReg = 0;   // ctrl_meas as last written
+  int32_t tFine = 0;     // from the last temperature read
+
+  void write8(uint8_t reg, uint8_t value);
+  uint8_t read8(uint8_t reg);
+  uint16_t read16(uint8_t reg);
+  uint32_t read24(uint8_t reg);
+};
+
+#endif
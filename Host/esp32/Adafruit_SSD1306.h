@@ -0,0 +1,98 @@
+// Adafruit_SSD1306.h - host stand-in for Adafruit_SSD1306 and the bits of
+// Adafruit_GFX the sketch uses
+//
+// The framebuffer (1 KB for 128x64) is allocated on the simulated heap by
+// begin(), as the library does, and every transfer goes over Wire to the
+// panel model the way the library sends it: ssd1306_command() as its own
+// transaction at 400 kHz, putting the bus back to 100 kHz afterwards, and
+// display() in chunks of I2C_BUFFER_LENGTH - 1 data bytes.
+//
+// Text uses made-up 5x7 glyphs (a fixed pattern per character, blank for
+// a space) in the usual 6x8 cell: the pixels differ from the real font,
+// but a changed character still changes its pixels, which is what the
+// tests look at.
+
+#ifndef HOST_ESP32_ADAFRUIT_SSD1306_H
+#define HOST_ESP32_ADAFRUIT_SSD1306_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define SSD1306_BLACK   0
+#define SSD1306_WHITE   1
+#define SSD1306_INVERSE 2
+
+#define SSD1306_MEMORYMODE          0x20
+#define SSD1306_COLUMNADDR          0x21
+#define SSD1306_PAGEADDR            0x22
+#define SSD1306_SETCONTRAST         0x81
+#define SSD1306_CHARGEPUMP          0x8D
+#define SSD1306_SEGREMAP            0xA0
+#define SSD1306_DISPLAYALLON_RESUME 0xA4
+#define SSD1306_NORMALDISPLAY       0xA6
+#define SSD1306_SETMULTIPLEX        0xA8
+#define SSD1306_DISPLAYOFF          0xAE
+#define SSD1306_DISPLAYON           0xAF
+#define SSD1306_COMSCANDEC          0xC8
+#define SSD1306_SETDISPLAYOFFSET    0xD3
+#define SSD1306_SETDISPLAYCLOCKDIV  0xD5
+#define SSD1306_SETPRECHARGE        0xD9
+#define SSD1306_SETCOMPINS          0xDA
+#define SSD1306_SETVCOMDETECT       0xDB
+#define SSD1306_SETSTARTLINE        0x40
+#define SSD1306_DEACTIVATE_SCROLL   0x2E
+#define SSD1306_EXTERNALVCC         0x01
+#define SSD1306_SWITCHCAPVCC        0x02
+
+class Adafruit_GFX : public Print {
+public:
+  Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h) {}
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void setCursor(int16_t x, int16_t y) { cursorX = x; cursorY = y; }
+  void setTextColor(uint16_t c) { textColor = textBgColor = c; }
+  void setTextColor(uint16_t c, uint16_t bg) { textColor = c; textBgColor = bg; }
+  void setTextSize(uint8_t s) { textSize = s ? s : 1; }
+  void setTextWrap(bool w) { wrap = w; }
+  int16_t width() const { return WIDTH; }
+  int16_t height() const { return HEIGHT; }
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+protected:
+  const int16_t WIDTH, HEIGHT;
+  int16_t cursorX = 0, cursorY = 0;
+  uint16_t textColor = 0xFFFF, textBgColor = 0xFFFF;  // equal: transparent background
+  uint8_t textSize = 1;
+  bool wrap = true;
+
+  void drawChar(int16_t x, int16_t y, unsigned char c);
+};
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi = &Wire, int8_t rstPin = -1,
+                   uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL);
+  ~Adafruit_SSD1306();
+
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0, bool reset = true,
+             bool periphBegin = true);
+  void display();
+  void clearDisplay();
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void ssd1306_command(uint8_t c);
+  uint8_t *getBuffer() { return buffer; }
+
+private:
+  TwoWire *wire;
+  uint8_t *buffer = nullptr;
+  uint8_t address = 0x3C;
+  uint32_t wireClk, restoreClk;
+
+  void command1(uint8_t c);
+  void commandList(const uint8_t *c, uint8_t n);
+};
+
+#endif
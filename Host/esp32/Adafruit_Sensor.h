@@ -0,0 +1,8 @@
+// Adafruit_Sensor.h - host stand-in: nothing the sketch uses directly
+
+#ifndef HOST_ESP32_ADAFRUIT_SENSOR_H
+#define HOST_ESP32_ADAFRUIT_SENSOR_H
+
+#include "Arduino.h"
+
+#endif
@@ -0,0 +1,280 @@
+// Arduino.h - host stand-in for the Arduino-ESP32 core
+//
+// Lets the Weather Node (Project 2) build and run on a PC, like Host/Arduino.h
+// does for the Uno sketches. The libraries the sketch includes (WiFi,
+// HTTPClient, ArduinoJson, Adafruit BME280 / SSD1306, PubSubClient,
+// LittleFS, ArduinoOTA) have stand-ins next to this file.
+//
+// What is modelled:
+//   - virtual time in microseconds. Code takes no time; only waiting does
+//     (delay(), FreeRTOS blocking calls, an I2C transfer, bytes on the
+//     network, flash writes), so days run in seconds
+//   - FreeRTOS tasks, each a pthread. Exactly one runs at a time and the
+//     highest-priority ready task goes first, so a run is deterministic.
+//     Both cores are modelled as one: with code taking no time, two tasks
+//     never compete for a core anyway (see Esp32.cpp)
+//   - queues, mutexes and vTaskDelayUntil(), with the ESP32's 1 ms tick
+//   - the ESP32 heap, as a first-fit allocator over a fixed arena, used by
+//     String and the library stand-ins for what they allocate on the chip,
+//     so ESP.getFreeHeap() and the largest free block mean something
+//   - deep sleep: RTC_DATA_ATTR variables live in their own section, which
+//     Esp32Sim.h can save and put back across a simulated reboot
+// The network, the I2C devices and the flash are modelled in the library
+// stand-ins; tests steer all of it through Esp32Sim.h.
+
+#ifndef HOST_ESP32_ARDUINO_H
+#define HOST_ESP32_ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <type_traits>
+
+#include "freertos/FreeRTOS.h"
+
+#define ESP32 1
+#define ARDUINO_ARCH_ESP32 1
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Kept in RTC slow memory, which deep sleep does not clear. The section
+// lets the simulation save and restore exactly these variables.
+#define RTC_DATA_ATTR __attribute__((section("rtc_data"), used))
+#define IRAM_ATTR
+
+// glibc only has strlcpy() from 2.38 on; the ESP32's newlib always has it
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// ---- Time ----
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// time() reads the simulated RTC: seconds since power-up until NTP has set
+// it, the epoch afterwards (see configTime())
+time_t simTime(time_t *out);
+#define time(out) simTime(out)
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+// ---- Maths ----
+// Templates rather than the core's macros, so the C++ library still builds
+template <typename A, typename B>
+typename std::common_type<A, B>::type min(A a, B b) { return b < a ? b : a; }
+template <typename A, typename B>
+typename std::common_type<A, B>::type max(A a, B b) { return a < b ? b : a; }
+template <typename X, typename L, typename H>
+X constrain(X x, L low, H high) { return x < low ? low : (high < x ? high : x); }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// ---- Heap ----
+// The simulated ESP32 heap. Only what the core and the library stand-ins
+// allocate on the chip goes here; the host's own bookkeeping does not.
+void *simHeapAlloc(size_t size);
+void *simHeapRealloc(void *block, size_t size);
+void simHeapFree(void *block);
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getHeapSize();
+  uint32_t getMaxAllocHeap();
+  void restart();
+};
+extern EspClass ESP;
+
+// ---- String ----
+// The core's String, with its buffer on the simulated heap. Like the
+// ESP32 core, up to 11 characters are kept inside the object itself.
+class String {
+public:
+  String(const char *s = "");
+  String(const char *s, size_t length);
+  String(const String &other);
+  String(String &&other);
+  explicit String(char c);
+  explicit String(int v, unsigned char base = DEC);
+  explicit String(unsigned int v, unsigned char base = DEC);
+  explicit String(long v, unsigned char base = DEC);
+  explicit String(unsigned long v, unsigned char base = DEC);
+  explicit String(double v, unsigned int digits = 2);
+  ~String();
+
+  String &operator=(const String &other);
+  String &operator=(String &&other);
+  String &operator=(const char *s);
+
+  const char *c_str() const { return buffer(); }
+  unsigned int length() const { return len; }
+  bool isEmpty() const { return len == 0; }
+  char operator[](unsigned int i) const { return i < len ? buffer()[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  bool concat(const char *s, size_t n);
+  bool concat(const char *s) { return s ? concat(s, strlen(s)) : false; }
+  bool concat(const String &s) { return concat(s.c_str(), s.len); }
+  bool concat(char c) { return concat(&c, 1); }
+  String &operator+=(const String &s) { concat(s); return *this; }
+  String &operator+=(const char *s) { concat(s); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+  friend String operator+(String a, const String &b) { return a += b; }
+  friend String operator+(String a, const char *b) { return a += b; }
+
+  bool equals(const String &s) const { return len == s.len && strcmp(c_str(), s.c_str()) == 0; }
+  bool equals(const char *s) const { return strcmp(c_str(), s ? s : "") == 0; }
+  bool equalsIgnoreCase(const String &s) const { return len == s.len && strcasecmp(c_str(), s.c_str()) == 0; }
+  bool operator==(const String &s) const { return equals(s); }
+  bool operator==(const char *s) const { return equals(s); }
+  bool operator!=(const String &s) const { return !equals(s); }
+  bool operator!=(const char *s) const { return !equals(s); }
+  bool startsWith(const String &prefix) const;
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const char *s, unsigned int from = 0) const;
+  String substring(unsigned int from, unsigned int to = (unsigned int)-1) const;
+  void trim();
+  void toLowerCase();
+  long toInt() const { return atol(c_str()); }
+  bool reserve(unsigned int size);
+
+private:
+  static const unsigned int SSO_SIZE = 12;  // 11 characters and the '\0'
+  char *heap = nullptr;
+  unsigned int cap = SSO_SIZE - 1;
+  unsigned int len = 0;
+  char sso[SSO_SIZE] = {0};
+
+  char *buffer() { return heap ? heap : sso; }
+  const char *buffer() const { return heap ? heap : sso; }
+  void assign(const char *s, size_t n);
+};
+
+// ---- Print / Stream ----
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+  size_t print(const Printable &p) { return p.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T>
+  size_t println(const T &v, int format) { size_t n = print(v, format); return n + println(); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long ms) { timeout = ms; }
+  unsigned long getTimeout() const { return timeout; }
+
+  // Wait up to the timeout for each byte, as the core does
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+  // Wait for more data until 'untilUs' (virtual time) at the latest. By
+  // default it looks again every millisecond; a stream fed by the
+  // simulation (WiFiClient) sleeps until its data arrives instead.
+  virtual void simWait(uint64_t untilUs);
+
+protected:
+  unsigned long timeout = 1000;
+  int timedRead();
+  int timedPeek();
+};
+
+// Serial: text goes nowhere unless the test echoes it (simSerialEcho)
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud);
+  void end() {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+// ---- IPAddress ----
+class IPAddress : public Printable {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{a, b, c, d} {}
+  size_t printTo(Print &p) const override;
+  String toString() const;
+
+private:
+  uint8_t bytes[4];
+};
+
+// The sketch
+void setup();
+void loop();
+
+#endif
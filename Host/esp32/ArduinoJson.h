@@ -0,0 +1,810 @@
+// ArduinoJson.h - host stand-in for the parts of ArduinoJson 6 the Weather
+// Node uses
+//
+// Keeps the library's memory model, so capacities and overflows mean the
+// same as on the chip: a document is a fixed pool, every value (object
+// member, array element) takes one 16-byte slot as on the ESP32
+// (JSON_OBJECT_SIZE / JSON_ARRAY_SIZE), and copied strings take their
+// length plus the '\0', stored once however often they appear. const char*
+// keys and values are only linked, not copied. A value that does not fit
+// sets overflowed() and is dropped; the parser then fails with NoMemory.
+//
+// deserializeJson() reads one byte at a time with readBytes(), as the
+// library does from a Stream, and takes a filter document: members the
+// filter does not name are skipped without using any memory. Numbers are
+// stored as int64 or double. serializeJson() writes compact JSON; doubles
+// come out with %.9g, which may differ from the library in the last digit.
+
+#ifndef HOST_ESP32_ARDUINOJSON_H
+#define HOST_ESP32_ARDUINOJSON_H
+
+#include "Arduino.h"
+#include <string>
+#include <type_traits>
+
+#define ARDUINOJSON_SLOT_SIZE 16
+#define ARDUINOJSON_DEFAULT_NESTING_LIMIT 10
+#define JSON_OBJECT_SIZE(n) ((n) * ARDUINOJSON_SLOT_SIZE)
+#define JSON_ARRAY_SIZE(n) ((n) * ARDUINOJSON_SLOT_SIZE)
+
+class JsonDocument;
+class JsonVariant;
+
+// ---- Storage ----
+// Slots are indexes into the document's pool; the root lives in the
+// document itself
+#define JSON_NONE (-1)
+#define JSON_ROOT (-2)
+
+struct JsonSlot {
+  enum Type : uint8_t { NUL, BOOL, INT, FLOAT, STRING, ARRAY, OBJECT };
+  Type type;
+  const char *key;   // object members only
+  int32_t next;      // next member / element
+  union {
+    bool b;
+    int64_t i;
+    double f;
+    const char *s;
+    struct {
+      int32_t head, tail;
+    } c;
+  } v;
+};
+
+class JsonDocument {
+public:
+  JsonDocument(const JsonDocument &) = delete;
+  JsonDocument &operator=(const JsonDocument &) = delete;
+
+  inline JsonVariant operator[](const char *key);
+  inline JsonVariant operator[](size_t index);
+  void clear() {
+    slotCount = 0;
+    stringBytes = 0;
+    overflow = false;
+    root.type = JsonSlot::NUL;
+  }
+  bool overflowed() const { return overflow; }
+  size_t memoryUsage() const { return slotCount * ARDUINOJSON_SLOT_SIZE + stringBytes; }
+  size_t capacity() const { return capacityBytes; }
+  bool isNull() const { return root.type == JsonSlot::NUL; }
+
+  // ---- Used by the variants and the parser ----
+  JsonSlot *slot(int32_t i) { return i == JSON_ROOT ? &root : (i >= 0 ? &slots[i] : nullptr); }
+
+  int32_t newSlot() {
+    if ((slotCount + 1) * ARDUINOJSON_SLOT_SIZE + stringBytes > capacityBytes) {
+      overflow = true;
+      return JSON_NONE;
+    }
+    JsonSlot *s = &slots[slotCount];
+    s->type = JsonSlot::NUL;
+    s->key = nullptr;
+    s->next = JSON_NONE;
+    return (int32_t)slotCount++;
+  }
+
+  // A copy of the string in the pool, shared with an equal one if any
+  const char *saveString(const char *s, size_t n) {
+    for (size_t at = 0; at < stringBytes;) {
+      size_t len = strlen(strings + at);
+      if (len == n && memcmp(strings + at, s, n) == 0) return strings + at;
+      at += len + 1;
+    }
+    if (slotCount * ARDUINOJSON_SLOT_SIZE + stringBytes + n + 1 > capacityBytes) {
+      overflow = true;
+      return nullptr;
+    }
+    char *copy = strings + stringBytes;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    stringBytes += n + 1;
+    return copy;
+  }
+
+  // Append a slot to a collection, returns it (JSON_NONE if out of memory)
+  int32_t append(int32_t collection) {
+    int32_t added = newSlot();
+    if (added == JSON_NONE) return JSON_NONE;
+    JsonSlot *c = slot(collection);
+    if (c->v.c.head == JSON_NONE) c->v.c.head = added;
+    else slot(c->v.c.tail)->next = added;
+    c->v.c.tail = added;
+    return added;
+  }
+
+  void makeCollection(int32_t i, JsonSlot::Type type) {
+    JsonSlot *s = slot(i);
+    s->type = type;
+    s->v.c.head = s->v.c.tail = JSON_NONE;
+  }
+
+  int32_t member(int32_t object, const char *key) {
+    JsonSlot *o = slot(object);
+    if (!o || o->type != JsonSlot::OBJECT) return JSON_NONE;
+    for (int32_t i = o->v.c.head; i != JSON_NONE; i = slots[i].next) {
+      if (strcmp(slots[i].key, key) == 0) return i;
+    }
+    return JSON_NONE;
+  }
+
+  int32_t element(int32_t array, size_t index) {
+    JsonSlot *a = slot(array);
+    if (!a || a->type != JsonSlot::ARRAY) return JSON_NONE;
+    for (int32_t i = a->v.c.head; i != JSON_NONE; i = slots[i].next) {
+      if (index-- == 0) return i;
+    }
+    return JSON_NONE;
+  }
+
+protected:
+  JsonDocument(JsonSlot *slots, char *strings, size_t capacity)
+      : slots(slots), strings(strings), capacityBytes(capacity) {
+    clear();
+  }
+
+private:
+  JsonSlot *slots;
+  char *strings;
+  size_t capacityBytes;
+  size_t slotCount = 0;
+  size_t stringBytes = 0;
+  bool overflow = false;
+  JsonSlot root;
+};
+
+template <size_t desiredCapacity>
+class StaticJsonDocument : public JsonDocument {
+public:
+  StaticJsonDocument() : JsonDocument(slotStore, stringStore, desiredCapacity) {}
+
+private:
+  JsonSlot slotStore[desiredCapacity / ARDUINOJSON_SLOT_SIZE + 1];
+  char stringStore[desiredCapacity + 1];
+};
+
+// ---- Variants ----
+// A value in a document, or the path to where one would go: reading a
+// path that does not exist gives null, writing to it creates it
+class JsonVariant {
+public:
+  JsonVariant() : doc(nullptr), base(JSON_NONE), depth(0) {}
+  JsonVariant(JsonDocument *doc, int32_t slot) : doc(doc), base(slot), depth(0) {}
+
+  JsonVariant operator[](const char *key) const {
+    JsonVariant v = *this;
+    if (depth == 0 && doc) {
+      int32_t found = doc->member(base, key);
+      if (found != JSON_NONE) return JsonVariant(doc, found);
+    }
+    v.push(key, 0);
+    return v;
+  }
+
+  JsonVariant operator[](size_t index) const {
+    JsonVariant v = *this;
+    if (depth == 0 && doc) {
+      int32_t found = doc->element(base, index);
+      if (found != JSON_NONE) return JsonVariant(doc, found);
+    }
+    v.push(nullptr, index);
+    return v;
+  }
+  JsonVariant operator[](int index) const { return (*this)[(size_t)index]; }
+
+  // ---- Reading ----
+  const JsonSlot *resolved() const {
+    if (!doc) return nullptr;
+    int32_t at = base;
+    for (uint8_t i = 0; i < depth && at != JSON_NONE; i++) {
+      at = steps[i].key ? doc->member(at, steps[i].key) : doc->element(at, steps[i].index);
+    }
+    return doc->slot(at);
+  }
+  int32_t resolvedIndex() const {
+    if (!doc) return JSON_NONE;
+    int32_t at = base;
+    for (uint8_t i = 0; i < depth && at != JSON_NONE; i++) {
+      at = steps[i].key ? doc->member(at, steps[i].key) : doc->element(at, steps[i].index);
+    }
+    return at;
+  }
+  JsonDocument *document() const { return doc; }
+
+  bool isNull() const {
+    const JsonSlot *s = resolved();
+    return !s || s->type == JsonSlot::NUL;
+  }
+
+  template <typename T>
+  T as() const;
+
+  // ---- Writing ----
+  JsonVariant &operator=(bool value) {
+    JsonSlot *s = create();
+    if (s) {
+      s->type = JsonSlot::BOOL;
+      s->v.b = value;
+    }
+    return *this;
+  }
+  JsonVariant &operator=(double value) {
+    JsonSlot *s = create();
+    if (s) {
+      s->type = JsonSlot::FLOAT;
+      s->v.f = value;
+    }
+    return *this;
+  }
+  JsonVariant &operator=(float value) { return *this = (double)value; }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, JsonVariant &>::type
+  operator=(T value) {
+    JsonSlot *s = create();
+    if (s) {
+      s->type = JsonSlot::INT;
+      s->v.i = (int64_t)value;
+    }
+    return *this;
+  }
+  JsonVariant &operator=(const char *value) {  // linked, not copied
+    JsonSlot *s = create();
+    if (s) {
+      s->type = value ? JsonSlot::STRING : JsonSlot::NUL;
+      s->v.s = value;
+    }
+    return *this;
+  }
+  JsonVariant &operator=(char *value) { return setCopy(value, value ? strlen(value) : 0); }
+  JsonVariant &operator=(const String &value) { return setCopy(value.c_str(), value.length()); }
+
+private:
+  struct Step {
+    const char *key;   // null: an array index
+    size_t index;
+  };
+  static const uint8_t MAX_DEPTH = 8;
+
+  JsonDocument *doc;
+  int32_t base;
+  uint8_t depth;
+  Step steps[MAX_DEPTH];
+
+  void push(const char *key, size_t index) {
+    if (depth == MAX_DEPTH) abort();  // deeper than any document here
+    steps[depth].key = key;
+    steps[depth].index = index;
+    depth++;
+  }
+
+  JsonVariant &setCopy(const char *value, size_t n) {
+    if (!value) return *this = (const char *)nullptr;
+    const char *copy = doc ? doc->saveString(value, n) : nullptr;
+    if (!copy) return *this;
+    return *this = copy;
+  }
+
+  // The slot at the end of the path, creating objects, arrays and members
+  // on the way; null if the path crosses a value of another type or the
+  // document is full
+  JsonSlot *create() {
+    if (!doc || base == JSON_NONE) return nullptr;
+    int32_t at = base;
+    for (uint8_t i = 0; i < depth; i++) {
+      JsonSlot *s = doc->slot(at);
+      JsonSlot::Type want = steps[i].key ? JsonSlot::OBJECT : JsonSlot::ARRAY;
+      if (s->type == JsonSlot::NUL) doc->makeCollection(at, want);
+      else if (s->type != want) return nullptr;
+
+      int32_t next;
+      if (steps[i].key) {
+        next = doc->member(at, steps[i].key);
+        if (next == JSON_NONE) {
+          next = doc->append(at);
+          if (next == JSON_NONE) return nullptr;
+          doc->slot(next)->key = steps[i].key;
+        }
+      } else {
+        next = doc->element(at, steps[i].index);
+        while (next == JSON_NONE) {
+          if (doc->append(at) == JSON_NONE) return nullptr;
+          next = doc->element(at, steps[i].index);
+        }
+      }
+      at = next;
+    }
+    // Later steps now exist, so this variant can point at the slot itself
+    base = at;
+    depth = 0;
+    return doc->slot(at);
+  }
+};
+
+inline JsonVariant JsonDocument::operator[](const char *key) {
+  return JsonVariant(this, JSON_ROOT)[key];
+}
+
+inline JsonVariant JsonDocument::operator[](size_t index) {
+  return JsonVariant(this, JSON_ROOT)[index];
+}
+
+// value | default: the value if it has a compatible type, else the default
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, T>::type
+operator|(const JsonVariant &v, T fallback) {
+  const JsonSlot *s = v.resolved();
+  if (!s) return fallback;
+  if (s->type == JsonSlot::INT) return (T)s->v.i;
+  if (s->type == JsonSlot::FLOAT) return (T)s->v.f;
+  return fallback;
+}
+
+inline bool operator|(const JsonVariant &v, bool fallback) {
+  const JsonSlot *s = v.resolved();
+  return s && s->type == JsonSlot::BOOL ? s->v.b : fallback;
+}
+
+inline const char *operator|(const JsonVariant &v, const char *fallback) {
+  const JsonSlot *s = v.resolved();
+  return s && s->type == JsonSlot::STRING ? s->v.s : fallback;
+}
+
+template <typename T>
+inline T JsonVariant::as() const {
+  return *this | T();
+}
+
+template <>
+inline const char *JsonVariant::as<const char *>() const {
+  return *this | (const char *)nullptr;
+}
+
+// ---- Arrays and objects ----
+class JsonArray {
+public:
+  JsonArray() : doc(nullptr), slot(JSON_NONE) {}
+  JsonArray(const JsonVariant &v) : doc(v.document()), slot(JSON_NONE) {
+    int32_t at = v.resolvedIndex();
+    if (doc && at != JSON_NONE && doc->slot(at)->type == JsonSlot::ARRAY) slot = at;
+  }
+
+  class iterator {
+  public:
+    iterator(JsonDocument *doc, int32_t at) : doc(doc), at(at) {}
+    JsonVariant operator*() const { return JsonVariant(doc, at); }
+    iterator &operator++() {
+      at = doc->slot(at)->next;
+      return *this;
+    }
+    bool operator!=(const iterator &other) const { return at != other.at; }
+
+  private:
+    JsonDocument *doc;
+    int32_t at;
+  };
+
+  iterator begin() const { return iterator(doc, slot == JSON_NONE ? JSON_NONE : doc->slot(slot)->v.c.head); }
+  iterator end() const { return iterator(doc, JSON_NONE); }
+  size_t size() const {
+    size_t n = 0;
+    for (iterator it = begin(); it != end(); ++it) n++;
+    return n;
+  }
+  bool isNull() const { return slot == JSON_NONE; }
+  JsonVariant operator[](size_t index) const { return JsonVariant(doc, slot)[index]; }
+
+private:
+  JsonDocument *doc;
+  int32_t slot;
+};
+
+class JsonObject {
+public:
+  JsonObject() : doc(nullptr), slot(JSON_NONE) {}
+  JsonObject(const JsonVariant &v) : doc(v.document()), slot(JSON_NONE) {
+    int32_t at = v.resolvedIndex();
+    if (doc && at != JSON_NONE && doc->slot(at)->type == JsonSlot::OBJECT) slot = at;
+  }
+
+  JsonVariant operator[](const char *key) const { return JsonVariant(slot == JSON_NONE ? nullptr : doc, slot)[key]; }
+  bool isNull() const { return slot == JSON_NONE; }
+  size_t size() const {
+    size_t n = 0;
+    if (slot == JSON_NONE) return 0;
+    for (int32_t i = doc->slot(slot)->v.c.head; i != JSON_NONE; i = doc->slot(i)->next) n++;
+    return n;
+  }
+
+private:
+  JsonDocument *doc;
+  int32_t slot;
+};
+
+// ---- Deserialization ----
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : value(code) {}
+  explicit operator bool() const { return value != Ok; }
+  bool operator==(Code code) const { return value == code; }
+  bool operator!=(Code code) const { return value != code; }
+  Code code() const { return value; }
+  const char *c_str() const {
+    static const char *const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+    return names[value];
+  }
+
+private:
+  Code value;
+};
+
+namespace DeserializationOption {
+class Filter {
+public:
+  Filter() : doc(nullptr) {}
+  explicit Filter(JsonDocument &filter) : doc(&filter) {}
+  JsonDocument *document() const { return doc; }
+
+private:
+  JsonDocument *doc;
+};
+}  // namespace DeserializationOption
+
+namespace ArduinoJsonHost {
+
+// What the filter lets through at one point of the input: everything
+// (no filter, or true), or what a filter object / array names
+struct FilterAt {
+  JsonDocument *doc;  // null: no filter, keep everything
+  int32_t slot;       // JSON_NONE: keep nothing
+
+  const JsonSlot *s() const { return doc ? doc->slot(slot) : nullptr; }
+  bool all() const { return !doc || (s() && s()->type == JsonSlot::BOOL && s()->v.b); }
+  bool any() const { return all() || (s() && s()->type != JsonSlot::NUL && !(s()->type == JsonSlot::BOOL && !s()->v.b)); }
+  bool objects() const { return all() || (s() && s()->type == JsonSlot::OBJECT); }
+  bool arrays() const { return all() || (s() && s()->type == JsonSlot::ARRAY); }
+  FilterAt member(const char *key) const {
+    if (all()) return *this;
+    int32_t m = doc->member(slot, key);
+    if (m == JSON_NONE) m = doc->member(slot, "*");
+    return FilterAt{doc, m};
+  }
+  FilterAt element() const {
+    if (all()) return *this;
+    return FilterAt{doc, doc->element(slot, 0)};
+  }
+};
+
+struct StreamReader {
+  Stream *stream;
+  int read() {
+    char c;
+    return stream->readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+  }
+};
+
+struct CharReader {
+  const char *p, *end;
+  int read() { return p < end ? (uint8_t)*p++ : -1; }
+};
+
+template <typename Reader>
+class Parser {
+public:
+  Parser(JsonDocument &doc, Reader reader) : doc(doc), reader(reader) {}
+
+  DeserializationError parse(FilterAt filter) {
+    doc.clear();
+    skipSpace();
+    if (current() < 0) return DeserializationError::EmptyInput;
+    DeserializationError err = value(JSON_ROOT, filter, ARDUINOJSON_DEFAULT_NESTING_LIMIT);
+    return err;
+  }
+
+private:
+  JsonDocument &doc;
+  Reader reader;
+  int lookahead = -2;   // -2: nothing read yet
+  std::string text;     // the string or number being read
+
+  int current() {
+    if (lookahead == -2) lookahead = reader.read();
+    return lookahead;
+  }
+  void advance() { lookahead = -2; }
+
+  void skipSpace() {
+    while (current() == ' ' || current() == '\t' || current() == '\n' || current() == '\r') advance();
+  }
+
+  bool eat(char c) {
+    skipSpace();
+    if (current() != c) return false;
+    advance();
+    return true;
+  }
+
+  DeserializationError endOrInvalid() {
+    return current() < 0 ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+  }
+
+  // Parse one value into 'at' (JSON_NONE: skip it)
+  DeserializationError value(int32_t at, FilterAt filter, int nesting) {
+    skipSpace();
+    int c = current();
+    if (c == '{') return object(filter.objects() ? at : JSON_NONE, filter, nesting);
+    if (c == '[') return array(filter.arrays() ? at : JSON_NONE, filter, nesting);
+    if (c == '"' || c == '\'') {
+      DeserializationError err = string();
+      if (err) return err;
+      if (at != JSON_NONE && filter.all()) {
+        const char *copy = doc.saveString(text.data(), text.size());
+        if (!copy) return DeserializationError::NoMemory;
+        JsonSlot *s = doc.slot(at);
+        s->type = JsonSlot::STRING;
+        s->v.s = copy;
+      }
+      return DeserializationError::Ok;
+    }
+    return scalar(filter.all() ? at : JSON_NONE);
+  }
+
+  DeserializationError object(int32_t at, FilterAt filter, int nesting) {
+    if (nesting == 0) return DeserializationError::TooDeep;
+    advance();  // '{'
+    if (at != JSON_NONE) doc.makeCollection(at, JsonSlot::OBJECT);
+    if (eat('}')) return DeserializationError::Ok;
+    for (;;) {
+      skipSpace();
+      DeserializationError err = string();
+      if (err) return err;
+      if (!eat(':')) return endOrInvalid();
+
+      FilterAt memberFilter = at != JSON_NONE ? filter.member(text.c_str()) : FilterAt{filter.doc, JSON_NONE};
+      int32_t memberAt = JSON_NONE;
+      if (at != JSON_NONE && memberFilter.any()) {
+        const char *key = doc.saveString(text.data(), text.size());
+        if (!key) return DeserializationError::NoMemory;
+        memberAt = doc.member(at, key);  // a repeated key keeps the last value
+        if (memberAt == JSON_NONE) {
+          memberAt = doc.append(at);
+          if (memberAt == JSON_NONE) return DeserializationError::NoMemory;
+          doc.slot(memberAt)->key = key;
+        }
+      }
+      err = value(memberAt, memberFilter, nesting - 1);
+      if (err) return err;
+      if (eat('}')) return DeserializationError::Ok;
+      if (!eat(',')) return endOrInvalid();
+    }
+  }
+
+  DeserializationError array(int32_t at, FilterAt filter, int nesting) {
+    if (nesting == 0) return DeserializationError::TooDeep;
+    advance();  // '['
+    if (at != JSON_NONE) doc.makeCollection(at, JsonSlot::ARRAY);
+    if (eat(']')) return DeserializationError::Ok;
+    FilterAt elementFilter = at != JSON_NONE ? filter.element() : FilterAt{filter.doc, JSON_NONE};
+    for (;;) {
+      int32_t elementAt = JSON_NONE;
+      if (at != JSON_NONE && elementFilter.any()) {
+        elementAt = doc.append(at);
+        if (elementAt == JSON_NONE) return DeserializationError::NoMemory;
+      }
+      DeserializationError err = value(elementAt, elementFilter, nesting - 1);
+      if (err) return err;
+      if (eat(']')) return DeserializationError::Ok;
+      if (!eat(',')) return endOrInvalid();
+    }
+  }
+
+  static void putUtf8(std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+      out += (char)cp;
+    } else if (cp < 0x800) {
+      out += (char)(0xC0 | (cp >> 6));
+      out += (char)(0x80 | (cp & 0x3F));
+    } else {
+      out += (char)(0xE0 | (cp >> 12));
+      out += (char)(0x80 | ((cp >> 6) & 0x3F));
+      out += (char)(0x80 | (cp & 0x3F));
+    }
+  }
+
+  DeserializationError string() {
+    int quote = current();
+    if (quote != '"' && quote != '\'') return endOrInvalid();
+    advance();
+    text.clear();
+    for (;;) {
+      int c = current();
+      advance();
+      if (c < 0) return DeserializationError::IncompleteInput;
+      if (c == quote) return DeserializationError::Ok;
+      if (c != '\\') {
+        text += (char)c;
+        continue;
+      }
+      c = current();
+      advance();
+      switch (c) {
+        case 'b': text += '\b'; break;
+        case 'f': text += '\f'; break;
+        case 'n': text += '\n'; break;
+        case 'r': text += '\r'; break;
+        case 't': text += '\t'; break;
+        case 'u': {
+          uint32_t cp = 0;
+          for (int i = 0; i < 4; i++) {
+            int h = current();
+            advance();
+            if (h < 0) return DeserializationError::IncompleteInput;
+            if (!isxdigit(h)) return DeserializationError::InvalidInput;
+            cp = (cp << 4) | (isdigit(h) ? h - '0' : (tolower(h) - 'a' + 10));
+          }
+          putUtf8(text, cp);
+          break;
+        }
+        case -1: return DeserializationError::IncompleteInput;
+        default: text += (char)c; break;
+      }
+    }
+  }
+
+  DeserializationError scalar(int32_t at) {
+    text.clear();
+    for (;;) {
+      int c = current();
+      if (c < 0 || !(isalnum(c) || c == '-' || c == '+' || c == '.')) break;
+      text += (char)c;
+      advance();
+    }
+    if (text.empty()) return endOrInvalid();
+
+    JsonSlot parsed;
+    if (text == "true" || text == "false") {
+      parsed.type = JsonSlot::BOOL;
+      parsed.v.b = text == "true";
+    } else if (text == "null") {
+      parsed.type = JsonSlot::NUL;
+    } else {
+      char *end;
+      bool isFloat = text.find_first_of(".eE") != std::string::npos;
+      if (!isFloat) {
+        errno = 0;
+        long long i = strtoll(text.c_str(), &end, 10);
+        if (*end) return DeserializationError::InvalidInput;
+        if (errno == ERANGE) isFloat = true;
+        parsed.type = JsonSlot::INT;
+        parsed.v.i = i;
+      }
+      if (isFloat) {
+        double f = strtod(text.c_str(), &end);
+        if (*end) return DeserializationError::InvalidInput;
+        parsed.type = JsonSlot::FLOAT;
+        parsed.v.f = f;
+      }
+    }
+    if (at != JSON_NONE) {
+      JsonSlot *s = doc.slot(at);
+      s->type = parsed.type;
+      s->v = parsed.v;
+    }
+    return DeserializationError::Ok;
+  }
+};
+
+}  // namespace ArduinoJsonHost
+
+inline DeserializationError deserializeJson(JsonDocument &doc, Stream &input,
+                                            DeserializationOption::Filter filter = DeserializationOption::Filter()) {
+  ArduinoJsonHost::StreamReader reader = {&input};
+  ArduinoJsonHost::Parser<ArduinoJsonHost::StreamReader> parser(doc, reader);
+  return parser.parse(ArduinoJsonHost::FilterAt{filter.document(), JSON_ROOT});
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t length,
+                                            DeserializationOption::Filter filter = DeserializationOption::Filter()) {
+  ArduinoJsonHost::CharReader reader = {input, input + length};
+  ArduinoJsonHost::Parser<ArduinoJsonHost::CharReader> parser(doc, reader);
+  return parser.parse(ArduinoJsonHost::FilterAt{filter.document(), JSON_ROOT});
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input,
+                                            DeserializationOption::Filter filter = DeserializationOption::Filter()) {
+  return deserializeJson(doc, input, strlen(input), filter);
+}
+
+// ---- Serialization ----
+namespace ArduinoJsonHost {
+
+inline void writeString(std::string &out, const char *s) {
+  out += '"';
+  for (; *s; s++) {
+    char c = *s;
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if ((uint8_t)c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+inline void writeValue(std::string &out, JsonDocument &doc, int32_t at) {
+  const JsonSlot *s = doc.slot(at);
+  char number[32];
+  switch (s->type) {
+    case JsonSlot::NUL: out += "null"; break;
+    case JsonSlot::BOOL: out += s->v.b ? "true" : "false"; break;
+    case JsonSlot::INT:
+      snprintf(number, sizeof(number), "%lld", (long long)s->v.i);
+      out += number;
+      break;
+    case JsonSlot::FLOAT:
+      if (isnan(s->v.f) || isinf(s->v.f)) {
+        out += isnan(s->v.f) ? "NaN" : (s->v.f > 0 ? "Infinity" : "-Infinity");
+      } else {
+        snprintf(number, sizeof(number), "%.9g", s->v.f);
+        out += number;
+      }
+      break;
+    case JsonSlot::STRING: writeString(out, s->v.s); break;
+    case JsonSlot::ARRAY:
+    case JsonSlot::OBJECT: {
+      bool isObject = s->type == JsonSlot::OBJECT;
+      out += isObject ? '{' : '[';
+      for (int32_t i = s->v.c.head; i != JSON_NONE; i = doc.slot(i)->next) {
+        if (i != s->v.c.head) out += ',';
+        if (isObject) {
+          writeString(out, doc.slot(i)->key);
+          out += ':';
+        }
+        writeValue(out, doc, i);
+      }
+      out += isObject ? '}' : ']';
+      break;
+    }
+  }
+}
+
+}  // namespace ArduinoJsonHost
+
+// Writes as much as fits and a '\0'; returns the length written
+inline size_t serializeJson(JsonDocument &doc, char *output, size_t size) {
+  std::string out;
+  ArduinoJsonHost::writeValue(out, doc, JSON_ROOT);
+  if (size == 0) return 0;
+  size_t n = out.size() < size - 1 ? out.size() : size - 1;
+  memcpy(output, out.data(), n);
+  output[n] = '\0';
+  return n;
+}
+
+inline size_t serializeJson(JsonDocument &doc, Print &output) {
+  std::string out;
+  ArduinoJsonHost::writeValue(out, doc, JSON_ROOT);
+  return output.write((const uint8_t *)out.data(), out.size());
+}
+
+inline size_t measureJson(JsonDocument &doc) {
+  std::string out;
+  ArduinoJsonHost::writeValue(out, doc, JSON_ROOT);
+  return out.size();
+}
+
+#endif
@@ -0,0 +1,37 @@
+// ArduinoOTA.h - host stand-in: OTA is set up but no update ever arrives
+
+#ifndef HOST_ESP32_ARDUINO_OTA_H
+#define HOST_ESP32_ARDUINO_OTA_H
+
+#include "Arduino.h"
+#include <functional>
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+public:
+  ArduinoOTAClass &setHostname(const char *name) { (void)name; return *this; }
+  ArduinoOTAClass &setPassword(const char *password) { (void)password; return *this; }
+  ArduinoOTAClass &onStart(std::function<void()> fn) { startFn = fn; return *this; }
+  ArduinoOTAClass &onEnd(std::function<void()> fn) { endFn = fn; return *this; }
+  ArduinoOTAClass &onError(std::function<void(ota_error_t)> fn) { errorFn = fn; return *this; }
+  void begin() { started = true; }
+  void handle() { handles++; }
+
+  bool started = false;
+  unsigned long handles = 0;
+
+private:
+  std::function<void()> startFn, endFn;
+  std::function<void(ota_error_t)> errorFn;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif
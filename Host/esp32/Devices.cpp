@@ -0,0 +1,806 @@
+// Devices.cpp - the I2C bus, the BME280 and SSD1306 models with their
+// Adafruit stand-ins, and the flash file system
+
+#include "Adafruit_BME280.h"
+#include "Adafruit_SSD1306.h"
+#include "ArduinoOTA.h"
+#include "Esp32Sim.h"
+#include "LittleFS.h"
+#include "SPIFFS.h"
+#include "Wire.h"
+
+// ---- Costs ----
+#define I2C_DRIVER_US            25   // i2c_master_cmd_begin() set-up and interrupt
+#define FLASH_OPEN_US            300  // path lookup in the metadata
+#define FLASH_PROGRAM_US_PER_PAGE 700 // one 256-byte page program
+#define FLASH_READ_NS_PER_BYTE   100  // 40 MHz quad SPI, with overhead
+
+// ---- I2C bus ----
+static SimI2cDevice *i2cDevices[128];
+static SimI2cStats i2cStats;
+
+void simI2cAttach(uint8_t address, SimI2cDevice *device) {
+  i2cDevices[address & 0x7F] = device;
+}
+
+SimI2cStats simI2cStats() {
+  return i2cStats;
+}
+
+TwoWire Wire;
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+  (void)sda;
+  (void)scl;
+  if (frequency) clock = frequency;
+  return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txLength = 0;
+  txPending = false;
+}
+
+size_t TwoWire::write(uint8_t c) {
+  if (txLength >= sizeof(txBuffer)) return 0;
+  txBuffer[txLength++] = c;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+  size_t n = 0;
+  while (n < quantity && write(data[n])) n++;
+  return n;
+}
+
+// One transaction: address + write bytes, then (repeated start) address +
+// read bytes. Returns false if the address was not ACKed.
+static bool i2cTransfer(uint32_t clock, uint8_t address, const uint8_t *out, size_t outLength,
+                        uint8_t *in, size_t inLength) {
+  size_t frames = (out ? 1 + outLength : 0) + (in ? 1 + inLength : 0);
+  uint64_t us = I2C_DRIVER_US + (frames * 9 + 2) * 1000000ULL / clock;
+  SimI2cDevice *device = i2cDevices[address & 0x7F];
+  bool ok = device != nullptr;
+  if (ok && out) ok = device->i2cWrite(out, outLength);
+  if (ok && in) ok = device->i2cRead(in, inLength);
+
+  i2cStats.transactions++;
+  i2cStats.perAddress[address & 0x7F]++;
+  i2cStats.bytes += (out ? outLength : 0) + (in ? inLength : 0);
+  i2cStats.bytesPerAddress[address & 0x7F] += (out ? outLength : 0) + (in ? inLength : 0);
+  i2cStats.busyUs += us;
+  simBusy(us);
+  return ok;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  if (!sendStop) {
+    txPending = true;  // sent with the next requestFrom()
+    return 0;
+  }
+  return i2cTransfer(clock, txAddress, txBuffer, txLength, nullptr, 0) ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  (void)sendStop;
+  rxIndex = rxLength = 0;
+  if (quantity > sizeof(rxBuffer)) quantity = sizeof(rxBuffer);
+  bool pending = txPending && txAddress == address;
+  txPending = false;
+  if (!i2cTransfer(clock, address, pending ? txBuffer : nullptr, pending ? txLength : 0, rxBuffer, quantity)) {
+    return 0;
+  }
+  rxLength = quantity;
+  return quantity;
+}
+
+// ---- BME280 model ----
+// Calibration of a real part (the datasheet's example values for T and P)
+static const uint16_t CAL_T1 = 27504;
+static const int16_t CAL_T2 = 26435, CAL_T3 = -1000;
+static const uint16_t CAL_P1 = 36477;
+static const int16_t CAL_P2 = -10685, CAL_P3 = 3024, CAL_P4 = 2855, CAL_P5 = 140, CAL_P6 = -7,
+                     CAL_P7 = 15500, CAL_P8 = -14600, CAL_P9 = 6000;
+static const uint8_t CAL_H1 = 75, CAL_H3 = 0;
+static const int16_t CAL_H2 = 362, CAL_H4 = 313, CAL_H5 = 50;
+static const int8_t CAL_H6 = 30;
+
+// Bosch compensation (datasheet section 8.2), to search for the raw
+// values that give the wanted weather
+static int32_t compensateT(int32_t adcT, int32_t &tFine) {
+  int32_t var1 = ((((adcT >> 3) - ((int32_t)CAL_T1 << 1))) * ((int32_t)CAL_T2)) >> 11;
+  int32_t var2 = (((((adcT >> 4) - ((int32_t)CAL_T1)) * ((adcT >> 4) - ((int32_t)CAL_T1))) >> 12) *
+                  ((int32_t)CAL_T3)) >> 14;
+  tFine = var1 + var2;
+  return (tFine * 5 + 128) >> 8;
+}
+
+static uint32_t compensateP(int32_t adcP, int32_t tFine) {
+  int64_t var1 = ((int64_t)tFine) - 128000;
+  int64_t var2 = var1 * var1 * (int64_t)CAL_P6;
+  var2 = var2 + ((var1 * (int64_t)CAL_P5) << 17);
+  var2 = var2 + (((int64_t)CAL_P4) << 35);
+  var1 = ((var1 * var1 * (int64_t)CAL_P3) >> 8) + ((var1 * (int64_t)CAL_P2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)CAL_P1) >> 33;
+  if (var1 == 0) return 0;
+  int64_t p = 1048576 - adcP;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)CAL_P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)CAL_P8) * p) >> 19;
+  return (uint32_t)(((p + var1 + var2) >> 8) + (((int64_t)CAL_P7) << 4));
+}
+
+static uint32_t compensateH(int32_t adcH, int32_t tFine) {
+  int32_t v = tFine - ((int32_t)76800);
+  v = (((((adcH << 14) - (((int32_t)CAL_H4) << 20) - (((int32_t)CAL_H5) * v)) + ((int32_t)16384)) >> 15) *
+       (((((((v * ((int32_t)CAL_H6)) >> 10) * (((v * ((int32_t)CAL_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+          ((int32_t)2097152)) * ((int32_t)CAL_H2) + 8192) >> 14));
+  v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)CAL_H1)) >> 4));
+  v = v < 0 ? 0 : v;
+  v = v > 419430400 ? 419430400 : v;
+  return (uint32_t)(v >> 12);
+}
+
+// Smallest raw value in [lo, hi] whose output reaches 'target', for an
+// output that rises (or, with 'falling', drops) with the raw value
+template <typename F>
+static int32_t searchRaw(int32_t lo, int32_t hi, int64_t target, bool falling, F output) {
+  while (lo < hi) {
+    int32_t mid = lo + (hi - lo) / 2;
+    int64_t v = output(mid);
+    bool before = falling ? v > target : v < target;
+    if (before) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+class Bme280Model : public SimI2cDevice {
+public:
+  SimBme280 weather;
+
+  Bme280Model() {
+    memset(regs, 0, sizeof(regs));
+    regs[0xD0] = 0x60;  // chip id
+    putWord(0x88, CAL_T1);
+    putWord(0x8A, CAL_T2);
+    putWord(0x8C, CAL_T3);
+    putWord(0x8E, CAL_P1);
+    putWord(0x90, CAL_P2);
+    putWord(0x92, CAL_P3);
+    putWord(0x94, CAL_P4);
+    putWord(0x96, CAL_P5);
+    putWord(0x98, CAL_P6);
+    putWord(0x9A, CAL_P7);
+    putWord(0x9C, CAL_P8);
+    putWord(0x9E, CAL_P9);
+    regs[0xA1] = CAL_H1;
+    putWord(0xE1, CAL_H2);
+    regs[0xE3] = CAL_H3;
+    regs[0xE4] = (uint8_t)(CAL_H4 >> 4);
+    regs[0xE5] = (uint8_t)((CAL_H4 & 0x0F) | ((CAL_H5 & 0x0F) << 4));
+    regs[0xE6] = (uint8_t)(CAL_H5 >> 4);
+    regs[0xE7] = (uint8_t)CAL_H6;
+    regs[0xFA] = 0x80;  // reset values of the data registers
+    regs[0xF7] = 0x80;
+    regs[0xFD] = 0x80;
+  }
+
+  bool i2cWrite(const uint8_t *data, size_t length) override {
+    if (!weather.present) return false;
+    if (length == 0) return true;
+    // Register / value pairs; a lone register only sets the read pointer
+    for (size_t i = 0; i + 1 < length; i += 2) writeRegister(data[i], data[i + 1]);
+    pointer = data[0];
+    return true;
+  }
+
+  bool i2cRead(uint8_t *data, size_t length) override {
+    if (!weather.present) return false;
+    finishConversion();
+    for (size_t i = 0; i < length; i++) {
+      uint8_t reg = pointer++;
+      data[i] = reg == 0xF3 ? status() : regs[reg];
+    }
+    return true;
+  }
+
+private:
+  uint8_t regs[256];
+  uint8_t pointer = 0;
+  uint64_t conversionEndUs = 0;
+  bool converting = false;
+
+  void putWord(uint8_t reg, uint16_t v) {
+    regs[reg] = v & 0xFF;
+    regs[reg + 1] = v >> 8;
+  }
+
+  uint8_t status() {
+    return converting && simNowUs() < conversionEndUs ? 0x08 : 0x00;
+  }
+
+  // Oversampling setting (0..5) to samples
+  static int samples(uint8_t osrs) {
+    return osrs == 0 ? 0 : 1 << (osrs > 5 ? 4 : osrs - 1);
+  }
+
+  void writeRegister(uint8_t reg, uint8_t value) {
+    if (reg == 0xE0) {
+      if (value == 0xB6) {  // soft reset
+        regs[0xF2] = regs[0xF4] = regs[0xF5] = 0;
+        converting = false;
+      }
+      return;
+    }
+    regs[reg] = value;
+    if (reg == 0xF4 && (value & 0x03) == 0x01) startConversion();
+  }
+
+  // Typical measurement time (datasheet section 9.1)
+  void startConversion() {
+    int t = samples((regs[0xF4] >> 5) & 7), p = samples((regs[0xF4] >> 2) & 7), h = samples(regs[0xF2] & 7);
+    uint64_t us = 1000 + 2000 * t + (p ? 2000 * p + 500 : 0) + (h ? 2000 * h + 500 : 0);
+    converting = true;
+    conversionEndUs = simNowUs() + us;
+    weather.conversions++;
+    if (weather.keepConversionTimes) weather.conversionStartsUs.push_back(simNowUs());
+  }
+
+  void finishConversion() {
+    if (!converting || simNowUs() < conversionEndUs) return;
+    converting = false;
+    regs[0xF4] &= ~0x03;  // back to sleep
+
+    int32_t wantT = (int32_t)lround(weather.temperature * 100.0);
+    int32_t tFine = 0;
+    int32_t adcT = searchRaw(0, (1 << 20) - 1, wantT, false, [&](int32_t raw) {
+      int32_t f;
+      return (int64_t)compensateT(raw, f);
+    });
+    compensateT(adcT, tFine);
+    int32_t adcP = searchRaw(0, (1 << 20) - 1, (int64_t)llround(weather.pressure * 256.0), true,
+                             [&](int32_t raw) { return (int64_t)compensateP(raw, tFine); });
+    int32_t adcH = searchRaw(0, 0xFFFF, (int64_t)llround(weather.humidity * 1024.0), false,
+                             [&](int32_t raw) { return (int64_t)compensateH(raw, tFine); });
+
+    regs[0xF7] = adcP >> 12;
+    regs[0xF8] = (adcP >> 4) & 0xFF;
+    regs[0xF9] = (adcP & 0x0F) << 4;
+    regs[0xFA] = adcT >> 12;
+    regs[0xFB] = (adcT >> 4) & 0xFF;
+    regs[0xFC] = (adcT & 0x0F) << 4;
+    regs[0xFD] = adcH >> 8;
+    regs[0xFE] = adcH & 0xFF;
+  }
+};
+
+// ---- SSD1306 panel model ----
+class PanelModel : public SimI2cDevice {
+public:
+  SimPanel panel;
+
+  PanelModel() {
+    memset(&panel, 0, sizeof(panel));
+  }
+
+  bool i2cWrite(const uint8_t *data, size_t length) override {
+    if (length == 0) return true;
+    // Control byte: 0x00 commands follow, 0x40 display data follows
+    bool isData = data[0] & 0x40;
+    for (size_t i = 1; i < length; i++) {
+      if (isData) dataByte(data[i]);
+      else commandByte(data[i]);
+    }
+    return true;
+  }
+
+  bool i2cRead(uint8_t *, size_t) override {
+    return true;
+  }
+
+private:
+  uint8_t command = 0;    // command waiting for its arguments
+  uint8_t argsLeft = 0;
+  uint8_t args[2];
+  uint8_t argCount = 0;
+  uint8_t colStart = 0, colEnd = 127, pageStart = 0, pageEnd = 7;
+  uint8_t col = 0, page = 0;
+
+  static uint8_t argumentsOf(uint8_t c) {
+    switch (c) {
+      case SSD1306_COLUMNADDR:
+      case SSD1306_PAGEADDR:
+        return 2;
+      case SSD1306_MEMORYMODE:
+      case SSD1306_SETCONTRAST:
+      case SSD1306_CHARGEPUMP:
+      case SSD1306_SETMULTIPLEX:
+      case SSD1306_SETDISPLAYOFFSET:
+      case SSD1306_SETDISPLAYCLOCKDIV:
+      case SSD1306_SETPRECHARGE:
+      case SSD1306_SETCOMPINS:
+      case SSD1306_SETVCOMDETECT:
+        return 1;
+      default:
+        return 0;
+    }
+  }
+
+  void commandByte(uint8_t c) {
+    panel.commandBytes++;
+    if (argsLeft) {
+      args[argCount++] = c;
+      if (--argsLeft == 0) apply();
+      return;
+    }
+    command = c;
+    argCount = 0;
+    argsLeft = argumentsOf(c);
+    if (!argsLeft) apply();
+  }
+
+  void apply() {
+    if (command == SSD1306_COLUMNADDR) {
+      colStart = col = args[0] & 0x7F;
+      colEnd = args[1] & 0x7F;
+    } else if (command == SSD1306_PAGEADDR) {
+      pageStart = page = args[0] & 0x07;
+      pageEnd = args[1] & 0x07;
+    } else if (command == SSD1306_DISPLAYON) {
+      panel.on = true;
+    } else if (command == SSD1306_DISPLAYOFF) {
+      panel.on = false;
+    }
+  }
+
+  void dataByte(uint8_t b) {
+    panel.dataBytes++;
+    panel.ram[page][col] = b;
+    if (col < colEnd) {
+      col++;
+      return;
+    }
+    col = colStart;
+    page = page < pageEnd ? page + 1 : pageStart;
+  }
+};
+
+static Bme280Model &bmeModel() {
+  static Bme280Model model;
+  return model;
+}
+
+static PanelModel &panelModel() {
+  static PanelModel model;
+  return model;
+}
+
+// Both devices are on the bus from power-up
+static struct DevicesOnBus {
+  DevicesOnBus() {
+    simI2cAttach(0x76, &bmeModel());
+    simI2cAttach(0x3C, &panelModel());
+  }
+} devicesOnBus;
+
+SimBme280 &simBme280() {
+  return bmeModel().weather;
+}
+
+const SimPanel &simPanel() {
+  return panelModel().panel;
+}
+
+// ---- Adafruit_BME280 ----
+void Adafruit_BME280::write8(uint8_t reg, uint8_t value) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  wire->write(value);
+  wire->endTransmission();
+}
+
+uint8_t Adafruit_BME280::read8(uint8_t reg) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  wire->endTransmission(false);
+  if (wire->requestFrom(address, (uint8_t)1) != 1) return 0;
+  return wire->read();
+}
+
+uint16_t Adafruit_BME280::read16(uint8_t reg) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  wire->endTransmission(false);
+  if (wire->requestFrom(address, (uint8_t)2) != 2) return 0;
+  uint16_t v = wire->read() << 8;
+  return v | wire->read();
+}
+
+uint32_t Adafruit_BME280::read24(uint8_t reg) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  wire->endTransmission(false);
+  if (wire->requestFrom(address, (uint8_t)3) != 3) return 0;
+  uint32_t v = wire->read();
+  v = (v << 8) | wire->read();
+  return (v << 8) | wire->read();
+}
+
+bool Adafruit_BME280::begin(uint8_t addr, TwoWire *twi) {
+  address = addr;
+  wire = twi;
+  sensorId = read8(0xD0);
+  if (sensorId != 0x60) return false;
+
+  write8(0xE0, 0xB6);  // soft reset
+  delay(10);
+  while (read8(0xF3) & 0x01) delay(10);  // NVM copy in progress
+
+  // The library reads the calibration one coefficient at a time
+  static const uint8_t words[] = {0x88, 0x8A, 0x8C, 0x8E, 0x90, 0x92, 0x94, 0x96, 0x98, 0x9A, 0x9C, 0x9E, 0xE1};
+  static const uint8_t bytes[] = {0xA1, 0xE3, 0xE4, 0xE5, 0xE6, 0xE5, 0xE7};
+  for (uint8_t reg : words) read16(reg);
+  for (uint8_t reg : bytes) read8(reg);
+
+  setSampling();
+  delay(100);
+  return true;
+}
+
+void Adafruit_BME280::setSampling(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                  sensor_sampling humSampling, sensor_filter filter, standby_duration duration) {
+  measReg = (tempSampling << 5) | (pressSampling << 2) | mode;
+  write8(0xF4, MODE_SLEEP);  // config is only writable in sleep mode
+  write8(0xF2, humSampling);
+  write8(0xF5, (duration << 5) | (filter << 2));
+  write8(0xF4, measReg);
+}
+
+bool Adafruit_BME280::takeForcedMeasurement() {
+  if ((measReg & 0x03) != MODE_FORCED) return false;
+  write8(0xF4, measReg);
+  unsigned long start = millis();
+  while (read8(0xF3) & 0x08) {
+    if (millis() - start > 2000) return false;
+    delay(1);
+  }
+  return true;
+}
+
+// The model's calibration is what begin() read from the chip
+float Adafruit_BME280::readTemperature() {
+  int32_t adcT = read24(0xFA);
+  if (adcT == 0x800000) return NAN;  // channel skipped
+  return compensateT(adcT >> 4, tFine) / 100.0F;
+}
+
+float Adafruit_BME280::readPressure() {
+  readTemperature();  // for tFine
+  int32_t adcP = read24(0xF7);
+  if (adcP == 0x800000) return NAN;
+  return compensateP(adcP >> 4, tFine) / 256.0F;
+}
+
+float Adafruit_BME280::readHumidity() {
+  readTemperature();  // for tFine
+  int32_t adcH = read16(0xFD);
+  if (adcH == 0x8000) return NAN;
+  return compensateH(adcH, tFine) / 1024.0F;
+}
+
+// ---- Adafruit_GFX ----
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  for (int16_t i = x; i < x + w; i++) {
+    for (int16_t j = y; j < y + h; j++) drawPixel(i, j, color);
+  }
+}
+
+// Made-up glyph columns: a fixed pattern per character
+static uint8_t glyphColumn(unsigned char c, int column) {
+  if (c == ' ') return 0;
+  uint32_t h = (c * 2654435761U) ^ ((column + 1) * 40503U);
+  h ^= h >> 13;
+  return (h & 0x7F) | 0x01;  // never blank, so every character shows
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c) {
+  for (int column = 0; column < 6; column++) {
+    uint8_t bits = column < 5 ? glyphColumn(c, column) : 0;
+    for (int row = 0; row < 8; row++) {
+      bool on = bits & (1 << row);
+      for (int sx = 0; sx < textSize; sx++) {
+        for (int sy = 0; sy < textSize; sy++) {
+          int16_t px = x + column * textSize + sx, py = y + row * textSize + sy;
+          if (on) drawPixel(px, py, textColor);
+          else if (textBgColor != textColor) drawPixel(px, py, textBgColor);
+        }
+      }
+    }
+  }
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+  if (c == '\n') {
+    cursorX = 0;
+    cursorY += textSize * 8;
+  } else if (c != '\r') {
+    if (wrap && cursorX + textSize * 6 > WIDTH) {
+      cursorX = 0;
+      cursorY += textSize * 8;
+    }
+    drawChar(cursorX, cursorY, c);
+    cursorX += textSize * 6;
+  }
+  return 1;
+}
+
+// ---- Adafruit_SSD1306 ----
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rstPin, uint32_t clkDuring,
+                                   uint32_t clkAfter)
+    : Adafruit_GFX(w, h), wire(twi), wireClk(clkDuring), restoreClk(clkAfter) {
+  (void)rstPin;
+}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() {
+  simHeapFree(buffer);
+}
+
+void Adafruit_SSD1306::command1(uint8_t c) {
+  wire->beginTransmission(address);
+  wire->write((uint8_t)0x00);
+  wire->write(c);
+  wire->endTransmission();
+}
+
+void Adafruit_SSD1306::commandList(const uint8_t *c, uint8_t n) {
+  wire->beginTransmission(address);
+  wire->write((uint8_t)0x00);
+  uint16_t bytesOut = 1;
+  while (n--) {
+    if (bytesOut >= I2C_BUFFER_LENGTH) {
+      wire->endTransmission();
+      wire->beginTransmission(address);
+      wire->write((uint8_t)0x00);
+      bytesOut = 1;
+    }
+    wire->write(*c++);
+    bytesOut++;
+  }
+  wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+  wire->setClock(wireClk);
+  command1(c);
+  wire->setClock(restoreClk);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t vcc, uint8_t addr, bool reset, bool periphBegin) {
+  (void)reset;
+  if (!buffer) {
+    buffer = (uint8_t *)simHeapAlloc(WIDTH * ((HEIGHT + 7) / 8));
+    if (!buffer) return false;
+  }
+  clearDisplay();
+  address = addr ? addr : 0x3C;
+  if (periphBegin) wire->begin();
+
+  wire->setClock(wireClk);
+  static const uint8_t init1[] = {SSD1306_DISPLAYOFF, SSD1306_SETDISPLAYCLOCKDIV, 0x80, SSD1306_SETMULTIPLEX};
+  commandList(init1, sizeof(init1));
+  command1(HEIGHT - 1);
+  static const uint8_t init2[] = {SSD1306_SETDISPLAYOFFSET, 0x00, SSD1306_SETSTARTLINE | 0x0, SSD1306_CHARGEPUMP};
+  commandList(init2, sizeof(init2));
+  command1(vcc == SSD1306_EXTERNALVCC ? 0x10 : 0x14);
+  static const uint8_t init3[] = {SSD1306_MEMORYMODE, 0x00, SSD1306_SEGREMAP | 0x1, SSD1306_COMSCANDEC};
+  commandList(init3, sizeof(init3));
+  command1(SSD1306_SETCOMPINS);
+  command1(HEIGHT == 64 ? 0x12 : 0x02);
+  command1(SSD1306_SETCONTRAST);
+  command1(vcc == SSD1306_EXTERNALVCC ? 0x9F : 0xCF);
+  command1(SSD1306_SETPRECHARGE);
+  command1(vcc == SSD1306_EXTERNALVCC ? 0x22 : 0xF1);
+  static const uint8_t init5[] = {SSD1306_SETVCOMDETECT, 0x40, SSD1306_DISPLAYALLON_RESUME,
+                                  SSD1306_NORMALDISPLAY, SSD1306_DEACTIVATE_SCROLL, SSD1306_DISPLAYON};
+  commandList(init5, sizeof(init5));
+  wire->setClock(restoreClk);
+  return true;
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+  if (buffer) memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (!buffer || x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) return;
+  uint8_t *b = &buffer[x + (y / 8) * WIDTH];
+  uint8_t bit = 1 << (y & 7);
+  if (color == SSD1306_WHITE) *b |= bit;
+  else if (color == SSD1306_BLACK) *b &= ~bit;
+  else *b ^= bit;
+}
+
+void Adafruit_SSD1306::display() {
+  wire->setClock(wireClk);
+  static const uint8_t dlist1[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0};
+  commandList(dlist1, sizeof(dlist1));
+  command1(WIDTH - 1);
+
+  uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+  const uint8_t *ptr = buffer;
+  wire->beginTransmission(address);
+  wire->write((uint8_t)0x40);
+  uint16_t bytesOut = 1;
+  while (count--) {
+    if (bytesOut >= I2C_BUFFER_LENGTH) {
+      wire->endTransmission();
+      wire->beginTransmission(address);
+      wire->write((uint8_t)0x40);
+      bytesOut = 1;
+    }
+    wire->write(*ptr++);
+    bytesOut++;
+  }
+  wire->endTransmission();
+  wire->setClock(restoreClk);
+}
+
+// ---- Flash file system ----
+static std::map<std::string, std::vector<uint8_t>> flashFiles;
+static SimFlashStats flashStats;
+
+std::map<std::string, std::vector<uint8_t>> &simFlashFiles() {
+  return flashFiles;
+}
+
+SimFlashStats simFlashStats() {
+  return flashStats;
+}
+
+namespace fs {
+
+struct SimFileHandle {
+  std::string path;
+  size_t pos;
+  bool canRead, canWrite, append;
+};
+
+static std::vector<uint8_t> *fileData(const std::shared_ptr<SimFileHandle> &h) {
+  auto it = flashFiles.find(h->path);
+  return it == flashFiles.end() ? nullptr : &it->second;
+}
+
+size_t File::write(const uint8_t *data, size_t size) {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  if (!bytes || !handle->canWrite) return 0;
+  if (handle->append) handle->pos = bytes->size();
+  if (handle->pos + size > bytes->size()) bytes->resize(handle->pos + size);
+  memcpy(bytes->data() + handle->pos, data, size);
+  size_t pages = size ? (handle->pos + size - 1) / 256 - handle->pos / 256 + 1 : 0;
+  handle->pos += size;
+  flashStats.bytesWritten += size;
+  flashStats.pagesWritten += pages;
+  flashStats.bytesWrittenTo[handle->path] += size;
+  simBusy(pages * FLASH_PROGRAM_US_PER_PAGE);
+  return size;
+}
+
+size_t File::read(uint8_t *data, size_t size) {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  if (!bytes || !handle->canRead || handle->pos >= bytes->size()) return 0;
+  size_t n = min(size, bytes->size() - handle->pos);
+  memcpy(data, bytes->data() + handle->pos, n);
+  handle->pos += n;
+  flashStats.bytesRead += n;
+  simBusy((n * FLASH_READ_NS_PER_BYTE + 999) / 1000);
+  return n;
+}
+
+int File::available() {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  return bytes && handle->pos < bytes->size() ? (int)(bytes->size() - handle->pos) : 0;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  return bytes && handle->pos < bytes->size() ? (*bytes)[handle->pos] : -1;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  if (!bytes) return false;
+  size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? handle->pos : bytes->size());
+  if (base + pos > bytes->size()) return false;
+  handle->pos = base + pos;
+  return true;
+}
+
+size_t File::position() const {
+  return handle ? handle->pos : 0;
+}
+
+size_t File::size() const {
+  std::vector<uint8_t> *bytes = handle ? fileData(handle) : nullptr;
+  return bytes ? bytes->size() : 0;
+}
+
+File FS::open(const char *path, const char *mode) {
+  flashStats.opens++;
+  simBusy(FLASH_OPEN_US);
+  bool exists = flashFiles.count(path) != 0;
+  std::shared_ptr<SimFileHandle> h = std::make_shared<SimFileHandle>();
+  h->path = path;
+  h->pos = 0;
+  h->append = false;
+  if (strcmp(mode, "r") == 0) {
+    if (!exists) return File();
+    h->canRead = true;
+    h->canWrite = false;
+  } else if (strcmp(mode, "r+") == 0) {
+    if (!exists) return File();
+    h->canRead = h->canWrite = true;
+  } else if (mode[0] == 'w') {
+    flashFiles[path].clear();
+    h->canWrite = true;
+    h->canRead = mode[1] == '+';
+  } else if (mode[0] == 'a') {
+    flashFiles[path];
+    h->canWrite = h->append = true;
+    h->canRead = mode[1] == '+';
+  } else {
+    return File();
+  }
+  return File(h);
+}
+
+bool FS::exists(const char *path) {
+  simBusy(FLASH_OPEN_US);
+  return flashFiles.count(path) != 0;
+}
+
+bool FS::remove(const char *path) {
+  flashStats.removes++;
+  simBusy(FLASH_OPEN_US);
+  return flashFiles.erase(path) != 0;
+}
+
+bool FS::rename(const char *from, const char *to) {
+  auto it = flashFiles.find(from);
+  if (it == flashFiles.end()) return false;
+  flashStats.renames++;
+  simBusy(FLASH_OPEN_US);
+  std::vector<uint8_t> bytes;
+  bytes.swap(it->second);
+  flashFiles.erase(it);
+  flashFiles[to].swap(bytes);
+  return true;
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  return true;
+}
+
+bool SPIFFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  return true;
+}
+
+}  // namespace fs
+
+fs::LittleFSFS LittleFS;
+fs::SPIFFSFS SPIFFS;
+ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,959 @@
+// Esp32.cpp - the simulation behind Host/esp32/Arduino.h and Esp32Sim.h:
+// virtual time, FreeRTOS tasks on pthreads, the heap, String and Serial
+//
+// Scheduling: each task is a pthread parked on its own semaphore. The
+// task holding the CPU runs until it blocks (delay, queue, mutex, a wait
+// inside a stand-in); it then picks the next task itself - the ready one
+// with the highest priority, first come first served among equals - and
+// posts that task's semaphore. When no task is ready the clock jumps to
+// the earliest timeout or simAt() action. Only the task holding the CPU
+// touches the simulation, so no lock is needed, and the order of events
+// never depends on the host's own scheduler. A task that blocks and turns
+// out to be next again just carries on, without a thread switch.
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Esp32Sim.h"
+#include "esp_heap_caps.h"
+#include "esp_sleep.h"
+
+#define NEVER UINT64_MAX
+#define HOST_STACK_SIZE (512 * 1024)   // the host needs more than the chip's few KB
+
+// ---- Clock and events ----
+static uint64_t nowUs = 0;
+static uint64_t bootUs = 0;         // millis() counts from here
+static uint64_t runUntil = 0;
+static bool rtcSet = false;
+static uint64_t rtcSetAtUs = 0;
+static uint32_t rtcEpochAtSet = 0;
+
+// Actions at the same time run in the order they were queued
+static std::multimap<uint64_t, std::function<void()>> actions;
+
+uint64_t simNowUs() {
+  return nowUs;
+}
+
+void simAt(uint64_t us, std::function<void()> action) {
+  actions.insert(std::make_pair(us, action));
+}
+
+// ---- Tasks ----
+struct SimTask {
+  std::string name;
+  TaskFunction_t code;
+  void *parameter;
+  std::function<void()> body;   // simRunTask() bodies
+  UBaseType_t priority;
+  pthread_t thread;
+  sem_t go;
+  enum State { READY, RUNNING, BLOCKED, FINISHED } state;
+  const void *waitKey;          // what it waits for, null = only the timeout
+  uint64_t wakeAt;
+  bool woken;                   // released by simWakeAll() rather than the timeout
+  uint64_t readyOrder;
+  unsigned long wakeups;
+  void *stackBlock;             // stack and TCB on the simulated heap
+};
+
+static std::vector<SimTask *> tasks;
+static SimTask *current = nullptr;
+static uint64_t readyCounter = 0;
+static bool inScheduler = false;
+static bool loopTaskStarted = false;
+static SimTask *stopWhenDone = nullptr;  // simRunTask(): end the run with it
+static sem_t mainGo;
+static bool mainGoReady = false;
+
+static void waitGo(sem_t *sem) {
+  while (sem_wait(sem) != 0 && errno == EINTR) {
+  }
+}
+
+static void makeReady(SimTask *t) {
+  t->state = SimTask::READY;
+  t->readyOrder = ++readyCounter;
+}
+
+static SimTask *pickReady() {
+  SimTask *best = nullptr;
+  for (SimTask *t : tasks) {
+    if (t->state != SimTask::READY) continue;
+    if (!best || t->priority > best->priority
+        || (t->priority == best->priority && t->readyOrder < best->readyOrder)) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+static uint64_t nextTime() {
+  uint64_t t = actions.empty() ? NEVER : actions.begin()->first;
+  for (SimTask *task : tasks) {
+    if (task->state == SimTask::BLOCKED && task->wakeAt < t) t = task->wakeAt;
+  }
+  return t;
+}
+
+// Give up the CPU: run whatever is next, moving the clock as needed.
+// 'self' is the calling task (already marked READY, BLOCKED or FINISHED),
+// or null for the main thread. Returns once 'self' is scheduled again.
+static void schedule(SimTask *self) {
+  inScheduler = true;
+  for (;;) {
+    SimTask *next = pickReady();
+    if (next) {
+      next->state = SimTask::RUNNING;
+      next->wakeups++;
+      current = next;
+      inScheduler = false;
+      if (next == self) return;
+      sem_post(&next->go);
+      break;
+    }
+
+    uint64_t t = nextTime();
+    if (t > runUntil) {
+      // The run is over: hand control back to the test
+      if (runUntil > nowUs) nowUs = runUntil;
+      current = nullptr;
+      inScheduler = false;
+      sem_post(&mainGo);
+      break;
+    }
+    if (t > nowUs) nowUs = t;
+    while (!actions.empty() && actions.begin()->first <= nowUs) {
+      std::function<void()> action = actions.begin()->second;
+      actions.erase(actions.begin());
+      action();
+    }
+    for (SimTask *task : tasks) {
+      if (task->state == SimTask::BLOCKED && task->wakeAt <= nowUs) {
+        task->woken = false;
+        makeReady(task);
+      }
+    }
+  }
+  if (self && self->state != SimTask::FINISHED) waitGo(&self->go);
+}
+
+static SimTask *runningTask(const char *what) {
+  if (!current) {
+    fprintf(stderr, "%s called outside a task: run the code with simRun() or simRunTask()\n", what);
+    abort();
+  }
+  return current;
+}
+
+// Block the running task on 'key' until woken or 'until'
+static bool blockTask(const void *key, uint64_t until) {
+  SimTask *self = runningTask("a blocking call");
+  self->state = SimTask::BLOCKED;
+  self->waitKey = key;
+  self->wakeAt = until;
+  self->woken = false;
+  schedule(self);
+  self->waitKey = nullptr;
+  return self->woken;
+}
+
+static uint64_t ticksToUs(TickType_t ticks) {
+  return ticks == portMAX_DELAY ? NEVER : (uint64_t)ticks * (1000000 / configTICK_RATE_HZ);
+}
+
+static uint64_t deadline(TickType_t ticks) {
+  uint64_t us = ticksToUs(ticks);
+  return us == NEVER ? NEVER : nowUs + us;
+}
+
+bool simWaitFor(const void *key, uint64_t until) {
+  return blockTask(key, until);
+}
+
+void simWakeAll(const void *key) {
+  bool preempt = false;
+  for (SimTask *t : tasks) {
+    if (t->state == SimTask::BLOCKED && t->waitKey == key) {
+      t->woken = true;
+      makeReady(t);
+      if (current && t->priority > current->priority) preempt = true;
+    }
+  }
+  // A higher-priority task that becomes ready takes the CPU at once
+  if (preempt && !inScheduler && current) {
+    SimTask *self = current;
+    makeReady(self);
+    schedule(self);
+  }
+}
+
+void simBusy(uint64_t us) {
+  blockTask(nullptr, nowUs + us);
+}
+
+static void finishTask(SimTask *t) {
+  t->state = SimTask::FINISHED;
+  if (t->stackBlock) {
+    simHeapFree(t->stackBlock);
+    t->stackBlock = nullptr;
+  }
+  if (stopWhenDone == t) runUntil = nowUs;
+}
+
+static void *taskMain(void *arg) {
+  SimTask *t = (SimTask *)arg;
+  waitGo(&t->go);
+  if (t->body) t->body();
+  else t->code(t->parameter);
+  // A FreeRTOS task must not return; treat it as deleting itself
+  finishTask(t);
+  schedule(t);
+  return nullptr;
+}
+
+static SimTask *createTask(const char *name, UBaseType_t priority, uint32_t stackDepth) {
+  if (!mainGoReady) {
+    sem_init(&mainGo, 0, 0);
+    mainGoReady = true;
+  }
+  SimTask *t = new SimTask();
+  t->name = name ? name : "";
+  t->code = nullptr;
+  t->parameter = nullptr;
+  t->priority = priority;
+  t->waitKey = nullptr;
+  t->wakeAt = NEVER;
+  t->woken = false;
+  t->wakeups = 0;
+  // ESP-IDF takes the stack (in bytes) and a ~350-byte TCB from the heap
+  t->stackBlock = simHeapAlloc(stackDepth + 352);
+  sem_init(&t->go, 0, 0);
+  makeReady(t);
+  tasks.push_back(t);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, HOST_STACK_SIZE);
+  pthread_create(&t->thread, &attr, taskMain, t);
+  pthread_attr_destroy(&attr);
+  return t;
+}
+
+// A new task with a higher priority than the creator runs at once
+static void startTask(SimTask *t) {
+  if (current && !inScheduler && t->priority > current->priority) {
+    SimTask *self = current;
+    makeReady(self);
+    schedule(self);
+  }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *created,
+                                   BaseType_t core) {
+  (void)core;
+  SimTask *t = createTask(name, priority, stackDepth);
+  t->code = code;
+  t->parameter = parameter;
+  if (created) *created = t;
+  startTask(t);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *created) {
+  return xTaskCreatePinnedToCore(code, name, stackDepth, parameter, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  SimTask *t = task ? task : runningTask("vTaskDelete(NULL)");
+  finishTask(t);
+  if (t == current) {
+    schedule(t);
+    pthread_exit(nullptr);
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  blockTask(nullptr, nowUs + ticksToUs(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)((nowUs - bootUs) / (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment) {
+  *previousWake += increment;
+  uint64_t wakeAt = bootUs + ticksToUs(*previousWake);
+  if (wakeAt > nowUs) blockTask(nullptr, wakeAt);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current;
+}
+
+void taskYIELD() {
+  SimTask *self = runningTask("taskYIELD()");
+  makeReady(self);
+  schedule(self);
+}
+
+static void loopTask(void *) {
+  setup();
+  for (;;) loop();
+}
+
+void simRun(uint64_t until) {
+  if (!loopTaskStarted) {
+    loopTaskStarted = true;
+    // As in the ESP32 core: 8 KB stack, priority 1, core 1
+    xTaskCreatePinnedToCore(loopTask, "loopTask", 8192, nullptr, 1, nullptr, 1);
+  }
+  if (!mainGoReady) {
+    sem_init(&mainGo, 0, 0);
+    mainGoReady = true;
+  }
+  runUntil = until;
+  schedule(nullptr);
+  waitGo(&mainGo);
+}
+
+void simRunTask(std::function<void()> body, uint64_t until) {
+  SimTask *t = createTask("test", 1, 8192);
+  t->body = body;
+  stopWhenDone = t;
+  runUntil = until;
+  schedule(nullptr);
+  waitGo(&mainGo);
+  stopWhenDone = nullptr;
+}
+
+std::vector<SimTaskStats> simTasks() {
+  std::vector<SimTaskStats> stats;
+  for (SimTask *t : tasks) stats.push_back(SimTaskStats{t->name, t->wakeups, t->state == SimTask::FINISHED});
+  return stats;
+}
+
+const char *simCurrentTaskName() {
+  return current ? current->name.c_str() : "";
+}
+
+// ---- Queues and semaphores ----
+// Items are copied in and out as FreeRTOS does; the storage is charged to
+// the simulated heap at creation, like xQueueCreate() mallocs it.
+struct SimQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  void *block;
+  char dataKey, spaceKey;       // addresses to wait on
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  SimQueue *q = new SimQueue();
+  q->length = length;
+  q->itemSize = itemSize;
+  q->block = simHeapAlloc(80 + length * itemSize);  // Queue_t + storage
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+  simHeapFree(q->block);
+  delete q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+  uint64_t until = deadline(wait);
+  while (q->items.size() >= q->length) {
+    if (until <= nowUs || !blockTask(&q->spaceKey, until)) {
+      if (q->items.size() >= q->length) return errQUEUE_FULL;
+    }
+  }
+  const uint8_t *bytes = (const uint8_t *)item;
+  q->items.push_back(std::vector<uint8_t>(bytes, bytes + q->itemSize));
+  simWakeAll(&q->dataKey);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t wait) {
+  return xQueueSend(q, item, wait);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *buffer, TickType_t wait) {
+  uint64_t until = deadline(wait);
+  while (q->items.empty()) {
+    if (until <= nowUs || !blockTask(&q->dataKey, until)) {
+      if (q->items.empty()) return pdFALSE;
+    }
+  }
+  if (q->itemSize) memcpy(buffer, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  simWakeAll(&q->spaceKey);
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  return q->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t s = xQueueCreate(1, 0);
+  xQueueSend(s, nullptr, 0);  // a mutex starts available
+  return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+  return xQueueReceive(s, nullptr, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  return xQueueSend(s, nullptr, 0);
+}
+
+// ---- Time ----
+unsigned long millis() {
+  return (unsigned long)((nowUs - bootUs) / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(nowUs - bootUs);
+}
+
+void delay(uint32_t ms) {
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  simBusy(us);
+}
+
+void yield() {
+  if (current) taskYIELD();
+}
+
+time_t simTime(time_t *out) {
+  time_t t = rtcSet ? (time_t)(rtcEpochAtSet + (nowUs - rtcSetAtUs) / 1000000)
+                    : (time_t)(nowUs / 1000000);  // the RTC counts from power-up
+  if (out) *out = t;
+  return t;
+}
+
+void simRtcSetEpoch(uint32_t epoch) {
+  rtcSet = true;
+  rtcSetAtUs = nowUs;
+  rtcEpochAtSet = epoch;
+}
+
+SimClockState simClockSave() {
+  return SimClockState{nowUs, bootUs, rtcSet, rtcSetAtUs, rtcEpochAtSet};
+}
+
+void simClockRestore(const SimClockState &state) {
+  nowUs = state.nowUs;
+  bootUs = state.bootUs;
+  rtcSet = state.rtcSet;
+  rtcSetAtUs = state.rtcSetAtUs;
+  rtcEpochAtSet = state.rtcEpochAtSet;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// ---- Heap ----
+// First fit over one arena, blocks split on allocation and merged with
+// free neighbours on release. 200 KB is about what an ESP32-WROOM-32 has
+// left once WiFi, lwIP and the core have taken theirs. Each block carries
+// an 8-byte header and sizes round up to 4 bytes, as in ESP-IDF's heap.
+#define HEAP_SIZE   (200 * 1024)
+#define HEAP_HEADER 8
+#define HEAP_MIN_SPLIT 16
+
+struct HeapBlock {
+  uint32_t size;      // whole block, header included
+  uint32_t prevSize;  // of the block before, 0 for the first
+  // followed by the data; 'used' is kept in the low bit of prevSize
+};
+
+alignas(8) static uint8_t heapArena[HEAP_SIZE];
+static bool heapReady = false;
+static size_t heapFree = 0, heapMinFree = 0;
+static unsigned long heapAllocations = 0, heapFrees = 0, heapFailures = 0;
+
+static HeapBlock *blockAt(size_t offset) {
+  return (HeapBlock *)(heapArena + offset);
+}
+
+static bool blockUsed(const HeapBlock *b) {
+  return b->prevSize & 1;
+}
+
+static uint32_t blockPrevSize(const HeapBlock *b) {
+  return b->prevSize & ~1U;
+}
+
+static void setBlock(size_t offset, uint32_t size, uint32_t prevSize, bool used) {
+  HeapBlock *b = blockAt(offset);
+  b->size = size;
+  b->prevSize = prevSize | (used ? 1 : 0);
+  if (offset + size < HEAP_SIZE) {
+    HeapBlock *next = blockAt(offset + size);
+    next->prevSize = size | (next->prevSize & 1);
+  }
+}
+
+static void heapInit() {
+  if (heapReady) return;
+  heapReady = true;
+  setBlock(0, HEAP_SIZE, 0, false);
+  heapFree = heapMinFree = HEAP_SIZE - HEAP_HEADER;
+}
+
+void *simHeapAlloc(size_t size) {
+  heapInit();
+  if (size == 0) size = 1;
+  uint32_t need = HEAP_HEADER + ((size + 3) & ~(size_t)3);
+  for (size_t offset = 0; offset < HEAP_SIZE; offset += blockAt(offset)->size) {
+    HeapBlock *b = blockAt(offset);
+    if (blockUsed(b) || b->size < need) continue;
+    uint32_t prev = blockPrevSize(b);
+    if (b->size - need >= HEAP_MIN_SPLIT) {
+      uint32_t rest = b->size - need;
+      setBlock(offset, need, prev, true);
+      setBlock(offset + need, rest, need, false);
+    } else {
+      setBlock(offset, b->size, prev, true);
+    }
+    heapFree -= blockAt(offset)->size;
+    if (heapFree < heapMinFree) heapMinFree = heapFree;
+    heapAllocations++;
+    return heapArena + offset + HEAP_HEADER;
+  }
+  heapFailures++;
+  return nullptr;
+}
+
+void simHeapFree(void *block) {
+  if (!block) return;
+  size_t offset = (uint8_t *)block - heapArena - HEAP_HEADER;
+  HeapBlock *b = blockAt(offset);
+  heapFree += b->size;
+  heapFrees++;
+  uint32_t size = b->size;
+  uint32_t prev = blockPrevSize(b);
+  // Merge with the next block, then the previous one, if free
+  if (offset + size < HEAP_SIZE && !blockUsed(blockAt(offset + size))) {
+    size += blockAt(offset + size)->size;
+  }
+  if (offset > 0 && !blockUsed(blockAt(offset - prev))) {
+    offset -= prev;
+    size += blockAt(offset)->size;
+    prev = blockPrevSize(blockAt(offset));
+  }
+  setBlock(offset, size, prev, false);
+}
+
+void *simHeapRealloc(void *block, size_t size) {
+  if (!block) return simHeapAlloc(size);
+  size_t offset = (uint8_t *)block - heapArena - HEAP_HEADER;
+  size_t have = blockAt(offset)->size - HEAP_HEADER;
+  if (size <= have) return block;
+  void *moved = simHeapAlloc(size);
+  if (!moved) return nullptr;
+  memcpy(moved, block, have);
+  simHeapFree(block);
+  return moved;
+}
+
+SimHeapStats simHeapStats() {
+  heapInit();
+  size_t largest = 0;
+  for (size_t offset = 0; offset < HEAP_SIZE; offset += blockAt(offset)->size) {
+    HeapBlock *b = blockAt(offset);
+    if (!blockUsed(b) && b->size - HEAP_HEADER > largest) largest = b->size - HEAP_HEADER;
+  }
+  return SimHeapStats{HEAP_SIZE, heapFree, heapMinFree, largest, heapAllocations, heapFrees, heapFailures};
+}
+
+void simHeapResetMinFree() {
+  heapInit();
+  heapMinFree = heapFree;
+}
+
+EspClass ESP;
+
+uint32_t EspClass::getFreeHeap() { return simHeapStats().free; }
+uint32_t EspClass::getMinFreeHeap() { return simHeapStats().minFree; }
+uint32_t EspClass::getHeapSize() { return HEAP_SIZE; }
+uint32_t EspClass::getMaxAllocHeap() { return simHeapStats().largestFree; }
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart() is not simulated\n");
+  abort();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  (void)caps;
+  return simHeapStats().largestFree;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  (void)caps;
+  return simHeapStats().free;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  (void)caps;
+  return simHeapStats().minFree;
+}
+
+// ---- Deep sleep and RTC memory ----
+std::function<void(uint64_t)> simOnDeepSleep;
+static unsigned long deepSleeps = 0;
+static uint64_t sleepTimerUs = 0;
+
+extern "C" {
+extern uint8_t __start_rtc_data[] __attribute__((weak));
+extern uint8_t __stop_rtc_data[] __attribute__((weak));
+}
+
+std::vector<uint8_t> simRtcSave() {
+  if (!__start_rtc_data) return std::vector<uint8_t>();
+  return std::vector<uint8_t>(__start_rtc_data, __stop_rtc_data);
+}
+
+void simRtcRestore(const std::vector<uint8_t> &image) {
+  if (__start_rtc_data && image.size() == (size_t)(__stop_rtc_data - __start_rtc_data)) {
+    memcpy(__start_rtc_data, image.data(), image.size());
+  }
+}
+
+unsigned long simDeepSleeps() {
+  return deepSleeps;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  sleepTimerUs = us;
+  return ESP_OK;
+}
+
+void simPowerSleep(uint64_t us);
+
+void esp_deep_sleep_start() {
+  deepSleeps++;
+  simPowerSleep(sleepTimerUs);
+  if (simOnDeepSleep) simOnDeepSleep(sleepTimerUs);
+  // Nothing to wake into: this task stops here
+  SimTask *self = runningTask("esp_deep_sleep_start()");
+  finishTask(self);
+  schedule(self);
+  pthread_exit(nullptr);
+}
+
+// ---- Power ----
+static SimPowerStats power = {0, 0, 0, 0, 0, 1};
+static uint64_t radioOnAt = NEVER;
+
+void simPowerRadio(bool on) {
+  if (on && radioOnAt == NEVER) radioOnAt = nowUs;
+  if (!on && radioOnAt != NEVER) {
+    power.radioUs += nowUs - radioOnAt;
+    radioOnAt = NEVER;
+  }
+}
+
+void simPowerBytes(size_t sent, size_t received) {
+  power.radioTxBytes += sent;
+  power.radioRxBytes += received;
+}
+
+void simPowerSleep(uint64_t us) {
+  simPowerRadio(false);
+  power.awakeUs += nowUs - bootUs;
+  power.sleepUs += us;
+}
+
+SimPowerStats simPowerStats() {
+  SimPowerStats stats = power;
+  if (radioOnAt != NEVER) stats.radioUs += nowUs - radioOnAt;
+  if (!deepSleeps) stats.awakeUs += nowUs - bootUs;
+  return stats;
+}
+
+void simPowerRestore(const SimPowerStats &stats) {
+  power = stats;
+  power.boots++;
+}
+
+// ---- String ----
+void String::assign(const char *s, size_t n) {
+  len = 0;
+  buffer()[0] = '\0';
+  concat(s, n);
+}
+
+String::String(const char *s) {
+  assign(s ? s : "", s ? strlen(s) : 0);
+}
+
+String::String(const char *s, size_t length) {
+  assign(s, length);
+}
+
+String::String(const String &other) {
+  assign(other.c_str(), other.len);
+}
+
+String::String(String &&other) {
+  if (other.heap) {
+    heap = other.heap;
+    cap = other.cap;
+    len = other.len;
+    other.heap = nullptr;
+    other.cap = SSO_SIZE - 1;
+    other.len = 0;
+    other.sso[0] = '\0';
+  } else {
+    assign(other.c_str(), other.len);
+  }
+}
+
+String::String(char c) {
+  assign(&c, 1);
+}
+
+static String numberString(unsigned long v, unsigned char base, bool negative) {
+  char digits[34];
+  int i = sizeof(digits) - 1;
+  digits[i] = '\0';
+  do {
+    int d = v % base;
+    digits[--i] = d < 10 ? '0' + d : 'A' + d - 10;
+    v /= base;
+  } while (v);
+  if (negative) digits[--i] = '-';
+  return String(digits + i);
+}
+
+String::String(int v, unsigned char base) : String((long)v, base) {}
+String::String(unsigned int v, unsigned char base) : String((unsigned long)v, base) {}
+
+String::String(long v, unsigned char base) {
+  bool negative = v < 0 && base == DEC;
+  String s = numberString(negative ? -(unsigned long)v : (unsigned long)v, base, negative);
+  assign(s.c_str(), s.len);
+}
+
+String::String(unsigned long v, unsigned char base) {
+  String s = numberString(v, base, false);
+  assign(s.c_str(), s.len);
+}
+
+String::String(double v, unsigned int digits) {
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", digits, v);
+  assign(text, strlen(text));
+}
+
+String::~String() {
+  simHeapFree(heap);
+}
+
+String &String::operator=(const String &other) {
+  if (this != &other) assign(other.c_str(), other.len);
+  return *this;
+}
+
+String &String::operator=(String &&other) {
+  if (this == &other) return *this;
+  if (other.heap) {
+    simHeapFree(heap);
+    heap = other.heap;
+    cap = other.cap;
+    len = other.len;
+    other.heap = nullptr;
+    other.cap = SSO_SIZE - 1;
+    other.len = 0;
+    other.sso[0] = '\0';
+  } else {
+    assign(other.c_str(), other.len);
+  }
+  return *this;
+}
+
+String &String::operator=(const char *s) {
+  assign(s ? s : "", s ? strlen(s) : 0);
+  return *this;
+}
+
+bool String::reserve(unsigned int size) {
+  if (size <= cap) return true;
+  // Grown to exactly what is asked, as the core's changeBuffer() does
+  char *grown = (char *)simHeapRealloc(heap, size + 1);
+  if (!grown) return false;
+  if (!heap) memcpy(grown, sso, len + 1);
+  heap = grown;
+  cap = size;
+  return true;
+}
+
+bool String::concat(const char *s, size_t n) {
+  if (!reserve(len + n)) return false;
+  memmove(buffer() + len, s, n);
+  len += n;
+  buffer()[len] = '\0';
+  return true;
+}
+
+bool String::startsWith(const String &prefix) const {
+  return prefix.len <= len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  if (from >= len) return -1;
+  const char *hit = strchr(c_str() + from, c);
+  return hit ? hit - c_str() : -1;
+}
+
+int String::indexOf(const char *s, unsigned int from) const {
+  if (from > len) return -1;
+  const char *hit = strstr(c_str() + from, s);
+  return hit ? hit - c_str() : -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (to > len) to = len;
+  if (from > to) from = to;
+  return String(c_str() + from, to - from);
+}
+
+void String::trim() {
+  unsigned int start = 0, end = len;
+  while (start < end && isspace((unsigned char)buffer()[start])) start++;
+  while (end > start && isspace((unsigned char)buffer()[end - 1])) end--;
+  memmove(buffer(), buffer() + start, end - start);
+  len = end - start;
+  buffer()[len] = '\0';
+}
+
+void String::toLowerCase() {
+  for (unsigned int i = 0; i < len; i++) buffer()[i] = tolower((unsigned char)buffer()[i]);
+}
+
+// ---- Print / Stream / Serial ----
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long v, int base) {
+  return print(String(v, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long v, int base) {
+  return print(String(v, (unsigned char)base));
+}
+
+size_t Print::print(double v, int digits) {
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", digits, v);
+  return write(text);
+}
+
+size_t Print::printf(const char *format, ...) {
+  // As the core: a 64-byte buffer on the stack, the heap for longer text
+  char local[64];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(local, sizeof(local), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(local)) return write((const uint8_t *)local, len);
+  char *text = (char *)simHeapAlloc(len + 1);
+  if (!text) return 0;
+  va_start(args, format);
+  vsnprintf(text, len + 1, format, args);
+  va_end(args);
+  size_t n = write((const uint8_t *)text, len);
+  simHeapFree(text);
+  return n;
+}
+
+void Stream::simWait(uint64_t untilUs) {
+  uint64_t now = simNowUs();
+  if (untilUs > now) simBusy(untilUs - now < 1000 ? untilUs - now : 1000);
+}
+
+int Stream::timedRead() {
+  uint64_t until = simNowUs() + (uint64_t)timeout * 1000;
+  for (;;) {
+    int c = read();
+    if (c >= 0 || simNowUs() >= until) return c;
+    simWait(until);
+  }
+}
+
+int Stream::timedPeek() {
+  uint64_t until = simNowUs() + (uint64_t)timeout * 1000;
+  for (;;) {
+    int c = peek();
+    if (c >= 0 || simNowUs() >= until) return c;
+    simWait(until);
+  }
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t n = 0;
+  while (n < length) {
+    int c = timedRead();
+    if (c < 0) break;
+    buffer[n++] = (char)c;
+  }
+  return n;
+}
+
+HardwareSerial Serial;
+bool simSerialEcho = false;
+bool simSerialKeep = false;
+static std::string serialLog;
+
+const std::string &simSerialLog() {
+  return serialLog;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  (void)baud;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if (simSerialEcho) fwrite(buffer, 1, size, stdout);
+  if (simSerialKeep) serialLog.append((const char *)buffer, size);
+  return size;
+}
+
+size_t IPAddress::printTo(Print &p) const {
+  return p.print(toString());
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+  return String(text);
+}
@@ -0,0 +1,126 @@
+// Esp32Sim.h - controls for the ESP32 simulation behind Host/esp32
+//
+// A test includes the sketch source, then this header, and drives the run:
+//
+//   #include <Arduino.h>
+//   #include "../../Project 2 (Weather Node).cpp"
+//   #include "Esp32Sim.h"
+//
+//   int main() {
+//     simAt(simMs(90000), [] { simBme280().temperature = 30; });
+//     simRun(simMs(600000));     // setup(), then the tasks, for 10 min
+//     return latestSample.t > 29 ? 0 : 1;
+//   }
+//
+// Time is counted in microseconds since the first power-up.
+
+#ifndef HOST_ESP32_SIM_H
+#define HOST_ESP32_SIM_H
+
+#include "Arduino.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// ---- Clock ----
+// Epoch of the first power-up: what NTP tells the device, plus the time
+// since (2026-01-01 00:00:00 UTC)
+#define SIM_EPOCH_AT_POWER_UP 1767225600UL
+
+uint64_t simNowUs();
+inline uint64_t simMs(double ms) { return (uint64_t)(ms * 1000.0); }
+inline uint64_t simSeconds(double s) { return (uint64_t)(s * 1000000.0); }
+inline double simNowMs() { return simNowUs() / 1000.0; }
+
+// Run the sketch until 'until' (absolute us): the first call starts the
+// Arduino loop task, which runs setup() and then loop(). Returns early if
+// every task is blocked for good.
+void simRun(uint64_t until);
+
+// Run 'body' as a task of its own (priority 1), for tests that call the
+// sketch's functions directly rather than through setup()/loop(). Returns
+// when the body does, or at 'until'.
+void simRunTask(std::function<void()> body, uint64_t until);
+
+// Run 'action' at an absolute time, from whichever task is running then
+// (or none). It may change the simulated world, not block.
+void simAt(uint64_t us, std::function<void()> action);
+
+// ---- Tasks ----
+struct SimTaskStats {
+  std::string name;
+  unsigned long wakeups;   // times it got the CPU
+  bool finished;
+};
+std::vector<SimTaskStats> simTasks();
+const char *simCurrentTaskName();   // "" outside any task
+
+// Block the running task for 'us' of virtual time from inside a stand-in
+// (a transfer on a bus, bytes on the network): other tasks run meanwhile
+void simBusy(uint64_t us);
+
+// Wait until simWakeAll(key) or 'until' (absolute us); true if woken
+bool simWaitFor(const void *key, uint64_t until);
+void simWakeAll(const void *key);
+
+// ---- Heap ----
+struct SimHeapStats {
+  size_t size;            // arena
+  size_t free;
+  size_t minFree;         // low-water mark since power-up or simHeapResetMinFree()
+  size_t largestFree;     // largest block malloc() could return
+  unsigned long allocations, frees, failures;
+};
+SimHeapStats simHeapStats();
+void simHeapResetMinFree();   // start a new low-water mark, to measure one call
+
+// ---- Deep sleep and reboots ----
+// esp_deep_sleep_start() calls this with the sleep time; by default the
+// calling task just stops. A test replaces it to reboot the sketch (see
+// Host/tests/weather_energy.cpp).
+extern std::function<void(uint64_t sleepUs)> simOnDeepSleep;
+unsigned long simDeepSleeps();
+
+// RTC memory: the RTC_DATA_ATTR variables, copied out and back
+std::vector<uint8_t> simRtcSave();
+void simRtcRestore(const std::vector<uint8_t> &image);
+
+// Where the clocks stand, so a rebooted process can pick them up:
+// virtual time, the time of the last boot (millis() counts from it) and
+// the RTC (epoch second at a given virtual time, if NTP ever set it)
+struct SimClockState {
+  uint64_t nowUs;
+  uint64_t bootUs;
+  bool rtcSet;
+  uint64_t rtcSetAtUs;
+  uint32_t rtcEpochAtSet;
+};
+SimClockState simClockSave();
+void simClockRestore(const SimClockState &state);
+void simRtcSetEpoch(uint32_t epoch);   // what a finished NTP exchange does
+
+// ---- Serial ----
+extern bool simSerialEcho;          // copy Serial output to stdout
+const std::string &simSerialLog();  // everything printed, if simSerialKeep
+extern bool simSerialKeep;
+
+// ---- Power ----
+// Time spent in each power state, for an energy model
+struct SimPowerStats {
+  uint64_t awakeUs;        // CPU running (not in deep sleep)
+  uint64_t radioUs;        // WiFi radio on (WiFi.begin() to WIFI_OFF)
+  uint64_t sleepUs;        // deep sleep
+  uint64_t radioTxBytes;   // bytes sent over WiFi
+  uint64_t radioRxBytes;   // bytes received over WiFi
+  unsigned long boots;
+};
+SimPowerStats simPowerStats();
+void simPowerRestore(const SimPowerStats &stats);   // counts a boot
+// Fed by the WiFi stand-in
+void simPowerRadio(bool on);
+void simPowerBytes(size_t sent, size_t received);
+
+#include "SimDevices.h"
+#include "SimNetwork.h"
+
+#endif
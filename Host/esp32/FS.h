@@ -0,0 +1,57 @@
+// FS.h - host stand-in for the ESP32 file system API (fs::FS, fs::File)
+//
+// LittleFS and SPIFFS share one in-memory flash; see SimDevices.h for
+// what a read or a write costs.
+
+#ifndef HOST_ESP32_FS_H
+#define HOST_ESP32_FS_H
+
+#include "Arduino.h"
+#include <memory>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct SimFileHandle;
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(std::shared_ptr<SimFileHandle> handle) : handle(handle) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t *data, size_t size);
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close() { handle.reset(); }
+  operator bool() const { return (bool)handle; }
+
+private:
+  std::shared_ptr<SimFileHandle> handle;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = "r");
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *from, const char *to);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
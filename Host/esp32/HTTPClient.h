@@ -0,0 +1,61 @@
+// HTTPClient.h - host stand-in for the ESP32 HTTPClient (GET only)
+//
+// Sends the same request as the core (HTTP/1.1, keep-alive when reuse is
+// on), reads the status line and headers with the 5 s TCP timeout and
+// leaves the body in the WiFiClient. end() drops whatever body is still
+// buffered and keeps the connection only if reuse is on and the server
+// did not say "Connection: close".
+
+#ifndef HOST_ESP32_HTTPCLIENT_H
+#define HOST_ESP32_HTTPCLIENT_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT 5000
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_NOT_MODIFIED = 304,
+  HTTP_CODE_NOT_FOUND = 404
+} t_http_codes;
+
+class HTTPClient {
+public:
+  ~HTTPClient();
+
+  bool begin(WiFiClient &client, const char *url);
+  void end();
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  void addHeader(const char *name, const char *value);
+  void collectHeaders(const char *headerKeys[], size_t count);
+  String header(const char *name);
+
+  int GET();
+  int getSize() { return size; }
+  WiFiClient *getStreamPtr() { return client; }
+  static String errorToString(int error);
+
+private:
+  WiFiClient *client = nullptr;
+  String host, uri, extraHeaders;
+  uint16_t port = 80;
+  bool reuse = true, canReuse = false;
+  int size = -1;
+  String *collected = nullptr;   // name, value pairs
+  void *collectedBlock = nullptr;  // what that array takes on the chip's heap
+  size_t collectedCount = 0;
+
+  bool connect();
+  int readResponseHeaders();
+  bool readLine(String &line, uint64_t untilUs);
+};
+
+#endif
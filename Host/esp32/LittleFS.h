@@ -0,0 +1,21 @@
+// LittleFS.h - host stand-in for the ESP32 LittleFS
+
+#ifndef HOST_ESP32_LITTLEFS_H
+#define HOST_ESP32_LITTLEFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = "spiffs");
+  void end() {}
+};
+
+}  // namespace fs
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,796 @@
+// Network.cpp - WiFi, TCP connections, NTP, and the HTTPClient and
+// PubSubClient stand-ins on top (see SimNetwork.h)
+
+#include <map>
+
+#include "Esp32Sim.h"
+#include "HTTPClient.h"
+#include "PubSubClient.h"
+#include "WiFi.h"
+
+// ---- Costs ----
+#define WIFI_RX_BUFFER_SIZE 1436   // WiFiClient's receive buffer (one TCP segment)
+#define TCP_PCB_SIZE        196    // lwIP's tcp_pcb and socket, per connection
+#define SNTP_RETRY_MS       15000  // lwIP SNTP retry while there is no answer
+
+static SimNetConfig netConfig;
+static SimNetStats netStats;
+
+SimNetConfig &simNetConfig() {
+  return netConfig;
+}
+
+SimNetStats simNetStats() {
+  return netStats;
+}
+
+// ---- Connections ----
+struct SimConnection : std::enable_shared_from_this<SimConnection> {
+  unsigned long id;
+  SimServer *server;
+  SimSocket socket;              // the server's end
+  std::string rx;                // arrived at the device, not read yet
+  size_t rxRead = 0;
+  bool reset = false;            // dropped by the stack (outage)
+  bool clientClosed = false;     // the device called stop()
+  bool serverClosed = false;     // the server's FIN reached the device
+  uint64_t upFreeUs = 0, downFreeUs = 0;  // when each direction's link is free
+
+  size_t buffered() const { return rx.size() - rxRead; }
+
+  // When 'length' bytes queued at 'startUs' reach the other end
+  uint64_t transfer(uint64_t &linkFreeUs, uint64_t startUs, size_t length) {
+    uint64_t start = startUs > linkFreeUs ? startUs : linkFreeUs;
+    linkFreeUs = start + length * 1000000ULL / netConfig.bytesPerSecond;
+    return linkFreeUs + netConfig.rttUs / 2;
+  }
+};
+
+static std::map<std::string, std::map<uint16_t, SimServer *>> listeners;
+static std::vector<std::weak_ptr<SimConnection>> connections;
+static std::map<std::string, uint64_t> dnsCache;  // host, expiry
+static unsigned long nextConnectionId = 1;
+
+void simNetListen(const char *host, uint16_t port, SimServer *server) {
+  listeners[host][port] = server;
+}
+
+// The server's end
+void SimSocket::send(const uint8_t *data, size_t length, uint64_t atUs) {
+  std::shared_ptr<SimConnection> c = connection->shared_from_this();
+  if (c->reset || c->serverClosed) return;
+  uint64_t now = simNowUs();
+  uint64_t arrive = c->transfer(c->downFreeUs, atUs > now ? atUs : now, length);
+  std::string bytes((const char *)data, length);
+  simAt(arrive, [c, bytes] {
+    if (c->reset || c->clientClosed) return;
+    if (c->rxRead == c->rx.size()) {
+      c->rx.clear();
+      c->rxRead = 0;
+    }
+    c->rx += bytes;
+    netStats.bytesReceived += bytes.size();
+    simPowerBytes(0, bytes.size());
+    simWakeAll(c.get());
+  });
+}
+
+void SimSocket::close(uint64_t atUs) {
+  std::shared_ptr<SimConnection> c = connection->shared_from_this();
+  uint64_t now = simNowUs();
+  uint64_t arrive = c->transfer(c->downFreeUs, atUs > now ? atUs : now, 0);
+  simAt(arrive, [c] {
+    c->serverClosed = true;
+    simWakeAll(c.get());
+  });
+}
+
+bool SimSocket::isOpen() const {
+  return !connection->reset && !connection->clientClosed && !connection->serverClosed;
+}
+
+unsigned long SimSocket::id() const {
+  return connection->id;
+}
+
+static void resetConnections() {
+  for (std::weak_ptr<SimConnection> &weak : connections) {
+    std::shared_ptr<SimConnection> c = weak.lock();
+    if (!c || c->reset || c->clientClosed) continue;
+    c->reset = true;
+    netStats.connectionsReset++;
+    if (!c->serverClosed) c->server->closed(c->socket);
+    simWakeAll(c.get());
+  }
+  connections.clear();
+}
+
+// ---- WiFi ----
+static bool radioOn = false;
+static bool associated = false;
+static bool lostAssociation = false;
+static unsigned long joinGeneration = 0;
+static int outageDepth = 0;
+
+WiFiClass WiFi;
+
+bool simNetInOutage() {
+  return outageDepth > 0;
+}
+
+// Scan, authenticate and get a lease; the join restarts if anything
+// happens to the radio meanwhile
+static void startJoin() {
+  unsigned long generation = ++joinGeneration;
+  if (outageDepth) return;  // joins when the access point is back
+  simAt(simNowUs() + netConfig.wifiJoinMs * 1000ULL, [generation] {
+    if (generation != joinGeneration || !radioOn || outageDepth) return;
+    associated = true;
+    lostAssociation = false;
+  });
+}
+
+void simNetOutage(uint64_t fromUs, uint64_t toUs) {
+  simAt(fromUs, [] {
+    if (outageDepth++) return;
+    joinGeneration++;
+    if (associated) lostAssociation = true;
+    associated = false;
+    resetConnections();
+  });
+  simAt(toUs, [] {
+    if (--outageDepth) return;
+    if (radioOn) startJoin();  // the station reconnects on its own
+  });
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase) {
+  (void)ssid;
+  (void)passphrase;
+  if (!radioOn) {
+    radioOn = true;
+    simPowerRadio(true);
+  }
+  associated = false;
+  resetConnections();
+  startJoin();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  (void)eraseAp;
+  associated = false;
+  lostAssociation = false;
+  joinGeneration++;
+  resetConnections();
+  if (wifiOff) mode(WIFI_OFF);
+  return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  bool on = m != WIFI_OFF;
+  if (on == radioOn) return true;
+  radioOn = on;
+  simPowerRadio(on);
+  if (!on) {
+    associated = false;
+    joinGeneration++;
+    resetConnections();
+  }
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (associated) return WL_CONNECTED;
+  return lostAssociation ? WL_CONNECTION_LOST : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  return associated ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+// ---- NTP ----
+static unsigned long sntpGeneration = 0;
+
+static void sntpRequest(unsigned long generation) {
+  if (generation != sntpGeneration) return;
+  if (!associated) {
+    simAt(simNowUs() + SNTP_RETRY_MS * 1000ULL, [generation] { sntpRequest(generation); });
+    return;
+  }
+  simAt(simNowUs() + netConfig.ntpMs * 1000ULL, [generation] {
+    if (generation != sntpGeneration) return;
+    if (!associated) {
+      sntpRequest(generation);
+      return;
+    }
+    simRtcSetEpoch(SIM_EPOCH_AT_POWER_UP + (uint32_t)(simNowUs() / 1000000));
+    netStats.bytesSent += 48;
+    netStats.bytesReceived += 48;
+    simPowerBytes(48, 48);
+  });
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2,
+                const char *server3) {
+  (void)gmtOffsetSec;
+  (void)daylightOffsetSec;
+  (void)server1;
+  (void)server2;
+  (void)server3;
+  sntpRequest(++sntpGeneration);
+}
+
+// ---- WiFiClient ----
+WiFiClient::WiFiClient() {}
+
+WiFiClient::~WiFiClient() {
+  stop();
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  return connect(host, port, WIFI_CLIENT_DEF_CONN_TIMEOUT_MS);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeoutMs) {
+  stop();
+  if (!associated) return 0;
+  uint64_t start = simNowUs();
+
+  auto known = dnsCache.find(host);
+  if (known == dnsCache.end() || known->second <= start) {
+    netStats.dnsLookups++;
+    simBusy(netConfig.rttUs);
+    if (!associated || !listeners.count(host)) return 0;
+    dnsCache[host] = simNowUs() + SIM_DNS_TTL_S * 1000000ULL;
+  }
+
+  // SYN, SYN-ACK; the ACK goes out with the first data
+  netStats.tcpConnects++;
+  unsigned long generation = joinGeneration;
+  simBusy(netConfig.rttUs);
+  if (!associated || generation != joinGeneration) {
+    // The SYN was lost: wait out the connect timeout
+    uint64_t until = start + (uint64_t)timeoutMs * 1000;
+    if (simNowUs() < until) simBusy(until - simNowUs());
+    return 0;
+  }
+  std::map<uint16_t, SimServer *> &ports = listeners[host];
+  if (!ports.count(port)) return 0;  // RST
+
+  std::shared_ptr<SimConnection> c = std::make_shared<SimConnection>();
+  c->id = nextConnectionId++;
+  c->server = ports[port];
+  c->socket.connection = c.get();
+  connection = c;
+  connections.push_back(c);
+  rxBuffer = simHeapAlloc(WIFI_RX_BUFFER_SIZE + TCP_PCB_SIZE);
+  c->server->accepted(c->socket);
+  return 1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (!connection || connection->reset || connection->clientClosed) return 0;
+  return !connection->serverClosed || connection->buffered() > 0;
+}
+
+void WiFiClient::stop() {
+  if (!connection) return;
+  std::shared_ptr<SimConnection> c = connection;
+  connection.reset();
+  simHeapFree(rxBuffer);
+  rxBuffer = nullptr;
+  if (c->reset || c->clientClosed) return;
+  c->clientClosed = true;
+  // FIN, after the data written before it
+  uint64_t arrive = c->transfer(c->upFreeUs, simNowUs(), 0);
+  simAt(arrive, [c] {
+    if (!c->reset) c->server->closed(c->socket);
+  });
+}
+
+int WiFiClient::available() {
+  return connection && !connection->reset ? (int)connection->buffered() : 0;
+}
+
+int WiFiClient::read() {
+  if (!available()) return -1;
+  return (uint8_t)connection->rx[connection->rxRead++];
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  size_t n = min(size, (size_t)available());
+  if (!n) return -1;
+  memcpy(buffer, connection->rx.data() + connection->rxRead, n);
+  connection->rxRead += n;
+  return (int)n;
+}
+
+int WiFiClient::peek() {
+  if (!available()) return -1;
+  return (uint8_t)connection->rx[connection->rxRead];
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  if (!connected() || connection->serverClosed) return 0;
+  std::shared_ptr<SimConnection> c = connection;
+  uint64_t arrive = c->transfer(c->upFreeUs, simNowUs(), size);
+  std::string bytes((const char *)buffer, size);
+  netStats.bytesSent += size;
+  simPowerBytes(size, 0);
+  simAt(arrive, [c, bytes] {
+    if (!c->reset) c->server->received(c->socket, (const uint8_t *)bytes.data(), bytes.size());
+  });
+  return size;
+}
+
+void WiFiClient::simWait(uint64_t untilUs) {
+  if (!connection || !connected() || available()) return;
+  simWaitFor(connection.get(), untilUs);
+}
+
+// ---- HTTPClient ----
+HTTPClient::~HTTPClient() {
+  collectHeaders(nullptr, 0);
+}
+
+bool HTTPClient::begin(WiFiClient &c, const char *url) {
+  client = &c;
+  extraHeaders = "";
+  String rest(url);
+  int scheme = rest.indexOf("://");
+  if (scheme < 0) return false;
+  rest = rest.substring(scheme + 3);
+  int slash = rest.indexOf('/');
+  String hostPort = slash < 0 ? rest : rest.substring(0, slash);
+  uri = slash < 0 ? String("/") : rest.substring(slash);
+  int colon = hostPort.indexOf(':');
+  if (colon >= 0) {
+    host = hostPort.substring(0, colon);
+    port = (uint16_t)hostPort.substring(colon + 1).toInt();
+  } else {
+    host = hostPort;
+    port = 80;
+  }
+  return true;
+}
+
+void HTTPClient::addHeader(const char *name, const char *value) {
+  extraHeaders += name;
+  extraHeaders += ": ";
+  extraHeaders += value;
+  extraHeaders += "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], size_t count) {
+  // The core keeps them in a new[]'d array of key / value Strings (16
+  // bytes each on the ESP32), replaced on every call
+  delete[] collected;
+  simHeapFree(collectedBlock);
+  collected = nullptr;
+  collectedBlock = nullptr;
+  collectedCount = count;
+  if (!count) return;
+  collectedBlock = simHeapAlloc(4 + 2 * count * 16);
+  collected = new String[2 * count];
+  for (size_t i = 0; i < count; i++) collected[2 * i] = headerKeys[i];
+}
+
+String HTTPClient::header(const char *name) {
+  for (size_t i = 0; i < collectedCount; i++) {
+    if (collected[2 * i].equalsIgnoreCase(String(name))) return collected[2 * i + 1];
+  }
+  return String();
+}
+
+bool HTTPClient::connect() {
+  if (client->connected() || client->available() > 0) {
+    while (client->available() > 0) client->read();
+    return true;
+  }
+  if (!client->connect(host.c_str(), port, HTTPCLIENT_DEFAULT_TCP_TIMEOUT)) return false;
+  client->setTimeout(HTTPCLIENT_DEFAULT_TCP_TIMEOUT);
+  return true;
+}
+
+int HTTPClient::GET() {
+  if (!client) return HTTPC_ERROR_NOT_CONNECTED;
+  if (!connect()) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+  String request = "GET ";
+  request += uri;
+  request += " HTTP/1.1\r\nHost: ";
+  request += host;
+  request += reuse ? "\r\nConnection: keep-alive" : "\r\nConnection: close";
+  request += "\r\nUser-Agent: ESP32HTTPClient\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+  request += extraHeaders;
+  request += "\r\n";
+  if (client->write((const uint8_t *)request.c_str(), request.length()) != request.length()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  return readResponseHeaders();
+}
+
+bool HTTPClient::readLine(String &line, uint64_t untilUs) {
+  line = "";
+  for (;;) {
+    int c = client->read();
+    if (c == '\n') {
+      line.trim();
+      return true;
+    }
+    if (c >= 0) {
+      line += (char)c;
+      continue;
+    }
+    if (!client->connected() || simNowUs() >= untilUs) return false;
+    client->simWait(untilUs);
+  }
+}
+
+int HTTPClient::readResponseHeaders() {
+  canReuse = reuse;
+  size = -1;
+  for (size_t i = 0; i < collectedCount; i++) collected[2 * i + 1] = "";
+
+  int code = 0;
+  String line;
+  for (;;) {
+    uint64_t until = simNowUs() + HTTPCLIENT_DEFAULT_TCP_TIMEOUT * 1000ULL;
+    if (!readLine(line, until)) {
+      canReuse = false;
+      return client->connected() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+    if (code == 0) {
+      if (!line.startsWith("HTTP/1.")) return HTTPC_ERROR_NO_HTTP_SERVER;
+      if (line[7] == '0') canReuse = false;
+      code = atoi(line.c_str() + 9);
+      continue;
+    }
+    if (line.length() == 0) break;
+
+    int colon = line.indexOf(':');
+    if (colon < 0) continue;
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    if (name.equalsIgnoreCase(String("Content-Length"))) size = value.toInt();
+    if (name.equalsIgnoreCase(String("Connection")) && value.indexOf("close") >= 0
+        && value.indexOf("keep-alive") < 0) {
+      canReuse = false;
+    }
+    for (size_t i = 0; i < collectedCount; i++) {
+      if (collected[2 * i].equalsIgnoreCase(name)) collected[2 * i + 1] = value;
+    }
+  }
+  return code;
+}
+
+void HTTPClient::end() {
+  if (!client) return;
+  if (client->connected() || client->available() > 0) {
+    while (client->available() > 0) client->read();
+    if (!(reuse && canReuse)) client->stop();
+  }
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return String("connection refused");
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return String("send header failed");
+    case HTTPC_ERROR_NOT_CONNECTED: return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST: return String("connection lost");
+    case HTTPC_ERROR_NO_HTTP_SERVER: return String("no HTTP server");
+    case HTTPC_ERROR_READ_TIMEOUT: return String("read Timeout");
+    default: return String();
+  }
+}
+
+// ---- PubSubClient ----
+#define MQTTCONNECT    (1 << 4)
+#define MQTTCONNACK    (2 << 4)
+#define MQTTPUBLISH    (3 << 4)
+#define MQTTPINGREQ    (12 << 4)
+#define MQTTPINGRESP   (13 << 4)
+#define MQTTDISCONNECT (14 << 4)
+
+PubSubClient::PubSubClient(Client &c) : client(&c) {
+  setBufferSize(MQTT_MAX_PACKET_SIZE);
+}
+
+PubSubClient::~PubSubClient() {
+  simHeapFree(buffer);
+}
+
+PubSubClient &PubSubClient::setServer(const char *d, uint16_t p) {
+  domain = d;
+  port = p;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) return false;
+  uint8_t *grown = (uint8_t *)(bufferSize == 0 ? simHeapAlloc(size) : simHeapRealloc(buffer, size));
+  if (!grown) return false;
+  buffer = grown;
+  bufferSize = size;
+  return true;
+}
+
+bool PubSubClient::readByte(uint8_t *out) {
+  uint64_t until = simNowUs() + MQTT_SOCKET_TIMEOUT * 1000000ULL;
+  while (!client->available()) {
+    if (simNowUs() >= until || !client->connected()) return false;
+    client->simWait(until);
+  }
+  *out = (uint8_t)client->read();
+  return true;
+}
+
+// Reads one packet into the buffer, returns its length (0 on a timeout)
+uint32_t PubSubClient::readPacket() {
+  uint16_t len = 0;
+  if (!readByte(&buffer[len++])) return 0;
+  uint32_t length = 0, multiplier = 1;
+  uint8_t digit;
+  do {
+    if (len == 5) return 0;
+    if (!readByte(&digit)) return 0;
+    buffer[len++] = digit;
+    length += (digit & 127) * multiplier;
+    multiplier <<= 7;
+  } while (digit & 128);
+  for (uint32_t i = 0; i < length; i++) {
+    if (!readByte(&digit)) return 0;
+    if (len < bufferSize) buffer[len++] = digit;
+  }
+  return len;
+}
+
+// The variable header and payload are at buffer + MQTT_MAX_HEADER_SIZE;
+// the fixed header goes right in front of them
+bool PubSubClient::writePacket(uint8_t header, uint16_t length) {
+  uint8_t lenBuf[4];
+  uint8_t llen = 0;
+  uint16_t len = length;
+  do {
+    uint8_t digit = len & 127;
+    len >>= 7;
+    if (len > 0) digit |= 0x80;
+    lenBuf[llen++] = digit;
+  } while (len > 0);
+  buffer[4 - llen] = header;
+  for (int i = 0; i < llen; i++) buffer[MQTT_MAX_HEADER_SIZE - llen + i] = lenBuf[i];
+  size_t total = length + 1 + llen;
+  size_t written = client->write(buffer + (MQTT_MAX_HEADER_SIZE - llen - 1), total);
+  lastOutActivity = millis();
+  return written == total;
+}
+
+uint16_t PubSubClient::writeString(const char *s, uint16_t pos) {
+  uint16_t n = strlen(s);
+  buffer[pos++] = n >> 8;
+  buffer[pos++] = n & 0xFF;
+  memcpy(buffer + pos, s, n);
+  return pos + n;
+}
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass) {
+  if (connected()) return true;
+  if (!client->connect(domain, port)) {
+    currentState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  static const uint8_t protocol[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04};
+  uint16_t pos = MQTT_MAX_HEADER_SIZE;
+  memcpy(buffer + pos, protocol, sizeof(protocol));
+  pos += sizeof(protocol);
+  uint8_t flags = 0x02;  // clean session
+  if (user) flags |= 0x80;
+  if (user && pass) flags |= 0x40;
+  buffer[pos++] = flags;
+  buffer[pos++] = MQTT_KEEPALIVE >> 8;
+  buffer[pos++] = MQTT_KEEPALIVE & 0xFF;
+  pos = writeString(id, pos);
+  if (user) pos = writeString(user, pos);
+  if (user && pass) pos = writeString(pass, pos);
+  writePacket(MQTTCONNECT, pos - MQTT_MAX_HEADER_SIZE);
+
+  lastInActivity = lastOutActivity = millis();
+  uint32_t len = readPacket();
+  if (len == 4 && buffer[0] == MQTTCONNACK) {
+    if (buffer[3] == 0) {
+      lastInActivity = millis();
+      pingOutstanding = false;
+      currentState = MQTT_CONNECTED;
+      return true;
+    }
+    currentState = buffer[3];
+  } else {
+    currentState = MQTT_CONNECTION_TIMEOUT;
+  }
+  client->stop();
+  return false;
+}
+
+void PubSubClient::disconnect() {
+  buffer[0] = MQTTDISCONNECT;
+  buffer[1] = 0;
+  client->write(buffer, 2);
+  currentState = MQTT_DISCONNECTED;
+  client->flush();
+  client->stop();
+  lastInActivity = lastOutActivity = millis();
+}
+
+bool PubSubClient::connected() {
+  if (!client->connected()) {
+    if (currentState == MQTT_CONNECTED) {
+      currentState = MQTT_CONNECTION_LOST;
+      client->flush();
+      client->stop();
+    }
+    return false;
+  }
+  return currentState == MQTT_CONNECTED;
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+  unsigned long t = millis();
+  if (t - lastInActivity > MQTT_KEEPALIVE * 1000UL || t - lastOutActivity > MQTT_KEEPALIVE * 1000UL) {
+    if (pingOutstanding) {
+      currentState = MQTT_CONNECTION_TIMEOUT;
+      client->stop();
+      return false;
+    }
+    buffer[0] = MQTTPINGREQ;
+    buffer[1] = 0;
+    client->write(buffer, 2);
+    lastOutActivity = lastInActivity = t;
+    pingOutstanding = true;
+  }
+  if (client->available()) {
+    uint32_t len = readPacket();
+    if (len > 0) {
+      lastInActivity = t;
+      uint8_t type = buffer[0] & 0xF0;
+      if (type == MQTTPINGREQ) {
+        buffer[0] = MQTTPINGRESP;
+        buffer[1] = 0;
+        client->write(buffer, 2);
+      } else if (type == MQTTPINGRESP) {
+        pingOutstanding = false;
+      }
+    } else if (!connected()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload) {
+  return publish(topic, (const uint8_t *)payload, payload ? strlen(payload) : 0);
+}
+
+bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length) {
+  if (!connected()) return false;
+  if (bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, bufferSize) + length) return false;
+  uint16_t pos = writeString(topic, MQTT_MAX_HEADER_SIZE);
+  memcpy(buffer + pos, payload, length);
+  pos += length;
+  return writePacket(MQTTPUBLISH, pos - MQTT_MAX_HEADER_SIZE);
+}
+
+// ---- Forecast API server ----
+void SimHttpServer::received(SimSocket &socket, const uint8_t *data, size_t length) {
+  socket.buffer.append((const char *)data, length);
+  for (;;) {
+    size_t end = socket.buffer.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    std::string request = socket.buffer.substr(0, end + 4);
+    socket.buffer.erase(0, end + 4);
+
+    Request seen = {simNowUs(), socket.id(), 0, request.size(), 0};
+    if (stalled) {
+      requests.push_back(seen);
+      continue;
+    }
+
+    std::string ifNoneMatch;
+    size_t at = request.find("\r\nIf-None-Match: ");
+    if (at != std::string::npos) {
+      at += 17;
+      ifNoneMatch = request.substr(at, request.find("\r\n", at) - at);
+    }
+    bool close = !keepAlive || request.find("\r\nConnection: close") != std::string::npos;
+
+    std::string response;
+    if (!etag.empty() && ifNoneMatch == etag) {
+      seen.status = 304;
+      response = "HTTP/1.1 304 Not Modified\r\n";
+    } else {
+      seen.status = 200;
+      response = "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\n";
+    }
+    if (!etag.empty()) response += "ETag: " + etag + "\r\n";
+    if (!lastModified.empty()) response += "Last-Modified: " + lastModified + "\r\n";
+    response += close ? "Connection: close\r\n" : "Connection: keep-alive\r\n";
+    if (seen.status == 200) {
+      if (chunked) {
+        response += "Transfer-Encoding: chunked\r\n\r\n";
+        for (size_t pos = 0; pos < body.size(); pos += chunkSize) {
+          size_t n = min(chunkSize, body.size() - pos);
+          char sizeLine[16];
+          snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", n);
+          response += sizeLine + body.substr(pos, n) + "\r\n";
+        }
+        response += "0\r\n\r\n";
+      } else {
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+      }
+    } else {
+      response += "\r\n";
+    }
+    seen.responseBytes = response.size();
+    requests.push_back(seen);
+
+    uint64_t sendAt = simNowUs() + responseDelayUs;
+    socket.send(response, sendAt);
+    if (close) {
+      socket.close(sendAt);
+      return;
+    }
+  }
+}
+
+// ---- MQTT broker ----
+void SimMqttBroker::received(SimSocket &socket, const uint8_t *data, size_t length) {
+  if (stalled) return;
+  socket.buffer.append((const char *)data, length);
+  for (;;) {
+    const std::string &b = socket.buffer;
+    // Fixed header: type, then the remaining length as a varint
+    size_t pos = 1;
+    uint32_t remaining = 0, multiplier = 1;
+    bool complete = false;
+    while (pos < b.size() && pos <= 4) {
+      uint8_t digit = b[pos++];
+      remaining += (digit & 127) * multiplier;
+      multiplier <<= 7;
+      if (!(digit & 128)) {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete || b.size() < pos + remaining) return;
+    uint8_t header = b[0];
+    uint8_t type = header & 0xF0;
+    std::string body = b.substr(pos, remaining);
+    socket.buffer.erase(0, pos + remaining);
+
+    if (type == MQTTCONNECT) {
+      connects++;
+      uint8_t connack[] = {MQTTCONNACK, 0x02, 0x00, connackCode};
+      socket.send(connack, sizeof(connack));
+      if (connackCode) socket.close();
+    } else if (type == MQTTPUBLISH) {
+      size_t topicLength = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+      size_t payloadAt = 2 + topicLength + ((header & 0x06) ? 2 : 0);
+      messages.push_back(Message{simNowUs(), body.substr(2, topicLength), body.substr(payloadAt)});
+    } else if (type == MQTTPINGREQ) {
+      pings++;
+      uint8_t pingresp[] = {MQTTPINGRESP, 0x00};
+      socket.send(pingresp, sizeof(pingresp));
+    } else if (type == MQTTDISCONNECT) {
+      disconnects++;
+      socket.close();
+      return;
+    }
+  }
+}
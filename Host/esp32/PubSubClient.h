@@ -0,0 +1,59 @@
+// PubSubClient.h - host stand-in for Nick O'Leary's PubSubClient (2.8)
+//
+// Sends real MQTT 3.1.1 packets through the Client: CONNECT with a 15 s
+// keep-alive, PUBLISH at QoS 0 (true once the packet is written, as the
+// library does), PINGREQ from loop() when either direction has been quiet
+// for the keep-alive, and DISCONNECT. Reads give up after the 15 s socket
+// timeout. The packet buffer lives on the simulated heap.
+
+#ifndef HOST_ESP32_PUBSUBCLIENT_H
+#define HOST_ESP32_PUBSUBCLIENT_H
+
+#include "Arduino.h"
+#include "Client.h"
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE 15
+#define MQTT_SOCKET_TIMEOUT 15
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT (-4)
+#define MQTT_CONNECTION_LOST    (-3)
+#define MQTT_CONNECT_FAILED     (-2)
+#define MQTT_DISCONNECTED       (-1)
+#define MQTT_CONNECTED          0
+
+class PubSubClient {
+public:
+  explicit PubSubClient(Client &client);
+  ~PubSubClient();
+
+  PubSubClient &setServer(const char *domain, uint16_t port);
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() const { return bufferSize; }
+
+  bool connect(const char *id, const char *user = nullptr, const char *pass = nullptr);
+  void disconnect();
+  bool connected();
+  bool loop();
+  bool publish(const char *topic, const char *payload);
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length);
+  int state() const { return currentState; }
+
+private:
+  Client *client;
+  uint8_t *buffer = nullptr;
+  uint16_t bufferSize = 0;
+  const char *domain = nullptr;
+  uint16_t port = 0;
+  unsigned long lastOutActivity = 0, lastInActivity = 0;
+  bool pingOutstanding = false;
+  int currentState = MQTT_DISCONNECTED;
+
+  bool readByte(uint8_t *out);
+  uint32_t readPacket();
+  bool writePacket(uint8_t header, uint16_t length);
+  uint16_t writeString(const char *s, uint16_t pos);
+};
+
+#endif
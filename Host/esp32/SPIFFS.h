@@ -0,0 +1,22 @@
+// SPIFFS.h - host stand-in for the ESP32 SPIFFS (the same in-memory flash
+// as LittleFS)
+
+#ifndef HOST_ESP32_SPIFFS_H
+#define HOST_ESP32_SPIFFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/spiffs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = nullptr);
+  void end() {}
+};
+
+}  // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif
@@ -0,0 +1,79 @@
+// SimDevices.h - the I2C devices and the flash behind the ESP32 stand-in
+//
+// Included by Esp32Sim.h. A BME280 (0x76) and an SSD1306 panel (0x3C) sit
+// on the bus from power-up; a test sets the weather the sensor sees and
+// reads back what reached the panel, the bus traffic and the flash wear.
+
+#ifndef HOST_ESP32_SIM_DEVICES_H
+#define HOST_ESP32_SIM_DEVICES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// ---- I2C bus ----
+// A device on the bus. A transaction is an optional write, then an
+// optional read (a repeated start in between); false means no ACK.
+class SimI2cDevice {
+public:
+  virtual ~SimI2cDevice() {}
+  virtual bool i2cWrite(const uint8_t *data, size_t length) = 0;
+  virtual bool i2cRead(uint8_t *data, size_t length) = 0;
+};
+
+void simI2cAttach(uint8_t address, SimI2cDevice *device);  // null detaches
+
+struct SimI2cStats {
+  unsigned long transactions;   // start .. stop, a write-read counts once
+  unsigned long bytes;          // data bytes either way, addresses not counted
+  uint64_t busyUs;              // time the bus was in use
+  unsigned long perAddress[128];       // transactions
+  unsigned long bytesPerAddress[128];  // data bytes
+};
+SimI2cStats simI2cStats();
+
+// ---- BME280 ----
+// Forced-mode conversions take the datasheet's typical time for the
+// oversampling set in ctrl_meas / ctrl_hum; at the end the data registers
+// get the raw ADC values that the Bosch compensation turns back into the
+// weather below (with the calibration of a real part).
+struct SimBme280 {
+  float temperature = 22.5F;  // C
+  float humidity = 55.0F;     // %
+  float pressure = 101325.0F; // Pa
+  bool present = true;        // false: the address is not ACKed
+  unsigned long conversions = 0;
+  std::vector<uint64_t> conversionStartsUs;  // when forced mode was set, if keepConversionTimes
+  bool keepConversionTimes = false;
+};
+SimBme280 &simBme280();
+
+// ---- SSD1306 ----
+// The panel's own display RAM (GDDRAM), filled by parsing the command and
+// data stream as the controller does (horizontal addressing, the
+// COLUMNADDR / PAGEADDR window)
+struct SimPanel {
+  uint8_t ram[8][128];          // [page][column]
+  unsigned long commandBytes;
+  unsigned long dataBytes;
+  bool on;
+};
+const SimPanel &simPanel();
+
+// ---- Flash (LittleFS / SPIFFS) ----
+// Files live in memory. Writes cost a page program (~0.7 ms per 256 bytes
+// touched), reads the SPI transfer; both block the calling task.
+struct SimFlashStats {
+  uint64_t bytesWritten;
+  uint64_t pagesWritten;                          // 256-byte pages programmed
+  std::map<std::string, uint64_t> bytesWrittenTo; // by the path written
+  uint64_t bytesRead;
+  unsigned long opens;
+  unsigned long renames, removes;
+};
+SimFlashStats simFlashStats();
+std::map<std::string, std::vector<uint8_t>> &simFlashFiles();
+
+#endif
@@ -0,0 +1,121 @@
+// SimNetwork.h - the WiFi network behind the ESP32 stand-in
+//
+// Included by Esp32Sim.h. Servers are objects in the test process that
+// listen on a host name and port; the device reaches them through
+// WiFiClient (and HTTPClient / PubSubClient on top). Every byte takes its
+// time: half a round trip of latency plus the transfer at the link rate,
+// one direction at a time per connection. A DNS lookup (cached for
+// SIM_DNS_TTL_S) and a TCP handshake each cost a round trip.
+//
+// An outage (simNetOutage) takes the access point away: the station loses
+// its association, the stack resets every open connection - whatever was
+// still in flight is lost - and WiFi comes back a join time after the end.
+//
+// SimHttpServer and SimMqttBroker are ready-made servers for the sketch's
+// forecast API and broker.
+
+#ifndef HOST_ESP32_SIM_NETWORK_H
+#define HOST_ESP32_SIM_NETWORK_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SIM_DNS_TTL_S 300
+
+struct SimNetConfig {
+  uint32_t rttUs = 40000;            // round trip to any server
+  uint32_t bytesPerSecond = 250000;  // per connection and direction
+  uint32_t wifiJoinMs = 2500;        // WiFi.begin() to connected (scan, auth, DHCP)
+  uint32_t ntpMs = 80;               // configTime() to the clock being set
+};
+SimNetConfig &simNetConfig();
+
+// No access point in [fromUs, toUs)
+void simNetOutage(uint64_t fromUs, uint64_t toUs);
+bool simNetInOutage();
+
+struct SimNetStats {
+  unsigned long dnsLookups;
+  unsigned long tcpConnects;        // handshakes started
+  unsigned long connectionsReset;   // by an outage
+  uint64_t bytesSent;               // device to servers
+  uint64_t bytesReceived;           // servers to device
+};
+SimNetStats simNetStats();
+
+// ---- Servers ----
+class SimSocket;
+
+class SimServer {
+public:
+  virtual ~SimServer() {}
+  virtual void accepted(SimSocket &socket) { (void)socket; }
+  virtual void received(SimSocket &socket, const uint8_t *data, size_t length) = 0;
+  virtual void closed(SimSocket &socket) { (void)socket; }
+};
+
+void simNetListen(const char *host, uint16_t port, SimServer *server);
+
+// The server's end of a connection
+class SimSocket {
+public:
+  // Queue bytes to the device, now or at 'atUs' (a server taking its time)
+  void send(const uint8_t *data, size_t length, uint64_t atUs = 0);
+  void send(const std::string &text, uint64_t atUs = 0) { send((const uint8_t *)text.data(), text.size(), atUs); }
+  void close(uint64_t atUs = 0);   // FIN, after anything queued before it
+  bool isOpen() const;
+  unsigned long id() const;
+  std::string buffer;              // for the server: bytes not parsed yet
+
+private:
+  friend class WiFiClient;
+  friend struct SimConnection;
+  struct SimConnection *connection = nullptr;
+};
+
+// ---- Forecast API ----
+// Answers every GET with 'body' (200) or, when the request's If-None-Match
+// matches 'etag', with 304 and no body
+struct SimHttpServer : SimServer {
+  std::string body;
+  std::string etag;                // "" = no ETag header
+  std::string lastModified;
+  bool chunked = false;            // Transfer-Encoding: chunked instead of Content-Length
+  size_t chunkSize = 1024;
+  bool keepAlive = true;           // false: Connection: close after each response
+  uint64_t responseDelayUs = 0;    // server think time before the response
+  bool stalled = false;            // accept requests but never answer
+
+  // Per request, as seen by the server
+  struct Request {
+    uint64_t atUs;
+    unsigned long connection;
+    int status;                    // 0 if stalled
+    size_t requestBytes, responseBytes;
+  };
+  std::vector<Request> requests;
+
+  void received(SimSocket &socket, const uint8_t *data, size_t length) override;
+};
+
+// ---- MQTT broker ----
+// MQTT 3.1.1 over the simulated TCP: CONNECT / CONNACK, PUBLISH (QoS 0),
+// PINGREQ / PINGRESP and DISCONNECT. Publications are kept in order.
+struct SimMqttBroker : SimServer {
+  struct Message {
+    uint64_t atUs;                 // when the broker had all of it
+    std::string topic;
+    std::string payload;
+  };
+  std::vector<Message> messages;
+  unsigned long connects = 0, pings = 0, disconnects = 0;
+  uint8_t connackCode = 0;         // non-zero refuses connections
+  bool stalled = false;            // read nothing and answer nothing
+
+  void received(SimSocket &socket, const uint8_t *data, size_t length) override;
+};
+
+#endif
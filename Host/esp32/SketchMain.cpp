@@ -0,0 +1,30 @@
+// SketchMain.cpp - runs the ESP32 sketch on the host
+//
+//   ./project_2_weather_node [ms] [--serial]
+//
+// Starts the Arduino loop task, which calls setup() and then loop(), and
+// runs every task for 'ms' of simulated time (10 s by default). Nothing
+// listens on the network, so the sketch sees its servers refuse it.
+// --serial prints what the sketch sends on the UART as it goes.
+
+#include "Arduino.h"
+#include "Esp32Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  double ms = 10000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--serial") == 0) simSerialEcho = true;
+    else ms = atof(argv[i]);
+  }
+
+  simRun(simMs(ms));
+
+  fflush(stdout);
+  SimHeapStats heap = simHeapStats();
+  fprintf(stderr, "\n%.0f ms simulated, %u of %u heap bytes free (largest block %u)\n",
+          simNowMs(), (unsigned)heap.free, (unsigned)heap.size, (unsigned)heap.largestFree);
+  return 0;
+}
@@ -0,0 +1,66 @@
+// WiFi.h - host stand-in for the ESP32 WiFi station and WiFiClient
+//
+// See SimNetwork.h for how the network behaves.
+
+#ifndef HOST_ESP32_WIFI_H
+#define HOST_ESP32_WIFI_H
+
+#include "Arduino.h"
+#include "Client.h"
+#include <memory>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+#define WIFI_CLIENT_DEF_CONN_TIMEOUT_MS 3000
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *passphrase = nullptr);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  bool mode(wifi_mode_t mode);
+  wl_status_t status();
+  IPAddress localIP();
+};
+
+extern WiFiClass WiFi;
+
+struct SimConnection;
+
+class WiFiClient : public Client {
+public:
+  WiFiClient();
+  ~WiFiClient();
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  int connect(const char *host, uint16_t port, int32_t timeoutMs);
+  uint8_t connected() override;
+  void stop() override;
+  operator bool() override { return connected(); }
+
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  void flush() override {}
+
+  void simWait(uint64_t untilUs) override;
+
+private:
+  std::shared_ptr<SimConnection> connection;
+  void *rxBuffer = nullptr;   // the core's receive buffer, on the simulated heap
+};
+
+#endif
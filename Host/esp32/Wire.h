@@ -0,0 +1,47 @@
+// Wire.h - host stand-in for the ESP32 TwoWire (I2C master)
+//
+// Transfers go to the device models registered with simI2cAttach() (see
+// SimDevices.h) and take their time on the bus: 9 clocks per byte (8 bits
+// and the ACK) plus the address byte, start and stop, at the set clock,
+// and a fixed cost in the driver. As on the ESP32 core,
+// endTransmission(false) only queues the write; the following
+// requestFrom() sends it together with the read in one transaction.
+
+#ifndef HOST_ESP32_WIRE_H
+#define HOST_ESP32_WIRE_H
+
+#include "Arduino.h"
+
+#define I2C_BUFFER_LENGTH 128
+
+class TwoWire : public Stream {
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  void setClock(uint32_t frequency) { clock = frequency; }
+  uint32_t getClock() const { return clock; }
+
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(bool sendStop = true);
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+  uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *data, size_t quantity) override;
+  using Print::write;
+  int available() override { return rxLength - rxIndex; }
+  int read() override { return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1; }
+  int peek() override { return rxIndex < rxLength ? rxBuffer[rxIndex] : -1; }
+
+private:
+  uint32_t clock = 100000;
+  uint8_t txAddress = 0;
+  uint8_t txBuffer[I2C_BUFFER_LENGTH];
+  size_t txLength = 0;
+  bool txPending = false;   // written with endTransmission(false)
+  uint8_t rxBuffer[I2C_BUFFER_LENGTH];
+  size_t rxIndex = 0, rxLength = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
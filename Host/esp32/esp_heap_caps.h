@@ -0,0 +1,16 @@
+// esp_heap_caps.h - host stand-in: figures of the simulated heap
+
+#ifndef HOST_ESP32_ESP_HEAP_CAPS_H
+#define HOST_ESP32_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT    (1 << 2)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+#endif
@@ -0,0 +1,17 @@
+// esp_sleep.h - host stand-in: the deep-sleep timer and entry
+//
+// esp_deep_sleep_start() ends the run of the calling task; a test can
+// catch it through simOnDeepSleep (Esp32Sim.h) to reboot the sketch.
+
+#ifndef HOST_ESP32_ESP_SLEEP_H
+#define HOST_ESP32_ESP_SLEEP_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us);
+void esp_deep_sleep_start();
+
+#endif
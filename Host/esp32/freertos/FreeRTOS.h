@@ -0,0 +1,67 @@
+// FreeRTOS.h - host stand-in for the ESP-IDF FreeRTOS API (tasks, queues,
+// semaphores)
+//
+// Every task is a pthread, but only one runs at a time: the simulation
+// hands the CPU to the highest-priority ready task and moves virtual time
+// on only when none is ready. Blocking calls are the points where a task
+// gives up the CPU, as on the chip. Not modelled: time slicing between
+// tasks of equal priority (code takes no time, so there is nothing to
+// slice), priority inheritance on mutexes, and the second core.
+
+#ifndef HOST_ESP32_FREERTOS_H
+#define HOST_ESP32_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+struct SimTask;
+struct SimQueue;
+typedef SimTask *TaskHandle_t;
+typedef SimQueue *QueueHandle_t;
+typedef SimQueue *SemaphoreHandle_t;  // a mutex is a queue of one, as in FreeRTOS
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+#define errQUEUE_FULL 0
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// ---- Tasks ----
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *created,
+                                   BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void taskYIELD();
+
+// ---- Queues ----
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+
+// ---- Semaphores ----
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif
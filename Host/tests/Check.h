@@ -0,0 +1,31 @@
+// Check.h - pass/fail reporting for the host tests
+//
+//   check(toggles <= 12, "LED toggled %lu times", toggles);
+//   return checkResult();
+//
+// Every check prints one line; the test fails if any check did.
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+static inline void check(bool ok, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  printf("%s ", ok ? "  ok  " : "  FAIL");
+  vprintf(format, args);
+  printf("\n");
+  va_end(args);
+  if (!ok) checkFailures++;
+}
+
+static inline int checkResult() {
+  printf(checkFailures ? "%d check(s) failed\n" : "all checks passed\n", checkFailures);
+  return checkFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,80 @@
+// adc_sampler.cpp - LED toggles of "1A. Turn ON Lights" on a noisy LDR
+//
+// The light level swings slowly through the threshold (100) six times a
+// minute with noise on top, so the LED should change exactly twice per
+// swing. The original sketch (one analogRead() per pass, "< 100") runs on
+// the same signal first as the baseline; then the real sketch, which
+// reads AdcSampler.h with a 90 / 110 Schmitt trigger.
+
+#include <random>
+
+#include <Arduino.h>
+#include "../../Assignments/1A. Turn ON Lights.cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS        60000
+#define SWING_MS      10000.0  // one dark-light cycle of the LDR
+#define NOISE_SD      6.0      // ADC counts
+#define IDEAL_TOGGLES (2 * (int)(RUN_MS / SWING_MS))
+
+static std::mt19937 rng(1234);
+static std::normal_distribution<double> noise(0.0, NOISE_SD);
+static uint64_t runStart = 0;
+
+static int ldrLevel() {
+  double t = (simCycles() - runStart) / (double)simMs(1);
+  return (int)lround(100.0 + 40.0 * sin(2 * M_PI * t / SWING_MS) + noise(rng));
+}
+
+// The loop() of 1A before the sampler
+static void baselineLoop() {
+  nilai = analogRead(ldr);
+  Serial.print("Nilai LDR: ");
+  Serial.println(nilai);
+
+  if (nilai < 100) {
+    digitalWrite(led, HIGH);
+  } else {
+    digitalWrite(led, LOW);
+  }
+}
+
+// Run 'body' for RUN_MS and count LED changes
+static unsigned long countToggles(void (*body)()) {
+  runStart = simCycles();
+  uint64_t end = runStart + simMs(RUN_MS);
+  int last = simPinLevel(led);
+  unsigned long toggles = 0;
+  while (simCycles() < end) {
+    body();
+    simCharge(simLoopCycles);
+    int level = simPinLevel(led);
+    if (level != last) {
+      toggles++;
+      last = level;
+    }
+  }
+  return toggles;
+}
+
+int main() {
+  simSetAnalog(ldr, ldrLevel);
+
+  pinMode(led, OUTPUT);
+  Serial.begin(9600);
+  unsigned long before = countToggles(baselineLoop);
+
+  setup();
+  simAdvance(simMs(50));  // let the first oversampled readings come in
+  unsigned long after = countToggles(loop);
+
+  printf("signal: 100 +/- 40 over %.0f s, noise sd %.0f counts, %d real crossings\n",
+         SWING_MS / 1000, NOISE_SD, IDEAL_TOGGLES);
+  printf("LED toggles in %d s: analogRead() < 100: %lu, AdcSampler 90/110: %lu\n",
+         RUN_MS / 1000, before, after);
+
+  check(after == IDEAL_TOGGLES, "sampler toggles once per crossing (%lu, want %d)", after, IDEAL_TOGGLES);
+  check(before > after, "baseline chatters more (%lu toggles)", before);
+  return checkResult();
+}
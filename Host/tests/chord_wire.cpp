@@ -0,0 +1,116 @@
+// chord_wire.cpp - bytes on the MIDI wire for chords, old and new output
+//
+// Chords of 1 to 8 notes are switched on and then off, first the old way
+// (a full 3-byte message per note, Note Off as 0x80, written byte by byte
+// as Serial.write() did) and then through Project 1's output layer
+// (running status, Note Off as Note On velocity 0, the whole chord
+// released to the transmit interrupt at once). For each chord it reports
+// the bytes sent and the time from the first message being ready to the
+// last byte leaving, at 31250 baud (320 us per byte). A dense passage
+// (random notes, each switched off before the next) gives the saving in
+// the long run.
+
+#include <random>
+
+#include <Arduino.h>
+#include "../../Project 1 (Midi Player).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define MAX_CHORD       8
+#define PASSAGE_NOTES   500
+
+// The old midiNoteOn() / midiNoteOff(): three bytes, waiting for the UART
+static void oldWrite(byte b) {
+  while (!(UCSR0A & (1 << UDRE0))) {}
+  UDR0 = b;
+}
+
+static void oldMessage(byte status, byte pitch, byte velocity) {
+  oldWrite(status);
+  oldWrite(pitch);
+  oldWrite(velocity);
+}
+
+struct Wire {
+  unsigned long bytes;
+  double lastByteUs;  // from the start of the call to the end of the last byte
+};
+
+// Bytes sent since 'start', once the line has gone quiet
+static Wire measure(uint64_t start) {
+  simAdvance(simMs(50));
+  Wire w = {0, 0};
+  for (const SimUartByte &b : simUartSent()) {
+    if (b.start < start) continue;
+    w.bytes++;
+    w.lastByteUs = (b.end - start) / (double)SIM_CYCLES_PER_US;
+  }
+  return w;
+}
+
+static Wire oldChord(int notes, bool on) {
+  uint64_t start = simCycles();
+  for (int i = 0; i < notes; i++) {
+    if (on) oldMessage(0x90, 60 + 4 * i, 100);
+    else oldMessage(0x80, 60 + 4 * i, 0);
+  }
+  return measure(start);
+}
+
+static Wire newChord(int notes, bool on) {
+  uint64_t start = simCycles();
+  for (int i = 0; i < notes; i++) {
+    if (on) midiNoteOn(0, 60 + 4 * i, 100);
+    else midiNoteOff(0, 60 + 4 * i, 0);
+  }
+  midiFlush();
+  return measure(start);
+}
+
+int main() {
+  midiBegin();  // the new layer sends its status byte once, in the first chord
+
+  printf("chord  on/off   old bytes  old last byte   new bytes  new last byte\n");
+  bool fasterEveryChord = true;
+  for (int notes = 1; notes <= MAX_CHORD; notes++) {
+    for (int on = 1; on >= 0; on--) {
+      Wire before = oldChord(notes, on);
+      Wire after = newChord(notes, on);
+      printf("%5d  %-6s   %9lu  %10.0f us   %9lu  %10.0f us\n", notes, on ? "on" : "off",
+             before.bytes, before.lastByteUs, after.bytes, after.lastByteUs);
+      if (after.lastByteUs >= before.lastByteUs && notes > 1) fasterEveryChord = false;
+    }
+  }
+
+  // Dense passage: one note after another on one channel
+  std::mt19937 rng(808);
+  std::uniform_int_distribution<int> pitch(36, 96);
+  uint64_t start = simCycles();
+  for (int i = 0; i < PASSAGE_NOTES; i++) {
+    byte p = pitch(rng);
+    oldMessage(0x90, p, 100);
+    oldMessage(0x80, p, 0);
+  }
+  Wire oldPassage = measure(start);
+
+  midiResetRunningStatus();
+  start = simCycles();
+  for (int i = 0; i < PASSAGE_NOTES; i++) {
+    byte p = pitch(rng);
+    midiNoteOn(0, p, 100);
+    midiNoteOff(0, p, 0);
+    midiFlush();
+  }
+  Wire newPassage = measure(start);
+  double saved = 1.0 - newPassage.bytes / (double)oldPassage.bytes;
+
+  printf("dense passage, %d notes: old %lu bytes, new %lu bytes (%.0f%% fewer), %.2f s vs %.2f s on the wire\n",
+         PASSAGE_NOTES, oldPassage.bytes, newPassage.bytes, saved * 100,
+         oldPassage.lastByteUs / 1e6, newPassage.lastByteUs / 1e6);
+
+  check(fasterEveryChord, "every chord of 2+ notes finishes sooner");
+  check(saved >= 0.33 - 0.005, "dense passage needs a third fewer bytes (%.1f%%)", saved * 100);
+  check(newPassage.bytes == 4UL * PASSAGE_NOTES + 1, "2 bytes per message after the first status byte");
+  return checkResult();
+}
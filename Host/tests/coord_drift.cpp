@@ -0,0 +1,91 @@
+// coord_drift.cpp - Project 3 flags a neighbour that keeps missing its slot
+//
+// One junction (node 1 of the ring) is fed the frames the rest of the
+// ring would send: SYNC from the master every second, and PHASE frames
+// from node 2, whose coordinated green is due 8 s into the common cycle.
+// Node 2's greens come
+//   - on time for a few cycles;
+//   - once late, as after a crossing, then on time again: not drifting;
+//   - late cycle after cycle, as when it has lost the clock and a
+//     crossing pushed it off: drifting after DRIFT_GREENS of them;
+//   - on time again: the flag clears on the first green in its slot.
+// Greens of node 2's other roads carry no slot and must never count.
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define NEIGHBOUR      2
+#define NEIGHBOUR_SLOT 8000UL   // its COORD_OFFSET
+#define NEIGHBOUR_HOPS 2        // 2 -> 3 -> 0 -> 1 round the ring
+#define LATE_MS        4000     // a crossing it never won back
+#define CYCLES         16
+
+static void receiveFrame(uint8_t type, uint8_t origin, uint8_t hops, const uint8_t *payload) {
+  uint8_t frame[FRAME_SIZE] = {FRAME_START, type, origin, hops,
+                               payload[0], payload[1], payload[2], payload[3], 0};
+  for (uint8_t i = 1; i < FRAME_SIZE - 1; i++) frame[FRAME_SIZE - 1] ^= frame[i];
+  for (uint8_t b : frame) simUartReceive(b);
+}
+
+// The master's clock is the simulated time
+static void sendSync(unsigned long at) {
+  simAt(simMs(at), [at] {
+    uint8_t payload[4] = {(uint8_t)at, (uint8_t)(at >> 8), (uint8_t)(at >> 16), (uint8_t)(at >> 24)};
+    receiveFrame(MSG_SYNC, 0, 0, payload);
+  });
+}
+
+// Node 2 turns 'road' green at 'startMs' on the common clock
+static void sendGreen(unsigned long startMs, uint8_t road, uint16_t offset) {
+  unsigned long at = startMs + (NEIGHBOUR_HOPS + 1) * HOP_DELAY_MS;
+  simAt(simMs(at), [road, offset] {
+    uint8_t payload[4] = {road, PH_GREEN, (uint8_t)offset, (uint8_t)(offset >> 8)};
+    receiveFrame(MSG_PHASE, NEIGHBOUR, NEIGHBOUR_HOPS, payload);
+  });
+}
+
+int main() {
+  setup();
+
+  // Late greens by cycle: one stray, then a run of them
+  long lateBy[CYCLES] = {0};
+  lateBy[4] = LATE_MS;
+  for (int c = 7; c < 7 + DRIFT_GREENS + 2; c++) lateBy[c] = LATE_MS;
+  int backOnSlot = 7 + DRIFT_GREENS + 2;
+
+  for (unsigned long t = 1000; t < CYCLES * COORD_CYCLE_MS; t += SYNC_PERIOD) sendSync(t);
+  bool flagged[CYCLES];
+  long error[CYCLES];
+  for (int c = 1; c < CYCLES; c++) {
+    unsigned long slot = c * COORD_CYCLE_MS + NEIGHBOUR_SLOT;
+    sendGreen(slot + lateBy[c], COORD_ROAD, NEIGHBOUR_SLOT);
+    // another road of node 2, half a cycle off: not coordinated
+    sendGreen(slot + COORD_CYCLE_MS / 2, 1, NO_SLOT);
+    simAt(simMs(slot + COORD_CYCLE_MS / 2 + 100), [c, &flagged, &error] {
+      flagged[c] = driftingNodes & (1 << NEIGHBOUR);
+      error[c] = nodeStatus[NEIGHBOUR].slotError;
+    });
+  }
+  simRunLoop(CYCLES * COORD_CYCLE_MS);
+
+  printf("cycle  late by   seen off by   flagged\n");
+  bool wrong = false, strayFlagged = false, clearedLate = false;
+  int flaggedAt = -1;
+  for (int c = 1; c < CYCLES; c++) {
+    printf("%5d  %7ld   %11ld   %s\n", c, lateBy[c], error[c], flagged[c] ? "yes" : "no");
+    if (labs(error[c] - lateBy[c]) > 50) wrong = true;
+    if (c < 7 && flagged[c]) strayFlagged = true;
+    if (flagged[c] && flaggedAt < 0) flaggedAt = c;
+    if (c >= backOnSlot && flagged[c]) clearedLate = true;
+  }
+
+  check(clockSynced, "follows the master clock");
+  check(!wrong, "each green seen off its slot by what it was late");
+  check(!strayFlagged, "one late green is not drifting");
+  check(flaggedAt == 7 + DRIFT_GREENS - 1, "drifting after %d late greens in a row (cycle %d)", DRIFT_GREENS,
+        flaggedAt);
+  check(!clearedLate, "the flag clears on the first green back in its slot");
+  return checkResult();
+}
@@ -0,0 +1,282 @@
+// corridor.cpp - a green wave along CORRIDOR_NODES junctions of Project 3
+//
+//   corridor <corridor_node_free> <corridor_node_0> ... <corridor_node_N-1>
+//
+// Every junction is a separate process running the sketch (see
+// corridor_node.cpp), stepped together in slices of SLICE_MS and wired
+// in a ring through pipes: what node k sends on its TX pin arrives on
+// node k+1's RX pin in the next slice, and the last node feeds node 0.
+// The junctions are powered up at random moments within one cycle, and
+// pedestrians press buttons now and then, which lengthens a junction's
+// cycle by the crossing phase.
+//
+// Vehicles enter at the first junction as a Poisson process and drive
+// along COORD_ROAD of every junction, CORRIDOR_TRAVEL_MS apart. At a
+// junction a vehicle drives on if the lamp is green and nobody is queued;
+// otherwise it stops, and the queue leaves on green one vehicle per
+// HEADWAY_MS. The same traffic and the same presses run twice: with the
+// uncoordinated sketch and with the ring (COORD_OFFSET = travel time from
+// the first junction). Reported: stops per vehicle and the time from
+// reaching the first junction to leaving the last. In the green wave no
+// junction may flag a neighbour as drifting off its slot once the ring
+// has synced.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "Check.h"
+
+#define SLICE_MS       10
+#define WARMUP_MS      120000UL            // let the ring sync before counting
+#define RUN_MS         (3600000UL)         // vehicles enter for this long after warm-up
+#define DRAIN_MS       300000UL            // then the corridor empties
+#define ENTRY_PER_MIN  3.0
+#define HEADWAY_MS     1500
+#define PED_EVERY_MS   180000.0            // mean gap between presses, per junction
+#define CYCLE_MS       32000               // the sketch's cycle (COORD_CYCLE_MS)
+
+struct Node {
+  pid_t pid;
+  int toNode, fromNode;
+  uint8_t lamp;
+  uint8_t flags;
+  std::vector<uint8_t> sent;  // TX bytes of the last slice
+};
+
+static bool spawn(Node &node, const char *path, double bootMs) {
+  int toChild[2], fromChild[2];
+  if (pipe(toChild) != 0 || pipe(fromChild) != 0) return false;
+  char boot[32], slice[32];
+  snprintf(boot, sizeof(boot), "%.0f", bootMs);
+  snprintf(slice, sizeof(slice), "%d", SLICE_MS);
+  node.pid = fork();
+  if (node.pid < 0) return false;
+  if (node.pid == 0) {
+    dup2(toChild[0], 0);
+    dup2(fromChild[1], 1);
+    close(toChild[0]); close(toChild[1]);
+    close(fromChild[0]); close(fromChild[1]);
+    execl(path, path, boot, slice, (char *)nullptr);
+    _exit(127);
+  }
+  close(toChild[0]);
+  close(fromChild[1]);
+  // Later nodes must not inherit this node's pipes, or it never sees EOF
+  fcntl(toChild[1], F_SETFD, FD_CLOEXEC);
+  fcntl(fromChild[0], F_SETFD, FD_CLOEXEC);
+  node.toNode = toChild[1];
+  node.fromNode = fromChild[0];
+  node.lamp = 0;
+  node.flags = 0;
+  return true;
+}
+
+static bool readAll(int fd, uint8_t *buffer, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, buffer, size);
+    if (n <= 0) return false;
+    buffer += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const uint8_t *buffer, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, buffer, size);
+    if (n <= 0) return false;
+    buffer += n;
+    size -= n;
+  }
+  return true;
+}
+
+// ---- Traffic ----
+struct Vehicle {
+  double enteredMs;
+  int stops;
+};
+
+struct Junction {
+  std::deque<int> queue;      // vehicles stopped at the line
+  double greenSince = -1;
+  double lastDeparture = -1e9;
+};
+
+struct Result {
+  bool ran;
+  unsigned long vehicles;
+  double stopsPerVehicle;
+  double meanTravelS;
+  bool failSafe;
+  bool synced;
+  unsigned long driftSlices;  // after warm-up, slices with a neighbour flagged
+};
+
+struct Schedule {
+  double bootMs[CORRIDOR_NODES];
+  std::vector<double> entries;                    // ms at the first junction
+  std::vector<std::pair<double, int>> presses[CORRIDOR_NODES];  // ms, road
+};
+
+static Result runCorridor(char **paths, const Schedule &plan) {
+  Result res = {false, 0, 0, 0, false, true, 0};
+  Node nodes[CORRIDOR_NODES];
+  for (int k = 0; k < CORRIDOR_NODES; k++) {
+    if (!spawn(nodes[k], paths[k], plan.bootMs[k])) return res;
+  }
+
+  std::vector<Vehicle> vehicles;
+  Junction junctions[CORRIDOR_NODES];
+  std::multimap<double, std::pair<int, int>> arriving;  // ms -> vehicle, junction
+  size_t nextEntry = 0, nextPress[CORRIDOR_NODES] = {0};
+  double totalTravel = 0, totalStops = 0;
+  bool ok = true;
+
+  const double endMs = WARMUP_MS + RUN_MS + DRAIN_MS;
+  for (double now = SLICE_MS; now <= endMs && ok; now += SLICE_MS) {
+    // One slice on every junction
+    for (int k = 0; k < CORRIDOR_NODES && ok; k++) {
+      Node &node = nodes[k];
+      const Node &before = nodes[(k + CORRIDOR_NODES - 1) % CORRIDOR_NODES];
+      uint8_t ped = 0xFF;
+      const std::vector<std::pair<double, int>> &presses = plan.presses[k];
+      if (nextPress[k] < presses.size() && presses[nextPress[k]].first < now) {
+        ped = presses[nextPress[k]++].second;
+      }
+      std::vector<uint8_t> msg = {ped, (uint8_t)before.sent.size()};
+      msg.insert(msg.end(), before.sent.begin(), before.sent.end());
+      ok = writeAll(node.toNode, msg.data(), msg.size());
+    }
+    for (int k = 0; k < CORRIDOR_NODES && ok; k++) {
+      Node &node = nodes[k];
+      uint8_t head[3];
+      ok = readAll(node.fromNode, head, 3);
+      if (!ok) break;
+      node.lamp = head[0];
+      node.flags = head[1];
+      node.sent.resize(head[2]);
+      ok = head[2] == 0 || readAll(node.fromNode, node.sent.data(), head[2]);
+      if (node.flags & 1) res.failSafe = true;
+      if ((node.flags & 4) && now > WARMUP_MS) res.driftSlices++;
+    }
+
+    // Vehicles entering the corridor
+    while (nextEntry < plan.entries.size() && plan.entries[nextEntry] < now) {
+      vehicles.push_back({plan.entries[nextEntry], 0});
+      arriving.insert({plan.entries[nextEntry], {(int)vehicles.size() - 1, 0}});
+      nextEntry++;
+    }
+
+    // Departures from each junction go on to the next one
+    std::vector<std::pair<int, int>> departed;  // vehicle, junction
+    while (!arriving.empty() && arriving.begin()->first < now) {
+      int v = arriving.begin()->second.first, j = arriving.begin()->second.second;
+      arriving.erase(arriving.begin());
+      Junction &jn = junctions[j];
+      if (nodes[j].lamp == 'G' && jn.queue.empty()) {
+        jn.lastDeparture = now;
+        departed.push_back({v, j});
+      } else {
+        vehicles[v].stops++;
+        jn.queue.push_back(v);
+      }
+    }
+    for (int j = 0; j < CORRIDOR_NODES; j++) {
+      Junction &jn = junctions[j];
+      if (nodes[j].lamp != 'G') {
+        jn.greenSince = -1;
+        continue;
+      }
+      if (jn.greenSince < 0) jn.greenSince = now;
+      double ready = std::max(jn.greenSince, jn.lastDeparture) + HEADWAY_MS;
+      if (!jn.queue.empty() && now >= ready) {
+        departed.push_back({jn.queue.front(), j});
+        jn.queue.pop_front();
+        jn.lastDeparture = now;
+      }
+    }
+    for (const std::pair<int, int> &d : departed) {
+      int v = d.first, j = d.second;
+      if (j + 1 < CORRIDOR_NODES) {
+        arriving.insert({now + CORRIDOR_TRAVEL_MS, {v, j + 1}});
+        continue;
+      }
+      if (vehicles[v].enteredMs < WARMUP_MS) continue;
+      res.vehicles++;
+      totalStops += vehicles[v].stops;
+      totalTravel += now - vehicles[v].enteredMs;
+    }
+  }
+
+  for (int k = 0; k < CORRIDOR_NODES; k++) {
+    if (!(nodes[k].flags & 2)) res.synced = false;
+    close(nodes[k].toNode);
+    close(nodes[k].fromNode);
+    int status;
+    waitpid(nodes[k].pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+  }
+  res.ran = ok && res.vehicles > 0;
+  if (res.vehicles > 0) {
+    res.stopsPerVehicle = totalStops / res.vehicles;
+    res.meanTravelS = totalTravel / res.vehicles / 1000;
+  }
+  return res;
+}
+
+static void print(const char *name, const Result &res) {
+  printf("%-13s %lu vehicles: %.2f stops per vehicle, %.1f s through the corridor (%.1f s of it driving)\n",
+         name, res.vehicles, res.stopsPerVehicle, res.meanTravelS,
+         (CORRIDOR_NODES - 1) * CORRIDOR_TRAVEL_MS / 1000.0);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 + CORRIDOR_NODES) {
+    fprintf(stderr, "usage: %s <corridor_node_free> <corridor_node_0> ... <corridor_node_%d>\n",
+            argv[0], CORRIDOR_NODES - 1);
+    return 2;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  Schedule plan;
+  std::mt19937 rng(1919);
+  std::uniform_real_distribution<double> boot(0, CYCLE_MS);
+  std::exponential_distribution<double> entryGap(ENTRY_PER_MIN / 60000.0), pressGap(1 / PED_EVERY_MS);
+  std::uniform_int_distribution<int> road(0, 3);
+  for (int k = 0; k < CORRIDOR_NODES; k++) {
+    plan.bootMs[k] = boot(rng);
+    for (double t = WARMUP_MS / 2 + pressGap(rng); t < WARMUP_MS + RUN_MS; t += pressGap(rng)) {
+      plan.presses[k].push_back({t, road(rng)});
+    }
+  }
+  for (double t = entryGap(rng); t < WARMUP_MS + RUN_MS; t += entryGap(rng)) plan.entries.push_back(t);
+
+  printf("%d junctions %d s apart, %.0f vehicles per minute, a pedestrian every %.0f s per junction, %.0f min\n",
+         CORRIDOR_NODES, CORRIDOR_TRAVEL_MS / 1000, ENTRY_PER_MIN, PED_EVERY_MS / 1000, RUN_MS / 60000.0);
+
+  char *freeNodes[CORRIDOR_NODES];
+  for (int k = 0; k < CORRIDOR_NODES; k++) freeNodes[k] = argv[1];
+  Result alone = runCorridor(freeNodes, plan);
+  Result ring = runCorridor(argv + 2, plan);
+  print("uncoordinated", alone);
+  print("green wave", ring);
+
+  check(alone.ran && ring.ran, "every junction ran to the end");
+  check(ring.synced, "every junction follows the master clock");
+  check(ring.driftSlices == 0, "no junction flags a neighbour as drifting (%lu slices)", ring.driftSlices);
+  check(!alone.failSafe && !ring.failSafe, "no junction latched the fail-safe");
+  check(ring.stopsPerVehicle < alone.stopsPerVehicle / 2, "the green wave halves the stops (%.2f vs %.2f)",
+        ring.stopsPerVehicle, alone.stopsPerVehicle);
+  check(ring.meanTravelS < alone.meanTravelS, "and shortens the trip (%.1f s vs %.1f s)",
+        ring.meanTravelS, alone.meanTravelS);
+  return checkResult();
+}
@@ -0,0 +1,102 @@
+// corridor_node.cpp - one Project 3 junction of the corridor test
+//
+//   corridor_node <boot ms> <slice ms>
+//
+// Run by the corridor test, one process per junction, with stdin/stdout
+// as pipes. The controller is powered up at <boot ms>. After that the
+// test steps every junction by the same slice of simulated time. Each
+// step is a binary message, one byte per field:
+//   in:  pedestrian road to press (0xFF = none), n, n bytes for the RX pin
+//   out: COORD_ROAD's lamp ('G', 'Y', 'R', or 0 while dark), flags
+//        (bit 0 fail-safe latched, bit 1 clock synced, bit 2 a drifting
+//        neighbour flagged), n, n bytes sent
+// The test passes each junction's bytes on to the next, closing the ring.
+// Built once per node with COORD_ENABLED, NODE_ID and COORD_OFFSET set,
+// and once without coordination.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+
+#define PRESS_MS  200  // how long a pedestrian holds the button
+
+static bool readAll(uint8_t *buffer, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(0, buffer, size);
+    if (n <= 0) return false;
+    buffer += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool writeAll(const uint8_t *buffer, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(1, buffer, size);
+    if (n <= 0) return false;
+    buffer += n;
+    size -= n;
+  }
+  return true;
+}
+
+static uint8_t corridorLamp() {
+  if (simPinLevel(greenPins[COORD_ROAD]) == HIGH) return 'G';
+  if (simPinLevel(yellowPins[COORD_ROAD]) == HIGH) return 'Y';
+  if (simPinLevel(redPins[COORD_ROAD]) == HIGH) return 'R';
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <boot ms> <slice ms>\n", argv[0]);
+    return 2;
+  }
+  double bootMs = atof(argv[1]), sliceMs = atof(argv[2]);
+
+  simLoopCycles = 16000;  // 1 ms per pass
+  bool booted = false;
+  size_t reported = 0;    // simUartSent() entries already passed on
+  unsigned long steps = 0;
+  uint8_t in[2 + 255];
+
+  while (readAll(in, 2)) {
+    uint8_t ped = in[0], n = in[1];
+    if (n > 0 && !readAll(in + 2, n)) break;
+    for (int i = 0; i < n; i++) simUartReceive(in[2 + i]);  // dropped until Serial.begin()
+
+    if (booted && ped < NUM_ROADS) {
+      uint8_t pin = pedButtons[ped];
+      simSetPin(pin, LOW);
+      simAt(simCycles() + simMs(PRESS_MS), [pin] { simSetPin(pin, HIGH); });
+    }
+
+    // Run to the end of the slice, on a grid so the junctions never drift
+    uint64_t end = simMs(++steps * sliceMs);
+    if (!booted && end > simMs(bootMs)) {
+      simAdvance(simMs(bootMs) - simCycles());
+      setup();
+      booted = true;
+    }
+    while (simCycles() < end) {
+      if (booted) {
+        loop();
+        simCharge(simLoopCycles);
+      } else {
+        simAdvance(end - simCycles());
+      }
+    }
+
+    std::vector<uint8_t> out = {corridorLamp(), (uint8_t)(failSafe | (clockSynced << 1) | ((driftingNodes != 0) << 2)), 0};
+    const std::vector<SimUartByte> &sent = simUartSent();
+    while (reported < sent.size() && out.size() < 3 + 255) out.push_back(sent[reported++].value);
+    out[2] = out.size() - 3;
+    if (!writeAll(out.data(), out.size())) break;
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+// emergency_latency.cpp - how fast Project 3 reacts to the emergency button
+//
+// The button is pressed at random moments (so presses land in every phase
+// and at any point inside a loop() pass), held for a random time, and the
+// time until every road shows red is measured. Pedestrian buttons are
+// pressed at random too, so the crossing phase is also hit.
+// With the old blocking cycle a press could wait for a whole road cycle;
+// the state machine should see it within one loop() pass.
+
+#include <random>
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define PRESSES 80
+
+static bool allRoadsRed() {
+  for (int i = 0; i < NUM_ROADS; i++) {
+    if (simPinLevel(redPins[i]) != HIGH) return false;
+    if (simPinLevel(yellowPins[i]) != LOW || simPinLevel(greenPins[i]) != LOW) return false;
+  }
+  return true;
+}
+
+static void pass() {
+  loop();
+  simCharge(simLoopCycles);
+}
+
+int main() {
+  std::mt19937 rng(2024);
+  std::uniform_real_distribution<double> gapMs(500, 12000);
+  std::uniform_real_distribution<double> holdMs(30, 3000);
+  std::uniform_int_distribution<int> road(0, NUM_ROADS - 1);
+
+  setup();
+
+  static const char *const phaseName[] = {"green", "yellow", "ped", "all red"};
+  unsigned long pressesIn[4] = {0, 0, 0, 0};
+  double worstUs = 0, totalUs = 0;
+  unsigned long slowPresses = 0;
+
+  for (int n = 0; n < PRESSES; n++) {
+    // A pedestrian now and then, so PH_PED shows up too
+    if (n % 3 == 0) {
+      uint8_t pin = pedButtons[road(rng)];
+      uint64_t at = simCycles() + simMs(gapMs(rng) / 2);
+      simAt(at, [pin] { simSetPin(pin, LOW); });
+      simAt(at + simMs(200), [pin] { simSetPin(pin, HIGH); });
+    }
+
+    uint64_t pressAt = simCycles() + simMs(gapMs(rng));
+    simAt(pressAt, [] { simSetPin(EMERGENCY_PIN, LOW); });
+    uint64_t releaseAt = pressAt + simMs(holdMs(rng));
+    simAt(releaseAt, [] { simSetPin(EMERGENCY_PIN, HIGH); });
+
+    // Run until the press, then until the lamps answer
+    Phase phaseAtPress = PH_EMERGENCY;
+    while (simCycles() < pressAt) {
+      phaseAtPress = currentPhase;
+      pass();
+    }
+    while (currentPhase != PH_EMERGENCY || !allRoadsRed()) pass();
+    double us = (simCycles() - pressAt) / (double)SIM_CYCLES_PER_US;
+
+    if (phaseAtPress < 4) pressesIn[phaseAtPress]++;
+    totalUs += us;
+    if (us > worstUs) worstUs = us;
+    if (us > 1000) slowPresses++;
+
+    // Wait out the emergency before the next press
+    while (simCycles() < releaseAt || currentPhase == PH_EMERGENCY) pass();
+  }
+
+  printf("%d emergency presses over %.1f min simulated (", PRESSES, simNowMs() / 60000.0);
+  const char *missed = NULL;
+  for (int p = 0; p < 4; p++) {
+    printf("%sin %s %lu", p ? ", " : "", phaseName[p], pressesIn[p]);
+    if (!pressesIn[p] && !missed) missed = phaseName[p];
+  }
+  printf(")\n");
+  printf("press to all red: mean %.1f us, worst %.1f us (loop pass charged %u cycles)\n",
+         totalUs / PRESSES, worstUs, (unsigned)simLoopCycles);
+
+  check(slowPresses == 0, "every press answered within 1 ms (worst %.1f us)", worstUs);
+  check(!missed, "presses landed in every phase (none in %s)", missed ? missed : "-");
+  check(!failSafe, "interlock never tripped");
+  return checkResult();
+}
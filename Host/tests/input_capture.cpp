@@ -0,0 +1,151 @@
+// input_capture.cpp - InputCapture.h under random, bouncing presses
+//
+// Three buttons, one on each port (pin 7 and pin 9 active HIGH as in x.ino
+// and blinking_battery.ino, A0 active LOW as in Project 3), are pressed
+// for 50 ms at random moments. Every press and every release bounces for
+// a few ms. loop() is busy for a random time between looks at the queue.
+// Each press must come out as exactly one press and one release, with
+// the right time, however long loop() was away.
+// For comparison the old blinking_battery ISR (debounce from the last
+// press only) is run on the same edges: a bounce on release reaches it
+// more than DEBOUNCE_MS after the press and counts as a new press.
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <Arduino.h>
+#include <InputCapture.h>
+#include "Sim.h"
+#include "Check.h"
+
+#define PRESSES_PER_BUTTON 1000
+#define PRESS_MS           50
+#define BOUNCE_MS          3.0  // bounces stay within this after an edge
+#define MAX_BUSY_MS        100  // longest loop() pass
+
+struct Button {
+  uint8_t pin;
+  bool activeLow;
+  int8_t input;
+  std::vector<double> pressAt;    // ms, as scheduled
+  std::vector<double> releaseAt;
+  unsigned long presses = 0, releases = 0, wrongTime = 0, outOfOrder = 0;
+  bool down = false;
+  unsigned long oldLatches = 0;   // presses seen by the old ISR
+  double oldLastPress = -1e9;
+
+  Button(uint8_t pin, bool activeLow) : pin(pin), activeLow(activeLow), input(-1) {}
+};
+
+static Button buttons[] = {{7, INPUT_ACTIVE_HIGH}, {9, INPUT_ACTIVE_HIGH}, {A0, INPUT_ACTIVE_LOW}};
+static const int NUM_BUTTONS = sizeof(buttons) / sizeof(buttons[0]);
+
+static std::mt19937 rng(3003);
+
+// Drive the pin and run the old "latch on a HIGH edge 20 ms after the
+// last press" logic on the same edge
+static void edge(Button &b, bool pressed) {
+  simSetPin(b.pin, pressed != b.activeLow ? HIGH : LOW);
+  double now = simNowMs();
+  if (pressed && now - b.oldLastPress >= INPUT_DEBOUNCE_MS) {
+    b.oldLastPress = now;
+    b.oldLatches++;
+  }
+}
+
+// The first edge at 'at', then a few bounces, ending in the 'pressed' state
+static void scheduleEdge(Button &b, double at, bool pressed) {
+  std::uniform_int_distribution<int> bounces(0, 4);
+  std::uniform_real_distribution<double> within(0, BOUNCE_MS);
+  Button *p = &b;
+  simAt(simMs(at), [p, pressed] { edge(*p, pressed); });
+
+  int n = bounces(rng);
+  std::vector<double> times;
+  for (int i = 0; i < 2 * n; i++) times.push_back(at + within(rng));
+  std::sort(times.begin(), times.end());
+  for (int i = 0; i < 2 * n; i++) {
+    bool level = i % 2 == 0 ? !pressed : pressed;
+    simAt(simMs(times[i]), [p, level] { edge(*p, level); });
+  }
+}
+
+void setup() {
+  for (Button &b : buttons) {
+    pinMode(b.pin, b.activeLow ? INPUT_PULLUP : INPUT);
+    simSetPin(b.pin, b.activeLow ? HIGH : LOW);
+    b.input = inputAttach(b.pin, b.activeLow);
+  }
+  inputBegin();
+}
+
+// An edge is seen at its first change, or at a later bounce if the first
+// one was shorter than the time the ISR takes to read the pin
+static bool timeMatches(unsigned long eventMs, double edgeMs) {
+  return eventMs + 1 > edgeMs && eventMs <= edgeMs + BOUNCE_MS;
+}
+
+// Take everything queued, then be busy elsewhere for a while
+void loop() {
+  std::uniform_real_distribution<double> busyMs(0, MAX_BUSY_MS);
+  InputEvent ev;
+  while (inputPop(ev)) {
+    Button &b = buttons[ev.input];
+    if (ev.pressed == b.down) {
+      b.outOfOrder++;
+      continue;
+    }
+    b.down = ev.pressed;
+    std::vector<double> &scheduled = ev.pressed ? b.pressAt : b.releaseAt;
+    unsigned long &count = ev.pressed ? b.presses : b.releases;
+    if (count < scheduled.size() && !timeMatches(ev.time, scheduled[count])) b.wrongTime++;
+    count++;
+  }
+  simAdvance(simMs(busyMs(rng)));
+}
+
+int main() {
+  setup();
+
+  std::uniform_real_distribution<double> gapMs(PRESS_MS, 1000);
+  double end = 0;
+  for (Button &b : buttons) {
+    double t = 100;
+    for (int i = 0; i < PRESSES_PER_BUTTON; i++) {
+      t += gapMs(rng);
+      b.pressAt.push_back(t);
+      scheduleEdge(b, t, true);
+      t += PRESS_MS;
+      b.releaseAt.push_back(t);
+      scheduleEdge(b, t, false);
+    }
+    if (t > end) end = t;
+  }
+
+  while (simNowMs() < end + 2 * MAX_BUSY_MS) loop();
+
+  unsigned long missed = 0, phantom = 0, extra = 0, wrongTime = 0, outOfOrder = 0;
+  for (Button &b : buttons) {
+    unsigned long want = b.pressAt.size();
+    if (b.presses < want) missed += want - b.presses;
+    if (b.presses > want) extra += b.presses - want;
+    if (b.releases != want) extra += b.releases > want ? b.releases - want : want - b.releases;
+    if (b.oldLatches > want) phantom += b.oldLatches - want;
+    wrongTime += b.wrongTime;
+    outOfOrder += b.outOfOrder;
+  }
+
+  printf("%d presses of %d ms on %d buttons over %.0f s, loop() away up to %d ms at a time\n",
+         NUM_BUTTONS * PRESSES_PER_BUTTON, PRESS_MS, NUM_BUTTONS, simNowMs() / 1000, MAX_BUSY_MS);
+  printf("InputCapture.h: %lu missed, %lu extra, %lu at the wrong time, %lu dropped (ring full)\n",
+         missed, extra, wrongTime, (unsigned long)inputOverflows);
+  printf("old blinking_battery ISR on the same edges: %lu phantom presses\n", phantom);
+
+  check(missed == 0, "no press missed");
+  check(extra == 0 && outOfOrder == 0, "one press and one release per press, in order");
+  check(wrongTime == 0, "events carry the time of the edge");
+  check(inputOverflows == 0, "queue never overflowed");
+  check(phantom > 0, "release bounces fool the old ISR (%lu phantoms)", phantom);
+  return checkResult();
+}
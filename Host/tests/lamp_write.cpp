@@ -0,0 +1,102 @@
+// lamp_write.cpp - cost of showing a lamp pattern in Project 3
+//
+// Every lamp pattern of one road cycle (green, yellow, all red for each
+// road) is shown twice: with a digitalWrite() per lamp, as the sketch did
+// before the lamp bank, and with lampPortsWrite(), one masked store per
+// port. Cycles are the emulated ATmega328P cycles of Host/Arduino.cpp:
+// the core's digitalWrite() is charged what it costs on the chip, a port
+// register access one cycle. The arithmetic around the stores is not
+// modelled, which flatters the port write by a few cycles.
+// Skew is the time between the first and the last lamp changing.
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define REPEATS 100
+
+const int NUM_LAMPS = 3 * NUM_ROADS;
+
+// Lamp pins in the order the old code wrote them
+static int lampPinNumber(int lamp) {
+  int road = lamp / 3;
+  return lamp % 3 == 0 ? redPins[road] : lamp % 3 == 1 ? yellowPins[road] : greenPins[road];
+}
+
+static const LampPin &lampOf(int lamp) {
+  const RoadLamps &r = roadLamps[lamp / 3];
+  return lamp % 3 == 0 ? r.red : lamp % 3 == 1 ? r.yellow : r.green;
+}
+
+// Image of road 'road' showing 'aspect' (0 red, 1 yellow, 2 green), others red
+static void buildImage(int road, int aspect) {
+  for (int i = 0; i < NUM_LAMP_PORTS; i++) lampImage[i] = 0;
+  for (int lamp = 0; lamp < NUM_LAMPS; lamp++) {
+    bool on = lamp / 3 == road ? lamp % 3 == aspect : lamp % 3 == 0;
+    lampSet(lampOf(lamp), on);
+  }
+}
+
+// The old way: one digitalWrite() per lamp; returns cycles, sets 'skew'
+static uint64_t writeEachLamp(uint64_t &skew) {
+  uint64_t start = simCycles();
+  uint64_t lastChange = start;
+  for (int lamp = 0; lamp < NUM_LAMPS; lamp++) {
+    lastChange = simCycles();
+    digitalWrite(lampPinNumber(lamp), lampOn(lampOf(lamp)) ? HIGH : LOW);
+  }
+  skew = lastChange - start;
+  return simCycles() - start;
+}
+
+static uint64_t writePorts() {
+  uint64_t start = simCycles();
+  lampPortsWrite();
+  return simCycles() - start;
+}
+
+// Current pin levels of all lamps, bit per lamp
+static unsigned lampLevels() {
+  unsigned levels = 0;
+  for (int lamp = 0; lamp < NUM_LAMPS; lamp++) {
+    if (simPinLevel(lampPinNumber(lamp)) == HIGH) levels |= 1 << lamp;
+  }
+  return levels;
+}
+
+int main() {
+  for (int lamp = 0; lamp < NUM_LAMPS; lamp++) pinMode(lampPinNumber(lamp), OUTPUT);
+
+  uint64_t eachCycles = 0, eachSkew = 0, portCycles = 0, patterns = 0;
+  unsigned long mismatches = 0;
+  for (int n = 0; n < REPEATS; n++) {
+    for (int road = 0; road < NUM_ROADS; road++) {
+      for (int aspect = 2; aspect >= 0; aspect--) {  // green, yellow, red
+        buildImage(road, aspect);
+        uint64_t skew;
+        eachCycles += writeEachLamp(skew);
+        if (skew > eachSkew) eachSkew = skew;
+        unsigned viaDigitalWrite = lampLevels();
+
+        allOff(millis());  // start the port write from a different pattern
+        buildImage(road, aspect);
+        portCycles += writePorts();
+        if (lampLevels() != viaDigitalWrite) mismatches++;
+        patterns++;
+      }
+    }
+  }
+
+  double each = eachCycles / (double)patterns, ports = portCycles / (double)patterns;
+  printf("%lu lamp patterns of %d lamps\n", (unsigned long)patterns, NUM_LAMPS);
+  printf("digitalWrite() x %d: %.0f cycles (%.1f us), skew %.1f us\n",
+         NUM_LAMPS, each, each / SIM_CYCLES_PER_US, eachSkew / (double)SIM_CYCLES_PER_US);
+  printf("lampPortsWrite():   %.0f cycles (%.2f us), skew at most %.2f us\n",
+         ports, ports / SIM_CYCLES_PER_US, ports / SIM_CYCLES_PER_US);
+  printf("speed-up %.0fx\n", each / ports);
+
+  check(mismatches == 0, "both ways light the same lamps");
+  check(each >= 10 * ports, "port write at least 10x cheaper (%.0fx)", each / ports);
+  return checkResult();
+}
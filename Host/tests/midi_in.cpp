@@ -0,0 +1,383 @@
+// midi_in.cpp - Project 1 following a MIDI clock and passing MIDI IN through
+//
+// A recorded-style byte stream from a DAW is replayed into MIDI IN at
+// 31250 baud, with the player's own song going out at the same time:
+//   - Start, then 24 clocks per quarter note with a little jitter: 100 BPM,
+//     a step to 140 BPM, Stop for a few seconds (clocks keep coming, as
+//     most DAWs send them), Continue, then a ramp down to 80 BPM, and
+//     finally no clock at all, so the player must fall back to its pot;
+//   - then a Start with no clock after it, and a few seconds of clock
+//     ending in a Stop with nothing after it: both times the song must
+//     wait for the timeout and then run at the pot's tempo;
+//   - notes on channel 6 with running status (Note On velocity 0 as Note
+//     Off), program changes, the odd SysEx and Active Sensing. Clock bytes
+//     land between the bytes of these messages whenever they fall due.
+// Tempo lock: at every clock the song clock is compared with where it
+// should be (one CLOCK_SONG_Q8 per clock since Start or Continue), in
+// real ms at the current tempo, and the sketch's clock period estimate
+// with the real period. The song clock moves in 1 ms Timer1 ticks, so up
+// to a tick of error is in the design. The first 2 beats after Start,
+// Continue and the tempo step are left out.
+// Thru latency: from the end of a message's last byte on MIDI IN to its
+// first byte starting on MIDI OUT, for every channel message and every
+// real-time byte, matched in order.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 1 (Midi Player).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define IN_CHANNEL   5        // channel 6; the song goes out on channel 1
+#define START_MS     500
+#define STEP_MS      60000    // 100 -> 140 BPM
+#define STOP_MS      120000
+#define CONTINUE_MS  123000
+#define RAMP_MS      150000   // 140 -> 80 BPM until CLOCK_END_MS
+#define CLOCK_END_MS 180000
+#define FALLBACK_MS  (CLOCK_END_MS + 2000)
+#define CUE_MS       185000   // Start, and no clock after it
+#define RECLOCK_MS   190000   // 120 BPM clock again ...
+#define LAST_STOP_MS 195000   // ... until a Stop with nothing after it
+#define RUN_MS       199000
+#define FREE_RUN_MS  2000     // song time measured after the fallback
+#define JITTER_US    200.0    // sd of the clock timing
+#define SETTLE_CLOCKS 48      // 2 beats
+
+static std::mt19937 rng(2525);
+
+static double bpmAt(double ms) {
+  if (ms < STEP_MS) return 100;
+  if (ms < RAMP_MS) return 140;
+  return 140 - 60 * (ms - RAMP_MS) / (CLOCK_END_MS - RAMP_MS);
+}
+
+// ---- The input stream ----
+struct InByte {
+  double ms;       // when the DAW sends it
+  uint8_t value;
+  int message;     // index into inMessages, -1 for real-time bytes
+  int clock;       // index into clocks, -1 otherwise
+};
+
+struct InMessage {
+  uint8_t status, data1, data2;
+  uint64_t end;    // last byte received (cycles)
+};
+
+struct Clock {
+  bool counted;    // the song should be at position * CLOCK_SONG_Q8
+  long position;
+  bool settled;
+  double periodUs;
+  uint64_t end;
+};
+
+static std::vector<InByte> stream;
+static std::vector<InMessage> inMessages;
+static std::vector<Clock> clocks;
+static std::vector<std::pair<uint8_t, uint64_t>> inRealtime;  // byte, end
+
+static void addRealtime(double ms, uint8_t value) {
+  stream.push_back({ms, value, -1, -1});
+}
+
+static void addClocks() {
+  std::normal_distribution<double> jitter(0, JITTER_US / 1000);
+  bool running = true, cued = true;
+  long position = 0, sinceCue = 0;
+  double next = START_MS + 10, lastStepAt = 0;
+  addRealtime(START_MS, 0xFA);
+  bool stopped = false, continued = false;
+  while (next < CLOCK_END_MS) {
+    if (!stopped && next >= STOP_MS) {
+      addRealtime(next - 1, 0xFC);
+      running = false;
+      stopped = true;
+    }
+    if (!continued && next >= CONTINUE_MS) {
+      addRealtime(next - 1, 0xFB);
+      running = cued = true;
+      sinceCue = 0;
+      continued = true;
+    }
+    double periodMs = 60000.0 / (bpmAt(next) * 24);
+    if (lastStepAt == 0 && next >= STEP_MS) lastStepAt = next;
+    Clock c = {false, 0, false, periodMs * 1000, 0};
+    if (running) {
+      if (cued) cued = false;
+      else position++;
+      sinceCue++;
+      c.counted = true;
+      c.position = position;
+      bool afterStep = lastStepAt > 0 && next - lastStepAt < SETTLE_CLOCKS * periodMs;
+      c.settled = sinceCue > SETTLE_CLOCKS && !afterStep;
+    }
+    stream.push_back({next + std::max(-1.0, std::min(1.0, jitter(rng))), 0xF8, -1, (int)clocks.size()});
+    clocks.push_back(c);
+    next += periodMs;
+  }
+}
+
+// Transport left waiting: Start with no clock, and Stop with the clock
+// gone too
+static void addUnclockedTransport() {
+  addRealtime(CUE_MS, 0xFA);
+  for (double t = RECLOCK_MS; t < LAST_STOP_MS; t += 60000.0 / (120 * 24)) addRealtime(t, 0xF8);
+  addRealtime(LAST_STOP_MS, 0xFC);
+}
+
+static void addMessage(double ms, uint8_t status, uint8_t data1, uint8_t data2, bool sendStatus) {
+  int index = inMessages.size();
+  inMessages.push_back({status, data1, data2, 0});
+  double byteMs = simUartByteCycles() / (double)simMs(1);
+  if (sendStatus) stream.push_back({ms, status, index, -1});
+  ms += sendStatus ? byteMs : 0;
+  stream.push_back({ms, data1, index, -1});
+  if (midiDataBytes(status) == 2) stream.push_back({ms + byteMs, data2, index, -1});
+}
+
+static void addChannelTraffic() {
+  std::uniform_real_distribution<double> gapMs(40, 250);
+  std::uniform_int_distribution<int> pitch(36, 96), velocity(1, 127), percent(0, 99);
+  uint8_t lastStatus = 0;
+  std::vector<uint8_t> held;
+  double sysexAt = 5000, sensingAt = 300;
+  for (double t = 200; t < RUN_MS - 1000; t += gapMs(rng)) {
+    uint8_t status, d1, d2 = 0;
+    int roll = percent(rng);
+    if (roll < 5) {
+      status = 0xC0 | IN_CHANNEL;              // program change, 1 data byte
+      d1 = pitch(rng);
+    } else if (!held.empty() && roll < 50) {
+      status = 0x90 | IN_CHANNEL;              // note off as velocity 0
+      d1 = held.front();
+      held.erase(held.begin());
+    } else {
+      status = 0x90 | IN_CHANNEL;
+      d1 = pitch(rng);
+      d2 = velocity(rng);
+      held.push_back(d1);
+    }
+    addMessage(t, status, d1, d2, status != lastStatus);
+    lastStatus = status;
+
+    if (t > sysexAt) {                         // skipped, and resets running status
+      double byteMs = simUartByteCycles() / (double)simMs(1);
+      const uint8_t sysex[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+      for (int i = 0; i < 6; i++) stream.push_back({t + 5 + i * byteMs, sysex[i], -1, -1});
+      lastStatus = 0;
+      sysexAt += 5000;
+    }
+    if (t > sensingAt) {
+      addRealtime(t + 10, 0xFE);
+      sensingAt += 300;
+    }
+  }
+}
+
+// Bytes go on the wire in time order, each once the line is free
+static void scheduleStream() {
+  std::stable_sort(stream.begin(), stream.end(), [](const InByte &a, const InByte &b) { return a.ms < b.ms; });
+  uint64_t lineFree = 0;
+  for (const InByte &b : stream) {
+    uint64_t start = std::max(simMs(b.ms), lineFree);
+    uint64_t end = start + simUartByteCycles();
+    lineFree = end;
+    uint8_t value = b.value;
+    simAt(start, [value] { simUartReceive(value); });
+    if (b.message >= 0) inMessages[b.message].end = end;
+    if (b.clock >= 0) clocks[b.clock].end = end;
+    if (value >= 0xF8) inRealtime.push_back({value, end});
+  }
+}
+
+// ---- Tempo lock ----
+struct LockSample {
+  double errorMs;   // song clock minus where it should be, real ms
+  double tempoErr;  // clockPeriod against the real period, fraction
+  bool settled, ramp;
+};
+
+static std::vector<LockSample> lockSamples;
+
+static void sampleLock(const Clock &c) {
+  // Just after the clock's interrupt: a little song time has passed since
+  const double afterUs = 50;
+  noInterrupts();
+  unsigned long pos = songClockQ8();
+  unsigned long period = clockPeriod;
+  interrupts();
+  double songPerUs = CLOCK_SONG_Q8 / c.periodUs;  // 1/256 song ms per real us
+  double ideal = c.position * (double)CLOCK_SONG_Q8 + afterUs * songPerUs;
+  double errorQ8 = (long)(pos - (unsigned long)llround(ideal));
+  LockSample s;
+  s.errorMs = errorQ8 / songPerUs / 1000;
+  s.tempoErr = period / c.periodUs - 1;
+  s.settled = c.settled;
+  s.ramp = c.end > simMs(RAMP_MS);
+  lockSamples.push_back(s);
+}
+
+// ---- MIDI OUT ----
+struct OutMessage {
+  uint8_t status, data1, data2;
+  uint64_t start;  // first byte of the message (the status, if it was sent)
+};
+
+static void parseOut(std::vector<OutMessage> &thru, std::vector<std::pair<uint8_t, uint64_t>> &realtime,
+                     unsigned long &sysexBytes) {
+  uint8_t status = 0, data[2];
+  int count = 0;
+  uint64_t start = 0;
+  bool statusSent = false;  // the message under way began with its status
+  for (const SimUartByte &b : simUartSent()) {
+    if (b.value >= 0xF8) {
+      realtime.push_back({b.value, b.start});
+      continue;
+    }
+    if (b.value >= 0xF0) {
+      sysexBytes++;
+      continue;
+    }
+    if (b.value & 0x80) {
+      status = b.value;
+      count = 0;
+      start = b.start;
+      statusSent = true;
+      continue;
+    }
+    if (count == 0 && !statusSent) start = b.start;  // running status
+    statusSent = false;
+    data[count++] = b.value;
+    if (count == midiDataBytes(status)) {
+      if ((status & 0x0F) == IN_CHANNEL) thru.push_back({status, data[0], count == 2 ? data[1] : (uint8_t)0, start});
+      count = 0;
+    }
+  }
+}
+
+// ---- Transport without a clock ----
+struct Latch {
+  double at;               // ms of the Start or Stop
+  Transport waiting;       // state right after it
+  bool held, freed;
+  unsigned long heldAt, from, to;  // songNow() samples
+  double potRate;          // song ms per ms the pot asks for
+};
+
+static void watchLatch(Latch &l) {
+  Latch *p = &l;
+  simAt(simMs(l.at + 100), [p] { p->heldAt = songNow(); });
+  simAt(simMs(l.at + 400), [p] { p->held = transport == p->waiting && songNow() == p->heldAt; });
+  simAt(simMs(l.at + 1000), [p] {
+    p->freed = transport == TRANSPORT_FREE;
+    p->from = songNow();
+    p->potRate = 100.0 / map(adcRead(tempoChannel), 0, ADC_MAX, 50, 150);
+  });
+  simAt(simMs(l.at + 1000 + FREE_RUN_MS), [p] { p->to = songNow(); });
+}
+
+static double latchRateErr(const Latch &l) {
+  return (l.to - l.from) / (FREE_RUN_MS * l.potRate) - 1;
+}
+
+static double usOf(uint64_t cycles) {
+  return cycles / (double)SIM_CYCLES_PER_US;
+}
+
+int main() {
+  simSetAnalog(TEMPO_POT, 512);
+  setup();  // sets the baud rate the stream is timed with
+
+  addClocks();
+  addUnclockedTransport();
+  addChannelTraffic();
+  scheduleStream();
+  for (const Clock &c : clocks) {
+    if (!c.counted) continue;
+    const Clock *clock = &c;
+    simAt(c.end + simUs(50), [clock] { sampleLock(*clock); });
+  }
+
+  bool fellBack = false;
+  simAt(simMs(FALLBACK_MS - 1), [&fellBack] { fellBack = transport == TRANSPORT_FREE; });
+
+  // Start with no clock: held at the top, then free at the pot's tempo
+  // (centre, 100%)
+  Latch cued = {CUE_MS, TRANSPORT_CUED};
+  watchLatch(cued);
+  // Stop with no clock: held where it stopped, then free with the pot
+  // turned fully up (150%, the song at 2/3 speed)
+  simAt(simMs(LAST_STOP_MS - 1000), [] { simSetAnalog(TEMPO_POT, 1023); });
+  Latch stopped = {LAST_STOP_MS, TRANSPORT_STOPPED};
+  watchLatch(stopped);
+  simRunLoop(RUN_MS);
+
+  // Tempo lock
+  double steadyMax = 0, steadySum = 0, rampMax = 0, tempoMax = 0;
+  unsigned long steady = 0;
+  for (const LockSample &s : lockSamples) {
+    if (!s.settled) continue;
+    if (s.ramp) {
+      rampMax = std::max(rampMax, fabs(s.errorMs));
+      continue;
+    }
+    steadyMax = std::max(steadyMax, fabs(s.errorMs));
+    steadySum += fabs(s.errorMs);
+    tempoMax = std::max(tempoMax, fabs(s.tempoErr));
+    steady++;
+  }
+
+  // Thru
+  std::vector<OutMessage> thru;
+  std::vector<std::pair<uint8_t, uint64_t>> outRealtime;
+  unsigned long sysexOut = 0;
+  parseOut(thru, outRealtime, sysexOut);
+  unsigned long wrong = 0;
+  double msgMax = 0, msgSum = 0, rtMax = 0;
+  size_t n = std::min(thru.size(), inMessages.size());
+  for (size_t i = 0; i < n; i++) {
+    const InMessage &in = inMessages[i];
+    const OutMessage &out = thru[i];
+    if (in.status != out.status || in.data1 != out.data1 || in.data2 != out.data2) wrong++;
+    double us = usOf(out.start) - usOf(in.end);
+    if (us < 0) wrong++;
+    msgMax = std::max(msgMax, us);
+    msgSum += us;
+  }
+  size_t r = std::min(outRealtime.size(), inRealtime.size());
+  for (size_t i = 0; i < r; i++) {
+    if (outRealtime[i].first != inRealtime[i].first) wrong++;
+    rtMax = std::max(rtMax, usOf(outRealtime[i].second) - usOf(inRealtime[i].second));
+  }
+
+  printf("%zu clocks (100, 140, Stop/Continue, 140 -> 80 BPM), jitter sd %.0f us\n", clocks.size(), JITTER_US);
+  printf("lock, steady tempo: mean %.2f ms, worst %.2f ms, period estimate within %.2f%%\n",
+         steadySum / steady, steadyMax, tempoMax * 100);
+  printf("lock, during the ramp: worst %.2f ms\n", rampMax);
+  printf("Start, no clock: %s, then %s at %.3fx (pot asks %.3fx)\n", cued.held ? "held" : "not held",
+         cued.freed ? "free" : "not free", (cued.to - cued.from) / (double)FREE_RUN_MS, cued.potRate);
+  printf("Stop, no clock:  %s, then %s at %.3fx (pot asks %.3fx)\n", stopped.held ? "held" : "not held",
+         stopped.freed ? "free" : "not free", (stopped.to - stopped.from) / (double)FREE_RUN_MS, stopped.potRate);
+  printf("thru: %zu of %zu messages, mean %.0f us, worst %.0f us; %zu of %zu real-time bytes, worst %.0f us\n",
+         thru.size(), inMessages.size(), msgSum / n, msgMax, outRealtime.size(), inRealtime.size(), rtMax);
+
+  check(steady > 1000, "tempo lock measured (%lu clocks)", steady);
+  check(steadyMax < 2 && steadySum / steady < 0.5, "song clock within 2 ms of the MIDI clock, 0.5 ms on average (worst %.2f ms)", steadyMax);
+  check(tempoMax < 0.02, "clock period estimated within 2%% once locked (%.2f%%)", tempoMax * 100);
+  check(rampMax < 3, "follows the ramp within 3 ms (%.2f ms)", rampMax);
+  check(fellBack, "back to the tempo pot once the clock stops");
+  check(cued.held && cued.freed && fabs(latchRateErr(cued)) < 0.02,
+        "Start with no clock waits, then runs at the pot's tempo (%+.1f%%)", latchRateErr(cued) * 100);
+  check(stopped.held && stopped.freed && fabs(latchRateErr(stopped)) < 0.02,
+        "Stop with no clock after it waits, then runs at the pot's tempo (%+.1f%%)", latchRateErr(stopped) * 100);
+  check(thru.size() == inMessages.size() && midiThruDropped == 0, "every channel message passed through");
+  check(outRealtime.size() == inRealtime.size(), "every real-time byte passed through");
+  check(wrong == 0 && sysexOut == 0, "passed through unchanged and in order, SysEx left out (%lu wrong)", wrong);
+  check(msgMax < 1000 && rtMax < 1000, "thru latency under 1 ms (worst %.0f us)", std::max(msgMax, rtMax));
+  return checkResult();
+}
@@ -0,0 +1,134 @@
+// midi_jitter.cpp - timing of the notes Project 1 sends, over 10 minutes
+//
+// The built-in song repeats for 10 minutes of simulated time with the
+// tempo pot at 100%. Every group of MIDI messages the player sends (a
+// note, or a chord with the note-offs due at the same time) is matched
+// with the song time it was scheduled for, and the spread of "sent minus
+// scheduled" is the jitter. Each group is timed by the start of its first
+// byte: the 320 us per byte after that is the wire, not the sequencer.
+// The run starts 5 minutes before the song clock passes 2^24 ms, where a
+// single Q8 clock used to wrap and freeze the song.
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 1 (Midi Player).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS      600000
+#define SONG_START  ((1UL << 24) - RUN_MS / 2)  // song ms at the start of the run
+#define FIRST_NOTE  (SONG_START + 1000)          // song ms of the first note
+#define BURST_GAP_MS 5.0                        // bytes closer than this belong to one group
+
+// One Note On / Note Off, as scheduled or as sent
+struct Message {
+  bool on;
+  byte pitch;
+  bool operator<(const Message &o) const { return on != o.on ? on < o.on : pitch < o.pitch; }
+};
+
+// What the song should send, by song ms, following scheduleNotes()
+static std::map<unsigned long, std::vector<Message>> expectedSchedule(unsigned long start, unsigned long end) {
+  std::map<unsigned long, std::vector<Message>> due;
+  SongReader reader = songReader;
+  songRewind(reader);
+  NoteEvent note{};
+  songNext(reader, note);
+  unsigned long time = start + note.delta, songEnd = 0;
+  while (time < end) {
+    due[time].push_back({true, note.pitch});
+    due[time + note.duration].push_back({false, note.pitch});
+    if (time + note.duration > songEnd) songEnd = time + note.duration;
+    if (!songNext(reader, note)) {
+      songRewind(reader);
+      songNext(reader, note);
+      time = songEnd + SONG_PAUSE;
+    }
+    time += note.delta;
+  }
+  return due;
+}
+
+// UART bytes split into groups, each decoded into its messages
+struct Burst {
+  double startMs;
+  std::vector<Message> messages;
+};
+
+static std::vector<Burst> sentBursts() {
+  std::vector<Burst> bursts;
+  byte status = 0, data[2];
+  int count = 0;
+  double lastEnd = -1e9;
+  for (const SimUartByte &b : simUartSent()) {
+    double start = b.start / (double)simMs(1);
+    if (start - lastEnd > BURST_GAP_MS) bursts.push_back({start, {}});
+    lastEnd = b.end / (double)simMs(1);
+    if (b.value & 0x80) {
+      status = b.value;
+      count = 0;
+      continue;
+    }
+    data[count++] = b.value;
+    if (count < 2) continue;
+    count = 0;
+    bool on = (status & 0xF0) == 0x90 && data[1] != 0;
+    bursts.back().messages.push_back({on, data[0]});
+  }
+  return bursts;
+}
+
+int main() {
+  simSetAnalog(TEMPO_POT, 512);  // tempo factor 100: one song ms per ms
+  setup();
+
+  // Move the song clock on, as if the player had been running for hours.
+  // The first note is a second away, so it is sent on a timer tick like
+  // all the others.
+  noInterrupts();
+  songMs = SONG_START;
+  nextNoteTime = FIRST_NOTE + nextNote.delta;
+  interrupts();
+  double runStartMs = simNowMs();
+
+  simRunLoop(RUN_MS);
+
+  std::map<unsigned long, std::vector<Message>> due = expectedSchedule(FIRST_NOTE, SONG_START + RUN_MS - 50);
+  std::vector<Burst> bursts = sentBursts();
+
+  double minOffset = 1e9, maxOffset = -1e9;
+  unsigned long matched = 0, wrongNotes = 0, afterWrap = 0;
+  auto expected = due.begin();
+  for (const Burst &burst : bursts) {
+    if (expected == due.end()) break;
+    std::vector<Message> want = expected->second, got = burst.messages;
+    std::sort(want.begin(), want.end());
+    std::sort(got.begin(), got.end());
+    if (want.size() != got.size() || !std::equal(want.begin(), want.end(), got.begin(),
+        [](const Message &a, const Message &b) { return !(a < b) && !(b < a); })) {
+      wrongNotes++;
+    }
+    double offset = (burst.startMs - runStartMs) - (expected->first - SONG_START);
+    if (offset < minOffset) minOffset = offset;
+    if (offset > maxOffset) maxOffset = offset;
+    if (expected->first >= (1UL << 24)) afterWrap++;
+    ++expected;
+    matched++;
+  }
+  double jitterUs = (maxOffset - minOffset) * 1000;
+
+  printf("%.0f min simulated from song time %lu ms (2^24 ms at %.0f min)\n",
+         RUN_MS / 60000.0, (unsigned long)SONG_START, ((1UL << 24) - SONG_START) / 60000.0);
+  printf("%lu message groups scheduled, %lu sent in time order, %lu after 2^24 ms\n",
+         (unsigned long)due.size(), matched, afterWrap);
+  printf("sent - scheduled: %.0f .. %.0f us, jitter %.0f us\n", minOffset * 1000, maxOffset * 1000, jitterUs);
+
+  check(matched == due.size(), "every scheduled group sent (%lu of %lu)", matched, (unsigned long)due.size());
+  check(wrongNotes == 0, "each group holds the scheduled notes");
+  check(afterWrap > 0, "the song goes on past 2^24 ms");
+  check(jitterUs < 1000, "jitter under 1 ms (%.0f us)", jitterUs);
+  return checkResult();
+}
@@ -0,0 +1,215 @@
+// midi_roundtrip.cpp - .mid -> Tools/midi2song -> Project 1's song reader
+//
+//   midi_roundtrip <path to midi2song>
+//
+// Writes a Standard MIDI File with a few thousand random notes (chords,
+// repeated velocities, running status, both kinds of Note Off, a tempo
+// change halfway through, tempo map in its own track as most sequencers
+// save it), converts it with midi2song, and reads the result back through
+// songNext() from the sketch. Every note must come back with the same
+// start, pitch, velocity and duration in ms.
+
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 1 (Midi Player).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define NOTES       5000
+#define DIVISION    480      // ticks per quarter note
+#define TEMPO_FAST  480000   // us per quarter: 1 tick = 1 ms
+#define TEMPO_SLOW  960000   // 1 tick = 2 ms, from CHANGE_TICK on
+#define MIDI_FILE   "midi_roundtrip.mid"
+
+struct TestNote {
+  uint32_t startTick, endTick;
+  uint8_t pitch, velocity;
+  uint32_t startMs, durationMs;
+};
+
+static const uint32_t CHANGE_TICK = NOTES / 2 * 100;  // about halfway
+
+static uint32_t tickToMs(uint32_t tick) {
+  return tick <= CHANGE_TICK ? tick : CHANGE_TICK + 2 * (tick - CHANGE_TICK);
+}
+
+// ---- Writing the file ----
+static void putBE(std::vector<uint8_t> &out, uint32_t v, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+static void putVLQ(std::vector<uint8_t> &out, uint32_t v) {
+  uint8_t groups[5];
+  int n = 0;
+  do {
+    groups[n++] = v & 0x7F;
+    v >>= 7;
+  } while (v);
+  while (n > 1) out.push_back(groups[--n] | 0x80);
+  out.push_back(groups[0]);
+}
+
+static void putTrack(std::vector<uint8_t> &file, const std::vector<uint8_t> &track) {
+  putBE(file, 0x4D54726B, 4);  // MTrk
+  putBE(file, track.size(), 4);
+  file.insert(file.end(), track.begin(), track.end());
+}
+
+struct TrackEvent {
+  uint32_t tick;
+  uint8_t status, d1, d2;
+};
+
+static std::vector<TestNote> makeNotes(std::mt19937 &rng) {
+  std::uniform_int_distribution<int> gap(0, 200), length(1, 1500), pitch(0, 127), velocity(1, 127);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::vector<TestNote> notes;
+  uint32_t busyUntil[128] = {0};  // a pitch is not restarted while it sounds
+  uint32_t tick = 0;
+  uint8_t lastVelocity = 64;
+  while (notes.size() < NOTES) {
+    if (percent(rng) >= 30) tick += gap(rng);  // 30% chord notes
+    TestNote n;
+    n.pitch = pitch(rng);
+    if (busyUntil[n.pitch] > tick) continue;
+    n.velocity = percent(rng) < 70 ? lastVelocity : velocity(rng);
+    lastVelocity = n.velocity;
+    n.startTick = tick;
+    n.endTick = tick + length(rng);
+    busyUntil[n.pitch] = n.endTick + 1;
+    n.startMs = tickToMs(n.startTick);
+    n.durationMs = tickToMs(n.endTick) - n.startMs;
+    notes.push_back(n);
+  }
+  return notes;
+}
+
+static std::vector<uint8_t> makeFile(const std::vector<TestNote> &notes, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  std::vector<TrackEvent> events;
+  for (const TestNote &n : notes) {
+    events.push_back({n.startTick, 0x90, n.pitch, n.velocity});
+    bool noteOff = percent(rng) < 50;  // 0x80, or 0x90 with velocity 0
+    events.push_back({n.endTick, (uint8_t)(noteOff ? 0x80 : 0x90), n.pitch,
+                      (uint8_t)(noteOff ? 64 : 0)});
+  }
+  // Offs before ons at the same tick, as sequencers write them
+  std::stable_sort(events.begin(), events.end(), [](const TrackEvent &a, const TrackEvent &b) {
+    if (a.tick != b.tick) return a.tick < b.tick;
+    bool aOff = a.status == 0x80 || a.d2 == 0, bOff = b.status == 0x80 || b.d2 == 0;
+    return aOff && !bOff;
+  });
+
+  std::vector<uint8_t> tempoTrack, noteTrack;
+  putVLQ(tempoTrack, 0);
+  tempoTrack.insert(tempoTrack.end(), {0xFF, 0x51, 0x03});
+  putBE(tempoTrack, TEMPO_FAST, 3);
+  putVLQ(tempoTrack, CHANGE_TICK);
+  tempoTrack.insert(tempoTrack.end(), {0xFF, 0x51, 0x03});
+  putBE(tempoTrack, TEMPO_SLOW, 3);
+  putVLQ(tempoTrack, 0);
+  tempoTrack.insert(tempoTrack.end(), {0xFF, 0x2F, 0x00});
+
+  uint32_t tick = 0;
+  uint8_t status = 0;
+  for (const TrackEvent &ev : events) {
+    putVLQ(noteTrack, ev.tick - tick);
+    tick = ev.tick;
+    if (ev.status != status) noteTrack.push_back(ev.status);  // running status
+    status = ev.status;
+    noteTrack.push_back(ev.d1);
+    noteTrack.push_back(ev.d2);
+  }
+  putVLQ(noteTrack, 0);
+  noteTrack.insert(noteTrack.end(), {0xFF, 0x2F, 0x00});
+
+  std::vector<uint8_t> file;
+  putBE(file, 0x4D546864, 4);  // MThd
+  putBE(file, 6, 4);
+  putBE(file, 1, 2);           // format 1
+  putBE(file, 2, 2);           // tracks
+  putBE(file, DIVISION, 2);
+  putTrack(file, tempoTrack);
+  putTrack(file, noteTrack);
+  return file;
+}
+
+// ---- Reading midi2song's output ----
+// The bytes of the printed C array
+static bool runConverter(const char *tool, std::vector<byte> &song) {
+  char command[1024];
+  snprintf(command, sizeof(command), "\"%s\" %s", tool, MIDI_FILE);
+  FILE *p = popen(command, "r");
+  if (!p) return false;
+  char line[512];
+  bool inArray = false;
+  while (fgets(line, sizeof(line), p)) {
+    if (strstr(line, "PROGMEM")) {
+      inArray = true;
+      continue;
+    }
+    if (!inArray) continue;
+    for (char *c = line; (c = strstr(c, "0x")) != nullptr; c += 2) {
+      song.push_back((byte)strtoul(c, nullptr, 16));
+    }
+  }
+  return pclose(p) == 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <midi2song>\n", argv[0]);
+    return 2;
+  }
+
+  std::mt19937 rng(7007);
+  std::vector<TestNote> notes = makeNotes(rng);
+  std::vector<uint8_t> file = makeFile(notes, rng);
+  FILE *f = fopen(MIDI_FILE, "wb");
+  if (!f) return 2;
+  fwrite(file.data(), 1, file.size(), f);
+  fclose(f);
+
+  std::vector<byte> song;
+  bool converted = runConverter(argv[1], song);
+
+  // midi2song orders notes by start, then by file order
+  std::stable_sort(notes.begin(), notes.end(), [](const TestNote &a, const TestNote &b) {
+    return a.startMs < b.startMs;
+  });
+
+  SongReader reader = {song.data(), song.data() + song.size(), song.data(), 0};
+  NoteEvent note;
+  unsigned long read = 0, wrong = 0;
+  uint32_t time = 0;
+  while (songNext(reader, note)) {
+    time += note.delta;
+    if (read < notes.size()) {
+      const TestNote &want = notes[read];
+      if (time != want.startMs || note.pitch != want.pitch || note.velocity != want.velocity
+          || note.duration != want.durationMs) {
+        if (wrong < 5) {
+          printf("note %lu: got %u ms pitch %u vel %u dur %lu, want %u ms pitch %u vel %u dur %u\n",
+                 read, time, note.pitch, note.velocity, note.duration,
+                 want.startMs, want.pitch, want.velocity, want.durationMs);
+        }
+        wrong++;
+      }
+    }
+    read++;
+  }
+
+  printf("%lu-byte .mid with %d notes -> %lu bytes packed (%.2f bytes per note, 4 in the old RAM array)\n",
+         (unsigned long)file.size(), NOTES, (unsigned long)song.size(), song.size() / (double)NOTES);
+  printf("reader state: 3 flash pointers + 1 byte = 7 bytes of RAM on the AVR, whatever the song length\n");
+
+  check(converted, "midi2song converted the file");
+  check(read == notes.size(), "every note read back (%lu of %lu)", read, (unsigned long)notes.size());
+  check(wrong == 0, "start, pitch, velocity and duration match (%lu wrong)", wrong);
+  return checkResult();
+}
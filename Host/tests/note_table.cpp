@@ -0,0 +1,89 @@
+// note_table.cpp - the buzzer frequency table of Project 1 against pow()
+//
+// Checks the constexpr table against 440 * 2^((pitch - 69) / 12) for all
+// 128 pitches, then measures what a note costs:
+//   - latency: from the Timer1 tick that makes a note due to tone() and to
+//     the first MIDI byte, in emulated cycles, over a few repeats of the
+//     song;
+//   - the lookup itself: pitchToFrequency() against the old pow() call,
+//     timed on the PC. The emulator does not count arithmetic, and a PC
+//     has an FPU, so this only shows the direction: on the AVR pow() is
+//     soft-float and costs far more.
+// The table takes 256 bytes of flash (128 two-byte entries); pow() and the
+// soft-float code it pulls in are not linked any more.
+
+#include <chrono>
+#include <cmath>
+
+#include <Arduino.h>
+#include "../../Project 1 (Midi Player).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS     20000
+#define LOOKUPS    1000000
+#define TICK_CYCLES (F_CPU / 1000)  // Timer1 compare match every 1 ms
+
+// The frequency playNote() used to work out for every note
+static unsigned int powFrequency(byte pitch) {
+  return 440 * pow(2, (pitch - 69) / 12.0);
+}
+
+template <typename F>
+static double nsPerLookup(F lookup) {
+  volatile unsigned long sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < LOOKUPS; i++) sink += lookup((byte)(i & 0x7F));
+  auto end = std::chrono::steady_clock::now();
+  (void)sink;
+  return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+int main() {
+  // Table and old code against the exact value
+  double tableError = 0, powError = 0;
+  for (int pitch = 0; pitch < 128; pitch++) {
+    double exact = 440 * pow(2, (pitch - 69) / 12.0);
+    tableError = fmax(tableError, fabs(pitchToFrequency(pitch) - exact));
+    powError = fmax(powError, fabs(powFrequency(pitch) - exact));
+  }
+
+  // Latency from the due tick, on the sketch as it runs
+  simSetAnalog(TEMPO_POT, 512);  // tempo factor 100
+  setup();
+  uint64_t timerStart = simCycles();  // setupSequencerTimer() is the last thing setup() does
+  simRunLoop(RUN_MS);
+
+  uint64_t toneWorst = 0, toneTotal = 0;
+  unsigned long notes = 0;
+  for (const SimToneEvent &t : simTones()) {
+    if (t.pin != BUZZER_PIN || t.frequency == 0) continue;
+    uint64_t latency = (t.cycle - timerStart) % TICK_CYCLES;
+    toneTotal += latency;
+    if (latency > toneWorst) toneWorst = latency;
+    notes++;
+  }
+  uint64_t byteWorst = 0, lastEnd = 0;
+  for (const SimUartByte &b : simUartSent()) {
+    bool firstOfGroup = lastEnd == 0 || b.start - lastEnd > simMs(1);
+    lastEnd = b.end;
+    if (!firstOfGroup) continue;
+    uint64_t sinceTick = (b.start - timerStart) % TICK_CYCLES;
+    if (sinceTick > byteWorst) byteWorst = sinceTick;
+  }
+
+  double tableNs = nsPerLookup(pitchToFrequency);
+  double powNs = nsPerLookup(powFrequency);
+
+  printf("table: %u bytes of flash on the AVR; worst error %.2f Hz (pow() then truncate: %.2f Hz)\n",
+         128 * 2, tableError, powError);
+  printf("%lu notes: due tick to tone() mean %.1f us, worst %.1f us; to first MIDI byte worst %.1f us\n",
+         notes, toneTotal / (double)notes / SIM_CYCLES_PER_US, toneWorst / (double)SIM_CYCLES_PER_US,
+         byteWorst / (double)SIM_CYCLES_PER_US);
+  printf("lookup on this PC: table %.2f ns, pow() %.2f ns (%.0fx)\n", tableNs, powNs, powNs / tableNs);
+
+  check(tableError <= powError, "table at least as close to 440 * 2^((p - 69) / 12) as the old code");
+  check(notes > 0 && toneWorst < simUs(100), "every note reaches the buzzer within 100 us of its tick");
+  check(tableNs < powNs, "table lookup cheaper than pow()");
+  return checkResult();
+}
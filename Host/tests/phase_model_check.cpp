@@ -0,0 +1,262 @@
+// phase_model_check.cpp - every reachable state of Project 3's phase machine
+//
+//   phase_model_check          the sketch as shipped
+//   phase_model_check_demand   VEHICLE_SENSORS 1: roads are skipped when idle
+//
+// A breadth-first search over the states of the sketch's own state machine.
+// A state is the step the controller is in (road, step, phase), the
+// requests it holds (pedestrian buttons, emergency button, roads with
+// vehicles waiting) and what the interlock remembers (roads open, roads
+// still inside their clearance time). From every state each event is
+// tried on a copy of it:
+//   - the phase runs out;
+//   - a pedestrian button on any road is pressed;
+//   - the emergency button is pressed as the phase starts, or just before
+//     it ends; the emergency button is released;
+//   - with detectors, a vehicle arrives on any road.
+// The events run through the real loop() on the simulated clock, and every
+// lamp pattern that reaches the pins is checked against the conflict
+// matrix. The interlock must never have to step in: a latched fail-safe
+// means the phase machine itself produced an unsafe pattern.
+// The search times every event to the ms. A last run lets the cycle go for
+// RUN_MS with loop() passes of about 1 ms, so millis() often ticks inside a
+// pass, as it does on the board when the lamps are written.
+
+#include <map>
+#include <queue>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS  (2 * 3600000UL)
+
+// Everything in the sketch that a transition reads or writes, with times
+// kept relative to the moment the copy was taken
+struct Snapshot {
+  uint8_t lamps[NUM_LAMP_PORTS];
+  bool failSafe;
+  uint8_t openRoads, openedBefore;
+  unsigned long sinceClosed[NUM_ROADS];
+  bool pedRequest[NUM_ROADS];
+  uint8_t vehicleCount[NUM_ROADS];
+  int road, step;
+  Phase phase;
+  unsigned long elapsed, length, sinceBeep;
+  bool emergencyHeld, emergencyRequest;
+};
+
+static Snapshot save() {
+  unsigned long now = millis();
+  Snapshot s;
+  for (int i = 0; i < NUM_LAMP_PORTS; i++) s.lamps[i] = lampImage[i];
+  s.failSafe = failSafe;
+  s.openRoads = openRoads;
+  s.openedBefore = openedBefore;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    s.sinceClosed[i] = now - closedAt[i];
+    s.pedRequest[i] = pedRequest[i];
+    s.vehicleCount[i] = vehicleCount[i];
+  }
+  s.road = currentRoad;
+  s.step = currentStep;
+  s.phase = currentPhase;
+  s.elapsed = now - phaseStart;
+  s.length = phaseLength;
+  s.sinceBeep = now - lastBeep;
+  s.emergencyHeld = emergencyHeld;
+  s.emergencyRequest = emergencyRequest;
+  return s;
+}
+
+static void restore(const Snapshot &s) {
+  unsigned long now = millis();
+  for (int i = 0; i < NUM_LAMP_PORTS; i++) lampImage[i] = s.lamps[i];
+  lampPortsWrite();
+  failSafe = s.failSafe;
+  openRoads = s.openRoads;
+  openedBefore = s.openedBefore;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    closedAt[i] = now - s.sinceClosed[i];
+    pedRequest[i] = s.pedRequest[i];
+    vehicleCount[i] = s.vehicleCount[i];
+  }
+  currentRoad = s.road;
+  currentStep = s.step;
+  currentPhase = s.phase;
+  phaseStart = now - s.elapsed;
+  phaseLength = s.length;
+  lastBeep = now - s.sinceBeep;
+  emergencyHeld = s.emergencyHeld;
+  emergencyRequest = s.emergencyRequest;
+}
+
+// What the search tells states apart by. Times are left out except for
+// whether the phase has run out and which roads are still clearing.
+static uint64_t stateKey(const Snapshot &s) {
+  uint64_t key = 0;
+  auto put = [&key](uint64_t value, int bits) { key = (key << bits) | value; };
+  put(s.road, 2);
+  put(s.step, 3);
+  put(s.phase, 3);
+  put(s.elapsed >= s.length, 1);
+  put(s.emergencyHeld, 1);
+  put(s.emergencyRequest, 1);
+  put(s.failSafe, 1);
+  put(s.openRoads, NUM_ROADS);
+  put(s.openedBefore, NUM_ROADS);
+  for (int i = 0; i < NUM_ROADS; i++) {
+    put(s.pedRequest[i], 1);
+    put(s.vehicleCount[i] > 0, 1);
+    put((s.openedBefore & (1 << i)) && s.sinceClosed[i] < MIN_CLEARANCE_MS, 1);
+  }
+  return key;
+}
+
+// ---- Checking the pins ----
+static unsigned long unsafePatterns = 0;
+static unsigned long lampWrites = 0;
+
+static bool roadOpen(int road) {
+  return simPinLevel(greenPins[road]) == HIGH || simPinLevel(yellowPins[road]) == HIGH;
+}
+
+// The fail-safe flash (yellow everywhere) is counted by the caller instead
+static void checkPins() {
+  if (failSafe) return;
+  lampWrites++;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    int lit = simPinLevel(redPins[i]) + simPinLevel(yellowPins[i]) + simPinLevel(greenPins[i]);
+    if (lit != 1) unsafePatterns++;
+    for (int j = i + 1; j < NUM_ROADS; j++) {
+      if (conflicts[i][j] && roadOpen(i) && roadOpen(j)) unsafePatterns++;
+    }
+  }
+}
+
+// One loop() pass, then the pins as the outside world sees them
+static void pass() {
+  loop();
+  checkPins();
+}
+
+static void advanceTo(unsigned long ms) {
+  uint64_t target = simMs(ms);
+  if (target > simCycles()) simAdvance(target - simCycles());
+}
+
+// ---- Events ----
+enum Event {
+  EV_TIMEOUT,
+  EV_PED,            // + road
+  EV_EMERGENCY_START = EV_PED + NUM_ROADS,
+  EV_EMERGENCY_LATE,
+  EV_EMERGENCY_RELEASE,
+  EV_VEHICLE,        // + road
+  EV_COUNT = EV_VEHICLE + NUM_ROADS
+};
+
+// Apply 'ev' to the state just restored; false if it does not apply there
+static bool apply(int ev) {
+  unsigned long end = phaseStart + phaseLength;
+  if (ev == EV_TIMEOUT) {
+    advanceTo(end);
+    pass();
+  } else if (ev < EV_EMERGENCY_START) {
+    int road = ev - EV_PED;
+    if (pedRequest[road]) return false;
+    pedRequest[road] = true;  // what processInputs() does with a press
+    pass();
+  } else if (ev == EV_EMERGENCY_START || ev == EV_EMERGENCY_LATE) {
+    if (emergencyHeld) return false;
+    if (ev == EV_EMERGENCY_LATE) {
+      if (phaseLength < 2 || millis() + 1 >= end) return false;
+      advanceTo(end - 1);
+    }
+    emergencyHeld = true;
+    emergencyRequest = true;
+    pass();
+  } else if (ev == EV_EMERGENCY_RELEASE) {
+    if (!emergencyHeld) return false;
+    emergencyHeld = false;
+    pass();
+  } else {
+#if VEHICLE_SENSORS
+    int road = ev - EV_VEHICLE;
+    if (vehicleCount[road] > 0) return false;
+    vehicleCount[road] = 1;  // what scanVehicles() does with an arrival
+    pass();
+#else
+    return false;
+#endif
+  }
+  return true;
+}
+
+int main() {
+  setup();
+#if VEHICLE_SENSORS
+  ADCSRA = 0;  // detectors not sampled: arrivals come from EV_VEHICLE
+#endif
+  checkPins();
+
+  std::map<uint64_t, Snapshot> seen;
+  std::queue<Snapshot> open;
+  Snapshot start = save();
+  seen[stateKey(start)] = start;
+  open.push(start);
+
+  unsigned long transitions = 0, stuck = 0, latched = 0;
+  bool greenSeen[NUM_ROADS] = {false, false, false, false};
+  bool pedSeen = false, emergencySeen = false;
+
+  while (!open.empty()) {
+    Snapshot from = open.front();
+    open.pop();
+    if (from.phase == PH_GREEN) greenSeen[from.road] = true;
+    if (from.phase == PH_PED) pedSeen = true;
+    if (from.phase == PH_EMERGENCY) emergencySeen = true;
+
+    bool expires = false;  // the timeout left the phase run out
+    for (int ev = 0; ev < EV_COUNT; ev++) {
+      restore(from);
+      if (!apply(ev)) continue;
+      transitions++;
+      Snapshot to = save();
+      if (to.failSafe) {
+        latched++;
+        continue;
+      }
+      if (ev == EV_TIMEOUT && to.elapsed >= to.length) expires = true;
+      uint64_t key = stateKey(to);
+      if (seen.count(key)) continue;
+      seen[key] = to;
+      open.push(to);
+    }
+    // A phase that runs out is followed by the next one (resting in all
+    // red counts), unless the emergency button is held
+    if (expires && !(from.phase == PH_EMERGENCY && from.emergencyHeld)) stuck++;
+  }
+
+  printf("%s: %lu reachable states, %lu transitions, %lu lamp patterns checked\n",
+         VEHICLE_SENSORS ? "vehicle detectors" : "fixed cycle", (unsigned long)seen.size(),
+         transitions, lampWrites);
+
+  // Free run from the first state, every road busy
+  restore(start);
+  for (int i = 0; i < NUM_ROADS; i++) vehicleCount[i] = 255;
+  simLoopCycles = 15990;  // just under 1 ms, so the tick lands anywhere in a pass
+  simRunLoop(RUN_MS);
+  printf("free run: %.0f min with 1 ms loop() passes\n", RUN_MS / 60000.0);
+
+  bool everyGreen = true;
+  for (int i = 0; i < NUM_ROADS; i++) everyGreen = everyGreen && greenSeen[i];
+  check(unsafePatterns == 0, "no conflicting or mixed lamps on the pins (%lu)", unsafePatterns);
+  check(latched == 0, "the interlock never had to latch the fail-safe (%lu)", latched);
+  check(stuck == 0, "a new phase follows every timeout but a held emergency (%lu stuck)", stuck);
+  check(everyGreen && pedSeen && emergencySeen, "every road's green, the crossing and the emergency reached");
+  check(!failSafe, "the free run never latched the fail-safe");
+  return checkResult();
+}
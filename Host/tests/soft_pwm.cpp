@@ -0,0 +1,160 @@
+// soft_pwm.cpp - SoftPWM.h: duty on the pins and the cost of its interrupt
+//
+// Sketch 8 runs first: its LED must breathe with loop() doing nothing.
+// Then the test takes the library over itself.
+// 1 to SOFTPWM_CHANNELS channels are attached, spread over ports B, C and
+// D as the lamps of Project 3 would be, each at its own level. The pins
+// are sampled every microsecond of simulated time for FRAMES frames, and
+// the share of time each one is HIGH must match its gamma-corrected duty.
+// A fade on its own must stop at its level.
+//
+// Cost per frame (8 interrupts, one per BAM bit), per channel count:
+//   - emulated cycles from simIsrStats(): entry and exit and the timer
+//     registers, as Host/Arduino.cpp charges them (the port stores go
+//     through a pointer and are plain memory here);
+//   - the bit 7 interrupt timed on this PC: it is the one that steps the
+//     fades and rebuilds the bit planes, the only work that grows with the
+//     channels. That work is all arithmetic, which the emulator does not
+//     count, so only the ratio between channel counts carries over.
+
+#include <chrono>
+
+#include <Arduino.h>
+#include "../../8. Blinking with PWM.cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define FRAMES        8
+#define HOST_FRAMES   200000
+#define HOST_RUNS     5       // the fastest run counts
+
+// Three ports in turn, so the bit interrupts write all of them from 3 channels on
+static const uint8_t pwmPins[SOFTPWM_CHANNELS] = {2, 8, A0, 3, 9, A1, 4, 10, A2, 5, 11, A3};
+
+static uint8_t levelOf(int channel) {
+  return 15 + channel * 20;
+}
+
+static void detachAll() {
+  TIMSK2 = 0;
+  softPwmChannels = 0;
+  softPwmPorts = 0;
+  for (int p = 0; p < SOFTPWM_PORTS; p++) softPwmPortMask[p] = 0;
+}
+
+static void attach(int count) {
+  detachAll();
+  for (int i = 0; i < count; i++) {
+    int8_t ch = softPwmAttach(pwmPins[i]);
+    softPwmSet(ch, levelOf(i));
+  }
+  softPwmBegin();
+  simAdvance(simUs(2 * SOFTPWM_FRAME_US));  // first frame built and shown
+}
+
+// Worst difference, in steps of 1/255, between the time each pin is HIGH
+// and its duty
+static double dutyError(int count) {
+  unsigned long high[SOFTPWM_CHANNELS] = {0};
+  unsigned long samples = FRAMES * SOFTPWM_FRAME_US;
+  for (unsigned long s = 0; s < samples; s++) {
+    simAdvance(simUs(1));
+    for (int i = 0; i < count; i++) high[i] += simPinLevel(pwmPins[i]) == HIGH;
+  }
+  double worst = 0;
+  for (int i = 0; i < count; i++) {
+    double shown = 255.0 * high[i] / samples;
+    double err = fabs(shown - gammaDuty(levelOf(i)));
+    if (err > worst) worst = err;
+  }
+  return worst;
+}
+
+struct Cost {
+  double cyclesPerFrame;  // emulated
+  uint64_t longest;       // emulated cycles of the longest interrupt
+  double hostNs;          // bit 7 interrupt on this PC
+};
+
+static Cost measure(int count) {
+  attach(count);
+  for (int i = 0; i < count; i++) softPwmPulse(i, 0, 255, 1000);  // every channel fading
+  simResetIsrStats();
+  simAdvance(simUs(FRAMES * SOFTPWM_FRAME_US));
+  const SimIsrStats &s = simIsrStats(SIM_TIMER2_COMPA);
+  Cost cost;
+  cost.cyclesPerFrame = s.cycles / (s.calls / 8.0);
+  cost.longest = s.maxCycles;
+
+  // The bit 7 handler alone, called straight in with the timer stopped
+  TIMSK2 = 0;
+  cli();
+  cost.hostNs = 1e9;
+  for (int run = 0; run < HOST_RUNS; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < HOST_FRAMES; f++) {
+      softPwmBit = 6;
+      TIMER2_COMPA_vect();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / HOST_FRAMES;
+    if (ns < cost.hostNs) cost.hostNs = ns;
+  }
+  sei();
+  return cost;
+}
+
+int main() {
+  // Sketch 8: up for 2.55 s, then back down
+  setup();
+  simRunLoop(1275);
+  bool rising = softPwmChannel[ledChannel].step > 0 && softPwmChannel[ledChannel].level > 100 << 8;
+  simRunLoop(2550);
+  bool falling = softPwmChannel[ledChannel].step < 0 && softPwmChannel[ledChannel].level > 100 << 8;
+  printf("sketch 8: LED on pin %d %s, then %s\n", led, rising ? "rising" : "not rising", falling ? "falling" : "not falling");
+
+  // Duty on the pins with every channel in use
+  attach(SOFTPWM_CHANNELS);
+  double dutyErr = dutyError(SOFTPWM_CHANNELS);
+  printf("%d channels, %d frames sampled every us: worst duty error %.2f / 255\n", SOFTPWM_CHANNELS, FRAMES, dutyErr);
+
+  // A fade, with nothing but time passing
+  attach(1);
+  softPwmSet(0, 0);
+  softPwmFade(0, 255, 1000);
+  simAdvance(simMs(600));
+  bool midFade = softPwmFading(0) && softPwmChannel[0].level > 0 && softPwmChannel[0].level < 255 << 8;
+  simAdvance(simMs(500));
+  bool fadeDone = !softPwmFading(0) && softPwmChannel[0].level == 255 << 8;
+
+  // Cost per channel count
+  printf("channels  ports  cycles/frame  CPU    longest ISR  host ns, bit 7\n");
+  Cost first = {0, 0, 0}, last = {0, 0, 0};
+  double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;  // straight line through the host times
+  for (int count = 1; count <= SOFTPWM_CHANNELS; count++) {
+    Cost c = measure(count);
+    sumX += count;
+    sumY += c.hostNs;
+    sumXY += count * c.hostNs;
+    sumXX += count * count;
+    double cpu = c.cyclesPerFrame / (SOFTPWM_FRAME_US * SIM_CYCLES_PER_US);
+    printf("%8d  %5d  %12.0f  %4.2f%%  %11llu  %15.0f\n", count, softPwmPorts, c.cyclesPerFrame, cpu * 100,
+           (unsigned long long)c.longest, c.hostNs);
+    if (count == 1) first = c;
+    last = c;
+  }
+  int n = SOFTPWM_CHANNELS;
+  double perChannel = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+  double fixed = (sumY - perChannel * sumX) / n;
+  printf("host, bit 7 interrupt: %.0f ns fixed, %.1f ns per channel\n", fixed, perChannel);
+
+  check(dutyErr <= 1.5, "every pin shows its gamma duty (worst %.2f / 255)", dutyErr);
+  check(rising && falling, "sketch 8's LED breathes with an empty loop()");
+  check(midFade && fadeDone, "a fade runs to its level and stops");
+  check(last.cyclesPerFrame <= first.cyclesPerFrame,
+        "no register work per channel (%.0f cycles per frame with 1, %.0f with %d)",
+        first.cyclesPerFrame, last.cyclesPerFrame, SOFTPWM_CHANNELS);
+  check(perChannel > 0 && last.hostNs < SOFTPWM_CHANNELS * first.hostNs,
+        "each channel adds a little to the frame, %d cost less than %d times one",
+        SOFTPWM_CHANNELS, SOFTPWM_CHANNELS);
+  return checkResult();
+}
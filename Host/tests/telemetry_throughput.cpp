@@ -0,0 +1,202 @@
+// telemetry_throughput.cpp - speed readings over 9600 baud, text vs Telemetry.h
+//
+//   telemetry_throughput <path to telemetry2csv>
+//
+// The pot of "9. Potentiometer (Speed)" sweeps 0..200 km/h and back every
+// SWEEP_MS. Three runs of RUN_MS each, all at 9600 baud:
+//   - text: the sketch's old loop() ("Speed: 123 km/h" per line) with its
+//     delay() taken out, so it prints as fast as the port lets it;
+//   - the sketch as shipped: a sample every 5 ms through Telemetry.h;
+//   - flat out: the same with a sample every ms, more than the port can
+//     carry, so whole records are dropped and counted.
+// The binary captures are decoded by Tools/telemetry2csv. Samples per
+// second are what reached the PC; the longest loop() pass shows how long
+// the sketch was held up by the serial port.
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../9. Potentiometer (Speed).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS        60000
+#define SWEEP_MS      20000.0  // 0 -> 200 km/h -> 0
+#define FLAT_OUT_MS   1
+
+static int potLevel() {
+  double phase = fmod(simNowMs(), SWEEP_MS) / SWEEP_MS;
+  return (int)lround(1023 * (phase < 0.5 ? 2 * phase : 2 - 2 * phase));
+}
+
+static double speedAt(double ms) {
+  double phase = fmod(ms, SWEEP_MS) / SWEEP_MS;
+  return 200 * (phase < 0.5 ? 2 * phase : 2 - 2 * phase);
+}
+
+// The loop() of 9 before Telemetry.h, without its delay(200)
+static void textLoop() {
+  speedValue = adcRead(potChannel);
+  int speed = map(speedValue, 0, ADC_MAX, 0, 200);
+  Serial.print("Speed: ");
+  Serial.print(speed);
+  Serial.println(" km/h");
+}
+
+// The sketch's loop() with a sample every FLAT_OUT_MS; every record made
+// is kept by sequence number so the decoded values can be compared
+static std::map<uint16_t, std::vector<int>> made;
+static unsigned long flatOutAdded = 0;
+
+static void flatOutLoop() {
+  if (millis() - lastSample >= FLAT_OUT_MS) {
+    lastSample += FLAT_OUT_MS;
+    speedValue = adcRead(potChannel);
+    int speed = map(speedValue, 0, ADC_MAX, 0, 200);
+    TelemetryStream &s = telemetryStream[SPEED_STREAM];
+    if (s.count == TELEMETRY_BATCH - 1) {
+      std::vector<int> &batch = made[telemetrySeq];
+      batch.assign(s.samples, s.samples + s.count);
+      batch.push_back(speed);
+    }
+    telemetryAdd(SPEED_STREAM, speed);
+    flatOutAdded++;
+  }
+  telemetryPump();
+}
+
+struct Run {
+  size_t firstByte, lastByte;  // range in simUartSent()
+  uint64_t longestPass;        // cycles
+};
+
+static Run run(void (*body)()) {
+  Run r;
+  r.firstByte = simUartSent().size();
+  r.longestPass = 0;
+  uint64_t end = simCycles() + simMs(RUN_MS);
+  while (simCycles() < end) {
+    uint64_t start = simCycles();
+    body();
+    simCharge(simLoopCycles);
+    if (simCycles() - start > r.longestPass) r.longestPass = simCycles() - start;
+  }
+  r.lastByte = simUartSent().size();
+  return r;
+}
+
+// Let the port send what is still queued; only Telemetry.h needs pumping
+static void drain(bool pump) {
+  uint64_t end = simCycles() + simMs(1000);
+  while (simCycles() < end) {
+    if (pump) telemetryPump();
+    simCharge(simLoopCycles);
+  }
+}
+
+struct Row {
+  int stream, seq;
+  double timeMs;
+  int value;
+};
+
+// Bytes sent during 'r' (and its drain) through telemetry2csv
+static bool decode(const char *tool, const Run &r, size_t drainedTo, const char *file, std::vector<Row> &rows) {
+  FILE *f = fopen(file, "wb");
+  if (!f) return false;
+  const std::vector<SimUartByte> &sent = simUartSent();
+  for (size_t i = r.firstByte; i < drainedTo; i++) fputc(sent[i].value, f);
+  fclose(f);
+
+  std::string cmd = std::string("'") + tool + "' " + file + " 2>/dev/null";
+  FILE *p = popen(cmd.c_str(), "r");
+  if (!p) return false;
+  char line[128];
+  bool header = fgets(line, sizeof(line), p) && strncmp(line, "stream,seq,time_ms,value", 24) == 0;
+  Row row;
+  while (fgets(line, sizeof(line), p)) {
+    if (sscanf(line, "%d,%d,%lf,%d", &row.stream, &row.seq, &row.timeMs, &row.value) == 4) rows.push_back(row);
+  }
+  return pclose(p) == 0 && header;
+}
+
+static double perSecond(double count) {
+  return count / (RUN_MS / 1000.0);
+}
+
+static double passMs(const Run &r) {
+  return r.longestPass / (double)simMs(1);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <path to telemetry2csv>\n", argv[0]);
+    return 2;
+  }
+  const char *tool = argv[1];
+  simSetAnalog(potPin, potLevel);
+
+  // Text, as fast as 9600 baud goes
+  setup();
+  simAdvance(simMs(50));  // first oversampled readings in
+  Run text = run(textLoop);
+  unsigned long lines = 0;
+  const std::vector<SimUartByte> &sent = simUartSent();
+  for (size_t i = text.firstByte; i < text.lastByte; i++) lines += sent[i].value == '\n';
+  drain(false);
+
+  // The sketch as shipped
+  lastSample = millis();
+  Run shipped = run(loop);
+  unsigned long shippedDropped = telemetryDropped;
+  drain(true);
+  std::vector<Row> shippedRows;
+  bool shippedDecoded = decode(tool, shipped, simUartSent().size(), "telemetry_shipped.bin", shippedRows);
+  double worstSpeed = 0;
+  for (const Row &row : shippedRows) {
+    double err = fabs(row.value - speedAt(row.timeMs));
+    if (err > worstSpeed) worstSpeed = err;
+  }
+
+  // Flat out: more samples than the port carries
+  telemetryFlush(SPEED_STREAM);
+  drain(true);
+  unsigned long droppedBefore = telemetryDropped;
+  lastSample = millis();
+  Run flatOut = run(flatOutLoop);
+  unsigned long flatOutDropped = telemetryDropped - droppedBefore;
+  drain(true);
+  std::vector<Row> flatOutRows;
+  bool flatOutDecoded = decode(tool, flatOut, simUartSent().size(), "telemetry_flat_out.bin", flatOutRows);
+  unsigned long wrongValues = 0;
+  std::map<uint16_t, int> rowInRecord;
+  for (const Row &row : flatOutRows) {
+    int i = rowInRecord[row.seq]++;
+    auto it = made.find(row.seq);
+    if (it == made.end() || i >= (int)it->second.size() || it->second[i] != row.value) wrongValues++;
+  }
+  unsigned long unsent = telemetryStream[SPEED_STREAM].count;  // last part-filled batch
+
+  printf("%d s at 9600 baud, speed sweeping 0..200 km/h every %.0f s\n", RUN_MS / 1000, SWEEP_MS / 1000);
+  printf("text lines:        %6.1f samples/s, longest loop() pass %6.2f ms\n", perSecond(lines), passMs(text));
+  printf("Telemetry, 5 ms:   %6.1f samples/s, longest loop() pass %6.2f ms, %lu dropped, worst error %.1f km/h\n",
+         perSecond(shippedRows.size()), passMs(shipped), shippedDropped, worstSpeed);
+  printf("Telemetry, 1 ms:   %6.1f samples/s, longest loop() pass %6.2f ms, %lu of %lu dropped (%.1fx text)\n",
+         perSecond(flatOutRows.size()), passMs(flatOut), flatOutDropped, flatOutAdded,
+         (double)flatOutRows.size() / lines);
+
+  check(shippedDecoded && flatOutDecoded, "telemetry2csv decoded both captures");
+  check(shippedDropped == 0 && shippedRows.size() >= RUN_MS / SAMPLE_MS - TELEMETRY_BATCH,
+        "the shipped sketch gets every 5 ms sample through (%zu)", shippedRows.size());
+  check(worstSpeed <= 3, "decoded speeds follow the pot (worst %.1f km/h off)", worstSpeed);
+  check(wrongValues == 0, "every decoded sample is the one sent (%lu wrong)", wrongValues);
+  check(flatOutRows.size() + flatOutDropped + unsent == flatOutAdded, "every sample arrives or is counted as dropped");
+  check(flatOutRows.size() >= 10 * lines, "at least 10x the samples of the text lines (%.1fx)",
+        (double)flatOutRows.size() / lines);
+  check(passMs(flatOut) < 1 && passMs(shipped) < 1, "loop() never waits for the port");
+  check(passMs(text) > 10, "the text loop does (%.1f ms)", passMs(text));
+  return checkResult();
+}
@@ -0,0 +1,227 @@
+// timer_wheel.cpp - TimerWheel.h with 1,000 timers running
+//
+// 1,000 timers with random delays up to 100 s (past the 65 s the default
+// wheel covers in one pass, so parking is exercised too): most periodic,
+// the rest one-shots that restart themselves from their callback, and a
+// random timer moved (restarted) every RESTART_EVERY ticks. The wheel is
+// driven tick by tick from a test clock for TICKS ms. Every callback checks
+// that it runs on exactly the tick its timer was due, and at the end no
+// timer may be left overdue.
+//
+// Cost is counted in the wheel's own operations through TIMER_WHEEL_COUNT,
+// so the checks give the same answer on any machine and under any load:
+//   - slots looked at per tick, which must not depend on the timer count;
+//   - links (a timer put in a slot: start, re-arm or cascade) per time a
+//     timer is given a new expiry, which stay under one per wheel level
+//     whatever the count (they rise a little with it only because with
+//     few timers most are moved by the test before they cascade);
+//   - the same 1,000 timers kept in an array, as a sketch juggling
+//     several millis() deadlines does, costs one compare per timer per
+//     tick;
+//   - start() + cancel() of one timer must be exactly one link.
+// The time per tick on this PC is printed too, for reference only.
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+
+struct WheelWork {
+  unsigned long slots, links;
+};
+static WheelWork work;
+#define TIMER_WHEEL_COUNT(counter) (work.counter++)
+#include <TimerWheel.h>
+#include "Sim.h"
+#include "Check.h"
+
+#define TIMERS     1000
+#define TICKS      1000000UL
+#define MAX_DELAY  100000    // ms
+#define RESTARTS   1000000
+#define RESTART_EVERY 20     // ticks between two timers moved by the test
+#define LEVELS     4         // of the default TimerWheel
+
+static unsigned long testNow = 0;
+static unsigned long testClock() { return testNow; }
+
+struct Expected {
+  unsigned long due;
+  unsigned long period;  // as passed to start()
+  unsigned long fired;
+};
+
+static std::mt19937 rng(2121);
+static std::uniform_int_distribution<unsigned long> delayMs(1, MAX_DELAY);
+static TimerWheel *wheel;
+static unsigned long wrongTick = 0, firings = 0, overdue = 0;
+
+static void onTimer(Timer &timer) {
+  Expected &e = *(Expected *)timer.context;
+  if (testNow != e.due) wrongTick++;
+  e.fired++;
+  firings++;
+  if (e.period) {
+    e.due += e.period;  // already back in the wheel
+  } else {
+    unsigned long d = delayMs(rng);
+    e.due = testNow + d;
+    wheel->start(timer, d);
+  }
+}
+
+struct Bench {
+  std::vector<Timer> timers;
+  std::vector<Expected> expected;
+};
+
+static void startAll(TimerWheel &w, Bench &b, int count) {
+  std::uniform_int_distribution<int> percent(0, 99);
+  b.timers.assign(count, Timer(onTimer));
+  b.expected.assign(count, Expected{0, 0, 0});
+  for (int i = 0; i < count; i++) {
+    b.timers[i].context = &b.expected[i];
+    unsigned long d = delayMs(rng);
+    unsigned long period = percent(rng) < 70 ? delayMs(rng) : 0;
+    b.expected[i].due = testNow + d;
+    b.expected[i].period = period;
+    w.start(b.timers[i], d, period);
+  }
+}
+
+// One run: update(), the callbacks, and the timers the test moves
+struct Run {
+  unsigned long ticks;
+  unsigned long schedules;  // times a timer got a new expiry
+  unsigned long firings;
+  WheelWork work;
+  double ns;                // per tick on this PC, for reference
+};
+
+static Run runWheel(int count, unsigned long ticks) {
+  TimerWheel w(testClock);
+  wheel = &w;
+  Bench b;
+  work = WheelWork{0, 0};
+  unsigned long firedBefore = firings;
+  startAll(w, b, count);
+  std::uniform_int_distribution<int> pick(0, count - 1);
+  std::vector<std::pair<int, unsigned long>> moves(ticks / RESTART_EVERY);  // timer, delay
+  for (auto &m : moves) m = {pick(rng), delayMs(rng)};
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long t = 0; t < ticks; t++) {
+    if (t % RESTART_EVERY == 0) {
+      const std::pair<int, unsigned long> &m = moves[t / RESTART_EVERY];
+      Expected &e = b.expected[m.first];
+      e.due = testNow + m.second;
+      w.start(b.timers[m.first], m.second, e.period);
+    }
+    testNow++;
+    w.update();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  for (const Expected &e : b.expected) {
+    if ((long)(e.due - testNow) <= 0) overdue++;
+  }
+  Run r;
+  r.ticks = ticks;
+  r.firings = firings - firedBefore;
+  // Each firing re-arms a periodic timer or restarts a one-shot
+  r.schedules = count + moves.size() + r.firings;
+  r.work = work;
+  r.ns = ns / ticks;
+  return r;
+}
+
+static double slotsPerTick(const Run &r) {
+  return r.work.slots / (double)r.ticks;
+}
+
+static double linksPerSchedule(const Run &r) {
+  return r.work.links / (double)r.schedules;
+}
+
+static double workPerTick(const Run &r) {
+  return (r.work.slots + r.work.links) / (double)r.ticks;
+}
+
+// The same deadlines in an array, every one compared on every tick
+struct Deadline {
+  unsigned long due, period;
+};
+
+static double runScan(int count, unsigned long ticks) {
+  std::vector<Deadline> deadlines(count);
+  for (Deadline &d : deadlines) d = {testNow + delayMs(rng), delayMs(rng)};
+  volatile unsigned long fired = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long t = 0; t < ticks; t++) {
+    testNow++;
+    for (Deadline &d : deadlines) {
+      if ((long)(testNow - d.due) >= 0) {
+        d.due += d.period;
+        fired = fired + 1;
+      }
+    }
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ticks;
+}
+
+int main() {
+  // Correctness and cost with 1,000 timers
+  Run base = runWheel(TIMERS, TICKS);
+  unsigned long wrong = wrongTick;
+
+  printf("%d timers, %lu ticks: %lu callbacks, %lu on the wrong tick\n", TIMERS, TICKS, base.firings, wrong);
+  printf("per tick: %.3f slots looked at, %.3f links (%.1f ns on this PC)\n",
+         slotsPerTick(base), base.work.links / (double)TICKS, base.ns);
+
+  printf("timers   slots/tick   links/expiry   callbacks/tick   ns/tick\n");
+  double minSlots = 1e9, maxSlots = 0, minLinks = 1e9, maxLinks = 0;
+  for (int count = 10; count <= 10000; count *= 10) {
+    Run r = runWheel(count, TICKS / 4);
+    printf("%6d   %10.4f   %12.3f   %14.4f   %7.1f\n", count, slotsPerTick(r), linksPerSchedule(r),
+           r.firings / (double)r.ticks, r.ns);
+    minSlots = std::min(minSlots, slotsPerTick(r));
+    maxSlots = std::max(maxSlots, slotsPerTick(r));
+    minLinks = std::min(minLinks, linksPerSchedule(r));
+    maxLinks = std::max(maxLinks, linksPerSchedule(r));
+  }
+
+  // The array compares every deadline on every tick
+  double scan = runScan(TIMERS, TICKS / 4);
+  printf("array of %d deadlines: %d compares per tick, %.0fx the wheel's %.3f operations (%.1f ns on this PC)\n",
+         TIMERS, TIMERS, TIMERS / workPerTick(base), workPerTick(base), scan);
+
+  // start() + cancel() of one timer among 1,000
+  TimerWheel w(testClock);
+  wheel = &w;
+  Bench b;
+  startAll(w, b, TIMERS);
+  std::uniform_int_distribution<int> pick(0, TIMERS - 1);
+  std::vector<std::pair<int, unsigned long>> order(RESTARTS);  // timer, delay
+  for (auto &o : order) o = {pick(rng), delayMs(rng)};
+  work = WheelWork{0, 0};
+  for (const auto &o : order) {
+    w.start(b.timers[o.first], o.second);
+    w.cancel(b.timers[o.first]);
+  }
+  WheelWork restart = work;
+  printf("start() + cancel(): %.3f links, %.3f slots looked at\n",
+         restart.links / (double)RESTARTS, restart.slots / (double)RESTARTS);
+
+  check(base.firings > TICKS * TIMERS / MAX_DELAY / 2, "timers fired (%lu)", base.firings);
+  check(wrongTick == 0, "every callback on its timer's tick, in every run (%lu wrong)", wrongTick);
+  check(overdue == 0, "no timer left overdue (%lu)", overdue);
+  check(maxSlots - minSlots < 0.001 && maxSlots < 1.1,
+        "a tick looks at the same slots with 10 or 10,000 timers (%.4f per tick)", maxSlots);
+  check(maxLinks <= LEVELS, "a timer is linked at most once per level on average (%.2f .. %.2f per expiry)",
+        minLinks, maxLinks);
+  check(workPerTick(base) * 100 < TIMERS, "update() does under 1%% of the work of scanning %d deadlines", TIMERS);
+  check(restart.links == RESTARTS && restart.slots == 0, "start() + cancel() is one link");
+  return checkResult();
+}
@@ -0,0 +1,198 @@
+// traffic_demand.cpp - Project 3 with random traffic, fixed vs adaptive
+//
+//   traffic_demand_fixed               the sketch as shipped (VEHICLE_SENSORS 0)
+//   traffic_demand <traffic_demand_fixed>   VEHICLE_SENSORS 1, compared with it
+//
+// Vehicles arrive at each road as a Poisson process, a different rate per
+// road (one busy road, two quieter ones, one nearly empty), never closer
+// than FOLLOW_MS so that the detector sees each vehicle. Each arrival
+// passes over its road's detector, which is wired into the R-2R ladder on
+// A5. A road discharges its queue while green, one vehicle per HEADWAY_MS
+// (the headway greenPerVehicle is sized for). Both builds see exactly the
+// same arrivals; each reports per road the mean wait from arrival to
+// departure and the vehicles served per hour, plus the share of green
+// time shown to an empty road.
+
+#include <deque>
+#include <random>
+
+#include <Arduino.h>
+#include "../../Project 3 (Traffic Lighting).cpp"
+#include "Sim.h"
+#include "Check.h"
+
+#define RUN_MS       (2 * 3600000UL)  // two hours
+#define HEADWAY_MS   1500             // one vehicle leaves per headway while green
+#define PULSE_MS     300              // time a vehicle spends on the detector
+#define FOLLOW_MS    1000             // shortest gap between two vehicles
+
+static const double arrivalsPerMin[NUM_ROADS] = {3.0, 1.5, 1.0, 0.3};
+
+struct Road {
+  std::vector<double> arrivals;     // ms, generated up front
+  size_t next = 0;                  // next arrival to happen
+  std::deque<double> queue;         // arrival times of waiting vehicles
+  double detectorUntil = 0;         // detector occupied until then
+  double greenSince = -1;           // -1 when not green
+  double lastDeparture = 0;
+  unsigned long served = 0;
+  double totalWait = 0;
+  double greenMs = 0, idleGreenMs = 0;
+};
+
+static Road roads[NUM_ROADS];
+
+#if VEHICLE_SENSORS
+// Detector ladder on A5: bit i HIGH while road i's detector is free
+static int ladderLevel() {
+  double now = simNowMs();
+  int code = 0;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    if (now >= roads[i].detectorUntil) code |= 1 << i;
+  }
+  return code * 64;  // code / 16 of the 10-bit range
+}
+#endif
+
+// Move the traffic on by one loop pass
+static void traffic(double now, double passMs) {
+  for (int i = 0; i < NUM_ROADS; i++) {
+    Road &r = roads[i];
+    while (r.next < r.arrivals.size() && r.arrivals[r.next] <= now) {
+      r.queue.push_back(r.arrivals[r.next]);
+      r.detectorUntil = r.arrivals[r.next] + PULSE_MS;
+      r.next++;
+    }
+
+    bool green = simPinLevel(greenPins[i]) == HIGH;
+    if (!green) {
+      r.greenSince = -1;
+      continue;
+    }
+    if (r.greenSince < 0) r.greenSince = now;
+    r.greenMs += passMs;
+    if (r.queue.empty()) r.idleGreenMs += passMs;
+
+    // The first vehicle needs a headway to get going, then one per headway
+    double ready = std::max(r.greenSince, r.lastDeparture) + HEADWAY_MS;
+    if (!r.queue.empty() && now >= ready) {
+      r.totalWait += now - r.queue.front();
+      r.queue.pop_front();
+      r.served++;
+      r.lastDeparture = now;
+    }
+  }
+}
+
+struct Result {
+  double meanWaitS[NUM_ROADS];
+  double perHour[NUM_ROADS];
+  double idleGreen;  // share of green time with nobody waiting
+};
+
+static Result run() {
+  std::mt19937 rng(1818);
+  for (int i = 0; i < NUM_ROADS; i++) {
+    // Shifted exponential gaps: same mean rate, no two vehicles on the detector at once
+    std::exponential_distribution<double> gap(1 / (60000.0 / arrivalsPerMin[i] - FOLLOW_MS));
+    for (double t = gap(rng); t < RUN_MS; t += FOLLOW_MS + gap(rng)) roads[i].arrivals.push_back(t);
+  }
+
+#if VEHICLE_SENSORS
+  simSetAnalog(DETECTOR_PIN, ladderLevel);
+#endif
+  simLoopCycles = 16000;  // 1 ms per pass: plenty for lamps changing every few s
+  setup();
+
+  double last = simNowMs();
+  while (simNowMs() < RUN_MS) {
+    loop();
+    simCharge(simLoopCycles);
+    double now = simNowMs();
+    traffic(now, now - last);
+    last = now;
+  }
+
+  Result res;
+  double green = 0, idle = 0;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    const Road &r = roads[i];
+    // Vehicles still waiting at the end count with the wait so far
+    double wait = r.totalWait;
+    for (double a : r.queue) wait += RUN_MS - a;
+    unsigned long vehicles = r.served + r.queue.size();
+    res.meanWaitS[i] = vehicles ? wait / vehicles / 1000 : 0;
+    res.perHour[i] = r.served / (RUN_MS / 3600000.0);
+    green += r.greenMs;
+    idle += r.idleGreenMs;
+  }
+  res.idleGreen = idle / green;
+  return res;
+}
+
+static void print(const char *name, const Result &res) {
+  printf("%-9s", name);
+  for (int i = 0; i < NUM_ROADS; i++) printf("  road %d: wait %5.1f s, %5.1f/h", i, res.meanWaitS[i], res.perHour[i]);
+  printf("  | empty green %2.0f%%\n", res.idleGreen * 100);
+}
+
+#if VEHICLE_SENSORS
+// Read the fixed build's result line back
+static bool runFixed(const char *path, Result &res) {
+  FILE *p = popen(path, "r");
+  if (!p) return false;
+  char line[512];
+  bool found = false;
+  while (fgets(line, sizeof(line), p)) {
+    if (strncmp(line, "fixed", 5) != 0) continue;
+    const char *c = line;
+    for (int i = 0; i < NUM_ROADS; i++) {
+      c = strstr(c, "wait");
+      if (!c || sscanf(c, "wait %lf s, %lf/h", &res.meanWaitS[i], &res.perHour[i]) != 2) return false;
+      c++;
+    }
+    c = strstr(c, "empty green");
+    found = c && sscanf(c, "empty green %lf%%", &res.idleGreen) == 1;
+    res.idleGreen /= 100;
+  }
+  return pclose(p) == 0 && found;
+}
+#endif
+
+int main(int argc, char **argv) {
+  printf("arrivals per minute:");
+  for (int i = 0; i < NUM_ROADS; i++) printf(" road %d %.1f", i, arrivalsPerMin[i]);
+  printf(", %lu h simulated\n", RUN_MS / 3600000UL);
+
+  Result res = run();
+#if !VEHICLE_SENSORS
+  (void)argc;
+  (void)argv;
+  print("fixed", res);
+  return 0;
+#else
+  Result fixed;
+  bool baseline = argc > 1 && runFixed(argv[1], fixed);
+  if (baseline) print("fixed", fixed);
+  print("adaptive", res);
+
+  check(baseline, "fixed-cycle baseline ran");
+  if (!baseline) return checkResult();
+  double fixedTotal = 0, adaptiveTotal = 0, fixedServed = 0, adaptiveServed = 0;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    fixedTotal += fixed.meanWaitS[i] * fixed.perHour[i];
+    adaptiveTotal += res.meanWaitS[i] * res.perHour[i];
+    fixedServed += fixed.perHour[i];
+    adaptiveServed += res.perHour[i];
+  }
+  double fixedMean = fixedTotal / fixedServed, adaptiveMean = adaptiveTotal / adaptiveServed;
+  printf("mean wait over all vehicles: fixed %.1f s, adaptive %.1f s\n", fixedMean, adaptiveMean);
+
+  check(adaptiveServed >= fixedServed * 0.99, "adaptive serves as many vehicles (%.0f/h vs %.0f/h)",
+        adaptiveServed, fixedServed);
+  check(adaptiveMean < fixedMean, "adaptive cuts the mean wait");
+  check(res.idleGreen < fixed.idleGreen, "adaptive wastes less green on empty roads");
+  check(!failSafe, "interlock never tripped");
+  return checkResult();
+#endif
+}
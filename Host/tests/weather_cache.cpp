@@ -0,0 +1,120 @@
+// weather_cache.cpp - flash cost of the Weather Node's forecast cache
+//
+//   weather_cache <One Call response>
+//
+// The binary cache (writeCache()/readCache(): a CRC-checked header and the
+// RemoteWeather record, written to a temporary file and renamed) against
+// the raw JSON cache it replaced, which stored the whole response on every
+// fetch and parsed it back into a 4 KB document at boot. The old code is
+// gone, so the JSON side is replayed here with the same file calls on the
+// same simulated flash (Host/esp32/Devices.cpp: 0.3 ms per open or rename,
+// 0.7 ms per 256-byte page programmed, 100 ns per byte read).
+//
+// One day: the sketch runs for 24 simulated hours against a forecast
+// server whose ETag changes before every fetch, so all 96 fetches return
+// a new body and rewrite the cache, the worst case for wear. The JSON
+// figure per day is the same count of whole-body writes.
+//
+// One boot: the time to read the cache back, which is what stands between
+// power-up and a forecast on the screen. The stand-in charges no CPU time,
+// so the JSON parse is not in its figure.
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#include <fstream>
+#include <sstream>
+
+#define DAY_US        (24ULL * 3600 * 1000000)
+#define OLD_JSON_FILE "/old_cache.json"
+#define OLD_DOC_SIZE  4096
+
+static StaticJsonDocument<OLD_DOC_SIZE> oldDoc;
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <One Call response>\n", argv[0]);
+    return 2;
+  }
+  std::ifstream file(argv[1]);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string body = contents.str();
+
+  // ---- One day ----
+  SimHttpServer api;
+  api.body = body;
+  api.etag = "\"0\"";
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+  for (unsigned i = 1; i < 24 * 4; i++) {
+    // Just before each fetch, after the first at boot
+    simAt(simSeconds(i * FETCH_INTERVAL_SECONDS - 30), [&api, i] { api.etag = "\"" + std::to_string(i) + "\""; });
+  }
+  simRun(DAY_US);
+
+  SimFlashStats day = simFlashStats();
+  unsigned long fetches = 0;
+  for (const SimHttpServer::Request &r : api.requests) {
+    if (r.status == HTTP_CODE_OK) fetches++;
+  }
+  uint64_t cacheBytes = day.bytesWrittenTo[CACHE_TMP_FILE];
+  uint64_t jsonBytes = (uint64_t)fetches * body.size();
+  printf("one day, %lu new forecasts: cache %llu bytes written (JSON cache: %llu), spool %llu bytes\n", fetches,
+         (unsigned long long)cacheBytes, (unsigned long long)jsonBytes,
+         (unsigned long long)day.bytesWrittenTo[SPOOL_FILE]);
+  check(fetches >= 95, "a new forecast at every fetch (%lu)", fetches);
+  check(cacheBytes == fetches * (sizeof(CacheHeader) + sizeof(RemoteWeather)), "one %u-byte record per fetch",
+        (unsigned)(sizeof(CacheHeader) + sizeof(RemoteWeather)));
+  check(cacheBytes * 20 < jsonBytes, "cache writes under 5%% of the JSON cache's (%.1f%%)",
+        100.0 * cacheBytes / jsonBytes);
+
+  // ---- One boot ----
+  RemoteWeather cached;
+  bool cacheOk = false;
+  double binReadMs = 0, binWriteMs = 0, jsonReadMs = 0, jsonWriteMs = 0;
+  uint64_t binReadBytes = 0;
+  DeserializationError oldErr;
+  simRunTask([&] {
+    double t0 = simNowMs();
+    uint64_t read0 = simFlashStats().bytesRead;
+    cacheOk = readCache(cached);
+    binReadMs = simNowMs() - t0;
+    binReadBytes = simFlashStats().bytesRead - read0;
+
+    t0 = simNowMs();
+    writeCache(cached);
+    binWriteMs = simNowMs() - t0;
+
+    // The old cache: the raw body in one write, read back whole and parsed
+    t0 = simNowMs();
+    File f = LittleFS.open(OLD_JSON_FILE, "w");
+    f.write((const uint8_t *)body.data(), body.size());
+    f.close();
+    jsonWriteMs = simNowMs() - t0;
+
+    t0 = simNowMs();
+    static char readBack[64 * 1024];
+    f = LittleFS.open(OLD_JSON_FILE, "r");
+    size_t n = f.read((uint8_t *)readBack, sizeof(readBack));
+    f.close();
+    jsonReadMs = simNowMs() - t0;
+    oldErr = deserializeJson(oldDoc, readBack, n);
+  }, simNowUs() + simSeconds(60));
+
+  printf("binary cache: read %.2f ms (%llu bytes), write %.2f ms\n", binReadMs, (unsigned long long)binReadBytes,
+         binWriteMs);
+  printf("JSON cache:   read %.2f ms (%u bytes), write %.2f ms, parse into %d bytes: %s\n", jsonReadMs,
+         (unsigned)body.size(), jsonWriteMs, OLD_DOC_SIZE, oldErr.c_str());
+  check(cacheOk && cached.hourlyCount == FORECAST_HOURS && cached.dailyCount == FORECAST_DAYS,
+        "binary cache read back whole (%u hours, %u days)", cached.hourlyCount, cached.dailyCount);
+  check(binReadMs < jsonReadMs, "binary read faster (%.2f ms vs %.2f ms)", binReadMs, jsonReadMs);
+  check(binWriteMs < jsonWriteMs, "binary write faster (%.2f ms vs %.2f ms)", binWriteMs, jsonWriteMs);
+  check(oldErr == DeserializationError::NoMemory, "the old 4 KB document could not hold the response (%s)",
+        oldErr.c_str());
+
+  return checkResult();
+}
@@ -0,0 +1,78 @@
+// weather_display.cpp - I2C traffic of the Weather Node's screen updates
+//
+// Runs Project 2 for RUN_MIN simulated minutes on the ESP32 stand-in. The
+// BME280 model's temperature rises 0.05 C a minute, so the local reading
+// on the screen changes at every sample, and the forecast server answers
+// 304 after the first fetch, so the forecast rows stay as they are. The
+// SSD1306 model parses the command and data stream into its own display
+// RAM, so the test sees what reached the panel, not what the sketch meant
+// to send.
+//
+// Steady state (after the first STEADY_FROM_MIN minutes): data bytes sent
+// to the panel per minute, against a full display() push per redraw, the
+// way renderDisplay() used to work; the full push is measured on the same
+// bus at the end. At the end the panel's RAM must equal the framebuffer.
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define RUN_MIN         60
+#define STEADY_FROM_MIN 5
+#define MINUTE_US       (60ULL * 1000000)
+
+static const char FORECAST[] =
+    "{\"current\":{\"temp\":29.5,\"weather\":[{\"description\":\"scattered clouds\"}]},"
+    "\"hourly\":[{\"temp\":29.1},{\"temp\":28.7},{\"temp\":28.2}],"
+    "\"daily\":[{\"temp\":{\"min\":24.9,\"max\":31.2}},{\"temp\":{\"min\":25.1,\"max\":30.8}}]}";
+
+int main() {
+  SimHttpServer api;
+  api.body = FORECAST;
+  api.etag = "\"1\"";
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+  simBme280().keepConversionTimes = true;
+
+  for (int m = 1; m < RUN_MIN; m++) {
+    simAt(m * MINUTE_US, [] { simBme280().temperature += 0.05F; });
+  }
+  unsigned long steadyFrom = 0;
+  size_t samplesBefore = 0;
+  simAt(STEADY_FROM_MIN * MINUTE_US, [&] {
+    steadyFrom = simI2cStats().bytesPerAddress[OLED_ADDR];
+    samplesBefore = simBme280().conversionStartsUs.size();
+  });
+
+  simRun(RUN_MIN * MINUTE_US);
+
+  unsigned long steadyBytes = simI2cStats().bytesPerAddress[OLED_ADDR] - steadyFrom;
+  size_t redraws = simBme280().conversionStartsUs.size() - samplesBefore;  // one per sample
+  double minutes = RUN_MIN - STEADY_FROM_MIN;
+
+  // ---- The panel shows the framebuffer ----
+  const SimPanel &panel = simPanel();
+  bool same = memcmp(panel.ram, display.getBuffer(), sizeof(panel.ram)) == 0;
+
+  // ---- A full push, as every redraw used to send ----
+  unsigned long fullPush = 0;
+  simRunTask([&] {
+    unsigned long before = simI2cStats().bytesPerAddress[OLED_ADDR];
+    display.display();
+    fullPush = simI2cStats().bytesPerAddress[OLED_ADDR] - before;
+  }, simNowUs() + simSeconds(10));
+
+  double perMinute = steadyBytes / minutes;
+  double oldPerMinute = fullPush * redraws / minutes;
+  printf("%u redraws in %.0f min: %.0f bytes/min to the panel, full pushes would be %.0f (%lu bytes each)\n",
+         (unsigned)redraws, minutes, perMinute, oldPerMinute, fullPush);
+  check(panel.on, "panel switched on");
+  check(same, "panel RAM equals the framebuffer");
+  check(redraws >= minutes - 1, "a redraw per sample (%u)", (unsigned)redraws);
+  check(perMinute < oldPerMinute * 0.2, "steady traffic cut by over 80%% (%.1f%% of full pushes)",
+        100.0 * perMinute / oldPerMinute);
+
+  return checkResult();
+}
@@ -0,0 +1,266 @@
+// weather_energy.cpp - average current of the Weather Node, awake vs
+// duty-cycled
+//
+//   weather_energy_awake                    DEEP_SLEEP_MODE 0
+//   weather_energy <weather_energy_awake>   DEEP_SLEEP_MODE 1, compared with it
+//
+// Both run the sketch for RUN_HOURS simulated hours against a forecast
+// server and an MQTT broker, and turn the time spent in each power state
+// (SimPowerStats) into an average current with the figures below.
+//
+// A deep sleep ends the process on the chip, so the duty-cycled build
+// runs every boot in a child process forked from a parent that never runs
+// the sketch itself: each child starts from the program's initial state,
+// like a wake-up from deep sleep, and gets back what survives one - RTC
+// memory, the RTC clock, the flash files - plus the power figures so far.
+// When the sketch sleeps, the child sends all of that up a pipe and exits,
+// and the parent starts the next boot the sleep time later. The servers
+// live in the children, so each child also reports what they saw.
+//
+// Current figures, typical, from the ESP32-WROOM-32 datasheet: CPU at
+// 240 MHz with the radio off 40 mA, radio receiving/listening another
+// 80 mA, deep sleep with the RTC timer and RTC memory 10 uA. Modem sleep
+// between beacons is not modelled, which counts the always-on radio high;
+// the OLED and the BME280 are left out of both.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define RUN_HOURS      3
+#define RUN_US         (RUN_HOURS * 3600ULL * 1000000)
+#define CPU_MA         40.0
+#define RADIO_MA       80.0
+#define DEEP_SLEEP_MA  0.010
+#define BATTERY_MAH    2000.0
+
+static const char FORECAST[] =
+    "{\"current\":{\"temp\":29.5,\"weather\":[{\"description\":\"scattered clouds\"}]},"
+    "\"hourly\":[{\"temp\":29.1},{\"temp\":28.7},{\"temp\":28.2}],"
+    "\"daily\":[{\"temp\":{\"min\":24.9,\"max\":31.2}},{\"temp\":{\"min\":25.1,\"max\":30.8}}]}";
+
+struct Result {
+  double mA;           // average over the run
+  double awakeS, radioS, sleepS;
+  unsigned long boots;
+  unsigned long published, fetches;
+};
+
+// Average current from the time spent in each state
+static Result energy(const SimPowerStats &p, unsigned long published, unsigned long fetches) {
+  Result r;
+  r.awakeS = p.awakeUs / 1e6;
+  r.radioS = p.radioUs / 1e6;
+  r.sleepS = p.sleepUs / 1e6;
+  double total = r.awakeS + r.sleepS;
+  r.mA = (CPU_MA * r.awakeS + RADIO_MA * r.radioS + DEEP_SLEEP_MA * r.sleepS) / total;
+  r.boots = p.boots;
+  r.published = published;
+  r.fetches = fetches;
+  return r;
+}
+
+static void print(const char *name, const Result &r) {
+  printf("%-6s %7.2f mA average per hour: awake %6.0f s, radio %6.0f s, asleep %6.0f s, %lu boots,"
+         " %lu messages, %lu forecasts (%.0f days on %.0f mAh)\n",
+         name, r.mA, r.awakeS, r.radioS, r.sleepS, r.boots, r.published, r.fetches,
+         BATTERY_MAH / r.mA / 24, BATTERY_MAH);
+}
+
+static void listen(SimHttpServer &api, SimMqttBroker &broker) {
+  api.body = FORECAST;
+  api.etag = "\"1\"";
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+}
+
+static unsigned long forecasts(const SimHttpServer &api) {
+  unsigned long n = 0;
+  for (const SimHttpServer::Request &r : api.requests) {
+    if (r.status == HTTP_CODE_OK || r.status == HTTP_CODE_NOT_MODIFIED) n++;
+  }
+  return n;
+}
+
+#if DEEP_SLEEP_MODE
+// ---- What survives a deep sleep, sent from each boot to the parent ----
+struct BootState {
+  SimClockState clock;
+  SimPowerStats power;
+  std::vector<uint8_t> rtc;
+  std::map<std::string, std::vector<uint8_t>> files;
+  unsigned long published, fetches;
+  unsigned long timeSyncs;   // boots that waited for NTP
+};
+
+static void writeBytes(int fd, const void *data, size_t size) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (size) {
+    ssize_t n = write(fd, p, size);
+    if (n <= 0) _exit(3);
+    p += n;
+    size -= n;
+  }
+}
+
+static bool readBytes(int fd, void *data, size_t size) {
+  uint8_t *p = (uint8_t *)data;
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static void writeBlob(int fd, const void *data, uint32_t size) {
+  writeBytes(fd, &size, sizeof(size));
+  writeBytes(fd, data, size);
+}
+
+static bool readBlob(int fd, std::vector<uint8_t> &out) {
+  uint32_t size;
+  if (!readBytes(fd, &size, sizeof(size))) return false;
+  out.resize(size);
+  return readBytes(fd, out.data(), size);
+}
+
+static void sendState(int fd, const BootState &s) {
+  writeBytes(fd, &s.clock, sizeof(s.clock));
+  writeBytes(fd, &s.power, sizeof(s.power));
+  writeBytes(fd, &s.published, sizeof(s.published));
+  writeBytes(fd, &s.fetches, sizeof(s.fetches));
+  writeBytes(fd, &s.timeSyncs, sizeof(s.timeSyncs));
+  writeBlob(fd, s.rtc.data(), s.rtc.size());
+  uint32_t count = s.files.size();
+  writeBytes(fd, &count, sizeof(count));
+  for (const auto &f : s.files) {
+    writeBlob(fd, f.first.data(), f.first.size());
+    writeBlob(fd, f.second.data(), f.second.size());
+  }
+}
+
+static bool receiveState(int fd, BootState &s) {
+  uint32_t count;
+  if (!readBytes(fd, &s.clock, sizeof(s.clock)) || !readBytes(fd, &s.power, sizeof(s.power)) ||
+      !readBytes(fd, &s.published, sizeof(s.published)) || !readBytes(fd, &s.fetches, sizeof(s.fetches)) ||
+      !readBytes(fd, &s.timeSyncs, sizeof(s.timeSyncs)) ||
+      !readBlob(fd, s.rtc) || !readBytes(fd, &count, sizeof(count))) {
+    return false;
+  }
+  s.files.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    std::vector<uint8_t> name, data;
+    if (!readBlob(fd, name) || !readBlob(fd, data)) return false;
+    s.files[std::string(name.begin(), name.end())] = data;
+  }
+  return true;
+}
+
+// One boot in a child process; false if it crashed or never slept
+static bool boot(BootState &state, bool first) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    static int out;
+    static BootState s;
+    static SimHttpServer api;
+    static SimMqttBroker broker;
+    out = fds[1];
+    s = state;
+    listen(api, broker);
+    simSerialKeep = true;
+    if (!first) {
+      simClockRestore(s.clock);
+      simPowerRestore(s.power);
+      simRtcRestore(s.rtc);
+      simFlashFiles() = s.files;
+    }
+    simOnDeepSleep = [](uint64_t sleepUs) {
+      s.clock = simClockSave();
+      s.clock.nowUs += sleepUs;
+      s.clock.bootUs = s.clock.nowUs;
+      s.power = simPowerStats();
+      s.rtc = simRtcSave();
+      s.files = simFlashFiles();
+      s.published += broker.messages.size();
+      s.fetches += forecasts(api);
+      s.timeSyncs += simSerialLog().find("Waiting for time sync") != std::string::npos;
+      sendState(out, s);
+      _exit(0);
+    };
+    simRun(RUN_US);
+    _exit(4);  // the run ended awake
+  }
+  close(fds[1]);
+  bool ok = receiveState(fds[0], state);
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Read the awake build's result line back
+static bool runAwake(const char *path, Result &r) {
+  FILE *p = popen(path, "r");
+  if (!p) return false;
+  char line[512];
+  bool found = false;
+  while (fgets(line, sizeof(line), p)) {
+    if (strncmp(line, "awake ", 6) != 0) continue;
+    found = sscanf(line, "awake %lf mA average per hour: awake %lf s, radio %lf s, asleep %lf s, %lu boots, %lu "
+                         "messages, %lu forecasts",
+                   &r.mA, &r.awakeS, &r.radioS, &r.sleepS, &r.boots, &r.published, &r.fetches) == 7;
+  }
+  return pclose(p) == 0 && found;
+}
+#endif
+
+int main(int argc, char **argv) {
+  printf("%d h simulated; %.0f mA CPU, +%.0f mA radio, %.0f uA deep sleep\n", RUN_HOURS, CPU_MA, RADIO_MA,
+         DEEP_SLEEP_MA * 1000);
+#if !DEEP_SLEEP_MODE
+  (void)argc;
+  (void)argv;
+  SimHttpServer api;
+  SimMqttBroker broker;
+  listen(api, broker);
+  simRun(RUN_US);
+  print("awake", energy(simPowerStats(), broker.messages.size(), forecasts(api)));
+  return 0;
+#else
+  BootState state = BootState();
+  bool allBooted = true;
+  for (bool first = true; state.clock.nowUs < RUN_US; first = false) {
+    if (!boot(state, first)) {
+      allBooted = false;
+      break;
+    }
+  }
+  Result sleeping = energy(state.power, state.published, state.fetches);
+
+  Result awake;
+  bool baseline = argc > 1 && runAwake(argv[1], awake);
+  if (baseline) print("awake", awake);
+  print("sleep", sleeping);
+
+  check(allBooted, "every boot ended in deep sleep (%lu boots)", sleeping.boots);
+  check(baseline, "always-on baseline ran");
+  if (!baseline) return checkResult();
+  check(sleeping.boots >= RUN_HOURS * 60 - 2, "a boot per sensor interval (%lu)", sleeping.boots);
+  check(sleeping.fetches >= RUN_HOURS * 4 - 1, "a forecast every 15 minutes (%lu)", sleeping.fetches);
+  check(state.timeSyncs == 1, "NTP on the cold boot only (%lu boots synced)", state.timeSyncs);
+  check(sleeping.published > 0, "samples published in batches (%lu messages)", sleeping.published);
+  check(sleeping.mA * 4 < awake.mA, "duty cycle under a quarter of the always-on current (%.2f vs %.2f mA)",
+        sleeping.mA, awake.mA);
+  return checkResult();
+#endif
+}
@@ -0,0 +1,145 @@
+// weather_fetch.cpp - bytes and time per forecast fetch
+//
+//   weather_fetch <One Call response>
+//
+// fetchWeatherFromAPI() against a simulated forecast server (SimHttpServer,
+// 40 ms round trip, 250 kB/s) serving Host/tests/onecall.json, one fetch
+// interval apart so the DNS entry (SIM_DNS_TTL_S) has expired each time:
+//   cold          first fetch: DNS lookup, TCP handshake, 200
+//   reuse, 304    the socket kept from the last fetch, forecast unchanged
+//   reuse, 200    the same socket, new ETag, so the whole body again
+//   chunked, 200  the same, Transfer-Encoding: chunked
+//   new conn, 304 the socket closed in between, forecast unchanged
+// and the fetch this replaced, replayed with the stand-in's HTTPClient: a
+// fresh client per fetch without keep-alive or validators, the body read
+// whole (getString() in the old sketch). Bytes are what the device sent
+// and received on the connection; time is the virtual time of the call.
+//
+// The stand-in server keeps an idle connection open for as long as the
+// device does. A real one usually closes it well within the 15 minutes
+// between fetches, so "new conn, 304" is the steady state to expect, and
+// "reuse" applies to retries and to servers with long idle timeouts.
+
+#include <fstream>
+#include <sstream>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+struct Fetch {
+  const char *name;
+  int status;
+  double ms;
+  uint64_t sent, received;
+  unsigned long dnsLookups, tcpConnects;
+};
+
+static SimHttpServer api;
+
+// One fetch interval later, run 'fetch' and record what it cost
+template <typename F>
+static Fetch measure(const char *name, F fetch) {
+  Fetch f = {name, 0, 0, 0, 0, 0, 0};
+  simRunTask([&] {
+    delay(FETCH_INTERVAL_SECONDS * 1000UL);
+    SimNetStats before = simNetStats();
+    double t0 = simNowMs();
+    fetch();
+    f.ms = simNowMs() - t0;
+    SimNetStats after = simNetStats();
+    f.sent = after.bytesSent - before.bytesSent;
+    f.received = after.bytesReceived - before.bytesReceived;
+    f.dnsLookups = after.dnsLookups - before.dnsLookups;
+    f.tcpConnects = after.tcpConnects - before.tcpConnects;
+  }, simNowUs() + simSeconds(FETCH_INTERVAL_SECONDS + 60));
+  f.status = api.requests.empty() ? 0 : api.requests.back().status;
+  printf("%-14s %3d %7.1f ms  %6llu bytes in, %4llu out, %lu DNS, %lu connect\n", f.name, f.status, f.ms,
+         (unsigned long long)f.received, (unsigned long long)f.sent, f.dnsLookups, f.tcpConnects);
+  return f;
+}
+
+// The sketch's own fetch
+static Fetch sketchFetch(const char *name, FetchResult expected) {
+  FetchResult result = FETCH_FAILED;
+  RemoteWeather remote;
+  Fetch f = measure(name, [&] { result = fetchWeatherFromAPI(remote); });
+  check(result == expected, "%s: fetch result %d", name, (int)result);
+  if (result == FETCH_UPDATED) {
+    // As the sketch does after a new forecast; flash time, not the fetch's
+    simRunTask([&] { writeCache(remote); }, simNowUs() + simSeconds(10));
+  }
+  return f;
+}
+
+// The old fetch: new client, Connection: close, whole body into memory
+static Fetch oldFetch() {
+  size_t bodyBytes = 0;
+  Fetch f = measure("old", [&] {
+    WiFiClient client;
+    HTTPClient http;
+    http.setReuse(false);
+    http.begin(client, weatherUrl);
+    if (http.GET() == HTTP_CODE_OK) {
+      static char body[64 * 1024];
+      bodyBytes = http.getStreamPtr()->readBytes(body, min(http.getSize(), (int)sizeof(body)));
+    }
+    http.end();
+  });
+  check(bodyBytes == api.body.size(), "old: whole body read (%u bytes)", (unsigned)bodyBytes);
+  return f;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <One Call response>\n", argv[0]);
+    return 2;
+  }
+  std::ifstream file(argv[1]);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  api.body = contents.str();
+  api.etag = "\"1\"";
+  api.lastModified = "Sat, 17 Oct 2026 06:00:00 GMT";
+  simNetListen("api.openweathermap.org", 80, &api);
+
+  simRunTask([] {
+    initFS();
+    initWeatherFilter();
+    buildWeatherUrl();
+    wifiConnect();
+    syncTime();
+  }, simSeconds(120));
+
+  Fetch cold = sketchFetch("cold", FETCH_UPDATED);
+  Fetch reuse304 = sketchFetch("reuse, 304", FETCH_NOT_MODIFIED);
+  api.etag = "\"2\"";
+  Fetch reuse200 = sketchFetch("reuse, 200", FETCH_UPDATED);
+  api.etag = "\"3\"";
+  api.chunked = true;
+  Fetch chunked = sketchFetch("chunked, 200", FETCH_UPDATED);
+  api.chunked = false;
+  simRunTask([] { weatherClient.stop(); }, simNowUs() + simSeconds(1));
+  Fetch new304 = sketchFetch("new conn, 304", FETCH_NOT_MODIFIED);
+  Fetch old = oldFetch();
+
+  check(cold.dnsLookups == 1 && cold.tcpConnects == 1, "cold: one DNS lookup and one connect");
+  check(reuse304.tcpConnects == 0 && reuse304.dnsLookups == 0 && reuse200.tcpConnects == 0 &&
+            chunked.tcpConnects == 0,
+        "reused socket: no DNS lookup or connect");
+  check(new304.tcpConnects == 1, "new conn: one connect");
+  check(reuse304.received * 50 < old.received, "304 under 2%% of the old fetch's bytes (%llu vs %llu)",
+        (unsigned long long)reuse304.received, (unsigned long long)old.received);
+  check(reuse304.ms < new304.ms, "reuse faster than a new connection (%.1f vs %.1f ms)", reuse304.ms, new304.ms);
+  check(reuse200.ms < old.ms, "reused 200 faster than the old fetch (%.1f vs %.1f ms)", reuse200.ms, old.ms);
+  // A new connection still pays the DNS lookup and handshake round trips;
+  // only the body transfer is saved
+  check(new304.ms < old.ms && new304.received * 50 < old.received,
+        "new-connection 304 faster and under 2%% of the old fetch's bytes (%.1f vs %.1f ms)", new304.ms, old.ms);
+  check(chunked.received > api.body.size() && chunked.received < reuse200.received + api.body.size() / 50,
+        "chunk framing under 2%% (%llu vs %llu bytes)", (unsigned long long)chunked.received,
+        (unsigned long long)reuse200.received);
+
+  return checkResult();
+}
@@ -0,0 +1,155 @@
+// weather_parse.cpp - memory and time of the Weather Node's forecast parse
+//
+//   weather_parse <One Call response>
+//
+// Host/tests/onecall.json is a One Call 2.5 response for the sketch's
+// location (exclude=minutely: current, 48 hourly, 8 daily, every field
+// the API sends). It was not captured from the live API, which needs a
+// key; it was built field by field from the API's documented response,
+// so its size and nesting match a real one.
+//
+// The parse on its own: deserializeJson() through weatherFilter, reading
+// the body from memory one byte at a time as it does from the socket.
+// It must not touch the heap and must fit the static weatherDoc (all 48
+// hourly temperatures are kept, though the node shows 12), and
+// extractRemoteWeather() must return the values an unfiltered parse of the
+// same body finds. Parse time is measured on the PC: it shows the cost of
+// reading every byte, not the ESP32's speed.
+//
+// The whole fetch: fetchWeatherFromAPI() against a simulated server, once
+// with Content-Length and once chunked, measuring the heap low-water mark
+// during the call and the virtual time it took (the first one includes the
+// DNS lookup; parsing itself takes no virtual time). The stand-in does not
+// model the stack, so stack use is not measured; the documents are static.
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define PARSE_RUNS     200
+#define TCP_BUFFERS    (1436 + 196)  // WiFiClient's receive buffer and PCB
+#define MAX_PARSE_HEAP 2048          // the target, besides the socket itself
+
+// A response body in memory
+class MemoryStream : public Stream {
+public:
+  explicit MemoryStream(const std::string &text) : text(text) {}
+  int available() override { return (int)(text.size() - at); }
+  int read() override { return at < text.size() ? (uint8_t)text[at++] : -1; }
+  int peek() override { return at < text.size() ? (uint8_t)text[at] : -1; }
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  const std::string &text;
+  size_t at = 0;
+};
+
+// Room for the whole body, to find the expected values
+static StaticJsonDocument<64 * 1024> fullDoc;
+
+static bool same(float a, float b) {
+  return (isnan(a) && isnan(b)) || fabsf(a - b) < 0.001f;
+}
+
+// Fetch once and report what it cost
+static void measureFetch(const char *name, const RemoteWeather &expected) {
+  RemoteWeather remote;
+  FetchResult result = FETCH_FAILED;
+  size_t freeBefore = 0, lowest = 0;
+  double ms = 0;
+  simRunTask([&] {
+    weatherClient.stop();  // a new connection each time
+    freeBefore = simHeapStats().free;
+    simHeapResetMinFree();
+    double t0 = simNowMs();
+    result = fetchWeatherFromAPI(remote);
+    ms = simNowMs() - t0;
+    lowest = simHeapStats().minFree;
+  }, simNowUs() + simSeconds(60));
+
+  size_t peak = freeBefore - lowest;
+  printf("%s: %.0f ms, heap peak %u bytes (%u for the socket)\n", name, ms, (unsigned)peak, TCP_BUFFERS);
+  check(result == FETCH_UPDATED, "%s: fetched", name);
+  check(same(remote.temp, expected.temp) && strcmp(remote.desc, expected.desc) == 0 &&
+            remote.hourlyCount == expected.hourlyCount && remote.dailyCount == expected.dailyCount,
+        "%s: same forecast as the parse from memory", name);
+  check(peak <= TCP_BUFFERS + MAX_PARSE_HEAP, "%s: heap peak %u <= %u + %u", name, (unsigned)peak, TCP_BUFFERS,
+        MAX_PARSE_HEAP);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <One Call response>\n", argv[0]);
+    return 2;
+  }
+  std::ifstream file(argv[1]);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string body = contents.str();
+  check(body.size() > 10000, "fixture read (%u bytes)", (unsigned)body.size());
+
+  // ---- Expected values, from an unfiltered parse ----
+  DeserializationError fullErr = deserializeJson(fullDoc, body.c_str(), body.size());
+  check(!fullErr, "unfiltered parse: %s (%u bytes of document)", fullErr.c_str(), (unsigned)fullDoc.memoryUsage());
+  RemoteWeather expected;
+  extractRemoteWeather(fullDoc, expected);
+
+  // ---- The parse on its own ----
+  initWeatherFilter();
+  RemoteWeather remote;
+  DeserializationError err;
+  SimHeapStats heapBefore, heapAfter;
+  double hostUs = 0;
+  simRunTask([&] {
+    heapBefore = simHeapStats();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < PARSE_RUNS; i++) {
+      MemoryStream stream(body);
+      err = deserializeJson(weatherDoc, stream, DeserializationOption::Filter(weatherFilter));
+    }
+    hostUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / PARSE_RUNS;
+    heapAfter = simHeapStats();
+    extractRemoteWeather(weatherDoc, remote);
+  }, simSeconds(60));
+
+  printf("filtered parse: %u of %u document bytes used, %.0f us per parse on this PC\n",
+         (unsigned)weatherDoc.memoryUsage(), (unsigned)weatherDoc.capacity(), hostUs);
+  printf("reading the body into a String first would take %u bytes of heap\n", (unsigned)body.size() + 1);
+  check(!err, "filtered parse: %s", err.c_str());
+  check(!weatherDoc.overflowed(), "filtered document did not overflow");
+  check(heapAfter.allocations == heapBefore.allocations, "no heap allocation while parsing (%lu)",
+        heapAfter.allocations - heapBefore.allocations);
+
+  bool match = same(remote.temp, expected.temp) && strcmp(remote.desc, expected.desc) == 0 &&
+               remote.hourlyCount == FORECAST_HOURS && remote.dailyCount == FORECAST_DAYS;
+  for (int i = 0; match && i < FORECAST_HOURS; i++) match = same(remote.hourlyTemp[i], expected.hourlyTemp[i]);
+  for (int i = 0; match && i < FORECAST_DAYS; i++) {
+    match = same(remote.dailyMax[i], expected.dailyMax[i]) && same(remote.dailyMin[i], expected.dailyMin[i]);
+  }
+  check(match, "filtered fields equal the unfiltered ones (%.2f C, \"%s\", %u hours, %u days)", remote.temp,
+        remote.desc, remote.hourlyCount, remote.dailyCount);
+
+  // ---- The whole fetch ----
+  SimHttpServer api;
+  api.body = body;
+  api.etag = "\"fixture\"";
+  simNetListen("api.openweathermap.org", 80, &api);
+  simRunTask([] {
+    initFS();
+    buildWeatherUrl();
+    wifiConnect();
+    syncTime();
+  }, simSeconds(120));
+
+  measureFetch("Content-Length", expected);
+  api.chunked = true;
+  weatherEtag[0] = '\0';  // ask for the whole body again
+  measureFetch("chunked", expected);
+
+  return checkResult();
+}
@@ -0,0 +1,81 @@
+// weather_sensor.cpp - I2C transactions of the Weather Node's sensor reads
+//
+// Runs Project 2 for RUN_MIN simulated minutes on the ESP32 stand-in and
+// counts the transactions to the BME280 (0x76) per minute in steady state
+// (after the first STEADY_FROM_MIN minutes, past the begin() and
+// calibration reads). Each sample is one forced conversion: a ctrl_meas
+// write, then one burst read of status and data.
+//
+// The old sketch read the sensor with readTemperature(), readHumidity()
+// and readPressure() for every sample, and again for the screen after
+// each forecast fetch; the library re-reads the temperature before the
+// humidity and the pressure. That triple is replayed through the
+// library stand-in at the end, on the same bus, and counted once per
+// sample and once per fetch. Fetch failures, which added a third triple,
+// are not in the run.
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define RUN_MIN         30
+#define STEADY_FROM_MIN 5
+#define MINUTE_US       (60ULL * 1000000)
+
+int main() {
+  SimHttpServer api;
+  api.body = "{\"current\":{\"temp\":29.5,\"weather\":[{\"description\":\"clear sky\"}]}}";
+  api.etag = "\"1\"";
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+
+  unsigned long steadyFrom = 0, conversionsFrom = 0;
+  size_t fetchesFrom = 0;
+  simAt(STEADY_FROM_MIN * MINUTE_US, [&] {
+    steadyFrom = simI2cStats().perAddress[BME_ADDR];
+    conversionsFrom = simBme280().conversions;
+    fetchesFrom = api.requests.size();
+  });
+
+  simRun(RUN_MIN * MINUTE_US);
+
+  double minutes = RUN_MIN - STEADY_FROM_MIN;
+  unsigned long transactions = simI2cStats().perAddress[BME_ADDR] - steadyFrom;
+  unsigned long samples = simBme280().conversions - conversionsFrom;
+  size_t fetches = api.requests.size() - fetchesFrom;
+
+  // ---- The old T/H/P triple ----
+  unsigned long triple = 0;
+  float t = 0, h = 0, p = 0;
+  simRunTask([&] {
+    unsigned long before = simI2cStats().perAddress[BME_ADDR];
+    t = bme.readTemperature();
+    h = bme.readHumidity();
+    p = bme.readPressure();
+    triple = simI2cStats().perAddress[BME_ADDR] - before;
+  }, simNowUs() + simSeconds(10));
+
+  double perMinute = transactions / minutes;
+  double oldPerMinute = (double)triple * (samples + fetches) / minutes;
+  printf("%lu samples, %u fetches in %.0f min: %.1f transactions/min to the BME280 (%.1f per sample)\n", samples,
+         (unsigned)fetches, minutes, perMinute, (double)transactions / samples);
+  printf("old reads: %lu per T/H/P triple, %.1f transactions/min\n", triple, oldPerMinute);
+  printf("latest sample %.2f C %.1f %% %.2f Pa, library read %.2f C %.1f %% %.2f Pa\n", latestSample.t,
+         latestSample.h, latestSample.p, t, h, p);
+
+  check(samples >= minutes - 1, "a conversion per sample (%lu)", samples);
+  check(transactions == 2 * samples, "two transactions per sample (%lu for %lu)", transactions, samples);
+  check(triple == 5, "the library's triple is five transactions (%lu)", triple);
+  check(perMinute * 2 < oldPerMinute, "under half the old transactions per minute (%.1f vs %.1f)", perMinute,
+        oldPerMinute);
+  check(fabsf(latestSample.t - simBme280().temperature) < 0.01F &&
+            fabsf(latestSample.h - simBme280().humidity) < 0.1F &&
+            fabsf(latestSample.p - simBme280().pressure) < 1.0F,
+        "burst read gives the sensor's weather");
+  check(fabsf(t - latestSample.t) < 0.01F && fabsf(h - latestSample.h) < 0.1F && fabsf(p - latestSample.p) < 1.0F,
+        "library reads agree with the burst read");
+
+  return checkResult();
+}
@@ -0,0 +1,121 @@
+// weather_soak.cpp - 30 days of the Weather Node, watching its heap
+//
+// Runs Project 2 on the ESP32 stand-in for 30 simulated days with a
+// forecast server and an MQTT broker, and reads back the heap statistics
+// the sketch publishes every 10 minutes (publishHeapStats()). Every day
+// the access point drops out for 5 minutes at 03:00, so the reconnect
+// paths run too; the forecast changes every 3 hours (new ETag) and is
+// answered with 304 in between. On day 10 the forecast server stops
+// answering for an hour.
+//
+// The sketch keeps its buffers static, so the largest free block should
+// not shrink after the first day: its lowest value on the last day must
+// be no lower than on the second. The stand-in's heap is a first-fit
+// allocator with coalescing (Host/esp32/Esp32.cpp), close to the ESP-IDF
+// one; WiFi driver buffers beyond those WiFiClient allocates are not
+// modelled.
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define DAYS       30
+#define DAY_US     (24ULL * 3600 * 1000000)
+
+// A forecast body that changes with 'version'
+static std::string forecast(unsigned version) {
+  char buffer[160];
+  std::string body = "{\"current\":{\"temp\":";
+  snprintf(buffer, sizeof(buffer), "%.1f,\"weather\":[{\"description\":\"%s\"}]},\"hourly\":[", 26 + version % 7 * 0.7,
+           version % 2 ? "light rain" : "broken clouds");
+  body += buffer;
+  for (int h = 0; h < 48; h++) {
+    snprintf(buffer, sizeof(buffer), "%s{\"dt\":%u,\"temp\":%.2f,\"humidity\":%d}", h ? "," : "", 1767225600u + h * 3600,
+             25 + (h + version) % 9 * 0.5, 60 + h % 30);
+    body += buffer;
+  }
+  body += "],\"daily\":[";
+  for (int d = 0; d < 8; d++) {
+    snprintf(buffer, sizeof(buffer), "%s{\"temp\":{\"min\":%.1f,\"max\":%.1f,\"day\":%.1f}}", d ? "," : "",
+             23 + (d + version) % 3 * 0.4, 30 + (d + version) % 4 * 0.6, 28.0);
+    body += buffer;
+  }
+  return body + "]}";
+}
+
+struct HeapReport {
+  uint64_t atUs;
+  unsigned long free, minFree, largest;
+};
+
+int main() {
+  SimHttpServer api;
+  api.body = forecast(0);
+  api.etag = "\"v0\"";
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+  simSerialKeep = true;
+
+  for (unsigned v = 1; v < DAYS * 8; v++) {
+    simAt(v * 3 * 3600ULL * 1000000, [&api, v] {
+      api.body = forecast(v);
+      api.etag = "\"v" + std::to_string(v) + "\"";
+    });
+  }
+  for (int day = 0; day < DAYS; day++) {
+    uint64_t at = day * DAY_US + 3 * 3600ULL * 1000000;
+    simNetOutage(at, at + simSeconds(5 * 60));
+  }
+  simAt(10 * DAY_US, [&api] { api.stalled = true; });
+  simAt(10 * DAY_US + simSeconds(3600), [&api] { api.stalled = false; });
+
+  simRun(DAYS * DAY_US);
+
+  // ---- Heap reports ----
+  std::vector<HeapReport> reports;
+  for (const SimMqttBroker::Message &m : broker.messages) {
+    if (m.topic != MQTT_TOPIC_HEAP) continue;
+    HeapReport r;
+    r.atUs = m.atUs;
+    if (sscanf(m.payload.c_str(), "{\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu", &r.free, &r.minFree,
+               &r.largest) == 3) {
+      reports.push_back(r);
+    }
+  }
+
+  unsigned long lowest[DAYS], highest[DAYS];
+  for (int day = 0; day < DAYS; day++) {
+    lowest[day] = ULONG_MAX;
+    highest[day] = 0;
+  }
+  for (const HeapReport &r : reports) {
+    int day = (int)(r.atUs / DAY_US);
+    if (day >= DAYS) continue;
+    lowest[day] = std::min(lowest[day], r.largest);
+    highest[day] = std::max(highest[day], r.largest);
+  }
+  printf("largest free block by day (lowest..highest):\n");
+  for (int day = 0; day < DAYS; day++) {
+    printf("  day %2d  %6lu .. %6lu\n", day + 1, lowest[day], highest[day]);
+  }
+  SimHeapStats heap = simHeapStats();
+  printf("%u heap reports, %lu allocations, %lu failed; min free %u of %u\n", (unsigned)reports.size(),
+         heap.allocations, heap.failures, (unsigned)heap.minFree, (unsigned)heap.size);
+
+  // One report per 10 minutes, less the outages and the stalled hour
+  check(reports.size() >= DAYS * 144 * 9 / 10, "%u heap reports over %d days", (unsigned)reports.size(), DAYS);
+  check(lowest[DAYS - 1] >= lowest[1], "largest free block flat: lowest %lu on day %d, %lu on day 2",
+        lowest[DAYS - 1], DAYS, lowest[1]);
+  unsigned long worst = *std::min_element(lowest + 1, lowest + DAYS);
+  check(worst >= lowest[1], "never below day 2 after it (lowest %lu)", worst);
+  check(heap.failures == 0, "no allocation failed (%lu)", heap.failures);
+  check(simSerialLog().find("NoMemory") == std::string::npos, "no forecast parse ran out of memory");
+
+  return checkResult();
+}
@@ -0,0 +1,101 @@
+// weather_tasks.cpp - the Weather Node's sensor period while its network
+// task is stuck
+//
+// Runs Project 2 for 45 minutes of simulated time on the ESP32 stand-in
+// (Host/esp32: FreeRTOS tasks on threads, scheduled by priority on one
+// virtual clock) with a forecast server and an MQTT broker behind the
+// simulated WiFi. For the middle of the run the network task is made to
+// block in every way it can:
+//   10-25 min  the broker accepts TCP but never answers CONNECT, so every
+//              mqttConnect() waits out PubSubClient's 15 s socket timeout,
+//              and the forecast server never answers, so a fetch waits out
+//              HTTPClient's 5 s timeout
+//   30-40 min  no access point: wifiConnect() spins for its 20 s each time
+// sensorTask samples with vTaskDelayUntil() and never touches the network,
+// so every BME280 conversion should still start 60 s after the one before.
+// The BME280 model records when each forced conversion starts.
+//
+// The stand-in runs one task at a time, by priority. The chip runs the
+// network task on the other core, so this is the harsher case; the WiFi
+// driver's own tasks and interrupts are not modelled.
+
+#include <algorithm>
+#include <vector>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define RUN_MIN       45
+#define PERIOD_US     (SENSOR_INTERVAL_SECONDS * 1000000ULL)
+#define MAX_JITTER_US 2000   // the I2C mutex may be held by a redraw
+
+static const char FORECAST[] =
+    "{\"current\":{\"temp\":29.5,\"weather\":[{\"description\":\"scattered clouds\"}]},"
+    "\"hourly\":[{\"temp\":29.1},{\"temp\":28.7},{\"temp\":28.2}],"
+    "\"daily\":[{\"temp\":{\"min\":24.9,\"max\":31.2}},{\"temp\":{\"min\":25.1,\"max\":30.8}}]}";
+
+int main() {
+  SimHttpServer api;
+  api.body = FORECAST;
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+  simBme280().keepConversionTimes = true;
+  simSerialKeep = true;
+
+  unsigned long connectsBeforeStall = 0, requestsBeforeStall = 0;
+  simAt(simSeconds(10 * 60), [&] {
+    connectsBeforeStall = broker.connects;
+    requestsBeforeStall = api.requests.size();
+    broker.stalled = true;
+    api.stalled = true;
+  });
+  simAt(simSeconds(25 * 60), [&] {
+    broker.stalled = false;
+    api.stalled = false;
+  });
+  simNetOutage(simSeconds(30 * 60), simSeconds(40 * 60));
+
+  simRun(simSeconds(RUN_MIN * 60));
+
+  // ---- Sensor period ----
+  const std::vector<uint64_t> &starts = simBme280().conversionStartsUs;
+  // The first conversion is sensorBegin()'s check in setup()
+  std::vector<uint64_t> periodic(starts.begin() + 1, starts.end());
+  uint64_t worst = 0;
+  for (size_t i = 1; i < periodic.size(); i++) {
+    uint64_t gap = periodic[i] - periodic[i - 1];
+    uint64_t off = gap > PERIOD_US ? gap - PERIOD_US : PERIOD_US - gap;
+    worst = std::max(worst, off);
+  }
+  printf("%u samples, worst period error %llu us\n", (unsigned)periodic.size(), (unsigned long long)worst);
+  check(periodic.size() >= RUN_MIN - 1, "a sample every minute (%u in %d min)", (unsigned)periodic.size(), RUN_MIN);
+  check(worst <= MAX_JITTER_US, "sensor period within %d us of %u s (worst %llu us)", MAX_JITTER_US,
+        (unsigned)SENSOR_INTERVAL_SECONDS, (unsigned long long)worst);
+  check(simSerialLog().find("Sample queue full") == std::string::npos, "no sample dropped at the queue");
+
+  // ---- The network task really was stuck ----
+  // A stalled broker reads nothing, so count the sketch's timeouts instead
+  unsigned long stalledConnects = 0;
+  const std::string &log = simSerialLog();
+  for (size_t at = log.find("rc=-4"); at != std::string::npos; at = log.find("rc=-4", at + 1)) {
+    stalledConnects++;
+  }
+  unsigned long stalledRequests = 0;
+  for (size_t i = requestsBeforeStall; i < api.requests.size(); i++) {
+    if (api.requests[i].status == 0) stalledRequests++;
+  }
+  printf("while stalled: %lu MQTT CONNECTs timed out, %lu forecast requests unanswered\n", stalledConnects,
+         stalledRequests);
+  check(connectsBeforeStall > 0, "MQTT up before the stall");
+  check(stalledConnects > 0 && stalledConnects <= 15 * 60 / MQTT_SOCKET_TIMEOUT,
+        "net task blocked in CONNECT (%lu timeouts in 15 min)", stalledConnects);
+  check(stalledRequests > 0, "net task blocked on a forecast request");
+  check(simNetStats().connectionsReset > 0, "the outage reset open connections");
+  check(WiFi.status() == WL_CONNECTED, "WiFi back after the outage");
+  check(broker.connects > connectsBeforeStall && mqttClient.connected(), "MQTT reconnected after the stall");
+
+  return checkResult();
+}
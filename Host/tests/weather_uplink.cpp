@@ -0,0 +1,156 @@
+// weather_uplink.cpp - the Weather Node's batched telemetry through an
+// MQTT broker, across outages
+//
+// Runs Project 2 for RUN_HOURS simulated hours on the ESP32 stand-in with
+// an MQTT 3.1.1 broker (SimMqttBroker, standing in for mosquitto) and
+// decodes every batch it receives (spoolFlush(): format byte, varint
+// count, zigzag varint deltas per sample). Along the way:
+//   1:00-2:00  no access point: samples pile up in the LittleFS spool
+//   3:00-3:20  the broker stops reading: the session times out
+//   4:00-4:05  no access point again
+// Every sample the sensor task took must reach the broker exactly once and
+// in order, except those still waiting in the spool at the end and those
+// already published when the broker stopped reading: PubSubClient
+// publishes at QoS 0, so publish() returning true only means the bytes
+// went into the socket, and the spool drops them then. Throughput
+// is the bytes per sample on the wire (MQTT header, topic and payload),
+// against the single JSON publish per sample this replaced, and the time
+// the backlog of the long outage took to drain.
+
+#include <set>
+
+#include <Arduino.h>
+#include "../../Project 2 (Weather Node).cpp"
+#include "Esp32Sim.h"
+#include "Check.h"
+
+#define RUN_HOURS 6
+#define HOUR_US   (3600ULL * 1000000)
+#define STALL_S   (3 * 3600)      // broker stops reading, seconds after power-up
+
+// The JSON message each sample used to be, for comparison
+#define OLD_TOPIC   "home/weather_node/metrics"
+#define OLD_PAYLOAD "{\"temperature\":22.5,\"humidity\":55,\"pressure\":1013.25,\"timestamp\":1767225600}"
+
+struct Received {
+  uint32_t time;
+  int32_t t, h, p;
+  uint64_t atUs;
+};
+
+static uint32_t getVarint(const std::string &b, size_t &at, bool &ok) {
+  uint32_t v = 0;
+  for (int shift = 0; at < b.size() && shift < 35; shift += 7) {
+    uint8_t c = b[at++];
+    v |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) return v;
+  }
+  ok = false;
+  return 0;
+}
+
+static int32_t getSignedVarint(const std::string &b, size_t &at, bool &ok) {
+  uint32_t v = getVarint(b, at, ok);
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// MQTT PUBLISH on the wire: fixed header, topic, payload
+static size_t wireBytes(size_t topic, size_t payload) {
+  size_t remaining = 2 + topic + payload;
+  return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+int main() {
+  SimHttpServer api;
+  api.body = "{\"current\":{\"temp\":29.5,\"weather\":[{\"description\":\"clear sky\"}]}}";
+  SimMqttBroker broker;
+  simNetListen("api.openweathermap.org", 80, &api);
+  simNetListen(MQTT_SERVER, MQTT_PORT, &broker);
+  simBme280().keepConversionTimes = true;
+
+  simNetOutage(1 * HOUR_US, 2 * HOUR_US);
+  simAt(simSeconds(STALL_S), [&broker] { broker.stalled = true; });
+  simAt(simSeconds(STALL_S + 20 * 60), [&broker] { broker.stalled = false; });
+  simNetOutage(4 * HOUR_US, 4 * HOUR_US + simSeconds(5 * 60));
+
+  simRun(RUN_HOURS * HOUR_US);
+
+  // ---- Decode the batches ----
+  std::vector<Received> received;
+  size_t batches = 0, wire = 0;
+  bool decoded = true;
+  for (const SimMqttBroker::Message &m : broker.messages) {
+    if (m.topic != MQTT_TOPIC_METRICS_BATCH) continue;
+    batches++;
+    wire += wireBytes(m.topic.size(), m.payload.size());
+    size_t at = 0;
+    bool ok = m.payload.size() > 1 && m.payload[at++] == 1;
+    uint32_t n = getVarint(m.payload, at, ok);
+    Received prev = {0, 0, 0, 0, 0};
+    for (uint32_t i = 0; ok && i < n; i++) {
+      Received r;
+      r.time = prev.time + getSignedVarint(m.payload, at, ok);
+      r.t = prev.t + getSignedVarint(m.payload, at, ok);
+      r.h = prev.h + getSignedVarint(m.payload, at, ok);
+      r.p = prev.p + getSignedVarint(m.payload, at, ok);
+      r.atUs = m.atUs;
+      received.push_back(r);
+      prev = r;
+    }
+    if (!ok || at != m.payload.size()) decoded = false;
+  }
+
+  // One conversion per sample, after sensorBegin()'s check in setup()
+  size_t taken = simBme280().conversionStartsUs.size() - 1;
+  size_t waiting = spool.count;
+
+  // Samples are a minute apart, so a longer gap is a lost sample; it was
+  // in flight at the stall if it was taken in the minute before. The first
+  // sample comes before NTP and carries seconds since boot.
+  bool inOrder = true;
+  std::set<uint32_t> times;
+  size_t lostAtStall = 0, lostElsewhere = 0;
+  for (size_t i = 0; i < received.size(); i++) {
+    times.insert(received[i].time);
+    if (i == 0) continue;
+    if (received[i].time <= received[i - 1].time) inOrder = false;
+    if (received[i - 1].time < SIM_EPOCH_AT_POWER_UP) continue;
+    for (uint32_t t = received[i - 1].time + SENSOR_INTERVAL_SECONDS; t + 1 < received[i].time;
+         t += SENSOR_INTERVAL_SECONDS) {
+      uint32_t sinceBoot = t - SIM_EPOCH_AT_POWER_UP;
+      if (sinceBoot + SENSOR_INTERVAL_SECONDS >= STALL_S && sinceBoot < STALL_S) lostAtStall++;
+      else lostElsewhere++;
+    }
+  }
+
+  // The backlog of the first outage: its last sample, and when it arrived
+  double drainS = -1;
+  for (const Received &r : received) {
+    if (r.time >= SIM_EPOCH_AT_POWER_UP + 2 * 3600 - 60 && r.time < SIM_EPOCH_AT_POWER_UP + 2 * 3600) {
+      drainS = (r.atUs - 2 * HOUR_US) / 1e6;
+    }
+  }
+
+  double perSample = received.empty() ? 0 : (double)wire / received.size();
+  double oldPerSample = wireBytes(strlen(OLD_TOPIC), strlen(OLD_PAYLOAD));
+  printf("%u samples taken, %u received in %u batches, %u still spooled\n", (unsigned)taken,
+         (unsigned)received.size(), (unsigned)batches, (unsigned)waiting);
+  printf("%.1f bytes per sample on the wire (one JSON publish each: %.0f), %.1f batches per hour\n", perSample,
+         oldPerSample, (double)batches / RUN_HOURS);
+  printf("first outage's backlog delivered %.1f s after the access point came back\n", drainS);
+
+  check(decoded, "every batch decodes");
+  check(inOrder, "samples arrive in order, none twice");
+  check(times.size() == received.size(), "sample times distinct");
+  check(received.size() + waiting + lostAtStall + lostElsewhere == taken,
+        "every sample accounted for (%u received, %u spooled, %u lost of %u taken)", (unsigned)received.size(),
+        (unsigned)waiting, (unsigned)(lostAtStall + lostElsewhere), (unsigned)taken);
+  check(lostElsewhere == 0, "none lost across the WiFi outages");
+  check(lostAtStall <= 1, "at most the sample in flight lost when the broker stopped (%u, QoS 0)",
+        (unsigned)lostAtStall);
+  check(perSample * 2 < oldPerSample, "under half the bytes of a JSON publish per sample (%.1f vs %.0f)",
+        perSample, oldPerSample);
+  check(drainS >= 0 && drainS < 60, "outage backlog sent within a minute of reconnecting (%.1f s)", drainS);
+
+  return checkResult();
+}
@@ -3,17 +3,26 @@
   ----------------------------
   Features:
    - Sends MIDI note messages over 5-pin DIN MIDI OUT
-   - Plays a predefined sequence (mini song)
+   - Follows MIDI clock, Start, Stop and Continue from MIDI IN, and
+     passes everything it receives on to MIDI OUT (soft thru)
+   - Plays a predefined sequence (mini song) streamed from flash
    - Optional piezo buzzer output for monitoring
-   - Supports adjustable tempo
+   - Supports adjustable tempo (when no MIDI clock comes in)
    - Well-commented for learning
 
   MIDI wiring (DIN connector):
     Pin 4 -> Arduino TX (D1) through 220Ω
     Pin 5 -> +5V through 220Ω
     Pin 2 -> GND
+
+  MIDI IN (DIN connector, through an optocoupler such as a 6N138):
+    Pin 4 -> 220Ω -> opto LED anode, pin 5 -> opto LED cathode
+    Opto output -> Arduino RX (D0), with a pull-up to +5V
+  Unplug MIDI IN while uploading: the USB link uses the same RX pin.
 */
 
+#include <AdcSampler.h>
+
 #define BUZZER_PIN 8   // optional piezo buzzer pin
 #define TEMPO_POT A0   // potentiometer for tempo control
 
@@ -22,80 +31,608 @@
 
 // Structure for a note event
 struct NoteEvent {
-  byte pitch;   // MIDI note number (60 = Middle C)
+  unsigned long delta;    // ms after the previous note starts
+  byte pitch;             // MIDI note number (60 = Middle C)
   byte velocity;
-  int duration; // in ms
+  unsigned long duration; // in ms
 };
 
-// Example sequence (a little C-major scale)
-NoteEvent song[] = {
-  {60, 100, 400}, // C4
-  {62, 100, 400}, // D
-  {64, 100, 400}, // E
-  {65, 100, 400}, // F
-  {67, 100, 400}, // G
-  {69, 100, 400}, // A
-  {71, 100, 400}, // B
-  {72, 100, 800}  // C5
+// Packed song stored in flash, read back one note at a time so the song
+// length is not limited by RAM. Each note is:
+//   delta     variable-length, ms after the previous note starts
+//   pitch     bit 7 set = a new velocity byte follows
+//   velocity  only when it changes
+//   duration  variable-length, ms
+// Variable-length numbers use 7 bits per byte, high group first, with
+// bit 7 set on every byte but the last (like MIDI files).
+// Tools/midi2song.cpp converts a .mid file into this format.
+//
+// Example sequence (a little C-major scale, ending on a chord)
+const byte songData[] PROGMEM = {
+  0x00,       0xBC, 0x64, 0x83, 0x10, // C4  (velocity 100, 400 ms)
+  0x83, 0x42, 0x3E,       0x83, 0x10, // D   (+450 ms)
+  0x83, 0x42, 0x40,       0x83, 0x10, // E
+  0x83, 0x42, 0x41,       0x83, 0x10, // F
+  0x83, 0x42, 0x43,       0x83, 0x10, // G
+  0x83, 0x42, 0x45,       0x83, 0x10, // A
+  0x83, 0x42, 0x47,       0x83, 0x10, // B
+  0x83, 0x42, 0x48,       0x86, 0x20, // C5  (800 ms)
+  0x00,       0xC0, 0x50, 0x86, 0x20, //  + E4 (velocity 80)
+  0x00,       0x43,       0x86, 0x20  //  + G4
 };
-int songLength = sizeof(song) / sizeof(song[0]);
 
-// ------------------ FUNCTIONS ----------------------
+// Streaming reader over a packed song in flash; a few bytes of RAM
+// whatever the length of the song
+struct SongReader {
+  const byte *start; // first byte of the song
+  const byte *end;   // one past the last byte
+  const byte *pos;   // next byte in flash
+  byte velocity;     // last velocity seen
+};
+
+SongReader songReader = {songData, songData + sizeof(songData), songData, 0};
+
+void songRewind(SongReader &reader) {
+  reader.pos = reader.start;
+  reader.velocity = 0;
+}
+
+unsigned long readVarLen(SongReader &reader) {
+  unsigned long value = 0;
+  byte b;
+  do {
+    b = pgm_read_byte(reader.pos++);
+    value = (value << 7) | (b & 0x7F);
+  } while (b & 0x80);
+  return value;
+}
+
+// Decode the next note; returns false at the end of the song
+bool songNext(SongReader &reader, NoteEvent &note) {
+  if (reader.pos >= reader.end) return false;
+  note.delta = readVarLen(reader);
+  byte p = pgm_read_byte(reader.pos++);
+  if (p & 0x80) reader.velocity = pgm_read_byte(reader.pos++);
+  note.pitch = p & 0x7F;
+  note.velocity = reader.velocity;
+  note.duration = readVarLen(reader);
+  return true;
+}
+
+#define SONG_PAUSE 1000  // ms of silence before the song repeats
+
+// ---------------- NOTE FREQUENCIES -----------------
+// Buzzer frequency (Hz) for every MIDI note, 440 * 2^((pitch - 69) / 12),
+// worked out by the compiler and stored in flash. Playing a note is then a
+// table lookup instead of a soft-float pow() call.
+constexpr double semitoneRatio(int n) {
+  return n == 0 ? 1.0 : 1.0594630943592953 * semitoneRatio(n - 1);
+}
+
+constexpr unsigned int noteFrequency(int pitch) {
+  return (unsigned int)((pitch >= 69 ? 440.0 * semitoneRatio(pitch - 69)
+                                     : 440.0 / semitoneRatio(69 - pitch)) + 0.5);
+}
+
+static_assert(noteFrequency(69) == 440 && noteFrequency(60) == 262, "pitch table");
+
+#define NOTE_FREQ4(p)  noteFrequency(p), noteFrequency(p + 1), noteFrequency(p + 2), noteFrequency(p + 3)
+#define NOTE_FREQ16(p) NOTE_FREQ4(p), NOTE_FREQ4(p + 4), NOTE_FREQ4(p + 8), NOTE_FREQ4(p + 12)
+#define NOTE_FREQ64(p) NOTE_FREQ16(p), NOTE_FREQ16(p + 16), NOTE_FREQ16(p + 32), NOTE_FREQ16(p + 48)
+
+const unsigned int noteFrequencies[128] PROGMEM = { NOTE_FREQ64(0), NOTE_FREQ64(64) };
+
+unsigned int pitchToFrequency(byte pitch) {
+  return pgm_read_word(&noteFrequencies[pitch & 0x7F]);
+}
+
+// ------------------ MIDI PORT ----------------------
+// The UART is driven directly instead of through Serial: the receive
+// interrupt needs the exact arrival time of every clock byte, and
+// received messages have to be passed on (MIDI thru) from inside the
+// interrupt to keep the delay under 1 ms.
+//
+// Outgoing messages wait in two queues, sent a whole message at a time
+// by the "transmit buffer empty" interrupt:
+//   - thru: messages received on MIDI IN, sent first;
+//   - out:  our own notes, filled by midiQueue() and released to the
+//           interrupt by midiFlush(), so a whole chord leaves in one go.
+// Real-time bytes (clock, start, stop) are allowed between any two bytes
+// of a message, so they skip both queues and go out after the current
+// byte.
+// Running status is applied while sending: the status byte is only sent
+// when it changes, and Note Off is sent as Note On with velocity 0, so a
+// run of notes on one channel costs 2 bytes per message instead of 3.
+#define MIDI_QUEUE_SIZE 16  // messages per queue, must be a power of two
+#define MIDI_RT_SIZE    8   // real-time bytes, must be a power of two
+
+struct MidiMessage {
+  byte status;
+  byte data1;
+  byte data2;
+};
+
+MidiMessage midiOutQueue[MIDI_QUEUE_SIZE];
+byte midiOutFill = 0;             // next free slot (loop() only)
+volatile byte midiOutHead = 0;    // end of what midiFlush() released
+volatile byte midiOutTail = 0;    // next message to send (ISR only)
+
+MidiMessage midiThruQueue[MIDI_QUEUE_SIZE];  // both ends in ISRs
+byte midiThruHead = 0;
+byte midiThruTail = 0;
+volatile unsigned int midiThruDropped = 0;   // thru messages lost to a full queue
+
+byte midiRtQueue[MIDI_RT_SIZE];
+byte midiRtHead = 0;
+byte midiRtTail = 0;
+
+// Transmit ISR state
+byte midiTxBytes[3];   // message being sent
+byte midiTxLength = 0;
+byte midiTxPos = 0;
+volatile byte runningStatus = 0;  // last status byte sent (0 = none yet)
+
+// Program Change and Channel Pressure have one data byte, the rest two
+byte midiDataBytes(byte status) {
+  return (status & 0xE0) == 0xC0 ? 1 : 2;
+}
+
+// Pick the next message to send, thru first; false if both queues are empty
+bool midiLoadNext() {
+  MidiMessage m;
+  if (midiThruTail != midiThruHead) {
+    m = midiThruQueue[midiThruTail];
+    midiThruTail = (midiThruTail + 1) & (MIDI_QUEUE_SIZE - 1);
+  } else if (midiOutTail != midiOutHead) {
+    m = midiOutQueue[midiOutTail];
+    midiOutTail = (midiOutTail + 1) & (MIDI_QUEUE_SIZE - 1);
+  } else {
+    return false;
+  }
+  midiTxLength = 0;
+  midiTxPos = 0;
+  if (m.status != runningStatus) {
+    midiTxBytes[midiTxLength++] = m.status;
+    runningStatus = m.status;
+  }
+  midiTxBytes[midiTxLength++] = m.data1;
+  if (midiDataBytes(m.status) == 2) midiTxBytes[midiTxLength++] = m.data2;
+  return true;
+}
+
+ISR(USART_UDRE_vect) {
+  if (midiRtTail != midiRtHead) {
+    UDR0 = midiRtQueue[midiRtTail];
+    midiRtTail = (midiRtTail + 1) & (MIDI_RT_SIZE - 1);
+    return;
+  }
+  if (midiTxPos == midiTxLength && !midiLoadNext()) {
+    UCSR0B &= ~(1 << UDRIE0);  // nothing left: stop asking
+    return;
+  }
+  UDR0 = midiTxBytes[midiTxPos++];
+}
+
+// 31250 baud 8N1, receive interrupt on (USART_RX_vect is further down)
+void midiBegin() {
+  UBRR0 = F_CPU / 16 / MIDI_BAUD - 1;  // 31 at 16 MHz, exact
+  UCSR0A = 0;
+  UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+  UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+// Release everything queued so far to the transmit interrupt
+void midiFlush() {
+  noInterrupts();
+  midiOutHead = midiOutFill;
+  UCSR0B |= (1 << UDRIE0);
+  interrupts();
+}
+
+// Add a channel message to the out queue
+void midiQueue(byte status, byte data1, byte data2) {
+  byte next = (midiOutFill + 1) & (MIDI_QUEUE_SIZE - 1);
+  while (next == midiOutTail) midiFlush();  // full: wait for the interrupt
+  midiOutQueue[midiOutFill].status = status;
+  midiOutQueue[midiOutFill].data1 = data1 & 0x7F;
+  midiOutQueue[midiOutFill].data2 = data2 & 0x7F;
+  midiOutFill = next;
+}
+
+// Send the next status byte in full (lets a receiver that was plugged in
+// late pick up the stream)
+void midiResetRunningStatus() {
+  runningStatus = 0;
+}
 
 // Send a MIDI "Note On" message
 void midiNoteOn(byte channel, byte pitch, byte velocity) {
-  Serial.write(0x90 | (channel & 0x0F)); // 0x90 = Note On
-  Serial.write(pitch & 0x7F);
-  Serial.write(velocity & 0x7F);
+  midiQueue(0x90 | (channel & 0x0F), pitch, velocity); // 0x90 = Note On
 }
 
 // Send a MIDI "Note Off" message
 void midiNoteOff(byte channel, byte pitch, byte velocity) {
-  Serial.write(0x80 | (channel & 0x0F)); // 0x80 = Note Off
-  Serial.write(pitch & 0x7F);
-  Serial.write(velocity & 0x7F);
+  if (velocity == 0) {
+    // Note On with velocity 0 means Note Off and keeps the running status
+    midiQueue(0x90 | (channel & 0x0F), pitch, 0);
+  } else {
+    midiQueue(0x80 | (channel & 0x0F), pitch, velocity); // 0x80 = Note Off
+  }
+}
+
+// ------------------ SEQUENCER ----------------------
+// Notes are turned into separate Note On / Note Off events with a
+// timestamp in "song milliseconds" and kept in a small time-ordered queue.
+// Timer1 advances the song clock every 1 ms, scaled by the tempo pot (or
+// by the MIDI clock, see below), and loop() sends every event whose time
+// has come. Nothing blocks, so notes can overlap and a tempo change takes
+// effect on the very next tick.
+
+#define EVENT_QUEUE_SIZE 16
+
+struct SeqEvent {
+  unsigned long time; // song ms
+  byte status;        // 0x90 Note On / 0x80 Note Off
+  byte pitch;
+  byte velocity;
+};
+
+SeqEvent eventQueue[EVENT_QUEUE_SIZE]; // sorted, earliest first
+int queuedEvents = 0;
+
+// Song clock, advanced by the Timer1 ISR: whole song ms plus a fraction
+// in 1/256 ms. Kept apart, the ms count runs the full 32 bits (49 days)
+// instead of wrapping after 2^24 ms (4.6 hours) as one Q8 number would.
+volatile unsigned long songMs = 0;
+volatile byte songFrac = 0;            // 1/256 ms
+volatile unsigned int tempoStep = 256; // song time per 1 ms tick (Q8)
+
+enum Transport {
+  TRANSPORT_FREE,     // no MIDI clock: own tempo from the pot
+  TRANSPORT_FOLLOW,   // locked to the MIDI clock
+  TRANSPORT_CUED,     // Start / Continue received, waiting for the next clock
+  TRANSPORT_STOPPED   // Stop received
+};
+
+volatile Transport transport = TRANSPORT_FREE;
+
+NoteEvent nextNote;             // next note to schedule, read ahead
+unsigned long nextNoteTime = 0; // song ms when nextNote starts
+unsigned long songEndTime = 0;  // song ms when the last note has ended
+byte buzzerPitch = 0;          // note currently on the buzzer (0 = none)
+
+ISR(TIMER1_COMPA_vect) {
+  unsigned long sum = songFrac + (unsigned long)tempoStep;
+  songMs += sum >> 8;
+  songFrac = sum & 0xFF;
+}
+
+// Song clock in 1/256 ms, modulo 2^32: only for differences between two
+// readings (interrupts off)
+unsigned long songClockQ8() {
+  return (songMs << 8) | songFrac;
+}
+
+// Move the song clock by 'delta' 1/256 ms, either way (interrupts off)
+void songClockShift(long delta) {
+  long sum = songFrac + delta;
+  songMs += sum >> 8;  // arithmetic shift: rounds down for negative sums
+  songFrac = sum & 0xFF;
+}
+
+// Timer1 in CTC mode: 16 MHz / 64 / 250 = 1 kHz tick
+void setupSequencerTimer() {
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
+  TCNT1 = 0;
+  OCR1A = 249;
+  TIMSK1 |= (1 << OCIE1A);
+  interrupts();
+}
+
+// Current song time in ms
+unsigned long songNow() {
+  noInterrupts();
+  unsigned long ms = songMs;
+  interrupts();
+  return ms;
+}
+
+// Tempo as a percentage of note durations (50 = twice as fast).
+// Ignored while the MIDI transport is in charge.
+void setTempo(int tempoFactor) {
+  unsigned int step = 25600UL / tempoFactor;
+  noInterrupts();
+  if (transport == TRANSPORT_FREE) tempoStep = step;
+  interrupts();
+}
+
+// Insert an event keeping the queue in time order; false if full
+bool queueEvent(unsigned long time, byte status, byte pitch, byte velocity) {
+  if (queuedEvents >= EVENT_QUEUE_SIZE) return false;
+  int i = queuedEvents++;
+  while (i > 0 && (long)(eventQueue[i - 1].time - time) > 0) {
+    eventQueue[i] = eventQueue[i - 1];
+    i--;
+  }
+  eventQueue[i].time = time;
+  eventQueue[i].status = status;
+  eventQueue[i].pitch = pitch;
+  eventQueue[i].velocity = velocity;
+  return true;
+}
+
+// Move song notes that are due into the event queue
+void scheduleNotes(unsigned long now) {
+  while ((long)(now - nextNoteTime) >= 0) {
+    // Each note needs two queue slots; wait for room
+    if (queuedEvents > EVENT_QUEUE_SIZE - 2) return;
+
+    queueEvent(nextNoteTime, 0x90, nextNote.pitch, nextNote.velocity);
+    queueEvent(nextNoteTime + nextNote.duration, 0x80, nextNote.pitch, 0);
+    if ((long)(nextNoteTime + nextNote.duration - songEndTime) > 0) {
+      songEndTime = nextNoteTime + nextNote.duration;
+    }
+
+    if (!songNext(songReader, nextNote)) {
+      // Start over after the pause
+      midiResetRunningStatus();
+      songRewind(songReader);
+      songNext(songReader, nextNote);
+      nextNoteTime = songEndTime + SONG_PAUSE;
+    }
+    nextNoteTime += nextNote.delta;
+  }
 }
 
-// Play a note (both MIDI and optional buzzer)
-void playNote(NoteEvent note, int tempoFactor) {
-  // Calculate adjusted duration based on tempo
-  int adjustedDuration = note.duration * tempoFactor / 100;
+// ------------------ MIDI INPUT ---------------------
+// Bytes from MIDI IN are parsed in the receive interrupt:
+//   - channel messages (with running status) are passed on to MIDI OUT;
+//   - real-time bytes are passed on at once and drive the transport:
+//     Clock (F8, 24 per quarter note), Start (FA), Continue (FB) and
+//     Stop (FC);
+//   - SysEx and system common messages are skipped, not passed on.
+//
+// Clock following: the song is written in ms at SONG_BPM, so each clock
+// should move the song on by a fixed amount (CLOCK_SONG_Q8). On every
+// clock the receive interrupt
+//   - averages the time between clocks (the period estimate), and
+//   - compares where the song clock is with where it should be by now
+//     (the phase error),
+// then sets tempoStep so the song clock covers one clock plus half of
+// that error by the time the next clock is due. Like a PLL, the error
+// halves on every clock, so jitter on single clocks is smoothed out while
+// a tempo change is followed within a few clocks.
 
-  // Send MIDI Note On
-  midiNoteOn(0, note.pitch, note.velocity);
+#define SONG_BPM 120                                    // tempo the song's ms are written at
+#define CLOCK_SONG_Q8 (60000L * 256 / (SONG_BPM * 24))  // song time per MIDI clock, 1/256 ms
+#define CLOCK_TIMEOUT_US 500000UL  // no clock, Start, Continue or Stop for this long = back to the pot
 
-  // Also play on buzzer (approx. frequency)
-  int freq = 440 * pow(2, (note.pitch - 69) / 12.0);
-  tone(BUZZER_PIN, freq, adjustedDuration);
+volatile bool startPending = false;  // for loop(): rewind the song
+volatile bool stopPending = false;   // for loop(): silence the notes
 
-  delay(adjustedDuration);
+// Receive ISR state
+byte midiInStatus = 0;       // running status (0 = none)
+byte midiInData[2];
+byte midiInCount = 0;
+volatile unsigned long clockLast = 0;   // micros() of the last clock
+volatile unsigned long transportLast = 0;  // micros() of the last clock, Start, Continue or Stop
+unsigned long clockPeriod = 0;          // smoothed us per clock, 0 = unknown
+unsigned long clockTarget = 0;          // songClockQ8() due at the last clock
+bool clockSeen = false;
 
-  // Send MIDI Note Off
-  midiNoteOff(0, note.pitch, 0);
+void midiThru(byte status, byte data1, byte data2) {
+  byte next = (midiThruHead + 1) & (MIDI_QUEUE_SIZE - 1);
+  if (next == midiThruTail) {
+    midiThruDropped++;
+    return;
+  }
+  midiThruQueue[midiThruHead].status = status;
+  midiThruQueue[midiThruHead].data1 = data1;
+  midiThruQueue[midiThruHead].data2 = data2;
+  midiThruHead = next;
+  UCSR0B |= (1 << UDRIE0);
+}
 
-  // Short gap between notes
-  delay(50);
+void midiThruRealtime(byte b) {
+  byte next = (midiRtHead + 1) & (MIDI_RT_SIZE - 1);
+  if (next == midiRtTail) return;  // cannot happen at one byte in per byte out
+  midiRtQueue[midiRtHead] = b;
+  midiRtHead = next;
+  UCSR0B |= (1 << UDRIE0);
 }
 
+// One MIDI clock (ISR only)
+void clockTick(unsigned long t) {
+  unsigned long measured = t - clockLast;
+  clockLast = t;
+  transportLast = t;
+  if (clockSeen && measured < CLOCK_TIMEOUT_US) {
+    // Period estimate: move a quarter of the way to each new measurement
+    if (clockPeriod == 0) clockPeriod = measured;
+    else clockPeriod += ((long)measured - (long)clockPeriod) / 4;
+  }
+  clockSeen = true;
+
+  if (transport == TRANSPORT_STOPPED) return;  // keep the estimate, stay put
+  if (transport != TRANSPORT_FOLLOW) {
+    // First clock: the song is where it should be
+    transport = TRANSPORT_FOLLOW;
+    clockTarget = songClockQ8();
+  } else {
+    clockTarget += CLOCK_SONG_Q8;
+  }
+
+  long error = (long)(clockTarget - songClockQ8());
+  if (error > 24 * CLOCK_SONG_Q8 || error < -24 * CLOCK_SONG_Q8) {
+    clockTarget = songClockQ8();  // more than a beat out: lock on from here
+    error = 0;
+  }
+  long want = CLOCK_SONG_Q8 + error / 2;  // song time to cover by the next clock
+  if (want < 0) want = 0;
+  if (clockPeriod == 0) {
+    tempoStep = 256;  // no period yet: the song's own tempo
+  } else {
+    unsigned long step = (unsigned long)want * 1000 / clockPeriod;
+    tempoStep = step > 0xFFFF ? 0xFFFF : step;
+  }
+}
+
+void midiRealtime(byte b) {
+  midiThruRealtime(b);
+  if (b == 0xFA || b == 0xFB || b == 0xFC) transportLast = micros();
+  switch (b) {
+    case 0xF8:  // Clock
+      clockTick(micros());
+      break;
+    case 0xFA:  // Start: from the top on the next clock
+      songMs = 0;
+      songFrac = 0;
+      tempoStep = 0;
+      transport = TRANSPORT_CUED;
+      startPending = true;
+      break;
+    case 0xFB:  // Continue: from here on the next clock
+      tempoStep = 0;
+      transport = TRANSPORT_CUED;
+      break;
+    case 0xFC:  // Stop
+      // Stop exactly on the last clock, so Continue picks up in step
+      if (transport == TRANSPORT_FOLLOW) songClockShift((long)(clockTarget - songClockQ8()));
+      tempoStep = 0;
+      transport = TRANSPORT_STOPPED;
+      stopPending = true;
+      break;
+  }
+}
+
+ISR(USART_RX_vect) {
+  bool broken = UCSR0A & ((1 << FE0) | (1 << DOR0));
+  byte b = UDR0;
+  if (broken) {
+    midiInStatus = 0;  // lost a byte: wait for the next status
+    return;
+  }
+
+  if (b >= 0xF8) {
+    midiRealtime(b);  // may come anywhere, even inside a message
+  } else if (b >= 0xF0) {
+    midiInStatus = 0;  // SysEx / system common: skip until the next status
+  } else if (b & 0x80) {
+    midiInStatus = b;
+    midiInCount = 0;
+  } else if (midiInStatus != 0) {
+    midiInData[midiInCount++] = b;
+    if (midiInCount == midiDataBytes(midiInStatus)) {
+      midiThru(midiInStatus, midiInData[0], midiInData[1]);
+      midiInCount = 0;  // running status: more data bytes = another message
+    }
+  }
+}
+
+// No clock for a while: fall back to the tempo pot. This also frees a
+// player left waiting after Start or Continue with no clock to follow, or
+// after a Stop from a DAW that stops sending clocks with it, which would
+// otherwise stand still with the pot ignored. setTempo() in loop() then
+// takes over the tempo again.
+void checkClockTimeout() {
+  noInterrupts();
+  bool lost = transport != TRANSPORT_FREE && micros() - transportLast > CLOCK_TIMEOUT_US;
+  if (lost) transport = TRANSPORT_FREE;
+  interrupts();
+}
+
+// ------------------ FUNCTIONS ----------------------
+
+// Send an event on MIDI and mirror it on the buzzer
+void playEvent(const SeqEvent &ev) {
+  if (ev.status == 0x90) {
+    midiNoteOn(0, ev.pitch, ev.velocity);
+
+    // The buzzer is monophonic: it follows the latest note
+    tone(BUZZER_PIN, pitchToFrequency(ev.pitch));
+    buzzerPitch = ev.pitch;
+  } else {
+    midiNoteOff(0, ev.pitch, ev.velocity);
+    if (ev.pitch == buzzerPitch) {
+      noTone(BUZZER_PIN);
+      buzzerPitch = 0;
+    }
+  }
+}
+
+// Send every queued event whose time has come
+void dispatchEvents(unsigned long now) {
+  int sent = 0;
+  while (sent < queuedEvents && (long)(now - eventQueue[sent].time) >= 0) {
+    playEvent(eventQueue[sent]);
+    sent++;
+  }
+  if (sent == 0) return;
+  midiFlush();
+
+  queuedEvents -= sent;
+  for (int i = 0; i < queuedEvents; i++) {
+    eventQueue[i] = eventQueue[i + sent];
+  }
+}
+
+// Stop / Start: end every note that is sounding and forget the queue
+void releaseNotes() {
+  for (int i = 0; i < queuedEvents; i++) {
+    if (eventQueue[i].status == 0x80) playEvent(eventQueue[i]);
+  }
+  queuedEvents = 0;
+  midiFlush();
+}
+
+// Act on the transport messages the receive interrupt has seen
+void transportService() {
+  if (stopPending) {
+    stopPending = false;
+    releaseNotes();
+  }
+  if (startPending) {
+    startPending = false;
+    releaseNotes();
+    midiResetRunningStatus();
+    songRewind(songReader);
+    songNext(songReader, nextNote);
+    nextNoteTime = nextNote.delta;
+    songEndTime = 0;
+  }
+  checkClockTimeout();
+}
+
+int8_t tempoChannel;  // AdcSampler channel of TEMPO_POT
+
 // ------------------- SETUP -------------------------
 void setup() {
-  Serial.begin(MIDI_BAUD); // MIDI OUT serial speed
+  midiBegin(); // MIDI IN and OUT
   pinMode(BUZZER_PIN, OUTPUT);
   pinMode(TEMPO_POT, INPUT);
+  tempoChannel = adcAttach(TEMPO_POT);
+  adcBegin(); // the pot is sampled in the background
 
-  Serial.println("MIDI Player Ready");
+  songRewind(songReader);
+  songNext(songReader, nextNote);
+  nextNoteTime = nextNote.delta;
+  setupSequencerTimer();
 }
 
 // -------------------- LOOP -------------------------
 void loop() {
-  // Read tempo pot (map 0-1023 to 50%–150% tempo)
-  int potVal = analogRead(TEMPO_POT);
-  int tempoFactor = map(potVal, 0, 1023, 50, 150);
+  transportService();
 
-  // Play the song
-  for (int i = 0; i < songLength; i++) {
-    playNote(song[i], tempoFactor);
-  }
+  // Read tempo pot (map 0-ADC_MAX to 50%–150% tempo); no waiting on the ADC.
+  // A MIDI clock overrides it
+  int potVal = adcRead(tempoChannel);
+  int tempoFactor = map(potVal, 0, ADC_MAX, 50, 150);
+  setTempo(tempoFactor);
 
-  delay(1000); // pause before repeating
+  // Play whatever is due; returns right away otherwise
+  unsigned long now = songNow();
+  scheduleNotes(now);
+  dispatchEvents(now);
 }
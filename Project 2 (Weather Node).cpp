@@ -8,6 +8,7 @@
    - Caches last successful forecast to LittleFS
    - OTA updates support (basic)
    - Backoff, retry, power-friendly scheduling (deep sleep option)
+   - Sensing, networking and display run as separate FreeRTOS tasks
   
   Required libraries:
    - WiFi.h
@@ -32,6 +33,8 @@
 #include <LittleFS.h>
 #include "SPIFFS.h"   // fallback if you prefer SPIFFS
 #include <ArduinoOTA.h>
+#include <esp_sleep.h>
+#include <esp_heap_caps.h>
 
 // ----------------- USER CONFIG -----------------------
 #define WIFI_SSID      "YOUR_WIFI_SSID"
@@ -47,13 +50,23 @@
 #define MQTT_PORT 1883
 #define MQTT_USER "mqtt_user"
 #define MQTT_PASS "mqtt_pass"
-#define MQTT_TOPIC_METRICS "home/weather_node/metrics"
+#define MQTT_TOPIC_METRICS_BATCH "home/weather_node/metrics/batch" // binary, see spoolFlush()
 #define MQTT_TOPIC_FORECAST "home/weather_node/forecast"
+#define MQTT_TOPIC_HEAP "home/weather_node/heap"
 
 // Polling & sleep intervals
 const uint32_t FETCH_INTERVAL_SECONDS = 15 * 60; // 15 minutes between online fetches
 const uint32_t SENSOR_INTERVAL_SECONDS = 60;     // measure local sensor every minute
 const uint8_t MAX_HTTP_RETRIES = 3;
+const uint32_t HEAP_REPORT_SECONDS = 10 * 60;    // heap statistics over MQTT
+
+// Deep-sleep duty cycle: 1 = sleep between sensor ticks and only bring up
+// WiFi when a fetch or a batched publish is due (no OTA in this mode),
+// 0 = stay awake in loop() with WiFi, MQTT and OTA always on
+#ifndef DEEP_SLEEP_MODE
+#define DEEP_SLEEP_MODE 0
+#endif
+const uint8_t PUBLISH_BATCH_SAMPLES = 10;        // samples per radio session when sleeping
 
 // Pins / devices
 #define BME_SDA_PIN 21
@@ -66,8 +79,16 @@ const uint8_t MAX_HTTP_RETRIES = 3;
 #define I2C_SDA BME_SDA_PIN
 #define I2C_SCL BME_SCL_PIN
 
-// LittleFS cache file
-const char *CACHE_FILE = "/weather_cache.json";
+// LittleFS cache file (binary, see writeCache())
+const char *CACHE_FILE = "/weather_cache.bin";
+const char *CACHE_TMP_FILE = "/weather_cache.tmp";
+const char *LEGACY_CACHE_FILE = "/weather_cache.json"; // old raw JSON cache
+
+// LittleFS telemetry spool: local samples wait here until MQTT is up
+const char *SPOOL_FILE = "/telemetry_spool.bin";
+#define SPOOL_CAPACITY  720  // samples (12 hours at one per minute)
+#define SPOOL_BATCH_MAX 60   // samples per MQTT message
+#define MQTT_BUFFER_SIZE 1536 // PubSubClient packet buffer, fits a full batch
 
 // -------------- Globals -------------------------------
 Adafruit_BME280 bme; // BME280 object
@@ -75,12 +96,69 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
 
-uint32_t lastFetchTime = 0;
-uint32_t lastSensorTime = 0;
+// Scheduling state lives in RTC memory so it survives deep sleep
+RTC_DATA_ATTR uint32_t lastFetchTime = 0;
 
 // Simple exponential backoff state
-uint8_t httpFailCount = 0;
-uint32_t nextAllowedFetchAt = 0; // epoch seconds
+RTC_DATA_ATTR uint8_t httpFailCount = 0;
+RTC_DATA_ATTR uint32_t nextAllowedFetchAt = 0; // epoch seconds
+
+// Local sensor samples waiting to be published (used in deep-sleep mode)
+struct SensorSample {
+  uint32_t time;  // epoch seconds
+  float t;        // C
+  float h;        // %
+  float p;        // Pa
+};
+
+#define SAMPLE_RING_SIZE 16
+RTC_DATA_ATTR SensorSample sampleRing[SAMPLE_RING_SIZE];
+RTC_DATA_ATTR uint8_t sampleHead = 0;   // next slot to write
+RTC_DATA_ATTR uint8_t sampleCount = 0;  // samples waiting, oldest dropped when full
+
+// The only fields of the One Call response the node uses
+#define FORECAST_HOURS 12
+#define FORECAST_DAYS  8
+
+struct RemoteWeather {
+  uint32_t fetchedAt;                // epoch seconds
+  float temp;                        // current.temp
+  char desc[32];                     // current.weather[0].description
+  uint8_t hourlyCount;
+  float hourlyTemp[FORECAST_HOURS];  // hourly[].temp
+  uint8_t dailyCount;
+  float dailyMax[FORECAST_DAYS];     // daily[].temp.max
+  float dailyMin[FORECAST_DAYS];     // daily[].temp.min
+};
+
+// Responses are parsed straight from the stream through this filter, so
+// only the fields above are ever stored (the full body is tens of KB).
+// Both documents are static to keep them off the loop task's stack.
+// The filter needs one slot per object member and array element it holds
+// (13 slots, 208 bytes on the ESP32); keys are literals, so they take no
+// room. A filter that runs out of room silently drops the last fields.
+#define WEATHER_FILTER_NEEDED (JSON_OBJECT_SIZE(3)                         /* current, hourly, daily */ \
+                             + JSON_OBJECT_SIZE(2)                         /* current.temp, .weather */ \
+                             + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(1)    /* weather[0].description */ \
+                             + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(1)    /* hourly[0].temp */ \
+                             + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(1)    /* daily[0].temp */ \
+                             + JSON_OBJECT_SIZE(2))                        /* temp.max, temp.min */
+#define WEATHER_FILTER_SIZE 256
+static_assert(WEATHER_FILTER_SIZE >= WEATHER_FILTER_NEEDED, "weatherFilter is too small for its fields");
+
+StaticJsonDocument<WEATHER_FILTER_SIZE> weatherFilter;
+StaticJsonDocument<3072> weatherDoc;
+
+// On-flash cache layout. Bump CACHE_VERSION whenever RemoteWeather changes.
+#define CACHE_MAGIC   0x57434348UL  // "WCCH"
+#define CACHE_VERSION 1
+
+struct CacheHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;     // sizeof(RemoteWeather)
+  uint32_t crc;      // CRC-32 of the RemoteWeather record
+};
 
 // Utility: convert millis() to epoch seconds using system time (requires NTP if you want true epoch)
 uint32_t nowEpoch() {
@@ -127,42 +205,250 @@ bool initFS() {
   return true;
 }
 
-// Save JSON string to cache file
-void writeCache(const String &json) {
-  File f = LittleFS.open(CACHE_FILE, "w");
+// Build the field filter used for API responses
+void initWeatherFilter() {
+  weatherFilter["current"]["temp"] = true;
+  weatherFilter["current"]["weather"][0]["description"] = true;
+  weatherFilter["hourly"][0]["temp"] = true;
+  weatherFilter["daily"][0]["temp"]["max"] = true;
+  weatherFilter["daily"][0]["temp"]["min"] = true;
+}
+
+// Copy the used fields out of a filtered document
+void extractRemoteWeather(JsonDocument &doc, RemoteWeather &out) {
+  memset(&out, 0, sizeof(out)); // padding included, the cache CRC covers it
+  out.temp = doc["current"]["temp"] | NAN;
+  strlcpy(out.desc, doc["current"]["weather"][0]["description"] | "unknown", sizeof(out.desc));
+
+  JsonArray hourly = doc["hourly"];
+  out.hourlyCount = 0;
+  for (JsonObject hour : hourly) {
+    if (out.hourlyCount >= FORECAST_HOURS) break;
+    out.hourlyTemp[out.hourlyCount++] = hour["temp"] | NAN;
+  }
+
+  JsonArray daily = doc["daily"];
+  out.dailyCount = 0;
+  for (JsonObject day : daily) {
+    if (out.dailyCount >= FORECAST_DAYS) break;
+    out.dailyMax[out.dailyCount] = day["temp"]["max"] | NAN;
+    out.dailyMin[out.dailyCount] = day["temp"]["min"] | NAN;
+    out.dailyCount++;
+  }
+}
+
+// CRC-32 (IEEE), bitwise; the cache record is only a few hundred bytes
+uint32_t crc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// Save the forecast to the cache as a binary record. The file is written
+// under a temporary name and renamed over the old one, so a reset halfway
+// through never leaves a half-written cache behind.
+void writeCache(const RemoteWeather &remote) {
+  CacheHeader header;
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.size = sizeof(RemoteWeather);
+  header.crc = crc32((const uint8_t *)&remote, sizeof(remote));
+
+  File f = LittleFS.open(CACHE_TMP_FILE, "w");
   if (!f) {
     Serial.println("Failed to open cache for writing");
     return;
   }
-  f.print(json);
+  bool ok = f.write((const uint8_t *)&header, sizeof(header)) == sizeof(header)
+         && f.write((const uint8_t *)&remote, sizeof(remote)) == sizeof(remote);
   f.close();
+
+  if (!ok || !LittleFS.rename(CACHE_TMP_FILE, CACHE_FILE)) {
+    Serial.println("Failed to write cache");
+    LittleFS.remove(CACHE_TMP_FILE);
+  }
 }
 
-// Read cached JSON (if exists). Returns empty string if not found.
-String readCache() {
-  if (!LittleFS.exists(CACHE_FILE)) return "";
+// Read the cached forecast (if it exists). Returns false if there is none,
+// or if it is from another firmware version or fails its CRC.
+bool readCache(RemoteWeather &out) {
+  if (LittleFS.exists(LEGACY_CACHE_FILE)) LittleFS.remove(LEGACY_CACHE_FILE);
+  if (!LittleFS.exists(CACHE_FILE)) return false;
+
   File f = LittleFS.open(CACHE_FILE, "r");
-  if (!f) return "";
-  String s = f.readString();
+  if (!f) return false;
+  CacheHeader header;
+  bool ok = f.read((uint8_t *)&header, sizeof(header)) == sizeof(header)
+         && header.magic == CACHE_MAGIC
+         && header.version == CACHE_VERSION
+         && header.size == sizeof(RemoteWeather)
+         && f.read((uint8_t *)&out, sizeof(out)) == sizeof(out)
+         && crc32((const uint8_t *)&out, sizeof(out)) == header.crc;
   f.close();
-  return s;
-}
-
-// Format JSON docs to string with safety
-String jsonToString(DynamicJsonDocument &doc) {
-  String out;
-  serializeJson(doc, out);
-  return out;
+  if (!ok) {
+    Serial.println("Cache missing, outdated or corrupt");
+    return false;
+  }
+  return true;
 }
 
 // Publish metrics to MQTT
-void publishMetrics(const String &payload, const char *topic) {
+bool publishMetrics(const char *topic, const char *payload) {
   if (mqttClient.connected()) {
-    bool ok = mqttClient.publish(topic, payload.c_str());
+    bool ok = mqttClient.publish(topic, payload);
     Serial.print("MQTT publish to "); Serial.print(topic); Serial.print(" -> ");
     Serial.println(ok ? "OK" : "Failed");
-  } else {
-    Serial.println("MQTT not connected, cannot publish.");
+    return ok;
+  }
+  Serial.println("MQTT not connected, cannot publish.");
+  return false;
+}
+
+// ---------------- Telemetry spool ---------------------
+// Every local sample is appended to a fixed-size ring file in LittleFS and
+// the ring is flushed to MQTT in batches whenever the broker is reachable,
+// so outages delay samples instead of losing them (the oldest are only
+// overwritten after SPOOL_CAPACITY samples).
+//
+// File layout: SpoolHeader, then SPOOL_CAPACITY SpoolRecords.
+#define SPOOL_MAGIC 0x53504F4CUL  // "SPOL"
+
+struct SpoolHeader {
+  uint32_t magic;
+  uint16_t head;   // slot the next sample goes to
+  uint16_t count;  // samples waiting to be sent
+};
+
+struct SpoolRecord {
+  uint32_t time;   // epoch seconds
+  int16_t t;       // 0.01 C
+  uint16_t h;      // 0.01 %
+  uint32_t p;      // Pa
+};
+
+SpoolHeader spool;
+bool spoolReady = false;
+SpoolRecord spoolBatch[SPOOL_BATCH_MAX];  // records being flushed
+uint8_t spoolPayload[8 + SPOOL_BATCH_MAX * 20];
+
+// Load the spool header, creating an empty spool if needed
+void spoolInit() {
+  const size_t fileSize = sizeof(SpoolHeader) + SPOOL_CAPACITY * sizeof(SpoolRecord);
+  File f = LittleFS.exists(SPOOL_FILE) ? LittleFS.open(SPOOL_FILE, "r") : File();
+  if (f && f.size() == fileSize
+      && f.read((uint8_t *)&spool, sizeof(spool)) == sizeof(spool)
+      && spool.magic == SPOOL_MAGIC && spool.head < SPOOL_CAPACITY && spool.count <= SPOOL_CAPACITY) {
+    f.close();
+    spoolReady = true;
+    return;
+  }
+  if (f) f.close();
+
+  // (Re)create the file at full size so later writes only seek
+  f = LittleFS.open(SPOOL_FILE, "w");
+  if (!f) {
+    Serial.println("Failed to create telemetry spool");
+    return;
+  }
+  spool.magic = SPOOL_MAGIC;
+  spool.head = 0;
+  spool.count = 0;
+  f.write((const uint8_t *)&spool, sizeof(spool));
+  memset(spoolBatch, 0, sizeof(spoolBatch));
+  for (int i = 0; i < SPOOL_CAPACITY; i += SPOOL_BATCH_MAX) {
+    int n = min(SPOOL_BATCH_MAX, SPOOL_CAPACITY - i);
+    f.write((const uint8_t *)spoolBatch, n * sizeof(SpoolRecord));
+  }
+  f.close();
+  spoolReady = true;
+}
+
+// Rewrite the spool header
+void spoolWriteHeader(File &f) {
+  f.seek(0);
+  f.write((const uint8_t *)&spool, sizeof(spool));
+}
+
+// Append one sample (the record first, then the header that commits it)
+void spoolAppend(const SensorSample &sample) {
+  if (!spoolReady) return;
+  SpoolRecord rec;
+  rec.time = sample.time;
+  rec.t = (int16_t)lroundf(sample.t * 100.0F);
+  rec.h = (uint16_t)lroundf(sample.h * 100.0F);
+  rec.p = (uint32_t)lroundf(sample.p);
+
+  File f = LittleFS.open(SPOOL_FILE, "r+");
+  if (!f) return;
+  f.seek(sizeof(SpoolHeader) + spool.head * sizeof(SpoolRecord));
+  f.write((const uint8_t *)&rec, sizeof(rec));
+  spool.head = (spool.head + 1) % SPOOL_CAPACITY;
+  if (spool.count < SPOOL_CAPACITY) spool.count++;
+  spoolWriteHeader(f);
+  f.close();
+}
+
+// Little-endian base-128 varint, returns bytes written
+size_t putVarint(uint8_t *out, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  out[n++] = v;
+  return n;
+}
+
+// Signed deltas as zigzag varints (small magnitudes stay one byte)
+size_t putSignedVarint(uint8_t *out, int32_t v) {
+  return putVarint(out, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+// Send waiting samples as compact binary batches, oldest first.
+// Payload: format byte (1), varint sample count, then per sample the
+// zigzag varint deltas of time (s), temperature (0.01 C), humidity
+// (0.01 %) and pressure (Pa) from the previous sample (the first sample
+// is a delta from zero). A steady minute-by-minute sample is ~5 bytes.
+void spoolFlush() {
+  while (spoolReady && spool.count > 0 && mqttClient.connected()) {
+    uint16_t n = min((uint16_t)SPOOL_BATCH_MAX, spool.count);
+    uint16_t tail = (spool.head + SPOOL_CAPACITY - spool.count) % SPOOL_CAPACITY;
+
+    File f = LittleFS.open(SPOOL_FILE, "r");
+    if (!f) return;
+    for (uint16_t i = 0; i < n; i++) {
+      uint16_t slot = (tail + i) % SPOOL_CAPACITY;
+      if (i == 0 || slot == 0) f.seek(sizeof(SpoolHeader) + slot * sizeof(SpoolRecord));
+      f.read((uint8_t *)&spoolBatch[i], sizeof(SpoolRecord));
+    }
+    f.close();
+
+    size_t len = 0;
+    spoolPayload[len++] = 1;
+    len += putVarint(spoolPayload + len, n);
+    SpoolRecord prev = {0, 0, 0, 0};
+    for (uint16_t i = 0; i < n; i++) {
+      const SpoolRecord &rec = spoolBatch[i];
+      len += putSignedVarint(spoolPayload + len, (int32_t)(rec.time - prev.time));
+      len += putSignedVarint(spoolPayload + len, rec.t - prev.t);
+      len += putSignedVarint(spoolPayload + len, (int32_t)rec.h - (int32_t)prev.h);
+      len += putSignedVarint(spoolPayload + len, (int32_t)(rec.p - prev.p));
+      prev = rec;
+    }
+
+    bool ok = mqttClient.publish(MQTT_TOPIC_METRICS_BATCH, spoolPayload, len);
+    Serial.printf("MQTT batch of %u samples (%u bytes) -> %s\n", (unsigned)n, (unsigned)len, ok ? "OK" : "Failed");
+    if (!ok) return;
+
+    // Sent: drop them from the spool
+    spool.count -= n;
+    f = LittleFS.open(SPOOL_FILE, "r+");
+    if (!f) return;
+    spoolWriteHeader(f);
+    f.close();
   }
 }
 
@@ -170,6 +456,7 @@ void publishMetrics(const String &payload, const char *topic) {
 void mqttConnect() {
   if (mqttClient.connected()) return;
   mqttClient.setServer(MQTT_SERVER, MQTT_PORT);
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
   Serial.print("Connecting to MQTT...");
   if (mqttClient.connect("weather_node_esp32", MQTT_USER, MQTT_PASS)) {
     Serial.println("connected");
@@ -181,154 +468,645 @@ void mqttConnect() {
   }
 }
 
-// Parse and display cached JSON (fallback)
+// ---------------- Sensor service ----------------------
+// One BME280 forced-mode conversion per sample, read back in a single
+// 8-byte burst (pressure, temperature, humidity at 0xF7..0xFE) and
+// compensated here with the Bosch integer formulas. The library's
+// readPressure() and readHumidity() each re-read the temperature first,
+// so a T/H/P triple used to cost five I2C transactions. A sample is now
+// two: start the conversion, then after the measurement time read the
+// status and the data in one burst.
+#define BME_ADDR       0x76  // common I2C address 0x76 or 0x77
+#define BME_REG_CALIB1 0x88  // T1..P9, 0xA1 = H1
+#define BME_REG_CALIB2 0xE1  // H2..H6
+#define BME_REG_STATUS 0xF3  // status, ctrl_meas, config, reserved, then the data
+#define BME_REG_CTRL   0xF4  // ctrl_meas: osrs_t, osrs_p, mode
+#define BME_DATA_AT    4     // press[3], temp[3], hum[2] after the status burst's first 4 bytes
+#define BME_MEASURING  0x08  // status bit: conversion running
+
+// Oversampling per channel; the sensor sleeps between forced conversions
+#define BME_OSRS_T Adafruit_BME280::SAMPLING_X2
+#define BME_OSRS_P Adafruit_BME280::SAMPLING_X4
+#define BME_OSRS_H Adafruit_BME280::SAMPLING_X1
+#define BME_CTRL_FORCED ((BME_OSRS_T << 5) | (BME_OSRS_P << 2) | Adafruit_BME280::MODE_FORCED)
+
+// Oversampling setting (1..5) to samples, 0 = channel skipped
+#define BME_SAMPLES(osrs) ((osrs) ? 1 << ((osrs) - 1) : 0)
+
+// Trim-mean filter over the last few samples: sort, drop the lowest and
+// highest value, average the rest (a median that still smooths)
+#define SENSOR_FILTER_LEN 5
+
+struct BmeCalib {
+  uint16_t T1; int16_t T2, T3;
+  uint16_t P1; int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+  uint8_t H1; int16_t H2; uint8_t H3; int16_t H4, H5; int8_t H6;
+};
+
+// Fixed-point sample as the compensation produces it
+struct RawSample {
+  int32_t t;   // 0.01 C
+  uint32_t h;  // %RH * 1024
+  uint32_t p;  // Pa * 256
+};
+
+BmeCalib bmeCalib;   // read once in sensorBegin()
+bool bmeReady = false;
+
+// Kept in RTC memory so the filter also works across deep sleep
+RTC_DATA_ATTR RawSample filterRing[SENSOR_FILTER_LEN];
+RTC_DATA_ATTR uint8_t filterHead = 0;
+RTC_DATA_ATTR uint8_t filterCount = 0;
+
+SensorSample latestSample;  // last filtered sample, shared by all consumers
+
+// Read consecutive registers in one I2C transaction
+bool bmeReadRegs(uint8_t reg, uint8_t *buf, uint8_t len) {
+  Wire.beginTransmission(BME_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)BME_ADDR, len) != len) return false;
+  for (uint8_t i = 0; i < len; i++) buf[i] = Wire.read();
+  return true;
+}
+
+// Maximum measurement time for the oversampling above (datasheet 9.1), in ms
+uint32_t bmeMeasureMs() {
+  uint32_t us = 1250 + 2300 * BME_SAMPLES(BME_OSRS_T);
+  if (BME_SAMPLES(BME_OSRS_P)) us += 2300 * BME_SAMPLES(BME_OSRS_P) + 575;
+  if (BME_SAMPLES(BME_OSRS_H)) us += 2300 * BME_SAMPLES(BME_OSRS_H) + 575;
+  return (us + 999) / 1000;
+}
+
+// One forced conversion: set forced mode, sleep through the measurement
+// and read status + data in one burst, instead of polling the status
+// register every millisecond as takeForcedMeasurement() does
+bool bmeForcedRead(uint8_t *data) {
+  Wire.beginTransmission(BME_ADDR);
+  Wire.write(BME_REG_CTRL);
+  Wire.write(BME_CTRL_FORCED);
+  if (Wire.endTransmission() != 0) return false;
+  delay(bmeMeasureMs());
+
+  uint8_t b[BME_DATA_AT + 8];
+  for (uint8_t tries = 0; tries < 5; tries++) {
+    if (!bmeReadRegs(BME_REG_STATUS, b, sizeof(b))) return false;
+    if (!(b[0] & BME_MEASURING)) {
+      memcpy(data, b + BME_DATA_AT, 8);
+      return true;
+    }
+    delay(1); // slower than the datasheet's maximum; look again
+  }
+  return false;
+}
+
+// Little-endian 16-bit word from the calibration block
+uint16_t bmeWord(const uint8_t *b) {
+  return b[0] | (b[1] << 8);
+}
+
+bool bmeReadCalib() {
+  uint8_t c[26];
+  uint8_t e[7];
+  if (!bmeReadRegs(BME_REG_CALIB1, c, sizeof(c))) return false;
+  if (!bmeReadRegs(BME_REG_CALIB2, e, sizeof(e))) return false;
+
+  bmeCalib.T1 = bmeWord(c + 0);
+  bmeCalib.T2 = (int16_t)bmeWord(c + 2);
+  bmeCalib.T3 = (int16_t)bmeWord(c + 4);
+  bmeCalib.P1 = bmeWord(c + 6);
+  bmeCalib.P2 = (int16_t)bmeWord(c + 8);
+  bmeCalib.P3 = (int16_t)bmeWord(c + 10);
+  bmeCalib.P4 = (int16_t)bmeWord(c + 12);
+  bmeCalib.P5 = (int16_t)bmeWord(c + 14);
+  bmeCalib.P6 = (int16_t)bmeWord(c + 16);
+  bmeCalib.P7 = (int16_t)bmeWord(c + 18);
+  bmeCalib.P8 = (int16_t)bmeWord(c + 20);
+  bmeCalib.P9 = (int16_t)bmeWord(c + 22);
+  bmeCalib.H1 = c[25];
+  bmeCalib.H2 = e[0] | (e[1] << 8);
+  bmeCalib.H3 = e[2];
+  bmeCalib.H4 = ((int8_t)e[3] << 4) | (e[4] & 0x0F);
+  bmeCalib.H5 = ((int8_t)e[5] << 4) | (e[4] >> 4);
+  bmeCalib.H6 = (int8_t)e[6];
+  return true;
+}
+
+// Bosch reference compensation (BME280 datasheet, section 8.2)
+int32_t bmeCompensateT(int32_t adcT, int32_t &tFine) {
+  const BmeCalib &c = bmeCalib;
+  int32_t var1 = ((((adcT >> 3) - ((int32_t)c.T1 << 1))) * ((int32_t)c.T2)) >> 11;
+  int32_t var2 = (((((adcT >> 4) - ((int32_t)c.T1)) * ((adcT >> 4) - ((int32_t)c.T1))) >> 12) *
+                  ((int32_t)c.T3)) >> 14;
+  tFine = var1 + var2;
+  return (tFine * 5 + 128) >> 8;
+}
+
+uint32_t bmeCompensateP(int32_t adcP, int32_t tFine) {
+  const BmeCalib &c = bmeCalib;
+  int64_t var1 = ((int64_t)tFine) - 128000;
+  int64_t var2 = var1 * var1 * (int64_t)c.P6;
+  var2 = var2 + ((var1 * (int64_t)c.P5) << 17);
+  var2 = var2 + (((int64_t)c.P4) << 35);
+  var1 = ((var1 * var1 * (int64_t)c.P3) >> 8) + ((var1 * (int64_t)c.P2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)c.P1) >> 33;
+  if (var1 == 0) return 0; // avoid a division by zero
+  int64_t p = 1048576 - adcP;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)c.P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)c.P8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((int64_t)c.P7) << 4);
+  return (uint32_t)p;
+}
+
+uint32_t bmeCompensateH(int32_t adcH, int32_t tFine) {
+  const BmeCalib &c = bmeCalib;
+  int32_t v = tFine - ((int32_t)76800);
+  v = (((((adcH << 14) - (((int32_t)c.H4) << 20) - (((int32_t)c.H5) * v)) + ((int32_t)16384)) >> 15) *
+       (((((((v * ((int32_t)c.H6)) >> 10) * (((v * ((int32_t)c.H3)) >> 11) + ((int32_t)32768))) >> 10) +
+          ((int32_t)2097152)) * ((int32_t)c.H2) + 8192) >> 14));
+  v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)c.H1)) >> 4));
+  v = v < 0 ? 0 : v;
+  v = v > 419430400 ? 419430400 : v;
+  return (uint32_t)(v >> 12);
+}
+
+// Trimmed mean of one channel of the filter ring
+int64_t filterChannel(int64_t *values, uint8_t n) {
+  // insertion sort, n is tiny
+  for (uint8_t i = 1; i < n; i++) {
+    int64_t v = values[i];
+    int8_t j = i - 1;
+    while (j >= 0 && values[j] > v) {
+      values[j + 1] = values[j];
+      j--;
+    }
+    values[j + 1] = v;
+  }
+  uint8_t first = n >= 3 ? 1 : 0;
+  uint8_t last = n >= 3 ? n - 1 : n;
+  int64_t sum = 0;
+  for (uint8_t i = first; i < last; i++) sum += values[i];
+  uint8_t used = last - first;
+  return (sum + used / 2) / used;
+}
+
+// Start the sensor in forced mode and read its calibration once
+bool sensorBegin() {
+  if (!bme.begin(BME_ADDR)) return false;
+  bme.setSampling(Adafruit_BME280::MODE_FORCED, BME_OSRS_T, BME_OSRS_P, BME_OSRS_H,
+                  Adafruit_BME280::FILTER_OFF);
+  bmeReady = bmeReadCalib();
+  return bmeReady;
+}
+
+// Take one forced measurement, filter it and update latestSample.
+// On a bus error latestSample keeps its previous values.
+bool sensorSample(SensorSample &out) {
+  uint8_t d[8];
+  if (!bmeReady || !bmeForcedRead(d)) {
+    out = latestSample;
+    out.time = nowEpoch();
+    return false;
+  }
+
+  int32_t adcP = ((uint32_t)d[0] << 12) | ((uint32_t)d[1] << 4) | (d[2] >> 4);
+  int32_t adcT = ((uint32_t)d[3] << 12) | ((uint32_t)d[4] << 4) | (d[5] >> 4);
+  int32_t adcH = ((uint32_t)d[6] << 8) | d[7];
+
+  RawSample raw;
+  int32_t tFine;
+  raw.t = bmeCompensateT(adcT, tFine);
+  raw.p = bmeCompensateP(adcP, tFine);
+  raw.h = bmeCompensateH(adcH, tFine);
+
+  filterRing[filterHead] = raw;
+  filterHead = (filterHead + 1) % SENSOR_FILTER_LEN;
+  if (filterCount < SENSOR_FILTER_LEN) filterCount++;
+
+  int64_t tv[SENSOR_FILTER_LEN], hv[SENSOR_FILTER_LEN], pv[SENSOR_FILTER_LEN];
+  for (uint8_t i = 0; i < filterCount; i++) {
+    tv[i] = filterRing[i].t;
+    hv[i] = filterRing[i].h;
+    pv[i] = filterRing[i].p;
+  }
+
+  latestSample.time = nowEpoch();
+  latestSample.t = filterChannel(tv, filterCount) / 100.0F;
+  latestSample.h = filterChannel(hv, filterCount) / 1024.0F;
+  latestSample.p = filterChannel(pv, filterCount) / 256.0F;
+  out = latestSample;
+  return true;
+}
+
+// ---------------- Screen model ------------------------
+// The OLED is kept as 8 text rows, one per SSD1306 page (size-1 text is
+// 8 px tall). Each labelled field owns a row: setting a field redraws that
+// row only if its text changed, and flushScreen() sends only the dirty
+// pages over I2C instead of the whole 1 KB framebuffer.
+enum ScreenField {
+  FIELD_TITLE,     // "Weather Node"
+  FIELD_LOCAL,     // local temperature + humidity
+  FIELD_PRESSURE,  // local pressure
+  FIELD_REMOTE,    // remote temperature
+  FIELD_SUMMARY,   // remote description
+  FIELD_HILO,      // today's high / low
+  NUM_FIELDS
+};
+
+const uint8_t fieldRow[NUM_FIELDS] = {0, 1, 2, 4, 5, 6};
+
+#define SCREEN_COLS  21           // 6 px wide characters on 128 px
+#define SCREEN_PAGES (SCREEN_HEIGHT / 8)
+#define OLED_ADDR    0x3C
+#define I2C_CHUNK    31           // data bytes per Wire transmission (+1 control byte)
+#define OLED_I2C_HZ  400000UL     // fast mode for the page data
+
+char fieldText[NUM_FIELDS][SCREEN_COLS + 1];
+uint8_t dirtyPages = 0;           // bit n set = page n must be sent
+
+// Update one field; only a changed text touches the framebuffer
+void setField(ScreenField field, const char *text) {
+  char clipped[SCREEN_COLS + 1];
+  strlcpy(clipped, text, sizeof(clipped));
+  if (strcmp(clipped, fieldText[field]) == 0) return;
+  strcpy(fieldText[field], clipped);
+
+  uint8_t row = fieldRow[field];
+  display.fillRect(0, row * 8, SCREEN_WIDTH, 8, SSD1306_BLACK);
+  display.setCursor(0, row * 8);
+  display.print(clipped);
+  dirtyPages |= 1 << row;
+}
+
+// Send the dirty pages; neighbouring dirty pages share one address window.
+// Adafruit_SSD1306 drops the bus back to 100 kHz after each of its own
+// transfers, so the raw data writes below set 400 kHz themselves and put
+// the previous clock back when done (the BME280 shares the bus).
+void flushScreen() {
+  uint8_t *buffer = display.getBuffer();
+  uint32_t busClock = Wire.getClock();
+  for (uint8_t page = 0; page < SCREEN_PAGES; page++) {
+    if (!(dirtyPages & (1 << page))) continue;
+    uint8_t last = page;
+    while (last + 1 < SCREEN_PAGES && (dirtyPages & (1 << (last + 1)))) last++;
+
+    display.ssd1306_command(SSD1306_PAGEADDR);
+    display.ssd1306_command(page);
+    display.ssd1306_command(last);
+    display.ssd1306_command(SSD1306_COLUMNADDR);
+    display.ssd1306_command(0);
+    display.ssd1306_command(SCREEN_WIDTH - 1);
+
+    const uint8_t *data = buffer + page * SCREEN_WIDTH;
+    size_t remaining = (last - page + 1) * SCREEN_WIDTH;
+    Wire.setClock(OLED_I2C_HZ); // the commands above reset it
+    while (remaining > 0) {
+      size_t n = min(remaining, (size_t)I2C_CHUNK);
+      Wire.beginTransmission(OLED_ADDR);
+      Wire.write((uint8_t)0x40); // data stream
+      Wire.write(data, n);
+      Wire.endTransmission();
+      data += n;
+      remaining -= n;
+    }
+    Wire.setClock(busClock);
+    page = last;
+  }
+  dirtyPages = 0;
+}
+
+// Display the cached forecast (fallback)
 void showCachedForecast() {
-  String cached = readCache();
-  if (cached.length() == 0) {
+  RemoteWeather cached;
+  if (!readCache(cached)) {
     Serial.println("No cached forecast");
     return;
   }
-  DynamicJsonDocument doc(4096);
-  DeserializationError err = deserializeJson(doc, cached);
-  if (err) {
-    Serial.println("Failed to parse cached JSON");
-    return;
-  }
   // Minimal display of cached data
-  const char* summary = doc["current"]["weather"][0]["description"] | "N/A";
-  float temp = doc["current"]["temp"] | 0.0;
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0,0);
-  display.println("Cached Forecast");
-  display.println(summary);
-  display.print("T: "); display.print(temp); display.println(" C");
-  display.display();
+  char line[SCREEN_COLS + 1];
+  setField(FIELD_TITLE, "Cached Forecast");
+  setField(FIELD_LOCAL, cached.desc);
+  snprintf(line, sizeof(line), "T: %.2f C", cached.temp);
+  setField(FIELD_PRESSURE, line);
+  setField(FIELD_REMOTE, "");
+  setField(FIELD_SUMMARY, "");
+  setField(FIELD_HILO, "");
+  flushScreen();
+}
+
+// ---------------- Forecast client ---------------------
+// One HTTPClient and socket are kept for the whole run: the request URL is
+// formatted once at boot, and HTTP/1.1 keep-alive lets later fetches (and
+// retries) skip the DNS lookup and TCP handshake. Keep-alive needs
+// HTTP/1.1, so bodies may arrive chunked; BodyStream strips the chunk
+// framing before ArduinoJson sees it, and every body is read to the end so
+// the socket is clean for the next request.
+// The server's ETag / Last-Modified are sent back as If-None-Match /
+// If-Modified-Since; an unchanged forecast then answers 304 with no body
+// and the cached copy is used.
+
+enum FetchResult {
+  FETCH_FAILED,
+  FETCH_UPDATED,       // new forecast parsed
+  FETCH_NOT_MODIFIED   // 304, forecast taken from the cache
+};
+
+WiFiClient weatherClient;
+HTTPClient weatherHttp;
+char weatherUrl[192];  // built once by buildWeatherUrl()
+
+// Validators of the cached forecast (RTC so they survive deep sleep)
+RTC_DATA_ATTR char weatherEtag[64] = "";
+RTC_DATA_ATTR char weatherLastModified[40] = "";
+
+const char *WEATHER_HEADERS[] = {"ETag", "Last-Modified", "Transfer-Encoding"};
+
+void buildWeatherUrl() {
+  snprintf(weatherUrl, sizeof(weatherUrl),
+           "http://api.openweathermap.org/data/2.5/onecall?lat=%.6f&lon=%.6f"
+           "&units=metric&exclude=minutely&appid=%s",
+           LOCATION_LAT, LOCATION_LON, OPENWEATHER_APIKEY);
+  weatherHttp.setReuse(true);
+}
+
+// Response body as a plain byte stream: reads exactly Content-Length
+// bytes, or decodes chunked transfer encoding
+class BodyStream : public Stream {
+public:
+  void begin(Stream *src, bool chunked, int length) {
+    _src = src;
+    _chunked = chunked;
+    _remaining = chunked ? 0 : length; // -1 = until the server closes
+    _firstChunk = true;
+    _done = !chunked && length == 0;
+    _timedOut = false;
+  }
+
+  int available() override {
+    if (_done) return 0;
+    int n = _src->available();
+    return (_remaining > 0 && n > _remaining) ? _remaining : n;
+  }
+
+  int read() override {
+    if (!fill()) return -1;
+    int c = _src->read();
+    if (c >= 0 && _remaining > 0) _remaining--;
+    if (!_chunked && _remaining == 0) _done = true;
+    return c;
+  }
+
+  int peek() override {
+    if (!fill()) return -1;
+    return _src->peek();
+  }
+
+  size_t write(uint8_t) override { return 0; }
+
+  // Read and discard whatever is left of the body. read() returns -1 as
+  // soon as the socket has nothing buffered, so keep waiting for more up
+  // to the stream timeout. Returns false if the body did not arrive in full.
+  bool drain() {
+    if (!_chunked && _remaining < 0) return true; // no length: the server closes anyway
+    uint32_t lastByte = millis();
+    while (!_done) {
+      if (read() >= 0) {
+        lastByte = millis();
+      } else if (millis() - lastByte >= getTimeout()) {
+        _timedOut = true;
+        break;
+      } else {
+        delay(1);
+      }
+    }
+    return !_timedOut;
+  }
+
+private:
+  Stream *_src = nullptr;
+  bool _chunked = false;
+  bool _firstChunk = true;
+  bool _done = true;
+  bool _timedOut = false;  // the body ended early: bytes may still be in flight
+  int32_t _remaining = 0;
+
+  int rawRead() {
+    uint8_t c;
+    return _src->readBytes(&c, 1) == 1 ? c : -1;
+  }
+
+  // Make sure body bytes are ready, reading the next chunk header if needed
+  bool fill() {
+    if (_done) return false;
+    if (_remaining != 0) return true;
+    if (!_chunked) {
+      _done = true;
+      return false;
+    }
+
+    if (!_firstChunk) {
+      // CRLF after the previous chunk's data
+      rawRead();
+      rawRead();
+    }
+    _firstChunk = false;
+
+    // "<hex size>[;extensions]\r\n"
+    int32_t size = 0;
+    bool inExtension = false;
+    for (;;) {
+      int c = rawRead();
+      if (c < 0) {
+        _done = true; // timeout or connection lost
+        _timedOut = true;
+        return false;
+      }
+      if (c == '\n') break;
+      if (c == ';') inExtension = true;
+      if (inExtension || c == '\r') continue;
+      int digit = isdigit(c) ? c - '0' : (isxdigit(c) ? (tolower(c) - 'a' + 10) : -1);
+      if (digit >= 0) size = (size << 4) | digit;
+    }
+
+    if (size == 0) {
+      // last chunk: skip trailer lines up to the empty line
+      int lineLength = 0;
+      for (;;) {
+        int c = rawRead();
+        if (c < 0) {
+          _timedOut = true;
+          break;
+        }
+        if (c == '\n') {
+          if (lineLength == 0) break;
+          lineLength = 0;
+        } else if (c != '\r') {
+          lineLength++;
+        }
+      }
+      _done = true;
+      return false;
+    }
+    _remaining = size;
+    return true;
+  }
+};
+
+BodyStream weatherBody;
+
+// End a response. If its body did not arrive in full, the rest could
+// still come in and be read as the next response, so close the socket
+// instead of keeping it for the next fetch.
+void endResponse(HTTPClient &http, bool bodyComplete) {
+  if (!bodyComplete) http.setReuse(false);
+  http.end();
+  http.setReuse(true);
 }
 
 // Fetch weather from OpenWeather One Call (v2.5/3 compatible)
 // Note: One Call requires lat/lon and may require paid subscription for some features.
-// We fetch current + daily summary.
-bool fetchWeatherFromAPI(String &outResponse) {
+// We fetch current + daily summary, parsing the body as it arrives.
+// On FETCH_NOT_MODIFIED, out holds the cached forecast.
+FetchResult fetchWeatherFromAPI(RemoteWeather &out) {
   if (nowEpoch() < nextAllowedFetchAt) {
     Serial.println("Fetch blocked by backoff; skipping");
-    return false;
+    return FETCH_FAILED;
   }
 
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("No WiFi - cannot fetch");
-    return false;
+    return FETCH_FAILED;
   }
 
-  HTTPClient http;
-  String endpoint = String("http://api.openweathermap.org/data/2.5/onecall?lat=")
-                    + String(LOCATION_LAT, 6)
-                    + "&lon=" + String(LOCATION_LON, 6)
-                    + "&units=metric&exclude=minutely&appid=" + OPENWEATHER_APIKEY;
-  Serial.print("Requesting: "); Serial.println(endpoint);
+  // Only ask for a 304 if there is a cached copy to fall back on
+  bool haveCache = readCache(out);
+
+  Serial.print("Requesting: "); Serial.println(weatherUrl);
+  HTTPClient &http = weatherHttp;
+  http.begin(weatherClient, weatherUrl); // reuses the open socket if the server kept it
+  http.collectHeaders(WEATHER_HEADERS, 3);
+  if (haveCache && weatherEtag[0]) http.addHeader("If-None-Match", weatherEtag);
+  if (haveCache && weatherLastModified[0]) http.addHeader("If-Modified-Since", weatherLastModified);
 
-  http.begin(endpoint);
+  uint32_t t0 = millis();
   int httpCode = http.GET();
   if (httpCode > 0) {
     Serial.print("HTTP code: "); Serial.println(httpCode);
-    if (httpCode == HTTP_CODE_OK) {
-      outResponse = http.getString();
-      http.end();
-      // success => reset fail count/backoff
+    weatherBody.begin(http.getStreamPtr(),
+                      http.header("Transfer-Encoding").equalsIgnoreCase("chunked"),
+                      httpCode == HTTP_CODE_NOT_MODIFIED ? 0 : http.getSize());
+    weatherBody.setTimeout(http.getStreamPtr()->getTimeout());
+
+    if (httpCode == HTTP_CODE_NOT_MODIFIED && haveCache) {
+      http.end(); // keeps the socket open
+      Serial.printf("Forecast unchanged (%lu ms)\n", (unsigned long)(millis() - t0));
+      out.fetchedAt = nowEpoch();
       httpFailCount = 0;
       nextAllowedFetchAt = 0;
-      return true;
+      return FETCH_NOT_MODIFIED;
+    }
+
+    if (httpCode == HTTP_CODE_OK) {
+      DeserializationError err = deserializeJson(weatherDoc, weatherBody,
+                                                 DeserializationOption::Filter(weatherFilter));
+      bool complete = weatherBody.drain();
+      strlcpy(weatherEtag, http.header("ETag").c_str(), sizeof(weatherEtag));
+      strlcpy(weatherLastModified, http.header("Last-Modified").c_str(), sizeof(weatherLastModified));
+      endResponse(http, complete);
+      if (!err) {
+        extractRemoteWeather(weatherDoc, out);
+        out.fetchedAt = nowEpoch();
+        Serial.printf("Forecast fetched (%lu ms)\n", (unsigned long)(millis() - t0));
+        // success => reset fail count/backoff
+        httpFailCount = 0;
+        nextAllowedFetchAt = 0;
+        return FETCH_UPDATED;
+      }
+      Serial.print("JSON parse error: ");
+      Serial.println(err.c_str());
     } else {
       Serial.print("Unexpected HTTP response: ");
       Serial.println(httpCode);
+      endResponse(http, weatherBody.drain());
     }
   } else {
     Serial.print("HTTP failed: ");
     Serial.println(http.errorToString(httpCode));
   }
-  http.end();
+  http.end(); // harmless if already ended
+
+  // A failed response may not match the cache; ask unconditionally next time
+  weatherEtag[0] = '\0';
+  weatherLastModified[0] = '\0';
 
   // Backoff logic
   httpFailCount = min((uint8_t)httpFailCount + 1, (uint8_t)10);
   uint32_t backoffSeconds = (1 << min(httpFailCount, (uint8_t)6)) * 30; // exponential up to some limit
   nextAllowedFetchAt = nowEpoch() + backoffSeconds;
   Serial.print("Setting backoff, nextAllowedFetchAt in seconds: "); Serial.println(backoffSeconds);
-  return false;
+  return FETCH_FAILED;
 }
 
 // Render the display with local + remote summary
-void renderDisplay(float t, float h, float p, DynamicJsonDocument *remoteDoc) {
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0,0);
-  display.println("Weather Node");
-  display.print("Local: "); display.print(t); display.print(" C ");
-  display.print(h); display.println(" %");
-  display.print("P: "); display.print(p/100.0F); display.println(" hPa");
-
-  if (remoteDoc) {
+void renderDisplay(float t, float h, float p, const RemoteWeather *remote) {
+  char line[SCREEN_COLS + 1];
+  setField(FIELD_TITLE, "Weather Node");
+  snprintf(line, sizeof(line), "Local: %.2f C %.1f %%", t, h);
+  setField(FIELD_LOCAL, line);
+  snprintf(line, sizeof(line), "P: %.2f hPa", p / 100.0F);
+  setField(FIELD_PRESSURE, line);
+
+  if (remote) {
     // show remote summary (current + next day)
-    const char* desc = (*remoteDoc)["current"]["weather"][0]["description"] | "N/A";
-    float rt = (*remoteDoc)["current"]["temp"] | 0.0;
-    display.println();
-    display.print("Now: "); display.print(rt); display.print(" C ");
-    display.println(desc);
+    snprintf(line, sizeof(line), "Now: %.2f C", remote->temp);
+    setField(FIELD_REMOTE, line);
+    setField(FIELD_SUMMARY, remote->desc);
 
     // daily high/low if available
-    if ((*remoteDoc).containsKey("daily")) {
-      float dmax = (*remoteDoc)["daily"][0]["temp"]["max"] | 0.0;
-      float dmin = (*remoteDoc)["daily"][0]["temp"]["min"] | 0.0;
-      display.print("H:"); display.print(dmax); display.print(" L:"); display.print(dmin);
-      display.println(" C");
+    if (remote->dailyCount > 0) {
+      snprintf(line, sizeof(line), "H:%.2f L:%.2f C", remote->dailyMax[0], remote->dailyMin[0]);
+      setField(FIELD_HILO, line);
+    } else {
+      setField(FIELD_HILO, "");
     }
   } else {
-    display.println();
-    display.println("Remote: (none)");
+    setField(FIELD_REMOTE, "Remote: (none)");
+    setField(FIELD_SUMMARY, "");
+    setField(FIELD_HILO, "");
   }
 
-  display.display();
+  flushScreen();
 }
 
-// Process fetched JSON (publish, cache, display)
-void processFetchedWeather(const String &jsonStr) {
-  // Parse JSON
-  // Use a sufficiently large buffer; OneCall returns a lot — adjust if you add more features.
-  StaticJsonDocument<8192> doc;
-  DeserializationError err = deserializeJson(doc, jsonStr);
-  if (err) {
-    Serial.print("JSON parse error: ");
-    Serial.println(err.c_str());
-    return;
-  }
-
-  // Cache raw JSON for offline fallback
-  writeCache(jsonStr);
-
-  // Extract key values
-  float remoteTemp = doc["current"]["temp"] | NAN;
-  const char* remoteDesc = doc["current"]["weather"][0]["description"] | "unknown";
+// Process fetched weather (publish, cache); the caller updates the display
+void processFetchedWeather(const RemoteWeather &remote) {
+  // Cache the forecast for offline fallback
+  writeCache(remote);
 
   // Create a smaller JSON to publish via MQTT (compact)
-  StaticJsonDocument<512> pub;
-  pub["remote_temp"] = remoteTemp;
-  pub["remote_desc"] = remoteDesc;
+  StaticJsonDocument<128> pub;
+  pub["remote_temp"] = remote.temp;
+  pub["remote_desc"] = remote.desc;
   pub["timestamp"] = nowEpoch();
 
-  String pubStr;
-  serializeJson(pub, pubStr);
-  publishMetrics(pubStr, MQTT_TOPIC_FORECAST);
-
-  // Also display using local sensor values
-  float t = bme.readTemperature();
-  float h = bme.readHumidity();
-  float p = bme.readPressure();
+  char payload[128];
+  serializeJson(pub, payload, sizeof(payload));
+  publishMetrics(MQTT_TOPIC_FORECAST, payload);
+}
 
-  // Render
-  // Build a copy dynamic doc pointer for rendering
-  DynamicJsonDocument *dynDoc = new DynamicJsonDocument(8192);
-  deserializeJson(*dynDoc, jsonStr);
-  renderDisplay(t, h, p, dynDoc);
-  delete dynDoc;
+// Publish heap statistics. Every buffer in this sketch is static, so
+// largest_block should stay flat over days of uptime; a falling value
+// means something is fragmenting the heap.
+void publishHeapStats() {
+  char payload[128];
+  snprintf(payload, sizeof(payload),
+           "{\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu,\"uptime\":%lu}",
+           (unsigned long)ESP.getFreeHeap(),
+           (unsigned long)ESP.getMinFreeHeap(),
+           (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (unsigned long)(millis() / 1000));
+  publishMetrics(MQTT_TOPIC_HEAP, payload);
 }
 
 // Setup OTA (basic)
@@ -351,6 +1129,238 @@ void setupOTA() {
   Serial.println("OTA ready");
 }
 
+// NTP time sync (useful for accurate timestamps and scheduling)
+void syncTime() {
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+  Serial.println("Waiting for time sync...");
+  uint32_t t0 = millis();
+  while (time(NULL) < 1000000000 && millis() - t0 < 10000) {
+    delay(200);
+  }
+}
+
+#if DEEP_SLEEP_MODE
+// Queue a sample in the RTC ring, dropping the oldest if it is full
+void pushSample(const SensorSample &sample) {
+  sampleRing[sampleHead] = sample;
+  sampleHead = (sampleHead + 1) % SAMPLE_RING_SIZE;
+  if (sampleCount < SAMPLE_RING_SIZE) sampleCount++;
+}
+
+// Move the RTC samples to the flash spool, oldest first
+void spoolQueuedSamples() {
+  while (sampleCount > 0) {
+    uint8_t oldest = (sampleHead + SAMPLE_RING_SIZE - sampleCount) % SAMPLE_RING_SIZE;
+    spoolAppend(sampleRing[oldest]);
+    sampleCount--;
+  }
+}
+
+// One wake-up of the duty cycle: sample, go online only when a fetch or a
+// batched publish is due, then deep sleep until the next sensor tick.
+// The system clock keeps running in deep sleep, so NTP is only needed
+// after a cold boot. Never returns.
+void dutyCycleRun() {
+  uint32_t wakeMillis = millis();
+  bool clockValid = time(NULL) >= 1000000000;
+
+  SensorSample sample;
+  sensorSample(sample);
+  pushSample(sample);
+  Serial.printf("Local sensor T: %.2f C  H: %.2f %%  P: %.2f Pa\n", sample.t, sample.h, sample.p);
+
+  uint32_t now = nowEpoch();
+  bool fetchDue = now - lastFetchTime >= FETCH_INTERVAL_SECONDS && now >= nextAllowedFetchAt;
+  bool publishDue = sampleCount >= PUBLISH_BATCH_SAMPLES;
+
+  RemoteWeather remote;
+  bool haveRemote = readCache(remote);
+
+  if (fetchDue || publishDue || !clockValid) {
+    // Samples wait in RTC memory between sessions (no flash write per
+    // wake-up); once a session starts they move to the spool, which keeps
+    // them if the upload fails
+    spoolQueuedSamples();
+
+    wifiConnect();
+    if (WiFi.status() == WL_CONNECTED) {
+      if (!clockValid) syncTime();
+      mqttConnect();
+      spoolFlush();
+      publishHeapStats();
+
+      if (fetchDue) {
+        lastFetchTime = nowEpoch();
+        FetchResult result = fetchWeatherFromAPI(remote);
+        if (result == FETCH_UPDATED) {
+          processFetchedWeather(remote);
+        }
+        if (result != FETCH_FAILED) haveRemote = true;
+      }
+      mqttClient.disconnect();
+    }
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+  }
+
+  renderDisplay(sample.t, sample.h, sample.p, haveRemote ? &remote : nullptr);
+
+  // Sleep for the rest of the sensor interval
+  uint32_t awakeMs = millis() - wakeMillis;
+  uint32_t intervalMs = SENSOR_INTERVAL_SECONDS * 1000UL;
+  uint32_t sleepMs = awakeMs < intervalMs ? intervalMs - awakeMs : 1000;
+  Serial.printf("Going to deep sleep for %lu ms\n", (unsigned long)sleepMs);
+  Serial.flush();
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000ULL);
+  esp_deep_sleep_start();
+}
+#endif
+
+// ---------------- Tasks -------------------------------
+// In always-on mode the work is split into FreeRTOS tasks, so a slow
+// network call (WiFi join, NTP, HTTP, MQTT connect) never holds up the
+// sensor cadence or the display:
+//   sensorTask  (core 1) samples the BME280 on a fixed period
+//   displayTask (core 1) redraws the OLED from the latest data
+//   netTask     (core 0) WiFi, MQTT, spool upload and forecast fetches
+// They only talk through bounded queues. loop() is left with OTA.
+
+// One message for the display task: a new sample or a new forecast
+struct DisplayUpdate {
+  bool isRemote;
+  SensorSample sample;
+  RemoteWeather remote;
+};
+
+#define SAMPLE_QUEUE_LENGTH  32  // samples buffered while the network is busy
+#define DISPLAY_QUEUE_LENGTH 4
+
+QueueHandle_t sampleQueue;   // sensorTask -> netTask
+QueueHandle_t displayQueue;  // sensorTask, netTask -> displayTask
+SemaphoreHandle_t i2cMutex;  // the BME280 and the OLED share one I2C bus
+volatile bool otaReady = false;
+
+// Hand a new forecast to the display task
+void postRemoteToDisplay(const RemoteWeather &remote) {
+  DisplayUpdate update;
+  update.isRemote = true;
+  update.remote = remote;
+  xQueueSend(displayQueue, &update, portMAX_DELAY); // the display drains quickly
+}
+
+// Fixed-period sensor sampling; never waits on the network
+void sensorTask(void *) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    SensorSample sample;
+    xSemaphoreTake(i2cMutex, portMAX_DELAY);
+    sensorSample(sample);
+    xSemaphoreGive(i2cMutex);
+    Serial.printf("Local sensor T: %.2f C  H: %.2f %%  P: %.2f Pa\n", sample.t, sample.h, sample.p);
+
+    // Never block here: a full queue means the network task is stuck
+    if (xQueueSend(sampleQueue, &sample, 0) != pdTRUE) {
+      Serial.println("Sample queue full, sample dropped");
+    }
+    DisplayUpdate update;
+    update.isRemote = false;
+    update.sample = sample;
+    xQueueSend(displayQueue, &update, 0);
+
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SENSOR_INTERVAL_SECONDS * 1000UL));
+  }
+}
+
+// Redraw whenever a new sample or forecast arrives
+void displayTask(void *) {
+  DisplayUpdate update;
+  SensorSample sample;
+  RemoteWeather remote;
+  bool haveSample = false;
+  bool haveRemote = false;
+
+  for (;;) {
+    xQueueReceive(displayQueue, &update, portMAX_DELAY);
+    if (update.isRemote) {
+      remote = update.remote;
+      haveRemote = true;
+    } else {
+      sample = update.sample;
+      haveSample = true;
+    }
+    if (!haveSample) continue;
+
+    xSemaphoreTake(i2cMutex, portMAX_DELAY);
+    renderDisplay(sample.t, sample.h, sample.p, haveRemote ? &remote : nullptr);
+    xSemaphoreGive(i2cMutex);
+  }
+}
+
+// All blocking network work: WiFi, NTP, OTA setup, MQTT, uploads, fetches
+void netTask(void *) {
+  uint32_t lastHeapReport = 0;
+  for (;;) {
+    if (WiFi.status() != WL_CONNECTED) {
+      wifiConnect();
+      if (WiFi.status() == WL_CONNECTED) {
+        if (time(NULL) < 1000000000) syncTime();
+        if (!otaReady) {
+          setupOTA();
+          otaReady = true;
+        }
+      }
+    }
+
+    // Maintain MQTT
+    if (WiFi.status() == WL_CONNECTED) {
+      if (!mqttClient.connected()) {
+        mqttConnect();
+      } else {
+        mqttClient.loop();
+      }
+    }
+
+    // Spool new samples and send everything waiting if MQTT is up
+    SensorSample sample;
+    while (xQueueReceive(sampleQueue, &sample, 0) == pdTRUE) {
+      spoolAppend(sample);
+    }
+    spoolFlush();
+
+    uint32_t now = nowEpoch();
+    if (mqttClient.connected() && now - lastHeapReport >= HEAP_REPORT_SECONDS) {
+      lastHeapReport = now;
+      publishHeapStats();
+    }
+
+    // Remote forecast fetch
+    if (now - lastFetchTime >= FETCH_INTERVAL_SECONDS) {
+      lastFetchTime = now;
+
+      // Respect backoff
+      if (now < nextAllowedFetchAt) {
+        Serial.println("Skipping fetch due to backoff");
+      } else {
+        RemoteWeather remote;
+        FetchResult result = fetchWeatherFromAPI(remote);
+        if (result == FETCH_UPDATED) {
+          Serial.println("Fetched weather successfully");
+          processFetchedWeather(remote);
+          postRemoteToDisplay(remote);
+        } else if (result == FETCH_NOT_MODIFIED) {
+          // The display already shows this forecast
+          Serial.println("Forecast not modified, keeping cache");
+        } else {
+          // The display keeps showing the last (or cached) forecast
+          Serial.println("Failed to fetch weather from API");
+        }
+      }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(200));
+  }
+}
+
 void setup() {
   Serial.begin(115200);
   delay(100);
@@ -358,129 +1368,64 @@ void setup() {
 
   // Initialize I2C, display, filesystem, sensor
   Wire.begin(I2C_SDA, I2C_SCL);
-  if(!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {
+  if(!display.begin(SSD1306_SWITCHCAPVCC, OLED_ADDR)) {
     Serial.println("SSD1306 allocation failed");
   } else {
     display.clearDisplay();
     display.setTextColor(SSD1306_WHITE);
+    display.setTextSize(1);
+    display.setTextWrap(false); // each field stays on its own row
+    display.display();          // one full push; later updates send dirty pages only
   }
 
+  initWeatherFilter();
+  if (weatherFilter.overflowed()) {
+    // Fields past the overflow would be dropped from every response
+    Serial.println("Weather filter overflowed - increase WEATHER_FILTER_SIZE");
+  }
+  buildWeatherUrl();
+
   if (!initFS()) {
     Serial.println("Filesystem failed to start - caching disabled");
+  } else {
+    spoolInit();
   }
 
-  if (!bme.begin(0x76)) { // BME280 common I2C address 0x76 or 0x77
+  if (!sensorBegin()) {
     Serial.println("Could not find a valid BME280 sensor, check wiring!");
   } else {
     Serial.println("BME280 found");
   }
 
-  // WiFi connect (and basic time sync for epoch)
-  wifiConnect();
-
-  // NTP time sync (optional but useful for accurate timestamps and scheduling)
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-  Serial.println("Waiting for time sync...");
-  uint32_t t0 = millis();
-  while (time(NULL) < 1000000000 && millis() - t0 < 10000) {
-    delay(200);
-  }
-
-  // MQTT connect
-  mqttConnect();
+#if DEEP_SLEEP_MODE
+  dutyCycleRun(); // does not return
+#endif
 
-  // OTA
-  setupOTA();
+  sampleQueue = xQueueCreate(SAMPLE_QUEUE_LENGTH, sizeof(SensorSample));
+  displayQueue = xQueueCreate(DISPLAY_QUEUE_LENGTH, sizeof(DisplayUpdate));
+  i2cMutex = xSemaphoreCreateMutex();
 
-  // show cached if no network fetch immediately
-  String cached = readCache();
-  if (cached.length() > 0) {
-    DynamicJsonDocument dd(4096);
-    if (!deserializeJson(dd, cached)) {
-      renderDisplay(bme.readTemperature(), bme.readHumidity(), bme.readPressure(), &dd);
-    }
+  // show cached until the first fetch completes
+  RemoteWeather cached;
+  if (readCache(cached)) {
+    postRemoteToDisplay(cached);
   }
 
-  // initial times
-  lastFetchTime = nowEpoch() - FETCH_INTERVAL_SECONDS; // force immediate fetch in loop
-  lastSensorTime = nowEpoch() - SENSOR_INTERVAL_SECONDS;
+  // force an immediate fetch once the network is up
+  lastFetchTime = nowEpoch() - FETCH_INTERVAL_SECONDS;
+
+  // Network on core 0 (with the WiFi stack), sensing and display on core 1
+  xTaskCreatePinnedToCore(sensorTask, "sensor", 4096, NULL, 3, NULL, 1);
+  xTaskCreatePinnedToCore(displayTask, "display", 4096, NULL, 2, NULL, 1);
+  xTaskCreatePinnedToCore(netTask, "net", 8192, NULL, 1, NULL, 0);
 }
 
-// Main loop
+// Main loop: everything else runs in the tasks above
 void loop() {
-  ArduinoOTA.handle(); // handle OTA if a client is updating
-
-  // Maintain MQTT
-  if (!mqttClient.connected()) {
-    mqttConnect();
-  } else {
-    mqttClient.loop();
-  }
-
-  uint32_t now = nowEpoch();
-
-  // Local sensor periodic read
-  if (now - lastSensorTime >= SENSOR_INTERVAL_SECONDS) {
-    lastSensorTime = now;
-    float t = bme.readTemperature();
-    float h = bme.readHumidity();
-    float p = bme.readPressure();
-    Serial.printf("Local sensor T: %.2f C  H: %.2f %%  P: %.2f Pa\n", t, h, p);
-
-    // Publish local sensor to MQTT
-    StaticJsonDocument<256> sensorDoc;
-    sensorDoc["local_temp"] = t;
-    sensorDoc["local_humidity"] = h;
-    sensorDoc["local_pressure"] = p / 100.0F; // hPa
-    sensorDoc["timestamp"] = now;
-    String s;
-    serializeJson(sensorDoc, s);
-    publishMetrics(s, MQTT_TOPIC_METRICS);
-
-    // update display with local values (remote may be stale)
-    // If you want to preserve remote data on display, you'd re-render with remote doc.
-    renderDisplay(t, h, p, nullptr);
-  }
-
-  // Remote forecast fetch
-  if (now - lastFetchTime >= FETCH_INTERVAL_SECONDS) {
-    lastFetchTime = now;
-
-    // Respect backoff
-    if (now < nextAllowedFetchAt) {
-      Serial.println("Skipping fetch due to backoff");
-    } else {
-      String response;
-      bool ok = fetchWeatherFromAPI(response);
-      if (ok) {
-        Serial.println("Fetched weather successfully");
-        processFetchedWeather(response);
-      } else {
-        Serial.println("Failed to fetch weather from API");
-        // show cached if available
-        String cached = readCache();
-        if (cached.length()) {
-          DynamicJsonDocument dd(4096);
-          if (!deserializeJson(dd, cached)) {
-            renderDisplay(bme.readTemperature(), bme.readHumidity(), bme.readPressure(), &dd);
-          } else {
-            Serial.println("Cached JSON parse error");
-          }
-        }
-      }
-    }
-  }
+  if (otaReady) ArduinoOTA.handle(); // handle OTA if a client is updating
 
-  // Optional: deep sleep scheduling to save power
-  // If you'd like to use deep sleep, comment out the main loop flow above and
-  // put the ESP32 to deep sleep for N seconds after publishing.
-  //
-  // Example (uncomment to use; adjust wakeTimeS):
-  // uint64_t wakeTimeS = 600; // sleep 10 minutes
-  // esp_sleep_enable_timer_wakeup(wakeTimeS * 1000000ULL);
-  // Serial.println("Going to deep sleep...");
-  // delay(100);
-  // esp_deep_sleep_start();
+  // For battery power set DEEP_SLEEP_MODE to 1: setup() then runs one
+  // duty cycle and sleeps, and this loop is never reached.
 
-  delay(200); // small yield
+  delay(50); // small yield
 }
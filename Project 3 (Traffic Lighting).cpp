@@ -4,16 +4,22 @@
   Features:
    - 4 roads with independent Red, Yellow, Green LEDs
    - Traffic light cycles automatically
-   - Pedestrian button: requests crossing, handled safely in cycle
+   - Pedestrian button: requests crossing, served at the next all-red gap
+   - Optional vehicle detectors: green time follows demand, idle roads are skipped
+   - Optional green wave: junctions on a serial ring share one cycle clock
+   - Safety interlock: every lamp pattern is checked, faults latch flashing yellow
    - Emergency button: all-red or priority lane green
+   - Non-blocking millis() state machine: buttons are read on every loop pass
 */
 
+#include <InputCapture.h>
+
 #define NUM_ROADS 4
 
 // ----------------- Pin Definitions -----------------
-int redPins[NUM_ROADS]    = {2, 5, 8, 11};
-int yellowPins[NUM_ROADS] = {3, 6, 9, 12};
-int greenPins[NUM_ROADS]  = {4, 7, 10, 13};
+constexpr int redPins[NUM_ROADS]    = {2, 5, 8, 11};
+constexpr int yellowPins[NUM_ROADS] = {3, 6, 9, 12};
+constexpr int greenPins[NUM_ROADS]  = {4, 7, 10, 13};
 
 // Pedestrian buttons (1 per road)
 int pedButtons[NUM_ROADS] = {A0, A1, A2, A3};
@@ -21,63 +27,699 @@ int pedButtons[NUM_ROADS] = {A0, A1, A2, A3};
 // Emergency override button
 #define EMERGENCY_PIN A4
 
-// Optional pedestrian buzzer
-#define BUZZER_PIN A5
+// Optional vehicle detectors, one per road, all read through A5 (see
+// Demand below). Set to 1 to plan the cycle from traffic.
+#ifndef VEHICLE_SENSORS
+#define VEHICLE_SENSORS 0
+#endif
+
+// Optional pedestrian buzzer. With the vehicle detectors A5 is taken, so
+// the buzzer moves to pin 1 (TX, free unless COORD_ENABLED is set).
+#if VEHICLE_SENSORS
+#define DETECTOR_PIN A5
+#define BUZZER_PIN   1
+#define ADC_CHANNELS 1  // AdcSampler only reads the detector ladder
+#include <AdcSampler.h>
+#else
+#define BUZZER_PIN   A5
+#endif
+
+// ----------------- Lamp Bank -----------------
+// The 12 lamps sit on two AVR ports (Uno pins 2..7 = PORTD, 8..13 = PORTB).
+// Each pin is resolved to a port/mask pair at compile time, and a full
+// lamp pattern is written as one masked store per port instead of a
+// digitalWrite() per lamp, so every lamp changes in the same instant.
+enum LampPort { LAMP_PORT_B, LAMP_PORT_C, LAMP_PORT_D, NUM_LAMP_PORTS };
+
+struct LampPin {
+  uint8_t port;  // LampPort
+  uint8_t mask;  // bit within that port
+};
+
+// Uno / Nano (ATmega328P) pin mapping: 0..7 PORTD, 8..13 PORTB, A0..A5 PORTC.
+// Other boards wire their pins to other ports, so the masks would light
+// the wrong lamps.
+#if !defined(__AVR_ATmega328P__)
+#error "The lamp bank writes the ATmega328P ports directly: build for an Uno or Nano"
+#endif
+
+constexpr LampPin lampPin(int pin) {
+  return pin < 8  ? LampPin{LAMP_PORT_D, (uint8_t)(1 << pin)}
+       : pin < 14 ? LampPin{LAMP_PORT_B, (uint8_t)(1 << (pin - 8))}
+       :            LampPin{LAMP_PORT_C, (uint8_t)(1 << (pin - 14))};
+}
+
+struct RoadLamps {
+  LampPin red, yellow, green;
+};
+
+#define ROAD_LAMPS(r) {lampPin(redPins[r]), lampPin(yellowPins[r]), lampPin(greenPins[r])}
+constexpr RoadLamps roadLamps[NUM_ROADS] = {
+  ROAD_LAMPS(0), ROAD_LAMPS(1), ROAD_LAMPS(2), ROAD_LAMPS(3)
+};
+
+// Bits of one port owned by the lamps of roads [0, road)
+constexpr uint8_t lampPortMask(uint8_t port, int road) {
+  return road == 0 ? 0
+       : lampPortMask(port, road - 1)
+         | (roadLamps[road - 1].red.port    == port ? roadLamps[road - 1].red.mask    : 0)
+         | (roadLamps[road - 1].yellow.port == port ? roadLamps[road - 1].yellow.mask : 0)
+         | (roadLamps[road - 1].green.port  == port ? roadLamps[road - 1].green.mask  : 0);
+}
+
+constexpr uint8_t LAMP_MASK_B = lampPortMask(LAMP_PORT_B, NUM_ROADS);
+constexpr uint8_t LAMP_MASK_C = lampPortMask(LAMP_PORT_C, NUM_ROADS);
+constexpr uint8_t LAMP_MASK_D = lampPortMask(LAMP_PORT_D, NUM_ROADS);
+
+// Pattern being built; only reaches the pins in lampBankWrite()
+uint8_t lampImage[NUM_LAMP_PORTS] = {0, 0, 0};
+
+void lampSet(const LampPin &lamp, bool on) {
+  if (on) lampImage[lamp.port] |= lamp.mask;
+  else    lampImage[lamp.port] &= ~lamp.mask;
+}
+
+bool lampOn(const LampPin &lamp) {
+  return lampImage[lamp.port] & lamp.mask;
+}
+
+// One masked store per port that carries lamps (unchecked, see lampBankWrite())
+void lampPortsWrite() {
+  uint8_t oldSREG = SREG;
+  cli();  // PORTx read-modify-write must not interleave with an ISR
+  if (LAMP_MASK_B) PORTB = (PORTB & ~LAMP_MASK_B) | lampImage[LAMP_PORT_B];
+  if (LAMP_MASK_C) PORTC = (PORTC & ~LAMP_MASK_C) | lampImage[LAMP_PORT_C];
+  if (LAMP_MASK_D) PORTD = (PORTD & ~LAMP_MASK_D) | lampImage[LAMP_PORT_D];
+  SREG = oldSREG;
+}
+
+// ----------------- Safety Interlock -----------------
+// Every lamp pattern is checked before it reaches the pins. A pattern is
+// refused if a road shows more than one aspect, if two conflicting roads
+// are open (green or yellow) together, or if a road opens before every
+// conflicting road has been red for MIN_CLEARANCE_MS. A refused pattern
+// is never shown: the controller latches into flashing yellow on every
+// road until it is reset.
+
+// conflicts[i][j]: roads i and j must never be open together. At the
+// roundabout every approach conflicts with every other one.
+constexpr bool conflicts[NUM_ROADS][NUM_ROADS] = {
+  {false, true,  true,  true },
+  {true,  false, true,  true },
+  {true,  true,  false, true },
+  {true,  true,  true,  false}
+};
+
+// A road never conflicts with itself, and i vs j must match j vs i
+constexpr bool conflictMatrixValid(int i, int j) {
+  return i == NUM_ROADS ? true
+       : j == NUM_ROADS ? conflictMatrixValid(i + 1, 0)
+       : conflicts[i][j] == conflicts[j][i] && (i != j || !conflicts[i][i])
+         && conflictMatrixValid(i, j + 1);
+}
+static_assert(conflictMatrixValid(0, 0), "conflict matrix must be symmetric with a clear diagonal");
+
+constexpr int bitCount(uint8_t v) {
+  return v == 0 ? 0 : (v & 1) + bitCount(v >> 1);
+}
+static_assert(bitCount(LAMP_MASK_B) + bitCount(LAMP_MASK_C) + bitCount(LAMP_MASK_D) == 3 * NUM_ROADS,
+              "two lamps share a pin");
+
+#define MIN_CLEARANCE_MS 800   // conflicting roads red at least this long before a road opens
+#define FLASH_PERIOD     500   // ms per half period of the fail-safe flash
+
+bool failSafe = false;               // latched by a refused pattern
+uint8_t openRoads = 0;               // bit i = road i shows green or yellow
+uint8_t openedBefore = 0;            // bit i = road i has been open since reset
+unsigned long closedAt[NUM_ROADS];   // millis() when road i last turned red
+
+// Check the pattern in lampImage; on success record which roads are open
+bool lampsSafe(unsigned long now) {
+  uint8_t open = 0;
+  for (int i = 0; i < NUM_ROADS; i++) {
+    int lit = lampOn(roadLamps[i].red) + lampOn(roadLamps[i].yellow) + lampOn(roadLamps[i].green);
+    if (lit > 1) return false;  // mixed aspect (a dark road counts as closed)
+    if (lit == 1 && !lampOn(roadLamps[i].red)) open |= 1 << i;
+  }
+
+  for (int i = 0; i < NUM_ROADS; i++) {
+    if (!(open & (1 << i))) continue;
+    for (int j = 0; j < NUM_ROADS; j++) {
+      if (!conflicts[i][j]) continue;
+      if (open & (1 << j)) return false;  // conflicting roads open together
+      // Minimum inter-green, only checked when road i opens
+      bool opening = !(openRoads & (1 << i));
+      if (opening && (openedBefore & (1 << j)) && now - closedAt[j] < MIN_CLEARANCE_MS) {
+        return false;
+      }
+    }
+  }
+
+  for (int i = 0; i < NUM_ROADS; i++) {
+    if ((openRoads & (1 << i)) && !(open & (1 << i))) closedAt[i] = now;
+  }
+  openRoads = open;
+  openedBefore |= open;
+  return true;
+}
+
+// Yellow on every road, blinking; the only pattern shown once latched
+void failSafeImage(unsigned long now) {
+  bool on = (now / FLASH_PERIOD) % 2 == 0;
+  for (int i = 0; i < NUM_LAMP_PORTS; i++) lampImage[i] = 0;
+  for (int i = 0; i < NUM_ROADS; i++) lampSet(roadLamps[i].yellow, on);
+}
+
+// Verified lamp write: every pattern goes through here. 'now' is the
+// timestamp the phase timing uses, so the clearance is measured on the
+// same clock as allRedTime.
+void lampBankWrite(unsigned long now) {
+  if (!failSafe && !lampsSafe(now)) {
+    failSafe = true;
+    noTone(BUZZER_PIN);
+  }
+  if (failSafe) failSafeImage(now);
+  lampPortsWrite();
+}
 
 // ----------------- Timing -----------------
 int greenTime   = 5000;  // 5s green
 int yellowTime  = 2000;  // 2s yellow
-int allRedTime  = 1000;  // 1s all red between changes
+constexpr int allRedTime = 1000;  // 1s all red between changes
 int pedTime     = 4000;  // 4s pedestrian crossing
 
+// The all-red gap must clear the interlock's inter-green with room to
+// spare, or a late loop() pass would latch the fail-safe
+static_assert(allRedTime >= MIN_CLEARANCE_MS + 200, "allRedTime too close to MIN_CLEARANCE_MS");
+
 // Pedestrian request flags
 bool pedRequest[NUM_ROADS] = {false, false, false, false};
 
+// ----------------- Demand -----------------
+// With VEHICLE_SENSORS set to 1 every road has a vehicle detector (induction
+// loop or IR beam, output HIGH when free, LOW when a vehicle is on it) and
+// the cycle adapts to traffic: a road only gets green when a vehicle is
+// waiting, and its green grows with the number of vehicles waiting,
+// between minGreenTime and maxGreenTime. A vehicle arriving on its own
+// green stretches that green, and vehicles a green has no room for stay
+// counted for the next one. With 0 every road is always served for
+// greenTime.
+//
+// An Uno has no digital pins left for the detectors, so all four share A5
+// through a 4-bit R-2R ladder (10k / 20k resistors): detector i drives
+// bit i, road 3 being the bit next to A5. The ladder gives code / 16 of
+// 5 V for the 4-bit code, AdcSampler.h reads it in the background, and
+// rounding the reading to the nearest step gives the code back:
+//   code = (reading + 128) >> 8     (reading 0..ADC_MAX, 256 per step)
+//   occupied = ~code & 0x0F         (bit i = road i)
+// While a detector switches, a reading can fall between two steps, so a
+// code is only taken once two readings in a row agree.
+#define LADDER_STEP 256  // adcRead() units per code step (ADC_MAX / 16)
+
+int minGreenTime    = 3000;   // green for a single waiting vehicle
+int maxGreenTime    = 12000;  // upper bound, so other roads are not starved
+int greenPerVehicle = 1500;   // extra green per waiting vehicle
+
+uint8_t vehicleCount[NUM_ROADS] = {0, 0, 0, 0}; // vehicles waiting for green
+uint8_t vehicleState = 0;                       // bit i = detector i occupied
+unsigned long lastVehicleEdge[NUM_ROADS];
+
+#if VEHICLE_SENSORS
+int8_t detectorChannel;     // AdcSampler channel of DETECTOR_PIN
+uint8_t detectorRound = 0;  // adcRounds of the last reading used
+uint8_t detectorCode = 0;   // last code read
+#endif
+
+// ----------------- Phase Table -----------------
+// The road cycle runs as a millis()-driven state machine: loop() never
+// blocks, it only checks inputs and whether the current phase has expired.
+enum Phase { PH_GREEN, PH_YELLOW, PH_PED, PH_ALL_RED, PH_EMERGENCY };
+
+struct PhaseStep {
+  Phase phase;
+  const int *duration;  // points at the timing variables above
+};
+
+// Steps every road goes through, in order
+const PhaseStep roadCycle[] = {
+  {PH_GREEN,   &greenTime},
+  {PH_YELLOW,  &yellowTime},
+  {PH_PED,     &pedTime},     // skipped unless a crossing was requested
+  {PH_ALL_RED, &allRedTime}
+};
+const int CYCLE_STEPS = sizeof(roadCycle) / sizeof(roadCycle[0]);
+#define PED_STEP 2  // index of PH_PED in roadCycle
+
+#define PED_BEEP_PERIOD       500  // ms between pedestrian beeps
+#define EMERGENCY_BEEP_PERIOD 400  // ms between emergency beeps
+#define EMERGENCY_BEEPS       5    // minimum beeps per emergency
+
+// State machine variables
+int currentRoad = 0;
+int currentStep = 0;
+Phase currentPhase = PH_ALL_RED;
+unsigned long phaseStart = 0;    // millis() when the phase began
+unsigned long phaseLength = 0;   // how long the phase lasts (ms)
+unsigned long lastBeep = 0;      // millis() of the last buzzer beep
+
+// ----------------- Input Capture -----------------
+// Button edges are caught by the pin-change interrupt of port C (A0..A4)
+// and queued with a timestamp by InputCapture.h, so a short press is never
+// lost while the loop is busy. The pedestrian buttons are attached first,
+// so input i is road i's button.
+#define INPUT_EMERGENCY   NUM_ROADS  // input index of the emergency button
+
+bool emergencyHeld = false;     // emergency button currently down
+bool emergencyRequest = false;  // latched on press, even a short one
+
+// Enable pin-change interrupts for the buttons (all active LOW)
+void setupInputCapture() {
+  for (uint8_t i = 0; i < NUM_ROADS; i++) {
+    inputAttach(pedButtons[i], INPUT_ACTIVE_LOW);
+  }
+  inputAttach(EMERGENCY_PIN, INPUT_ACTIVE_LOW);  // = INPUT_EMERGENCY
+  inputBegin();
+}
+
+// Drain queued button events into the request flags
+void processInputs() {
+  InputEvent ev;
+  while (inputPop(ev)) {
+    if (ev.input == INPUT_EMERGENCY) {
+      emergencyHeld = ev.pressed;
+      if (ev.pressed) emergencyRequest = true;
+    } else if (ev.pressed) {
+      pedRequest[ev.input] = true;
+    }
+  }
+}
+
+// Make room in the running green for one more vehicle, up to
+// maxGreenTime; false if the green cannot take it
+bool extendGreen(unsigned long now) {
+  unsigned long length = max(phaseLength, now - phaseStart) + greenPerVehicle;
+  if (length > (unsigned long)maxGreenTime) return false;
+  phaseLength = length;
+  return true;
+}
+
+// Count vehicles arriving at each detector (polled: a vehicle stays on
+// the detector for far longer than one loop pass)
+void scanVehicles(unsigned long now) {
+#if VEHICLE_SENSORS
+  uint8_t round = adcRounds;
+  if (round == detectorRound) return;  // no new reading yet
+  detectorRound = round;
+  uint16_t step = (adcRead(detectorChannel) + LADDER_STEP / 2) / LADDER_STEP;
+  uint8_t code = min(step, (uint16_t)0x0F);
+  bool steady = code == detectorCode;
+  detectorCode = code;
+  if (!steady) return;
+
+  uint8_t occupiedBits = ~code & 0x0F;
+  for (uint8_t i = 0; i < NUM_ROADS; i++) {
+    bool occupied = occupiedBits & (1 << i);
+    bool reported = vehicleState & (1 << i);
+    if (occupied == reported || now - lastVehicleEdge[i] < INPUT_DEBOUNCE_MS) continue;
+    lastVehicleEdge[i] = now;
+    vehicleState ^= (1 << i);
+    if (!occupied) continue;
+    // A vehicle arriving on its own green is let through on this green
+    // if it can still be stretched; otherwise it waits for the next one
+    bool servedNow = currentPhase == PH_GREEN && currentRoad == i && extendGreen(now);
+    if (!servedNow && vehicleCount[i] < 255) vehicleCount[i]++;
+  }
+#else
+  (void)now;
+#endif
+}
+
+// ----------------- Planner -----------------
+
+bool roadHasDemand(int road) {
+#if VEHICLE_SENSORS
+  return vehicleCount[road] > 0;
+#else
+  (void)road;
+  return true;
+#endif
+}
+
+// Next road after 'from' with vehicles waiting ('from' itself last), or -1
+int nextRoadWithDemand(int from) {
+  for (int i = 1; i <= NUM_ROADS; i++) {
+    int road = (from + i) % NUM_ROADS;
+    if (roadHasDemand(road)) return road;
+  }
+  return -1;
+}
+
+// Vehicles a green of 'length' ms lets through (the inverse of plannedGreen())
+uint8_t greenCapacity(unsigned long length) {
+  if (length < (unsigned long)minGreenTime) return 1;
+  unsigned long extra = (length - minGreenTime) / greenPerVehicle;
+  return extra >= 254 ? 255 : 1 + extra;
+}
+
+// Green time in proportion to the vehicles waiting
+unsigned long plannedGreen(int road) {
+#if VEHICLE_SENSORS
+  uint8_t waiting = vehicleCount[road] > 0 ? vehicleCount[road] - 1 : 0;
+  unsigned long length = minGreenTime + (unsigned long)waiting * greenPerVehicle;
+  return min(length, (unsigned long)maxGreenTime);
+#else
+  (void)road;
+  return greenTime;
+#endif
+}
+
+bool anyPedRequest() {
+  for (int i = 0; i < NUM_ROADS; i++) {
+    if (pedRequest[i]) return true;
+  }
+  return false;
+}
+
+// ----------------- Coordination -----------------
+// Several controllers along a corridor can share one cycle clock, so a
+// platoon leaving one roundabout on green meets green at the next one
+// ("green wave"). The controllers are chained in a ring over the UART
+// (pins 0/1, TX of each node to RX of the next). Node 0 is the clock master
+// and sends SYNC frames with its cycle clock; every node announces its
+// phase changes in PHASE frames. Each node passes on the frames of the
+// others, so every node hears every frame.
+// COORD_ROAD turns green COORD_OFFSET ms after the start of each common
+// cycle: give each junction its travel time from the first one. A PHASE
+// frame carries the sender's offset, so every node can check the others'
+// greens against the common clock and flag one that keeps missing its
+// slot (driftingNodes) - a broken ring link or a stuck button upstream
+// shows up there long before drivers notice.
+#ifndef COORD_ENABLED
+#define COORD_ENABLED   0
+#endif
+#ifndef NODE_ID
+#define NODE_ID         0        // 0 = clock master
+#endif
+#ifndef COORD_ROAD
+#define COORD_ROAD      0        // the road along the corridor
+#endif
+#ifndef COORD_OFFSET
+#define COORD_OFFSET    0UL      // ms into the common cycle
+#endif
+#if COORD_ENABLED && VEHICLE_SENSORS
+#error "With VEHICLE_SENSORS the buzzer is on pin 1, which the coordination ring needs for TX"
+#endif
+#define COORD_CYCLE_MS  32000UL  // common cycle: 4 x (green + yellow + all red)
+#define COORD_BAUD      57600
+#define COORD_MAX_NODES 8        // also the hop limit of a frame
+#define SYNC_PERIOD     1000     // ms between SYNC frames from the master
+#define SYNC_TIMEOUT    5000     // run uncoordinated after this long without SYNC
+#define HOP_DELAY_MS    2        // one frame on the wire at COORD_BAUD
+#define COORD_DRIFT_MS  2000     // a green this far off its slot is off ...
+#define DRIFT_GREENS    4        // ... and this many in a row is drifting
+
+// Frame: start, type, origin node, hops, payload[4], checksum (XOR of type..payload)
+#define FRAME_START 0x7E
+#define FRAME_SIZE  9
+#define MSG_SYNC    1  // payload: cycle clock in ms (little endian)
+#define MSG_PHASE   2  // payload: road, phase, the road's COORD_OFFSET in ms (16 bit)
+#define NO_SLOT     0xFFFF  // offset sent for a road that is not COORD_ROAD
+
+// Last phase heard from every node on the ring, and how well its
+// COORD_ROAD greens keep to their slot on this node's copy of the clock
+struct NodeStatus {
+  uint8_t road;
+  uint8_t phase;
+  unsigned long seen;  // millis() when the frame arrived
+  long slotError;      // ms its last coordinated green was late (< 0: early)
+  uint8_t offSlot;     // greens in a row more than COORD_DRIFT_MS off
+};
+NodeStatus nodeStatus[COORD_MAX_NODES];
+uint8_t driftingNodes = 0;           // bit per node that keeps missing its slot
+
+long clockOffset = 0;                // cycle clock = millis() + clockOffset
+bool clockSynced = (NODE_ID == 0);   // the master is the clock
+unsigned long lastSync = 0;          // millis() of the last SYNC sent / heard
+uint8_t rxFrame[FRAME_SIZE];
+uint8_t rxLength = 0;
+uint16_t frameErrors = 0;            // frames dropped on a bad checksum
+
+unsigned long cycleClock(unsigned long now) {
+  return now + clockOffset;
+}
+
+// How far the cycle clock 'clock' is past the slot that starts 'offset'
+// ms into the common cycle: negative = early by that many ms, positive =
+// late
+long slotError(unsigned long clock, unsigned long offset) {
+  // both taken modulo the cycle first, so an offset larger than the clock
+  // (just after power-up) does not wrap around 2^32
+  unsigned long intoCycle = (clock % COORD_CYCLE_MS + COORD_CYCLE_MS
+                             - offset % COORD_CYCLE_MS) % COORD_CYCLE_MS;
+  if (intoCycle < COORD_CYCLE_MS / 2) return (long)intoCycle;
+  return -(long)(COORD_CYCLE_MS - intoCycle);
+}
+
+// Queue one frame; dropped rather than blocking when the TX buffer is full
+void sendFrame(uint8_t type, uint8_t origin, uint8_t hops, const uint8_t *payload) {
+#if COORD_ENABLED
+  if (Serial.availableForWrite() < FRAME_SIZE) return;
+  uint8_t frame[FRAME_SIZE] = {FRAME_START, type, origin, hops,
+                               payload[0], payload[1], payload[2], payload[3], 0};
+  for (uint8_t i = 1; i < FRAME_SIZE - 1; i++) frame[FRAME_SIZE - 1] ^= frame[i];
+  Serial.write(frame, FRAME_SIZE);
+#else
+  (void)type; (void)origin; (void)hops; (void)payload;
+#endif
+}
+
+// Tell the ring about a phase change
+void coordSendPhase(Phase phase) {
+  uint16_t offset = currentRoad == COORD_ROAD ? COORD_OFFSET % COORD_CYCLE_MS : NO_SLOT;
+  uint8_t payload[4] = {(uint8_t)currentRoad, (uint8_t)phase,
+                        (uint8_t)offset, (uint8_t)(offset >> 8)};
+  sendFrame(MSG_PHASE, NODE_ID, 0, payload);
+}
+
+void handleFrame(const uint8_t *frame, unsigned long now) {
+  uint8_t type = frame[1];
+  uint8_t origin = frame[2];
+  uint8_t hops = frame[3];
+  const uint8_t *payload = frame + 4;
+
+  if (origin == NODE_ID || origin >= COORD_MAX_NODES) return; // back around the ring
+  if (hops + 1 < COORD_MAX_NODES) sendFrame(type, origin, hops + 1, payload);
+
+  if (type == MSG_SYNC && origin == 0 && NODE_ID != 0) {
+    unsigned long masterClock = (unsigned long)payload[0] | ((unsigned long)payload[1] << 8)
+                              | ((unsigned long)payload[2] << 16) | ((unsigned long)payload[3] << 24);
+    // the frame spent one HOP_DELAY_MS on every link it crossed
+    clockOffset = (long)(masterClock + (hops + 1) * HOP_DELAY_MS - now);
+    clockSynced = true;
+    lastSync = now;
+  } else if (type == MSG_PHASE) {
+    NodeStatus &node = nodeStatus[origin];
+    node.road = payload[0];
+    node.phase = payload[1];
+    node.seen = now;
+    uint16_t offset = payload[2] | (payload[3] << 8);
+    if (node.phase == PH_GREEN && offset != NO_SLOT && clockSynced) {
+      // Its coordinated green began when the frame was sent. A late green
+      // or two after a crossing is normal and won back within a few cycles.
+      node.slotError = slotError(cycleClock(now) - (hops + 1) * HOP_DELAY_MS, offset);
+      bool off = node.slotError > COORD_DRIFT_MS || node.slotError < -(long)COORD_DRIFT_MS;
+      if (!off) node.offSlot = 0;
+      else if (node.offSlot < 255) node.offSlot++;
+      if (node.offSlot >= DRIFT_GREENS) driftingNodes |= 1 << origin;
+      else driftingNodes &= ~(1 << origin);
+    }
+  }
+}
+
+// Receive and pass on frames, and keep the shared clock running
+void coordService(unsigned long now) {
+#if COORD_ENABLED
+  while (Serial.available() > 0) {
+    uint8_t c = Serial.read();
+    if (rxLength == 0 && c != FRAME_START) continue; // hunt for a frame start
+    rxFrame[rxLength++] = c;
+    if (rxLength < FRAME_SIZE) continue;
+    rxLength = 0;
+
+    uint8_t check = 0;
+    for (uint8_t i = 1; i < FRAME_SIZE; i++) check ^= rxFrame[i];
+    if (check == 0) handleFrame(rxFrame, now);
+    else frameErrors++;
+  }
+
+  if (NODE_ID == 0) {
+    if (now - lastSync >= SYNC_PERIOD) {
+      lastSync = now;
+      unsigned long clock = cycleClock(now);
+      uint8_t payload[4] = {(uint8_t)clock, (uint8_t)(clock >> 8),
+                            (uint8_t)(clock >> 16), (uint8_t)(clock >> 24)};
+      sendFrame(MSG_SYNC, NODE_ID, 0, payload);
+    }
+  } else if (clockSynced && now - lastSync > SYNC_TIMEOUT) {
+    clockSynced = false; // master lost: keep cycling on our own
+  }
+#else
+  (void)now;
+#endif
+}
+
+// Where COORD_ROAD's green would start relative to its slot in the common
+// cycle: negative = early by that many ms (hold all red), positive = late
+// (start at once and trim the green so the next cycle is on time)
+long coordError(unsigned long now) {
+#if COORD_ENABLED
+  if (!clockSynced) return 0;
+  return slotError(cycleClock(now), COORD_OFFSET);
+#else
+  (void)now;
+  return 0;
+#endif
+}
+
+// Green for a road other than COORD_ROAD, cut short (never below
+// minGreenTime) if the cycle would otherwise reach COORD_ROAD's slot late,
+// e.g. after a crossing phase. The time is won back on the side roads, so
+// COORD_ROAD keeps its full green for the platoon.
+unsigned long coordSideGreen(int road, unsigned long length, unsigned long now) {
+  if (road == COORD_ROAD || length <= (unsigned long)minGreenTime) return length;
+  // When COORD_ROAD would turn green after this green and the roads before it
+  unsigned long toSlot = length + yellowTime + allRedTime + (anyPedRequest() ? pedTime : 0);
+  for (int r = (road + 1) % NUM_ROADS; r != COORD_ROAD; r = (r + 1) % NUM_ROADS) {
+    if (roadHasDemand(r)) toSlot += plannedGreen(r) + yellowTime + allRedTime;
+  }
+  long late = coordError(now + toSlot);
+  if (late <= 0) return length;
+  unsigned long spare = length - minGreenTime;
+  return length - min((unsigned long)late, spare);
+}
+
 // ----------------- Functions -----------------
 
 // Turn all lights OFF
-void allOff() {
+void allOff(unsigned long now) {
+  for (int i = 0; i < NUM_LAMP_PORTS; i++) lampImage[i] = 0;
+  lampBankWrite(now);
+}
+
+// Set a road's light state
+void setLights(int road, bool red, bool yellow, bool green, unsigned long now) {
+  lampSet(roadLamps[road].red, red);
+  lampSet(roadLamps[road].yellow, yellow);
+  lampSet(roadLamps[road].green, green);
+  lampBankWrite(now);
+}
+
+// Every road shows red, written in one go
+void allRed(unsigned long now) {
   for (int i = 0; i < NUM_ROADS; i++) {
-    digitalWrite(redPins[i], LOW);
-    digitalWrite(yellowPins[i], LOW);
-    digitalWrite(greenPins[i], LOW);
+    lampSet(roadLamps[i].red, HIGH);
+    lampSet(roadLamps[i].yellow, LOW);
+    lampSet(roadLamps[i].green, LOW);
   }
+  lampBankWrite(now);
 }
 
-// Set a road's light state
-void setLights(int road, bool red, bool yellow, bool green) {
-  digitalWrite(redPins[road], red);
-  digitalWrite(yellowPins[road], yellow);
-  digitalWrite(greenPins[road], green);
-}
-
-// Pedestrian crossing sequence for given road
-void handlePedestrian(int road) {
-  if (pedRequest[road]) {
-    // Ensure traffic is stopped (all red)
-    allOff();
-    for (int i = 0; i < NUM_ROADS; i++) digitalWrite(redPins[i], HIGH);
-
-    // Pedestrian buzzer signal
-    for (int t = 0; t < pedTime / 500; t++) {
-      tone(BUZZER_PIN, 1000, 200);
-      delay(500);
+// Switch lamps for a new phase and start its timer
+void enterPhase(Phase phase, unsigned long length, unsigned long now) {
+  currentPhase = phase;
+  phaseStart = now;
+  phaseLength = length;
+  coordSendPhase(phase);
+
+  switch (phase) {
+    case PH_GREEN:
+      setLights(currentRoad, LOW, LOW, HIGH, now);
+      break;
+    case PH_YELLOW:
+      setLights(currentRoad, LOW, HIGH, LOW, now);
+      break;
+    case PH_PED:
+    case PH_ALL_RED:
+    case PH_EMERGENCY:
+      allRed(now);
+      break;
+  }
+
+  // Start the buzzer pattern right away
+  if (!failSafe && (phase == PH_PED || phase == PH_EMERGENCY)) {
+    lastBeep = now;
+    tone(BUZZER_PIN, phase == PH_PED ? 1000 : 200, 200);
+  }
+}
+
+// Start the step at currentStep of currentRoad (skipping empty steps).
+// At the end of a road's cycle the planner picks the next road with demand.
+void enterStep(unsigned long now) {
+  while (true) {
+    if (currentStep >= CYCLE_STEPS) {
+      int next = nextRoadWithDemand(currentRoad);
+      if (next < 0) {
+        // Nothing waiting anywhere: rest in all red (letting pedestrians
+        // cross if anyone asked) and plan again afterwards
+        currentStep = anyPedRequest() ? PED_STEP : CYCLE_STEPS - 1;
+      } else if (next == COORD_ROAD && coordError(now) < 0) {
+        // Early for the coordinated slot: hold all red until it comes
+        currentStep = CYCLE_STEPS - 1;
+        enterPhase(PH_ALL_RED, -coordError(now), now);
+        return;
+      } else {
+        currentRoad = next;
+        currentStep = 0;
+      }
+    }
+    const PhaseStep &step = roadCycle[currentStep];
+    // Every road is red in the crossing phase, so all waiting
+    // pedestrians cross in the first gap after any road's yellow
+    if (step.phase == PH_PED && !anyPedRequest()) {
+      currentStep++;
+      continue;
+    }
+    if (step.phase == PH_PED) {
+      for (int i = 0; i < NUM_ROADS; i++) pedRequest[i] = false; // requests served
     }
 
-    pedRequest[road] = false; // reset request
+    unsigned long length = *step.duration;
+    if (step.phase == PH_GREEN) {
+      length = plannedGreen(currentRoad);
+      length = coordSideGreen(currentRoad, length, now);
+      if (currentRoad == COORD_ROAD && coordError(now) > 0) {
+        // Late for the slot: win the time back, but never below minGreenTime
+        unsigned long late = coordError(now);
+        unsigned long shortest = min(length, (unsigned long)minGreenTime);
+        length = length > shortest + late ? length - late : shortest;
+      }
+      // The queue is being served; what does not fit waits for the next green
+      uint8_t capacity = greenCapacity(length);
+      uint8_t &waiting = vehicleCount[currentRoad];
+      waiting = waiting > capacity ? waiting - capacity : 0;
+    }
+    enterPhase(step.phase, length, now);
+    return;
   }
 }
 
-// Emergency mode → all red
-void emergencyMode() {
-  allOff();
-  for (int i = 0; i < NUM_ROADS; i++) {
-    digitalWrite(redPins[i], HIGH);
+// Pedestrian / emergency beeps, one short tone per period
+void serviceBuzzer(unsigned long now) {
+  unsigned long period;
+  int freq;
+  if (currentPhase == PH_PED) {
+    period = PED_BEEP_PERIOD;
+    freq = 1000;
+  } else if (currentPhase == PH_EMERGENCY) {
+    period = EMERGENCY_BEEP_PERIOD;
+    freq = 200;
+  } else {
+    return;
   }
-  // Flash buzzer
-  for (int i = 0; i < 5; i++) {
-    tone(BUZZER_PIN, 200, 200);
-    delay(400);
+
+  if (now - lastBeep >= period) {
+    lastBeep += period;
+    tone(BUZZER_PIN, freq, 200);
   }
 }
 
@@ -92,43 +734,62 @@ void setup() {
   }
   pinMode(EMERGENCY_PIN, INPUT_PULLUP);
   pinMode(BUZZER_PIN, OUTPUT);
+  setupInputCapture();
+#if VEHICLE_SENSORS
+  pinMode(DETECTOR_PIN, INPUT);  // no pull-up: it would load the ladder
+  detectorChannel = adcAttach(DETECTOR_PIN);
+  adcBegin();
+#endif
+#if COORD_ENABLED
+  Serial.begin(COORD_BAUD); // pins 0/1: the coordination ring
+#endif
+
+  unsigned long now = millis();
+  allRed(now);
 
-  allOff();
+  // Plan from the end of the last road's cycle, so road 0 goes first
+  currentRoad = NUM_ROADS - 1;
+  currentStep = CYCLE_STEPS;
+  enterStep(now);
 }
 
 // ----------------- Main Loop -----------------
+// Runs in microseconds: drain input events, then advance the phase if its time is up.
 void loop() {
-  // Check pedestrian buttons
-  for (int i = 0; i < NUM_ROADS; i++) {
-    if (digitalRead(pedButtons[i]) == LOW) {
-      pedRequest[i] = true;
-    }
-  }
+  unsigned long now = millis();
 
-  // Check emergency button
-  if (digitalRead(EMERGENCY_PIN) == LOW) {
-    emergencyMode();
-    return; // skip normal cycle until released
+  // A refused lamp pattern stops the controller: flash until reset
+  if (failSafe) {
+    lampBankWrite(now);
+    return;
   }
 
-  // Cycle through each road
-  for (int road = 0; road < NUM_ROADS; road++) {
-    // Green for this road
-    setLights(road, LOW, LOW, HIGH);
-    delay(greenTime);
+  // Pedestrian and emergency presses captured since the last pass
+  processInputs();
+  scanVehicles(now);
+  coordService(now);
+
+  // Emergency button → all red immediately, from any phase
+  if (emergencyRequest) {
+    emergencyRequest = false;
+    if (currentPhase != PH_EMERGENCY) {
+      enterPhase(PH_EMERGENCY, (unsigned long)EMERGENCY_BEEPS * EMERGENCY_BEEP_PERIOD, now);
+    }
+  }
 
-    // Handle pedestrian crossing if requested
-    handlePedestrian(road);
+  serviceBuzzer(now);
 
-    // Yellow phase
-    setLights(road, LOW, HIGH, LOW);
-    delay(yellowTime);
+  if (now - phaseStart < phaseLength) return;
 
-    // All red before next road
-    allOff();
-    for (int i = 0; i < NUM_ROADS; i++) {
-      digitalWrite(redPins[i], HIGH);
-    }
-    delay(allRedTime);
+  if (currentPhase == PH_EMERGENCY) {
+    if (emergencyHeld) return;  // hold all red until released
+    // All-red clearance, then the cycle wraps around to road 0
+    currentRoad = NUM_ROADS - 1;
+    currentStep = CYCLE_STEPS - 1;
+    enterPhase(PH_ALL_RED, allRedTime, now);
+    return;
   }
+
+  currentStep++;
+  enterStep(now);
 }
@@ -0,0 +1,241 @@
+/*
+  midi2song - Standard MIDI File to packed PROGMEM song converter
+  ---------------------------------------------------------------
+  Turns a .mid file (format 0 or 1) into the compact song format played
+  by "Project 1 (Midi Player).cpp" and prints it as a C array that can be
+  pasted over songData[] in the sketch.
+
+  Build and run on a PC (not on the Arduino):
+    g++ -O2 -o midi2song "Tools/midi2song.cpp"
+    ./midi2song input.mid > song.txt
+
+  Song format, one record per note, ordered by start time:
+    delta     variable-length quantity, ms after the previous note starts
+    pitch     bits 0..6 = MIDI note, bit 7 set = a velocity byte follows
+    velocity  only present when it differs from the previous note
+    duration  variable-length quantity, ms the note is held
+
+  Variable-length quantities are MIDI style: 7 bits per byte, most
+  significant group first, bit 7 set on every byte except the last.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+struct RawEvent {
+  uint32_t tick;
+  int order;         // file order, keeps sorting stable
+  uint8_t type;      // 0x90 note on, 0x80 note off, 0x51 tempo
+  uint8_t channel;
+  uint8_t pitch;
+  uint8_t velocity;
+  uint32_t tempo;    // us per quarter note (tempo events only)
+};
+
+struct Note {
+  uint32_t startMs;
+  uint32_t endMs;
+  uint8_t pitch;
+  uint8_t velocity;
+  int order;
+};
+
+static std::vector<uint8_t> data;
+static size_t pos = 0;
+
+static void fail(const char *msg) {
+  fprintf(stderr, "midi2song: %s\n", msg);
+  exit(1);
+}
+
+static uint8_t readByte() {
+  if (pos >= data.size()) fail("unexpected end of file");
+  return data[pos++];
+}
+
+static uint32_t readBE(int bytes) {
+  uint32_t v = 0;
+  for (int i = 0; i < bytes; i++) v = (v << 8) | readByte();
+  return v;
+}
+
+static uint32_t readVLQ() {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    uint8_t b = readByte();
+    v = (v << 7) | (b & 0x7F);
+    if (!(b & 0x80)) return v;
+  }
+  fail("variable-length quantity too long");
+  return 0;
+}
+
+static void writeVLQ(std::vector<uint8_t> &out, uint32_t v) {
+  uint8_t groups[5];
+  int n = 0;
+  do {
+    groups[n++] = v & 0x7F;
+    v >>= 7;
+  } while (v);
+  while (n > 1) out.push_back(groups[--n] | 0x80);
+  out.push_back(groups[0]);
+}
+
+// Parse one MTrk chunk body ending at 'end'
+static void readTrack(size_t end, std::vector<RawEvent> &events) {
+  uint32_t tick = 0;
+  uint8_t status = 0;
+
+  while (pos < end) {
+    tick += readVLQ();
+    uint8_t b = readByte();
+
+    if (b == 0xFF) {                      // meta event
+      uint8_t type = readByte();
+      uint32_t len = readVLQ();
+      if (type == 0x51 && len == 3) {
+        RawEvent ev = {tick, (int)events.size(), 0x51, 0, 0, 0, 0};
+        ev.tempo = readBE(3);
+        events.push_back(ev);
+      } else {
+        pos += len;
+      }
+      if (type == 0x2F) break;            // end of track
+      continue;
+    }
+    if (b == 0xF0 || b == 0xF7) {         // sysex
+      pos += readVLQ();
+      continue;
+    }
+
+    uint8_t d1;
+    if (b & 0x80) {
+      status = b;
+      d1 = readByte();
+    } else {
+      if (!status) fail("running status without a status byte");
+      d1 = b;
+    }
+
+    uint8_t kind = status & 0xF0;
+    if (kind == 0xC0 || kind == 0xD0) continue;  // one data byte
+    uint8_t d2 = readByte();
+
+    if (kind == 0x90 || kind == 0x80) {
+      RawEvent ev = {tick, (int)events.size(), kind, (uint8_t)(status & 0x0F),
+                     (uint8_t)(d1 & 0x7F), (uint8_t)(d2 & 0x7F), 0};
+      if (kind == 0x90 && ev.velocity == 0) ev.type = 0x80;
+      events.push_back(ev);
+    }
+  }
+  pos = end;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s input.mid [array_name]\n", argv[0]);
+    return 2;
+  }
+  const char *name = argc > 2 ? argv[2] : "songData";
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f) fail("cannot open input file");
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+
+  // Header chunk
+  if (readBE(4) != 0x4D546864) fail("not a Standard MIDI File (no MThd)");
+  uint32_t headerLen = readBE(4);
+  size_t headerEnd = pos + headerLen;
+  readBE(2);                              // format 0 or 1 handled the same
+  uint32_t trackCount = readBE(2);
+  uint32_t division = readBE(2);
+  if (division & 0x8000) fail("SMPTE time division is not supported");
+  pos = headerEnd;
+
+  std::vector<RawEvent> events;
+  for (uint32_t t = 0; t < trackCount && pos + 8 <= data.size(); t++) {
+    uint32_t id = readBE(4);
+    uint32_t len = readBE(4);
+    if (id != 0x4D54726B) {               // skip unknown chunks
+      pos += len;
+      t--;
+      continue;
+    }
+    readTrack(pos + len, events);
+  }
+
+  std::stable_sort(events.begin(), events.end(), [](const RawEvent &a, const RawEvent &b) {
+    return a.tick < b.tick;
+  });
+
+  // Walk the merged events, converting ticks to ms through the tempo map
+  uint32_t tempo = 500000;                // default 120 BPM
+  uint32_t lastTick = 0;
+  double lastUs = 0;
+  std::vector<Note> notes;
+  std::vector<int> sounding[16][128];     // open notes per channel/pitch
+
+  for (const RawEvent &ev : events) {
+    double us = lastUs + (double)(ev.tick - lastTick) * tempo / division;
+    lastTick = ev.tick;
+    lastUs = us;
+    uint32_t ms = (uint32_t)(us / 1000.0 + 0.5);
+
+    if (ev.type == 0x51) {
+      tempo = ev.tempo;
+    } else if (ev.type == 0x90) {
+      Note note = {ms, ms, ev.pitch, ev.velocity, ev.order};
+      sounding[ev.channel][ev.pitch].push_back((int)notes.size());
+      notes.push_back(note);
+    } else {
+      std::vector<int> &open = sounding[ev.channel][ev.pitch];
+      if (open.empty()) continue;
+      notes[open.front()].endMs = ms;     // first in, first out
+      open.erase(open.begin());
+    }
+  }
+
+  // Notes never switched off end with the last event
+  uint32_t songEnd = (uint32_t)(lastUs / 1000.0 + 0.5);
+  for (int c = 0; c < 16; c++)
+    for (int p = 0; p < 128; p++)
+      for (int i : sounding[c][p]) notes[i].endMs = songEnd;
+
+  std::stable_sort(notes.begin(), notes.end(), [](const Note &a, const Note &b) {
+    return a.startMs != b.startMs ? a.startMs < b.startMs : a.order < b.order;
+  });
+
+  // Encode
+  std::vector<uint8_t> out;
+  uint32_t prevStart = 0;
+  int prevVelocity = -1;
+  for (const Note &note : notes) {
+    writeVLQ(out, note.startMs - prevStart);
+    prevStart = note.startMs;
+    if (note.velocity != prevVelocity) {
+      out.push_back(note.pitch | 0x80);
+      out.push_back(note.velocity);
+      prevVelocity = note.velocity;
+    } else {
+      out.push_back(note.pitch);
+    }
+    uint32_t duration = note.endMs > note.startMs ? note.endMs - note.startMs : 1;
+    writeVLQ(out, duration);
+  }
+
+  printf("// Generated by midi2song from %s: %u notes, %u bytes\n",
+         argv[1], (unsigned)notes.size(), (unsigned)out.size());
+  printf("const byte %s[] PROGMEM = {", name);
+  for (size_t i = 0; i < out.size(); i++) {
+    printf(i % 12 ? " 0x%02X," : "\n  0x%02X,", out[i]);
+  }
+  printf("\n};\n");
+  return 0;
+}
@@ -0,0 +1,173 @@
+/*
+  telemetry2csv - decoder for the binary stream sent by Telemetry.h
+  -----------------------------------------------------------------
+  Reads the raw bytes a sketch sends with telemetryAdd() and prints one
+  CSV line per sample. Give it a capture of the serial port, or pipe the
+  port straight in (Linux example below).
+
+  Build and run on a PC (not on the Arduino):
+    g++ -O2 -o telemetry2csv "Tools/telemetry2csv.cpp"
+    stty -F /dev/ttyACM0 9600 raw && ./telemetry2csv < /dev/ttyACM0
+    ./telemetry2csv capture.bin > samples.csv
+
+  Output columns:
+    stream    stream number given to telemetryAdd()
+    seq       record sequence number
+    time_ms   millis() on the Arduino; samples inside a record are spread
+              evenly between its first and last time
+    value     the sample
+
+  Records that fail the CRC and gaps in the sequence numbers (records the
+  sketch dropped because the serial port could not keep up) are reported
+  on stderr, with totals at the end.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MAX_FRAME 512
+
+static void fail(const char *msg) {
+  fprintf(stderr, "telemetry2csv: %s\n", msg);
+  exit(1);
+}
+
+// Same CRC-8 (poly 0x07) as Telemetry.h
+static uint8_t crc8(const uint8_t *data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Undo COBS; returns the decoded length, or -1 if the frame is malformed
+static long cobsDecode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = 0, n = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) return -1;
+    for (uint8_t k = 1; k < code; k++) out[n++] = in[i++];
+    if (code != 0xFF && i < len) out[n++] = 0;
+  }
+  return (long)n;
+}
+
+static bool getVarint(const uint8_t *data, size_t len, size_t &pos, uint32_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return false;
+    uint8_t b = data[pos++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static long records = 0, samples = 0, crcErrors = 0, badRecords = 0, missing = 0;
+static bool seenSeq = false;
+static uint16_t expectSeq = 0;
+
+static void handleRecord(const uint8_t *rec, size_t len) {
+  if (len < 12) {
+    badRecords++;
+    fprintf(stderr, "short record (%zu bytes)\n", len);
+    return;
+  }
+  if (crc8(rec, len - 1) != rec[len - 1]) {
+    crcErrors++;
+    fprintf(stderr, "CRC error, record skipped\n");
+    return;
+  }
+  len--;  // drop the CRC
+
+  uint8_t stream = rec[0];
+  uint16_t seq = rec[1] | (rec[2] << 8);
+  uint32_t time = rec[3] | (rec[4] << 8) | (rec[5] << 16) | ((uint32_t)rec[6] << 24);
+  uint16_t span = rec[7] | (rec[8] << 8);
+  uint8_t count = rec[9];
+
+  if (seenSeq && seq != expectSeq) {
+    uint16_t gap = seq - expectSeq;
+    missing += gap;
+    fprintf(stderr, "gap: %u record(s) missing before seq %u\n", gap, seq);
+  }
+  seenSeq = true;
+  expectSeq = seq + 1;
+
+  int32_t values[256];
+  size_t pos = 10;
+  int32_t prev = 0;
+  for (int i = 0; i < count; i++) {
+    uint32_t z;
+    if (!getVarint(rec, len, pos, z)) {
+      badRecords++;
+      fprintf(stderr, "truncated samples in seq %u\n", seq);
+      return;
+    }
+    int32_t delta = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    prev += delta;
+    values[i] = (int16_t)prev;
+  }
+  if (pos != len || count == 0) {
+    badRecords++;
+    fprintf(stderr, "bad sample count in seq %u\n", seq);
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    double t = time + (count > 1 ? (double)span * i / (count - 1) : 0.0);
+    printf("%u,%u,%.1f,%d\n", stream, seq, t, values[i]);
+  }
+  records++;
+  samples += count;
+}
+
+int main(int argc, char **argv) {
+  FILE *in = stdin;
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [capture.bin]   (reads stdin without a file)\n", argv[0]);
+    return 1;
+  }
+  if (argc == 2) {
+    in = fopen(argv[1], "rb");
+    if (!in) fail("cannot open input file");
+  }
+
+  printf("stream,seq,time_ms,value\n");
+
+  uint8_t frame[MAX_FRAME], record[MAX_FRAME];
+  size_t len = 0;
+  bool overflow = false;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c != 0) {
+      if (len < MAX_FRAME) frame[len++] = (uint8_t)c;
+      else overflow = true;
+      continue;
+    }
+    // 0x00 ends a frame; the bytes before the first one may be the tail of
+    // a record that started before the capture, which fails the CRC
+    if (len > 0) {
+      long n = overflow ? -1 : cobsDecode(frame, len, record);
+      if (n < 0) {
+        badRecords++;
+        fprintf(stderr, "bad frame skipped\n");
+      } else {
+        handleRecord(record, (size_t)n);
+      }
+    }
+    len = 0;
+    overflow = false;
+    fflush(stdout);
+  }
+  if (in != stdin) fclose(in);
+
+  fprintf(stderr, "%ld records, %ld samples, %ld CRC errors, %ld bad, %ld missing\n",
+          records, samples, crcErrors, badRecords, missing);
+  return 0;
+}
@@ -1,39 +1,92 @@
 // Three LEDs with button control
 
-int led1 = 2;
-int led2 = 3;
-int led3 = 4;
+#include <InputCapture.h>
+#include <TimerWheel.h>
+
+const int led1 = 2;
+const int led2 = 3;
+const int led3 = 4;
 int buttonPin = 7;
 int buttonState = 0; // Tip: Meaning it is off, 1 when it's on: Binary code
 
+// led1..led3 are PD2..PD4 on an Uno: one PORTD store sets all three
+#if !defined(__AVR_ATmega328P__)
+#error "showLeds() writes PORTD directly: pins 2..4 are only PD2..PD4 on an Uno or Nano"
+#endif
+const byte LED_MASK = (1 << led1) | (1 << led2) | (1 << led3);
+
+void showLeds(byte pattern) {
+  PORTD = (PORTD & ~LED_MASK) | (pattern & LED_MASK);
+}
+
+// The pin-change interrupt on pin 7 (PD7) queues presses through
+// InputCapture.h, so pressing the button while the LEDs are still
+// blinking is not missed. Its debounce follows every edge, so the bounce
+// of a release cannot be taken for a new press.
+int8_t buttonInput;
+
+// True if the button was pressed since the last call
+bool pressLatched() {
+  bool pressed = false;
+  InputEvent ev;
+  while (inputPop(ev)) {
+    if (ev.pressed) pressed = true;
+  }
+  return pressed;
+}
+
+// The blink sequence is stepped by a timer instead of delay()
+const byte sequence[] = {1 << led1, 1 << led2, 1 << led3};
+const byte SEQUENCE_LENGTH = sizeof(sequence);
+#define STEP_MS 300
+
+TimerWheel wheel;
+bool blinking = false;
+byte sequenceStep = 0;  // next LED to light
+
+// Light the next LED, or end the sequence with all LEDs off
+void nextStep(Timer &timer) {
+  if (sequenceStep == SEQUENCE_LENGTH) {
+    showLeds(0);
+    blinking = false;
+    return;
+  }
+  showLeds(sequence[sequenceStep++]);
+  wheel.start(timer, STEP_MS);
+}
+
+Timer stepTimer(nextStep);
+
 void setup() {
   pinMode(led1, OUTPUT);
   pinMode(led2, OUTPUT);
   pinMode(led3, OUTPUT);
   pinMode(buttonPin, INPUT);
+
+  // Pin-change interrupt on pin 7 (PCINT23)
+  buttonInput = inputAttach(buttonPin, INPUT_ACTIVE_HIGH);
+  inputBegin();
 }
 
 void loop() {
+  wheel.update();
+  if (blinking) return; // a press now is latched for the next round
+
   buttonState = digitalRead(buttonPin);
 
+  // Also count a press that happened during the last blink sequence
+  if (pressLatched()) {
+    buttonState = HIGH;
+  }
+
   if (buttonState == HIGH) {
     // If button is pressed → blink LEDs in sequence
-    digitalWrite(led1, HIGH);
-    delay(300);
-    digitalWrite(led1, LOW);
-
-    digitalWrite(led2, HIGH);
-    delay(300);
-    digitalWrite(led2, LOW);
-
-    digitalWrite(led3, HIGH);
-    delay(300);
-    digitalWrite(led3, LOW);
+    blinking = true;
+    sequenceStep = 0;
+    nextStep(stepTimer);
   } 
   else {
     // If button is not pressed → keep LEDs off
-    digitalWrite(led1, LOW);
-    digitalWrite(led2, LOW);
-    digitalWrite(led3, LOW);
+    showLeds(0);
   }
 }
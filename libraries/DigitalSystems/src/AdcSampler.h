@@ -0,0 +1,145 @@
+// AdcSampler.h - analog inputs read in the background
+//
+// analogRead() waits ~110 us for every conversion and returns one noisy
+// sample. Here the ADC runs free (one conversion after another) and its
+// interrupt walks through the attached channels, so loop() only picks up
+// the latest values:
+//   - each channel gets ADC_OVERSAMPLE samples in a row, summed and scaled
+//     down to ADC_EXTRA_BITS more bits than the plain 10 (less noise);
+//   - after switching channels two results are thrown away: the one
+//     already converting on the old channel, and the first one on the new
+//     channel while its input settles;
+//   - finished values go into a double buffer, so a reading never mixes
+//     old and new halves;
+//   - each channel can have a Schmitt trigger (a low and a high threshold)
+//     so a value hovering near one threshold does not chatter.
+//
+//   #include <AdcSampler.h>
+//
+//   int8_t pot = adcAttach(A0);
+//   adcBegin();
+//   uint16_t value = adcRead(pot);   // 0 .. ADC_MAX
+//
+// Do not call analogRead() while the sampler runs.
+
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include <Arduino.h>
+
+#ifndef ADC_CHANNELS
+#define ADC_CHANNELS 4        // define before the #include to change
+#endif
+#define ADC_EXTRA_BITS 2
+#define ADC_OVERSAMPLE (1 << (2 * ADC_EXTRA_BITS))  // 4 samples per extra bit
+#define ADC_MAX        (1023U << ADC_EXTRA_BITS)
+
+// Convert an analogRead()-style value (0..1023) to adcRead() units
+#define ADC_SCALE(x)   ((uint16_t)(x) << ADC_EXTRA_BITS)
+
+struct AdcChannel {
+  uint8_t mux;       // ADMUX channel bits
+  uint16_t low;      // Schmitt thresholds, adcRead() units
+  uint16_t high;
+};
+
+AdcChannel adcChannel[ADC_CHANNELS];
+uint8_t adcChannels = 0;
+
+volatile uint16_t adcBuffer[2][ADC_CHANNELS];  // [front / back][channel]
+volatile uint8_t adcFront = 0;                 // buffer loop() reads
+volatile uint8_t adcAboveMask = 0;             // Schmitt state, bit per channel
+volatile uint8_t adcRounds = 0;                // completed passes over all channels
+
+// ISR state
+uint8_t adcCurrent = 0;    // channel being sampled
+uint8_t adcSkip = 2;       // results still to throw away
+uint8_t adcCount = 0;      // samples summed so far
+uint16_t adcSum = 0;
+
+// Add an analog pin (A0..A7); returns the channel number or -1 if full
+int8_t adcAttach(uint8_t pin) {
+  if (adcChannels == ADC_CHANNELS) return -1;
+  AdcChannel &c = adcChannel[adcChannels];
+  c.mux = (pin >= A0 ? pin - A0 : pin) & 0x07;
+  c.low = 0;
+  c.high = ADC_MAX;
+  return adcChannels++;
+}
+
+// Schmitt trigger: adcAbove() turns on above 'high' and off below 'low'
+void adcHysteresis(uint8_t channel, uint16_t low, uint16_t high) {
+  if (channel >= adcChannels) return;
+  uint8_t oldSREG = SREG;
+  cli();
+  adcChannel[channel].low = low;
+  adcChannel[channel].high = high;
+  SREG = oldSREG;
+}
+
+// In free-running mode the next conversion has already started when the
+// interrupt runs, so a new ADMUX only applies to the conversion after it.
+// Skipping two results after a switch drops that stale one plus the
+// settling sample.
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+  if (adcSkip > 0) {
+    adcSkip--;
+    return;
+  }
+
+  adcSum += sample;
+  if (++adcCount < ADC_OVERSAMPLE) return;
+
+  // Decimate: ADC_OVERSAMPLE samples carry ADC_EXTRA_BITS more bits
+  uint16_t value = adcSum >> ADC_EXTRA_BITS;
+  adcSum = 0;
+  adcCount = 0;
+
+  uint8_t back = adcFront ^ 1;
+  adcBuffer[back][adcCurrent] = value;
+
+  const AdcChannel &c = adcChannel[adcCurrent];
+  uint8_t bit = 1 << adcCurrent;
+  if (value > c.high) adcAboveMask |= bit;
+  else if (value < c.low) adcAboveMask &= ~bit;
+
+  // Next channel; after the last one the finished set becomes the front
+  adcCurrent++;
+  if (adcCurrent == adcChannels) {
+    adcCurrent = 0;
+    adcFront = back;
+    adcRounds++;
+  }
+  if (adcChannels > 1) {
+    ADMUX = (1 << REFS0) | adcChannel[adcCurrent].mux;
+    adcSkip = 2;
+  }
+}
+
+// Start free-running conversions (AVcc reference, clk/128 = 125 kHz ADC clock)
+void adcBegin() {
+  if (adcChannels == 0) return;
+  for (uint8_t i = 0; i < adcChannels; i++) {
+    DIDR0 |= 1 << adcChannel[i].mux;  // digital input buffer off: less noise
+  }
+  adcCurrent = 0;
+  adcSkip = 2;
+  ADMUX = (1 << REFS0) | adcChannel[0].mux;
+  ADCSRB = 0;  // free running
+  ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIE)
+         | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+}
+
+// Latest value of a channel, 0..ADC_MAX
+uint16_t adcRead(uint8_t channel) {
+  // The ISR only writes the back buffer, and the front one is not reused
+  // for a whole pass, so no locking is needed here
+  return adcBuffer[adcFront][channel];
+}
+
+bool adcAbove(uint8_t channel) {
+  return adcAboveMask & (1 << channel);
+}
+
+#endif
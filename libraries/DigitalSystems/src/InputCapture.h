@@ -0,0 +1,179 @@
+// InputCapture.h - button presses caught by pin-change interrupts
+//
+// A button read with digitalRead() in loop() is missed when it is pressed
+// and released while loop() is busy elsewhere. Here every change on an
+// attached pin raises a pin-change interrupt, which debounces it and
+// queues a timestamped press or release, and loop() takes the events
+// whenever it gets to them:
+//   - each input keeps its own debounced state. An edge counts when the
+//     pin differs from that state and the input's last counted edge (press
+//     or release) is at least INPUT_DEBOUNCE_MS old, so the bounces after
+//     a release are dropped just like the ones after a press;
+//   - a bounce that settles inside the debounce window raises no further
+//     interrupt, so inputPop() rescans the pins before it looks at the queue;
+//   - events are pushed (inputHead moves) from the ISR and from the
+//     rescan in inputPop(), which runs under cli(), so pushes never
+//     overlap; inputPop() is the only writer of inputTail.
+//
+//   #include <InputCapture.h>
+//
+//   pinMode(7, INPUT);
+//   int8_t button = inputAttach(7, INPUT_ACTIVE_HIGH);
+//   inputBegin();
+//
+//   InputEvent ev;
+//   while (inputPop(ev)) {
+//     if (ev.input == button && ev.pressed) ...
+//   }
+//
+// Works on pins 0..13 and A0..A5 of an Uno. The header defines the three
+// pin-change vectors (PCINT0..2), so a sketch using it must not.
+
+#ifndef INPUT_CAPTURE_H
+#define INPUT_CAPTURE_H
+
+#include <Arduino.h>
+
+#if !defined(__AVR_ATmega328P__)
+#error "InputCapture.h maps pins to ATmega328P ports and PCINT vectors: build for an Uno or Nano"
+#endif
+
+#ifndef INPUT_CAPTURE_INPUTS
+#define INPUT_CAPTURE_INPUTS 8   // define before the #include to change (max 8)
+#endif
+#ifndef INPUT_QUEUE_SIZE
+#define INPUT_QUEUE_SIZE     16  // must be a power of two
+#endif
+#ifndef INPUT_DEBOUNCE_MS
+#define INPUT_DEBOUNCE_MS    20  // ignore bounces this soon after an edge
+#endif
+
+static_assert(INPUT_CAPTURE_INPUTS <= 8, "input states are kept in one byte");
+static_assert((INPUT_QUEUE_SIZE & (INPUT_QUEUE_SIZE - 1)) == 0, "INPUT_QUEUE_SIZE must be a power of two");
+
+#define INPUT_ACTIVE_HIGH false  // pressed reads HIGH (pull-down resistor)
+#define INPUT_ACTIVE_LOW  true   // pressed reads LOW (INPUT_PULLUP)
+
+struct InputEvent {
+  uint8_t input;       // number returned by inputAttach()
+  bool pressed;        // true on press, false on release
+  unsigned long time;  // millis() of the edge
+};
+
+// ---- Inputs ----
+// Uno pin mapping: 0..7 PORTD (PCINT2), 8..13 PORTB (PCINT0), A0..A5 PORTC (PCINT1)
+enum InputPort { INPUT_PORT_B, INPUT_PORT_C, INPUT_PORT_D };
+
+struct InputPin {
+  uint8_t port;     // InputPort, also the PCIEx bit
+  uint8_t mask;     // bit within that port
+  bool activeLow;
+};
+
+InputPin inputPin[INPUT_CAPTURE_INPUTS];
+uint8_t inputCount = 0;
+
+volatile InputEvent inputQueue[INPUT_QUEUE_SIZE];
+volatile uint8_t inputHead = 0;       // next slot inputPush() writes
+volatile uint8_t inputTail = 0;       // next slot inputPop() reads
+volatile uint8_t inputOverflows = 0;  // events dropped because the ring was full
+
+// ISR-side debounce state
+volatile uint8_t inputState = 0;      // bit i = input i pressed
+unsigned long inputLastEdge[INPUT_CAPTURE_INPUTS];
+
+// Add a button pin; returns the input number or -1 if full.
+// Set the pin's pinMode() yourself.
+int8_t inputAttach(uint8_t pin, bool activeLow) {
+  if (inputCount == INPUT_CAPTURE_INPUTS || pin > A5) return -1;
+  InputPin &in = inputPin[inputCount];
+  if (pin < 8) {
+    in.port = INPUT_PORT_D;
+    in.mask = 1 << pin;
+  } else if (pin < 14) {
+    in.port = INPUT_PORT_B;
+    in.mask = 1 << (pin - 8);
+  } else {
+    in.port = INPUT_PORT_C;
+    in.mask = 1 << (pin - A0);
+  }
+  in.activeLow = activeLow;
+  return inputCount++;
+}
+
+// Queue one edge; called with interrupts disabled
+void inputPush(uint8_t input, bool pressed, unsigned long time) {
+  uint8_t next = (inputHead + 1) & (INPUT_QUEUE_SIZE - 1);
+  if (next == inputTail) {
+    inputOverflows++;
+    return;
+  }
+  inputQueue[inputHead].input = input;
+  inputQueue[inputHead].pressed = pressed;
+  inputQueue[inputHead].time = time;
+  inputHead = next;
+}
+
+bool inputPinPressed(const InputPin &in, const uint8_t pins[3]) {
+  return ((pins[in.port] & in.mask) != 0) != in.activeLow;
+}
+
+// Compare every input with its debounced state and queue the changes;
+// called with interrupts disabled
+void inputScan(unsigned long now) {
+  const uint8_t pins[3] = {PINB, PINC, PIND};
+  for (uint8_t i = 0; i < inputCount; i++) {
+    bool pressed = inputPinPressed(inputPin[i], pins);
+    bool reported = inputState & (1 << i);
+    if (pressed == reported || now - inputLastEdge[i] < INPUT_DEBOUNCE_MS) continue;
+    inputLastEdge[i] = now;
+    inputState ^= 1 << i;
+    inputPush(i, pressed, now);
+  }
+}
+
+ISR(PCINT0_vect) { inputScan(millis()); }
+ISR(PCINT1_vect) { inputScan(millis()); }
+ISR(PCINT2_vect) { inputScan(millis()); }
+
+// Take the current pin levels as the starting state and enable the
+// pin-change interrupts of the attached pins
+void inputBegin() {
+  uint8_t oldSREG = SREG;
+  cli();
+  const uint8_t pins[3] = {PINB, PINC, PIND};
+  unsigned long now = millis();
+  inputState = 0;
+  for (uint8_t i = 0; i < inputCount; i++) {
+    const InputPin &in = inputPin[i];
+    if (inputPinPressed(in, pins)) inputState |= 1 << i;
+    inputLastEdge[i] = now - INPUT_DEBOUNCE_MS;
+    if (in.port == INPUT_PORT_B) PCMSK0 |= in.mask;
+    else if (in.port == INPUT_PORT_C) PCMSK1 |= in.mask;
+    else PCMSK2 |= in.mask;
+    PCICR |= 1 << in.port;  // PCIE0..2 follow the port order
+  }
+  SREG = oldSREG;
+}
+
+// Take the oldest event; returns false when there is none
+bool inputPop(InputEvent &ev) {
+  uint8_t oldSREG = SREG;
+  cli();
+  inputScan(millis());
+  SREG = oldSREG;
+
+  if (inputTail == inputHead) return false;
+  ev.input = inputQueue[inputTail].input;
+  ev.pressed = inputQueue[inputTail].pressed;
+  ev.time = inputQueue[inputTail].time;
+  inputTail = (inputTail + 1) & (INPUT_QUEUE_SIZE - 1);
+  return true;
+}
+
+// Debounced state of an input, without taking events from the queue
+bool inputPressed(uint8_t input) {
+  return inputState & (1 << input);
+}
+
+#endif
@@ -0,0 +1,215 @@
+// SoftPWM.h - PWM on any pin, with gamma correction and fades
+//
+// Timer2 drives bit-angle modulation (BAM): each frame shows bit 0 of
+// every channel's duty for 1 time unit, bit 1 for 2 units ... bit 7 for
+// 128 units. The interrupt only copies a precomputed pattern to each
+// port, so its cost depends on the number of ports, not channels. Once
+// per frame (during the long bit 7) the ISR also steps the fades and
+// rebuilds the patterns, so a fade runs with nothing to do in loop().
+//
+//   #include <SoftPWM.h>
+//
+//   int8_t led = softPwmAttach(9);     // any digital pin
+//   softPwmBegin();
+//   softPwmFade(led, 255, 1000);       // fade up over one second
+//
+// Timing (16 MHz): Timer2 at clk/128 = 8 us per count, 1 unit = 2 counts,
+// so a frame is 255 units = 4.08 ms (245 Hz, no visible flicker).
+// Timer2 is taken over, so tone() and analogWrite() on pins 3 and 11 stop
+// working while SoftPWM runs. Code that writes whole PORTx registers of a
+// SoftPWM pin itself must do it with interrupts off.
+
+#ifndef SOFT_PWM_H
+#define SOFT_PWM_H
+
+#include <Arduino.h>
+
+#ifndef SOFTPWM_CHANNELS
+#define SOFTPWM_CHANNELS 12  // define before the #include to change
+#endif
+#define SOFTPWM_PORTS    3   // distinct output ports (B, C, D on an Uno)
+#define SOFTPWM_FRAME_US 4080UL
+
+// ---- Gamma ----
+// The eye sees brightness roughly on a power curve, so a linear fade looks
+// like it jumps at the bottom and stalls at the top. Levels are mapped
+// through duty = 255 * (level / 255) ^ 2.5 before they are shown.
+constexpr double softPwmSqrtStep(double x, double guess, int n) {
+  return n == 0 ? guess : softPwmSqrtStep(x, 0.5 * (guess + x / guess), n - 1);
+}
+
+constexpr double softPwmSqrt(double x) {
+  return x <= 0 ? 0 : softPwmSqrtStep(x, 1.0, 12);
+}
+
+constexpr uint8_t gammaDuty(int level) {
+  return (uint8_t)(255.0 * (level / 255.0) * (level / 255.0) * softPwmSqrt(level / 255.0) + 0.5);
+}
+
+static_assert(gammaDuty(0) == 0 && gammaDuty(255) == 255, "gamma table must span 0..255");
+
+#define GAMMA4(l)  gammaDuty(l), gammaDuty(l + 1), gammaDuty(l + 2), gammaDuty(l + 3)
+#define GAMMA16(l) GAMMA4(l), GAMMA4(l + 4), GAMMA4(l + 8), GAMMA4(l + 12)
+#define GAMMA64(l) GAMMA16(l), GAMMA16(l + 16), GAMMA16(l + 32), GAMMA16(l + 48)
+
+const uint8_t softPwmGamma[256] PROGMEM = {
+  GAMMA64(0), GAMMA64(64), GAMMA64(128), GAMMA64(192)
+};
+
+// ---- Channels ----
+struct SoftPwmChannel {
+  uint8_t port;      // index into softPwmPort[]
+  uint8_t mask;      // pin bit within that port
+  uint16_t level;    // brightness, 8.8 fixed point (before gamma)
+  uint16_t target;   // where the fade stops, 8.8
+  int16_t step;      // change per frame, 8.8 (0 = not fading)
+  uint16_t bounceTo; // pulse: fade back here at the target, 8.8
+  bool pulse;        // keep fading between bounceTo and target
+};
+
+volatile SoftPwmChannel softPwmChannel[SOFTPWM_CHANNELS];
+uint8_t softPwmChannels = 0;
+
+volatile uint8_t *softPwmPort[SOFTPWM_PORTS];  // PORTx register of each port
+uint8_t softPwmPortMask[SOFTPWM_PORTS];        // bits owned by SoftPWM
+uint8_t softPwmPorts = 0;
+
+// Pattern per BAM bit and port; rebuilt once per frame
+volatile uint8_t softPwmPlane[8][SOFTPWM_PORTS];
+volatile uint8_t softPwmBit = 7;
+
+// Use 'pin' as a channel; returns the channel number, or -1 if the
+// channel or port tables are full
+int8_t softPwmAttach(uint8_t pin) {
+  if (softPwmChannels == SOFTPWM_CHANNELS) return -1;
+  volatile uint8_t *reg = portOutputRegister(digitalPinToPort(pin));
+  uint8_t mask = digitalPinToBitMask(pin);
+
+  uint8_t port = 0;
+  while (port < softPwmPorts && softPwmPort[port] != reg) port++;
+  if (port == softPwmPorts) {
+    if (softPwmPorts == SOFTPWM_PORTS) return -1;
+    softPwmPort[softPwmPorts++] = reg;
+  }
+
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  softPwmPortMask[port] |= mask;
+  volatile SoftPwmChannel &c = softPwmChannel[softPwmChannels];
+  c.port = port;
+  c.mask = mask;
+  c.level = c.target = c.bounceTo = 0;
+  c.step = 0;
+  c.pulse = false;
+  SREG = oldSREG;
+  return softPwmChannels++;
+}
+
+// Step one fade and return the channel's duty for the next frame
+// (ISR only)
+uint8_t softPwmAdvance(volatile SoftPwmChannel &c) {
+  if (c.step != 0) {
+    long next = (long)c.level + c.step;
+    bool reached = c.step > 0 ? next >= c.target : next <= c.target;
+    if (!reached) {
+      c.level = next;
+    } else if (c.pulse) {
+      c.level = c.target;
+      c.target = c.bounceTo;  // turn around
+      c.bounceTo = c.level;
+      c.step = -c.step;
+    } else {
+      c.level = c.target;
+      c.step = 0;
+    }
+  }
+  return pgm_read_byte(&softPwmGamma[c.level >> 8]);
+}
+
+// BAM: bit 0 for 1 unit ... bit 7 for 128 units
+ISR(TIMER2_COMPA_vect) {
+  uint8_t bit = (softPwmBit + 1) & 7;
+  softPwmBit = bit;
+  OCR2A = (2 << bit) - 1;
+  // Bit 0 lasts 2 counts: if another interrupt delayed us past it, restart
+  // the count rather than waiting for the timer to wrap
+  if (TCNT2 >= OCR2A) TCNT2 = 0;
+
+  for (uint8_t p = 0; p < softPwmPorts; p++) {
+    *softPwmPort[p] = (*softPwmPort[p] & ~softPwmPortMask[p]) | softPwmPlane[bit][p];
+  }
+
+  if (bit != 7) return;
+
+  // Bit 7 is shown for 2 ms: time to prepare the next frame
+  for (uint8_t b = 0; b < 8; b++) {
+    for (uint8_t p = 0; p < softPwmPorts; p++) softPwmPlane[b][p] = 0;
+  }
+  for (uint8_t i = 0; i < softPwmChannels; i++) {
+    volatile SoftPwmChannel &c = softPwmChannel[i];
+    uint8_t duty = softPwmAdvance(c);
+    for (uint8_t b = 0; b < 8; b++) {
+      if (duty & (1 << b)) softPwmPlane[b][c.port] |= c.mask;
+    }
+  }
+}
+
+// Start Timer2 in CTC mode at clk/128
+void softPwmBegin() {
+  uint8_t oldSREG = SREG;
+  cli();
+  TCCR2A = (1 << WGM21);
+  TCCR2B = (1 << CS22) | (1 << CS20);
+  TCNT2 = 0;
+  OCR2A = 255;
+  TIMSK2 = (1 << OCIE2A);
+  SREG = oldSREG;
+}
+
+// Fade to 'level' (0..255) over 'ms' milliseconds; 0 ms sets it at once
+void softPwmFade(uint8_t channel, uint8_t level, unsigned int ms) {
+  if (channel >= softPwmChannels) return;
+  uint16_t target = (uint16_t)level << 8;
+  unsigned long frames = (ms * 1000UL) / SOFTPWM_FRAME_US;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  volatile SoftPwmChannel &c = softPwmChannel[channel];
+  c.pulse = false;
+  c.target = target;
+  if (frames == 0 || c.level == target) {
+    c.level = target;
+    c.step = 0;
+  } else {
+    long step = ((long)target - (long)c.level) / (long)frames;
+    if (step == 0) step = target > c.level ? 1 : -1;
+    step = constrain(step, -32767L, 32767L); // very short fades take a frame more
+    c.step = step;
+  }
+  SREG = oldSREG;
+}
+
+void softPwmSet(uint8_t channel, uint8_t level) {
+  softPwmFade(channel, level, 0);
+}
+
+// Breathe between 'low' and 'high' forever, 'ms' per fade
+void softPwmPulse(uint8_t channel, uint8_t low, uint8_t high, unsigned int ms) {
+  if (channel >= softPwmChannels) return;
+  softPwmSet(channel, low);
+  softPwmFade(channel, high, ms);
+  uint8_t oldSREG = SREG;
+  cli();
+  softPwmChannel[channel].bounceTo = (uint16_t)low << 8;
+  softPwmChannel[channel].pulse = softPwmChannel[channel].step != 0;
+  SREG = oldSREG;
+}
+
+bool softPwmFading(uint8_t channel) {
+  return channel < softPwmChannels && softPwmChannel[channel].step != 0;
+}
+
+#endif
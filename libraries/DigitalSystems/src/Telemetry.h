@@ -0,0 +1,178 @@
+// Telemetry.h - compact binary sample stream over Serial
+//
+// A text line like "Speed: 123 km/h" costs 17 bytes, and Serial.print()
+// waits once the 64-byte TX buffer is full, so at 9600 baud the sketch
+// stalls for ~20 ms per line. Here samples are batched into small binary
+// records that go through a ring buffer; telemetryPump() hands the ring to
+// Serial only as fast as it has room, so nothing ever waits. When the ring
+// is full the record is dropped and counted instead.
+//
+//   #include <Telemetry.h>
+//
+//   void setup() { telemetryBegin(9600); }
+//   void loop() {
+//     telemetryAdd(0, analogValue);   // stream 0
+//     telemetryPump();
+//   }
+//
+// Decode on the PC with Tools/telemetry2csv.cpp.
+//
+// Record (before framing), little endian:
+//   stream   1 byte
+//   seq      2 bytes, counts every record made (gaps = dropped records)
+//   time     4 bytes, millis() of the first sample
+//   span     2 bytes, ms from the first to the last sample
+//   count    1 byte
+//   samples  zigzag varints, each the difference to the previous sample
+//            (the first one from 0): a slow signal costs ~1 byte a sample
+//   crc      1 byte, CRC-8 (poly 0x07) of everything above
+// Each record is COBS encoded and ends with a 0x00 byte, so the decoder
+// can find the next record after any glitch.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#ifndef TELEMETRY_STREAMS
+#define TELEMETRY_STREAMS 2       // define before the #include to change
+#endif
+#define TELEMETRY_BATCH      32   // samples per record
+#define TELEMETRY_MAX_AGE_MS 500  // send a part-filled record after this long
+#define TELEMETRY_RING_SIZE  256  // must be a power of two
+
+#define TELEMETRY_RECORD_MAX (10 + TELEMETRY_BATCH * 3 + 1)
+#define TELEMETRY_FRAME_MAX  (TELEMETRY_RECORD_MAX + TELEMETRY_RECORD_MAX / 254 + 2)
+
+struct TelemetryStream {
+  uint8_t count;
+  unsigned long firstTime;
+  unsigned long lastTime;
+  int16_t samples[TELEMETRY_BATCH];
+};
+
+TelemetryStream telemetryStream[TELEMETRY_STREAMS];
+uint16_t telemetrySeq = 0;
+unsigned long telemetryDropped = 0;   // samples lost to a full ring
+
+uint8_t telemetryRing[TELEMETRY_RING_SIZE];
+uint16_t telemetryHead = 0;           // next byte to fill
+uint16_t telemetryTail = 0;           // next byte to send
+
+void telemetryBegin(unsigned long baud) {
+  Serial.begin(baud);
+}
+
+uint8_t telemetryCrc8(const uint8_t *data, uint8_t len) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+uint8_t telemetryPutVarint(uint8_t *out, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  out[n++] = v;
+  return n;
+}
+
+// COBS: replace every 0x00 by the distance to the next one, so 0x00 only
+// ever appears as the frame end. Returns the frame length with the 0x00.
+uint8_t telemetryCobs(const uint8_t *in, uint8_t len, uint8_t *out) {
+  uint8_t code = 1;
+  uint8_t codeAt = 0;
+  uint8_t n = 1;
+  for (uint8_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[n++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[codeAt] = code;
+      code = 1;
+      codeAt = n++;
+    }
+  }
+  out[codeAt] = code;
+  out[n++] = 0x00;
+  return n;
+}
+
+// Build the record of one stream and queue it (or count it as dropped)
+void telemetryFlush(uint8_t stream) {
+  TelemetryStream &s = telemetryStream[stream];
+  if (s.count == 0) return;
+
+  uint8_t record[TELEMETRY_RECORD_MAX];
+  uint8_t len = 0;
+  unsigned long span = s.lastTime - s.firstTime;
+  if (span > 0xFFFF) span = 0xFFFF;
+  record[len++] = stream;
+  record[len++] = telemetrySeq;
+  record[len++] = telemetrySeq >> 8;
+  for (uint8_t i = 0; i < 4; i++) record[len++] = s.firstTime >> (8 * i);
+  record[len++] = span;
+  record[len++] = span >> 8;
+  record[len++] = s.count;
+  int16_t prev = 0;
+  for (uint8_t i = 0; i < s.count; i++) {
+    int32_t delta = (int32_t)s.samples[i] - prev;
+    len += telemetryPutVarint(record + len, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    prev = s.samples[i];
+  }
+  record[len] = telemetryCrc8(record, len);
+  len++;
+  telemetrySeq++;
+
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+  uint8_t frameLen = telemetryCobs(record, len, frame);
+
+  uint16_t used = (telemetryHead - telemetryTail) & (TELEMETRY_RING_SIZE - 1);
+  if (TELEMETRY_RING_SIZE - 1 - used < frameLen) {
+    telemetryDropped += s.count;   // the link is too slow: drop, never wait
+  } else {
+    for (uint8_t i = 0; i < frameLen; i++) {
+      telemetryRing[telemetryHead] = frame[i];
+      telemetryHead = (telemetryHead + 1) & (TELEMETRY_RING_SIZE - 1);
+    }
+  }
+  s.count = 0;
+}
+
+// Add one sample to a stream; a full batch is queued right away
+void telemetryAdd(uint8_t stream, int16_t value) {
+  if (stream >= TELEMETRY_STREAMS) return;
+  TelemetryStream &s = telemetryStream[stream];
+  unsigned long now = millis();
+  if (s.count == 0) s.firstTime = now;
+  s.lastTime = now;
+  s.samples[s.count++] = value;
+  if (s.count == TELEMETRY_BATCH) telemetryFlush(stream);
+}
+
+// Call on every loop() pass: sends old part-filled batches and moves as
+// much of the ring to Serial as fits without waiting
+void telemetryPump() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < TELEMETRY_STREAMS; i++) {
+    if (telemetryStream[i].count > 0 && now - telemetryStream[i].firstTime >= TELEMETRY_MAX_AGE_MS) {
+      telemetryFlush(i);
+    }
+  }
+
+  int room = Serial.availableForWrite();
+  while (room-- > 0 && telemetryTail != telemetryHead) {
+    Serial.write(telemetryRing[telemetryTail]);
+    telemetryTail = (telemetryTail + 1) & (TELEMETRY_RING_SIZE - 1);
+  }
+}
+
+#endif
@@ -0,0 +1,177 @@
+// TimerWheel.h - cooperative timers without delay()
+//
+// A hierarchical timer wheel: timers sit in slots by expiry time, so
+// starting or cancelling a timer is O(1) and each tick only looks at one
+// slot, however many timers are running. Callbacks run from update(),
+// which loop() calls on every pass - never from an interrupt.
+//
+//   #include <TimerWheel.h>
+//
+//   TimerWheel wheel;              // ticks in ms (TimerWheel wheel(micros) for us)
+//   Timer blinkTimer(blink);
+//
+//   void blink(Timer &) { digitalWrite(13, !digitalRead(13)); }
+//
+//   void setup() { wheel.start(blinkTimer, 500, 500); } // first run, then period
+//   void loop()  { wheel.update(); }
+//
+// Layout: LEVELS wheels of 2^SLOT_BITS slots. Level 0 holds timers due in
+// the next 2^SLOT_BITS ticks, level 1 the next 2^(2*SLOT_BITS), and so on;
+// when level 0 wraps, the matching slot of level 1 is re-sorted ("cascaded")
+// into level 0, like the hands of a clock. Delays past the top level are
+// parked in its last slot and re-sorted until they come into range.
+// The default 4 x 16 slots covers 65 s in one pass and costs 128 bytes of
+// slot pointers on an AVR.
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+
+// Work counter for the host benchmark (Host/tests/timer_wheel.cpp):
+// TIMER_WHEEL_COUNT(slots) runs for every slot a tick looks at and
+// TIMER_WHEEL_COUNT(links) every time a timer is put in a slot. Define it
+// before the #include; by default it compiles to nothing.
+#ifndef TIMER_WHEEL_COUNT
+#define TIMER_WHEEL_COUNT(counter)
+#endif
+
+class Timer;
+typedef void (*TimerCallback)(Timer &timer);
+
+// One timer. Timers are owned by the sketch (usually globals) and linked
+// into the wheel directly, so the wheel never allocates.
+class Timer {
+public:
+  explicit Timer(TimerCallback callback, void *context = nullptr)
+    : callback(callback), context(context) {}
+
+  bool active() const { return slot != nullptr; }
+
+  TimerCallback callback;
+  void *context;           // free for the sketch
+
+private:
+  template <uint8_t, uint8_t> friend class BasicTimerWheel;
+
+  Timer *next = nullptr;
+  Timer *prev = nullptr;
+  Timer **slot = nullptr;  // list head the timer is linked into, null if idle
+  unsigned long expires = 0;
+  unsigned long period = 0;
+};
+
+template <uint8_t SLOT_BITS = 4, uint8_t LEVELS = 4>
+class BasicTimerWheel {
+public:
+  explicit BasicTimerWheel(unsigned long (*clock)() = millis) : clock(clock) {
+    for (uint8_t l = 0; l < LEVELS; l++) {
+      for (uint8_t s = 0; s < SLOTS; s++) slots[l][s] = nullptr;
+    }
+    current = clock();
+  }
+
+  // Run 'timer' after 'delay' ticks, then every 'period' ticks (0 = once).
+  // Restarting a running timer moves it.
+  void start(Timer &timer, unsigned long delay, unsigned long period = 0) {
+    cancel(timer);
+    timer.period = period;
+    timer.expires = clock() + delay;
+    insert(timer);
+  }
+
+  void cancel(Timer &timer) {
+    if (!timer.slot) return;
+    if (timer.prev) timer.prev->next = timer.next;
+    else *timer.slot = timer.next;
+    if (timer.next) timer.next->prev = timer.prev;
+    timer.next = timer.prev = nullptr;
+    timer.slot = nullptr;
+  }
+
+  // Fire everything that is due; call on every loop() pass
+  void update() {
+    unsigned long now = clock();
+    while ((long)(now - current) > 0) tick();
+  }
+
+private:
+  static const uint8_t SLOTS = 1 << SLOT_BITS;
+  static const uint8_t MASK = SLOTS - 1;
+  static const unsigned long SPAN = 1UL << (SLOT_BITS * LEVELS); // ticks the wheel covers
+
+  unsigned long (*clock)();
+  unsigned long current;          // last tick processed
+  Timer *slots[LEVELS][SLOTS];
+
+  void link(Timer &timer, Timer **head) {
+    TIMER_WHEEL_COUNT(links);
+    timer.slot = head;
+    timer.prev = nullptr;
+    timer.next = *head;
+    if (*head) (*head)->prev = &timer;
+    *head = &timer;
+  }
+
+  // Put a timer in the slot of the lowest level whose range covers it.
+  // While cascading, a timer due this very tick goes in the slot about to
+  // be run; otherwise anything overdue runs on the next tick.
+  void insert(Timer &timer, bool cascading = false) {
+    long delta = (long)(timer.expires - current);
+    if (delta < 0 || (delta == 0 && !cascading)) {
+      link(timer, &slots[0][(current + 1) & MASK]);
+      return;
+    }
+    unsigned long when = timer.expires;
+    if ((unsigned long)delta >= SPAN) when = current + SPAN - 1; // parked, re-sorted later
+    for (uint8_t l = 0; l < LEVELS; l++) {
+      if ((unsigned long)delta < (1UL << (SLOT_BITS * (l + 1))) || l == LEVELS - 1) {
+        link(timer, &slots[l][(when >> (SLOT_BITS * l)) & MASK]);
+        return;
+      }
+    }
+  }
+
+  // Re-sort one slot of a higher level into the levels below
+  void cascade(uint8_t level, uint8_t index) {
+    TIMER_WHEEL_COUNT(slots);
+    Timer *timer = slots[level][index];
+    slots[level][index] = nullptr;
+    while (timer) {
+      Timer *next = timer->next;
+      timer->slot = nullptr;
+      insert(*timer, true);
+      timer = next;
+    }
+  }
+
+  void tick() {
+    current++;
+    uint8_t index = current & MASK;
+    if (index == 0) {
+      for (uint8_t l = 1; l < LEVELS; l++) {
+        uint8_t upper = (current >> (SLOT_BITS * l)) & MASK;
+        cascade(l, upper);
+        if (upper != 0) break;
+      }
+    }
+
+    // Take timers off one at a time, so a callback may start or cancel
+    // any timer (including the one running) safely
+    Timer **head = &slots[0][index];
+    TIMER_WHEEL_COUNT(slots);
+    while (*head) {
+      Timer &timer = **head;
+      cancel(timer);
+      if (timer.period) {
+        timer.expires += timer.period;
+        insert(timer);
+      }
+      timer.callback(timer);
+    }
+  }
+};
+
+typedef BasicTimerWheel<> TimerWheel;
+
+#endif
@@ -1,3 +1,6 @@
+#include <InputCapture.h>
+#include <TimerWheel.h>
+
 // Pin assignments
 const int ledLeft = 2;
 const int ledMiddle = 3;
@@ -7,13 +10,84 @@ const int buttonLeft = 5;
 const int buttonMiddle = 6;
 const int buttonRight = 7;
 
+// The three LEDs are PD2..PD4 on an Uno, so a whole LED pattern can be
+// written to PORTD in one store and the LEDs switch together
+#if !defined(__AVR_ATmega328P__)
+#error "showLeds() writes PORTD directly: pins 2..4 are only PD2..PD4 on an Uno or Nano"
+#endif
+const byte LED_MASK = (1 << ledLeft) | (1 << ledMiddle) | (1 << ledRight);
+
+// Show exactly the LEDs in 'pattern' (bits of LED_MASK), others off
+void showLeds(byte pattern) {
+  PORTD = (PORTD & ~LED_MASK) | (pattern & LED_MASK);
+}
+
+// ---- Blink sequences ----
+// Each step shows an LED pattern for a while. The steps are advanced by a
+// one-shot timer instead of delay(), so loop() keeps running while a
+// sequence plays.
+struct Step {
+  byte pattern;      // bits of LED_MASK
+  unsigned int ms;   // how long it stays on
+};
+
+const Step leftToRight[] = {{1 << ledLeft, 200}, {1 << ledMiddle, 200}, {1 << ledRight, 200}};
+const Step allTogether[] = {{LED_MASK, 300}, {0, 300}};
+const Step rightToLeft[] = {{1 << ledRight, 200}, {1 << ledMiddle, 200}, {1 << ledLeft, 200}};
+
+TimerWheel wheel;
+
+const Step *sequence = nullptr;  // sequence playing, null when idle
+byte sequenceLength = 0;
+byte sequenceStep = 0;           // next step to show
+
+// Show the next step, or end the sequence with the LEDs off
+void nextStep(Timer &timer) {
+  if (sequenceStep == sequenceLength) {
+    showLeds(0);
+    sequence = nullptr;
+    return;
+  }
+  showLeds(sequence[sequenceStep].pattern);
+  wheel.start(timer, sequence[sequenceStep].ms);
+  sequenceStep++;
+}
+
+Timer stepTimer(nextStep);
+
+void play(const Step *steps, byte length) {
+  sequence = steps;
+  sequenceLength = length;
+  sequenceStep = 0;
+  nextStep(stepTimer);
+}
 
+#define PLAY(steps) play(steps, sizeof(steps) / sizeof(steps[0]))
 
 // Tip: Use 10k resistors for components with high energy (i.e. buttons)
 
 // Tip 2: GND and pins can flow together
 
 
+// Button presses are caught by the pin-change interrupt on port D
+// (pins 5, 6, 7 = PD5..PD7) and queued by InputCapture.h, so a quick press
+// made while a blink sequence is running still gets its own sequence
+// afterwards.
+int8_t buttonInput[3];  // input numbers of buttonLeft, buttonMiddle, buttonRight
+
+// Take the oldest queued press; returns its pin, or 0 if there is none
+int nextPress() {
+  InputEvent ev;
+  while (inputPop(ev)) {
+    if (!ev.pressed) continue;  // releases are not needed here
+    if (ev.input == buttonInput[0]) return buttonLeft;
+    if (ev.input == buttonInput[1]) return buttonMiddle;
+    return buttonRight;
+  }
+  return 0;
+}
+
+
 void setup() {
   // LEDs as outputs
   pinMode(ledLeft, OUTPUT);
@@ -24,59 +98,48 @@ void setup() {
   pinMode(buttonLeft, INPUT);
   pinMode(buttonMiddle, INPUT);
   pinMode(buttonRight, INPUT);
+
+  // Pin-change interrupt for the three buttons
+  buttonInput[0] = inputAttach(buttonLeft, INPUT_ACTIVE_HIGH);
+  buttonInput[1] = inputAttach(buttonMiddle, INPUT_ACTIVE_HIGH);
+  buttonInput[2] = inputAttach(buttonRight, INPUT_ACTIVE_HIGH);
+  inputBegin();
 }
 
 
 
 
 void loop() {
+  wheel.update();
+
+  // Presses made while a sequence plays stay queued until it ends
+  if (sequence) return;
+
+  // A queued press counts as pressed even if it was already released
+  int queued = nextPress();
+
   // Read button states
-  int leftPressed = digitalRead(buttonLeft);
-  int middlePressed = digitalRead(buttonMiddle);
-  int rightPressed = digitalRead(buttonRight);
+  int leftPressed = queued == buttonLeft || digitalRead(buttonLeft);
+  int middlePressed = queued == buttonMiddle || digitalRead(buttonMiddle);
+  int rightPressed = queued == buttonRight || digitalRead(buttonRight);
 
   // LEFT button: blink left to right
   if (leftPressed == HIGH) {
-    digitalWrite(ledLeft, HIGH);
-    delay(200);
-    digitalWrite(ledLeft, LOW);
-    digitalWrite(ledMiddle, HIGH);
-    delay(200);
-    digitalWrite(ledMiddle, LOW);
-    digitalWrite(ledRight, HIGH);
-    delay(200);
-    digitalWrite(ledRight, LOW);
+    PLAY(leftToRight);
   }
 
   // MIDDLE button: blink all together
   else if (middlePressed == HIGH) {
-    digitalWrite(ledLeft, HIGH);
-    digitalWrite(ledMiddle, HIGH);
-    digitalWrite(ledRight, HIGH);
-    delay(300);
-    digitalWrite(ledLeft, LOW);
-    digitalWrite(ledMiddle, LOW);
-    digitalWrite(ledRight, LOW);
-    delay(300);
+    PLAY(allTogether);
   }
 
   // RIGHT button: blink right to left
   else if (rightPressed == HIGH) {
-    digitalWrite(ledRight, HIGH);
-    delay(200);
-    digitalWrite(ledRight, LOW);
-    digitalWrite(ledMiddle, HIGH);
-    delay(200);
-    digitalWrite(ledMiddle, LOW);
-    digitalWrite(ledLeft, HIGH);
-    delay(200);
-    digitalWrite(ledLeft, LOW);
+    PLAY(rightToLeft);
   }
 
   // If no button pressed, keep LEDs off
   else {
-    digitalWrite(ledLeft, LOW);
-    digitalWrite(ledMiddle, LOW);
-    digitalWrite(ledRight, LOW);
+    showLeds(0);
   }
 }